@@ -1445,7 +1445,7 @@ static bool bio_attempt_back_merge(struct request_queue *q, struct request *req,
 	req->biotail->bi_next = bio;
 	req->biotail = bio;
 	req->__data_len += bio->bi_size;
-	req->ioprio = ioprio_best(req->ioprio, bio_prio(bio));
+	req->ioprio = ioprio_best(req->ioprio, blk_bio_ioprio(bio));
 
 	drive_stat_acct(req, 0);
 	return true;
@@ -1475,7 +1475,7 @@ static bool bio_attempt_front_merge(struct request_queue *q,
 	req->buffer = bio_data(bio);
 	req->__sector = bio->bi_sector;
 	req->__data_len += bio->bi_size;
-	req->ioprio = ioprio_best(req->ioprio, bio_prio(bio));
+	req->ioprio = ioprio_best(req->ioprio, blk_bio_ioprio(bio));
 
 	drive_stat_acct(req, 0);
 	return true;
@@ -1534,6 +1534,26 @@ out:
 	return ret;
 }
 
+/**
+ * blk_bio_ioprio - I/O priority a bio is issued with
+ * @bio: bio being queued
+ *
+ * Bios rarely carry a priority of their own, so fall back to the one of
+ * the submitting task, the same way the io schedulers resolve it.  Must be
+ * called from the submitter's context.
+ */
+unsigned short blk_bio_ioprio(struct bio *bio)
+{
+	struct io_context *ioc = current->io_context;
+
+	if (bio_prio_valid(bio))
+		return bio_prio(bio);
+	if (ioc && ioprio_valid(ioc->ioprio))
+		return ioc->ioprio;
+	return IOPRIO_PRIO_VALUE(task_nice_ioclass(current),
+				 task_nice_ioprio(current));
+}
+
 void init_request_from_bio(struct request *req, struct bio *bio)
 {
 	req->cmd_type = REQ_TYPE_FS;
@@ -1544,11 +1564,13 @@ void init_request_from_bio(struct request *req, struct bio *bio)
 
 	req->errors = 0;
 	req->__sector = bio->bi_sector;
-	req->ioprio = bio_prio(bio);
+	req->ioprio = blk_bio_ioprio(bio);
 	blk_rq_bio_prep(req->q, req, bio);
 }
 EXPORT_SYMBOL(init_request_from_bio);
 
+static unsigned int blk_flush_plug_list_fg(struct blk_plug *plug);
+
 void blk_queue_bio(struct request_queue *q, struct bio *bio)
 {
 	const bool sync = !!(bio->bi_rw & REQ_SYNC);
@@ -1643,8 +1665,17 @@ get_rq:
 		if (list_empty(&plug->list))
 			trace_block_plug(q);
 		else {
+			/*
+			 * A full plug only needs to push out foreground
+			 * requests right away; idle class ones may stay to
+			 * keep merging until there are enough of them.
+			 */
 			if (request_count >= BLK_MAX_REQUEST_COUNT) {
-				blk_flush_plug_list(plug, false);
+				if (blk_ioprio_class(req->ioprio) ==
+				    IOPRIO_CLASS_IDLE ||
+				    blk_flush_plug_list_fg(plug) >=
+				    BLK_MAX_REQUEST_COUNT)
+					blk_flush_plug_list(plug, false);
 				trace_block_plug(q);
 			}
 		}
@@ -3010,9 +3041,18 @@ static int plug_rq_cmp(void *priv, struct list_head *a, struct list_head *b)
 {
 	struct request *rqa = container_of(a, struct request, queuelist);
 	struct request *rqb = container_of(b, struct request, queuelist);
+	int ca, cb;
+
+	if (rqa->q != rqb->q)
+		return !(rqa->q < rqb->q);
+
+	/* queue RT, then BE, then idle requests to the elevator */
+	ca = blk_ioprio_class(rqa->ioprio);
+	cb = blk_ioprio_class(rqb->ioprio);
+	if (ca != cb)
+		return !(ca < cb);
 
-	return !(rqa->q < rqb->q ||
-		(rqa->q == rqb->q && blk_rq_pos(rqa) < blk_rq_pos(rqb)));
+	return !(blk_rq_pos(rqa) < blk_rq_pos(rqb));
 }
 
 /*
@@ -3076,23 +3116,14 @@ struct blk_plug_cb *blk_check_plugged(blk_plug_cb_fn unplug, void *data,
 }
 EXPORT_SYMBOL(blk_check_plugged);
 
-void blk_flush_plug_list(struct blk_plug *plug, bool from_schedule)
+static void blk_dispatch_plug_list(struct list_head *list, bool from_schedule)
 {
 	struct request_queue *q;
 	unsigned long flags;
 	struct request *rq;
-	LIST_HEAD(list);
 	unsigned int depth;
 
-	BUG_ON(plug->magic != PLUG_MAGIC);
-
-	flush_plug_callbacks(plug, from_schedule);
-	if (list_empty(&plug->list))
-		return;
-
-	list_splice_init(&plug->list, &list);
-
-	list_sort(NULL, &list, plug_rq_cmp);
+	list_sort(NULL, list, plug_rq_cmp);
 
 	q = NULL;
 	depth = 0;
@@ -3102,8 +3133,8 @@ void blk_flush_plug_list(struct blk_plug *plug, bool from_schedule)
 	 * queue lock we have to take.
 	 */
 	local_irq_save(flags);
-	while (!list_empty(&list)) {
-		rq = list_entry_rq(list.next);
+	while (!list_empty(list)) {
+		rq = list_entry_rq(list->next);
 		list_del_init(&rq->queuelist);
 		BUG_ON(!rq->q);
 		if (rq->q != q) {
@@ -3145,6 +3176,52 @@ void blk_flush_plug_list(struct blk_plug *plug, bool from_schedule)
 	local_irq_restore(flags);
 }
 
+void blk_flush_plug_list(struct blk_plug *plug, bool from_schedule)
+{
+	LIST_HEAD(list);
+
+	BUG_ON(plug->magic != PLUG_MAGIC);
+
+	flush_plug_callbacks(plug, from_schedule);
+	if (list_empty(&plug->list))
+		return;
+
+	list_splice_init(&plug->list, &list);
+	blk_dispatch_plug_list(&list, from_schedule);
+}
+
+/*
+ * Dispatch only the RT and best effort requests on @plug, leaving idle
+ * class requests plugged.  Returns the number of requests left behind.
+ *
+ * Only blk_queue_bio() calls this, when the plug is full.  Whatever it
+ * leaves behind is sent by the full blk_flush_plug_list() like any other
+ * plugged request: from blk_finish_plug(), from blk_schedule_flush_plug()
+ * when the task blocks (blk_needs_flush_plug() looks at the whole list,
+ * idle requests included), or by blk_queue_bio() itself once as many
+ * idle requests as a full plug have piled up.
+ */
+static unsigned int blk_flush_plug_list_fg(struct blk_plug *plug)
+{
+	struct request *rq, *tmp;
+	unsigned int left = 0;
+	LIST_HEAD(list);
+
+	BUG_ON(plug->magic != PLUG_MAGIC);
+
+	list_for_each_entry_safe(rq, tmp, &plug->list, queuelist) {
+		if (blk_ioprio_class(rq->ioprio) == IOPRIO_CLASS_IDLE)
+			left++;
+		else
+			list_move_tail(&rq->queuelist, &list);
+	}
+
+	if (!list_empty(&list))
+		blk_dispatch_plug_list(&list, false);
+
+	return left;
+}
+
 void blk_finish_plug(struct blk_plug *plug)
 {
 	blk_flush_plug_list(plug, false);
@@ -424,6 +424,10 @@ static int attempt_merge(struct request_queue *q, struct request *req,
 	    !blk_write_same_mergeable(req->bio, next->bio))
 		return 0;
 
+	/* don't let background I/O grow a foreground request, or vice versa */
+	if (blk_ioprio_class(req->ioprio) != blk_ioprio_class(next->ioprio))
+		return 0;
+
 	/*
 	 * If we are allowed to merge, then append bio list
 	 * from next to rq and release next. merge_requests_fn
@@ -532,6 +536,11 @@ bool blk_rq_merge_ok(struct request *rq, struct bio *bio)
 	if (!security_allow_merge_bio(rq->bio, bio))
 		return false;
 
+	/* don't merge across I/O priority classes */
+	if (blk_ioprio_class(rq->ioprio) !=
+	    blk_ioprio_class(blk_bio_ioprio(bio)))
+		return false;
+
 	return true;
 }
 
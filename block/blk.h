@@ -141,6 +141,18 @@ int blk_attempt_req_merge(struct request_queue *q, struct request *rq,
 void blk_rq_set_mixed_merge(struct request *rq);
 bool blk_rq_merge_ok(struct request *rq, struct bio *bio);
 int blk_try_merge(struct request *rq, struct bio *bio);
+unsigned short blk_bio_ioprio(struct bio *bio);
+
+/*
+ * I/O priority class used to keep merging and plug ordering from mixing
+ * foreground and background I/O.  Unset priorities count as best effort.
+ */
+static inline int blk_ioprio_class(unsigned short ioprio)
+{
+	int class = IOPRIO_PRIO_CLASS(ioprio);
+
+	return class == IOPRIO_CLASS_NONE ? IOPRIO_CLASS_BE : class;
+}
 
 void blk_queue_congestion_threshold(struct request_queue *q);
 
@@ -85,6 +85,9 @@ static DEFINE_MUTEX(loop_index_mutex);
 static int max_part;
 static int part_shift;
 
+/* Upper bound on bios a direct I/O loop device keeps in flight */
+#define LO_DIO_MAX_INFLIGHT	16
+
 /*
  * Transfer functions
  */
@@ -519,11 +522,105 @@ struct switch_request {
 
 static void do_loop_switch(struct loop_device *, struct switch_request *);
 
+/*
+ * Direct I/O mode.
+ *
+ * This kernel has no way to hand kernel pages to the backing file's
+ * ->direct_IO(), so direct mode is built from the buffered path: each bio
+ * is served by an unbound worker, writes are pushed to the backing store
+ * before the bio completes, and the backing file's pages covering the
+ * range are dropped again afterwards.  The data therefore lives only in
+ * the loop device's own page cache, and up to LO_DIO_MAX_INFLIGHT bios
+ * are serviced concurrently instead of one at a time by loop_thread.
+ */
+struct loop_dio_cmd {
+	struct work_struct	work;
+	struct loop_device	*lo;
+	struct bio		*bio;
+};
+
+static int lo_dio_complete(struct loop_device *lo, struct bio *bio,
+			   loff_t pos, unsigned int len)
+{
+	struct address_space *mapping = lo->lo_backing_file->f_mapping;
+	int ret = 0;
+
+	if (!len || (bio->bi_rw & REQ_DISCARD))
+		return 0;
+
+	if (bio_rw(bio) == WRITE) {
+		ret = filemap_write_and_wait_range(mapping, pos,
+						   pos + len - 1);
+		if (unlikely(ret))
+			ret = -EIO;
+	}
+	invalidate_mapping_pages(mapping, pos >> PAGE_CACHE_SHIFT,
+				 (pos + len - 1) >> PAGE_CACHE_SHIFT);
+	return ret;
+}
+
+static void loop_dio_work(struct work_struct *work)
+{
+	struct loop_dio_cmd *cmd =
+		container_of(work, struct loop_dio_cmd, work);
+	struct loop_device *lo = cmd->lo;
+	struct bio *bio = cmd->bio;
+	loff_t pos = ((loff_t) bio->bi_sector << 9) + lo->lo_offset;
+	unsigned int len = bio->bi_size;
+	int ret;
+
+	ret = do_bio_filebacked(lo, bio);
+	if (!ret)
+		ret = lo_dio_complete(lo, bio, pos, len);
+	bio_endio(bio, ret);
+	kfree(cmd);
+
+	atomic_dec(&lo->lo_dio_inflight);
+	smp_mb__after_atomic_dec();
+	wake_up(&lo->lo_dio_wait);
+}
+
+static void loop_dio_drain(struct loop_device *lo)
+{
+	wait_event(lo->lo_dio_wait, !atomic_read(&lo->lo_dio_inflight));
+}
+
+static void loop_queue_dio(struct loop_device *lo, struct bio *bio)
+{
+	struct loop_dio_cmd *cmd;
+
+	wait_event(lo->lo_dio_wait,
+		   atomic_read(&lo->lo_dio_inflight) < LO_DIO_MAX_INFLIGHT);
+
+	cmd = kmalloc(sizeof(*cmd), GFP_NOIO);
+	if (unlikely(!cmd)) {
+		/* no memory for a command, serve it synchronously */
+		loff_t pos = ((loff_t) bio->bi_sector << 9) + lo->lo_offset;
+		unsigned int len = bio->bi_size;
+		int ret = do_bio_filebacked(lo, bio);
+
+		if (!ret)
+			ret = lo_dio_complete(lo, bio, pos, len);
+		bio_endio(bio, ret);
+		return;
+	}
+
+	INIT_WORK(&cmd->work, loop_dio_work);
+	cmd->lo = lo;
+	cmd->bio = bio;
+	atomic_inc(&lo->lo_dio_inflight);
+	queue_work(lo->lo_dio_wq, &cmd->work);
+}
+
 static inline void loop_handle_bio(struct loop_device *lo, struct bio *bio)
 {
 	if (unlikely(!bio->bi_bdev)) {
+		/* the backing file may change, nothing may be in flight */
+		loop_dio_drain(lo);
 		do_loop_switch(lo, bio->bi_private);
 		bio_put(bio);
+	} else if (lo->lo_flags & LO_FLAGS_DIRECT_IO) {
+		loop_queue_dio(lo, bio);
 	} else {
 		int ret = do_bio_filebacked(lo, bio);
 		bio_endio(bio, ret);
@@ -567,6 +664,7 @@ static int loop_thread(void *data)
 		loop_handle_bio(lo, bio);
 	}
 
+	loop_dio_drain(lo);
 	return 0;
 }
 
@@ -758,11 +856,19 @@ static ssize_t loop_attr_partscan_show(struct loop_device *lo, char *buf)
 	return sprintf(buf, "%s\n", partscan ? "1" : "0");
 }
 
+static ssize_t loop_attr_dio_show(struct loop_device *lo, char *buf)
+{
+	int dio = (lo->lo_flags & LO_FLAGS_DIRECT_IO);
+
+	return sprintf(buf, "%s\n", dio ? "1" : "0");
+}
+
 LOOP_ATTR_RO(backing_file);
 LOOP_ATTR_RO(offset);
 LOOP_ATTR_RO(sizelimit);
 LOOP_ATTR_RO(autoclear);
 LOOP_ATTR_RO(partscan);
+LOOP_ATTR_RO(dio);
 
 static struct attribute *loop_attrs[] = {
 	&loop_attr_backing_file.attr,
@@ -770,6 +876,7 @@ static struct attribute *loop_attrs[] = {
 	&loop_attr_sizelimit.attr,
 	&loop_attr_autoclear.attr,
 	&loop_attr_partscan.attr,
+	&loop_attr_dio.attr,
 	NULL,
 };
 
@@ -1015,6 +1122,11 @@ static int loop_clr_fd(struct loop_device *lo)
 
 	kthread_stop(lo->lo_thread);
 
+	if (lo->lo_dio_wq) {
+		destroy_workqueue(lo->lo_dio_wq);
+		lo->lo_dio_wq = NULL;
+	}
+
 	spin_lock_irq(&lo->lo_lock);
 	lo->lo_backing_file = NULL;
 	spin_unlock_irq(&lo->lo_lock);
@@ -1284,6 +1396,41 @@ static int loop_set_capacity(struct loop_device *lo, struct block_device *bdev)
 	return figure_loop_size(lo, lo->lo_offset, lo->lo_sizelimit);
 }
 
+static int loop_set_direct_io(struct loop_device *lo, unsigned long arg)
+{
+	struct address_space *mapping;
+	int err;
+
+	if (unlikely(lo->lo_state != Lo_bound))
+		return -ENXIO;
+	if (!!arg == !!(lo->lo_flags & LO_FLAGS_DIRECT_IO))
+		return 0;
+
+	if (arg && !lo->lo_dio_wq) {
+		lo->lo_dio_wq = alloc_workqueue("kloopd%d",
+				WQ_MEM_RECLAIM | WQ_UNBOUND,
+				LO_DIO_MAX_INFLIGHT, lo->lo_number);
+		if (!lo->lo_dio_wq)
+			return -ENOMEM;
+	}
+
+	/* let everything queued so far finish in the old mode */
+	err = loop_flush(lo);
+	if (err)
+		return err;
+
+	if (arg) {
+		/* whatever the backing file cached up to now is a duplicate */
+		mapping = lo->lo_backing_file->f_mapping;
+		filemap_write_and_wait(mapping);
+		invalidate_mapping_pages(mapping, 0, -1);
+		lo->lo_flags |= LO_FLAGS_DIRECT_IO;
+	} else {
+		lo->lo_flags &= ~LO_FLAGS_DIRECT_IO;
+	}
+	return 0;
+}
+
 static int lo_ioctl(struct block_device *bdev, fmode_t mode,
 	unsigned int cmd, unsigned long arg)
 {
@@ -1327,6 +1474,11 @@ static int lo_ioctl(struct block_device *bdev, fmode_t mode,
 		if ((mode & FMODE_WRITE) || capable(CAP_SYS_ADMIN))
 			err = loop_set_capacity(lo, bdev);
 		break;
+	case LOOP_SET_DIRECT_IO:
+		err = -EPERM;
+		if ((mode & FMODE_WRITE) || capable(CAP_SYS_ADMIN))
+			err = loop_set_direct_io(lo, arg);
+		break;
 	default:
 		err = lo->ioctl ? lo->ioctl(lo, cmd, arg) : -EINVAL;
 	}
@@ -1481,6 +1633,7 @@ static int lo_compat_ioctl(struct block_device *bdev, fmode_t mode,
 		arg = (unsigned long) compat_ptr(arg);
 	case LOOP_SET_FD:
 	case LOOP_CHANGE_FD:
+	case LOOP_SET_DIRECT_IO:
 		err = lo_ioctl(bdev, mode, cmd, arg);
 		break;
 	default:
@@ -1666,6 +1819,8 @@ static int loop_add(struct loop_device **l, int i)
 	lo->lo_thread		= NULL;
 	init_waitqueue_head(&lo->lo_event);
 	init_waitqueue_head(&lo->lo_req_wait);
+	init_waitqueue_head(&lo->lo_dio_wait);
+	atomic_set(&lo->lo_dio_inflight, 0);
 	spin_lock_init(&lo->lo_lock);
 	disk->major		= LOOP_MAJOR;
 	disk->first_minor	= i << part_shift;
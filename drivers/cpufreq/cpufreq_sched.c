@@ -0,0 +1,429 @@
+/*
+ * drivers/cpufreq/cpufreq_sched.c
+ *
+ * Scheduler driven cpufreq governor.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Instead of sampling load from a timer, the scheduler calls into this
+ * governor on enqueue, dequeue and tick with the runnable average (PELT)
+ * of the cpu.  The frequency is picked right away from the busiest cpu of
+ * the policy, so that load bursts are acted upon at the next scheduler
+ * event rather than a sampling period later.  Frequency changes are rate
+ * limited by comparing against the time of the last change; the actual
+ * switch is done by a per-policy kthread since the scheduler calls in with
+ * rq->lock held.
+ */
+
+#include <linux/cpu.h>
+#include <linux/cpufreq.h>
+#include <linux/irq_work.h>
+#include <linux/kthread.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/sched.h>
+#include <linux/sched/rt.h>
+#include <linux/slab.h>
+
+/* Up and down rate limits, in usecs */
+#define DEFAULT_UP_RATE_LIMIT		(1 * USEC_PER_MSEC)
+#define DEFAULT_DOWN_RATE_LIMIT		(20 * USEC_PER_MSEC)
+
+/*
+ * A cpu whose utilization was not refreshed for this long is idle with the
+ * tick stopped; don't let its stale utilization hold the policy up.
+ */
+#define STALE_UTIL_NS			(2 * TICK_NSEC)
+
+struct cpufreq_sched_policy {
+	struct cpufreq_policy *policy;
+	raw_spinlock_t lock;		/* protects the fields below */
+	u64 last_freq_update_time;
+	unsigned int next_freq;
+	bool work_pending;
+
+	struct irq_work irq_work;
+	struct task_struct *thread;
+	struct mutex work_lock;		/* serializes frequency switching */
+	bool stopped;			/* under work_lock, no switch after GOV_STOP */
+};
+
+struct cpufreq_sched_cpu {
+	struct update_util_data update_util;
+	struct cpufreq_sched_policy *sp;
+	unsigned long util;
+	unsigned long max;
+	unsigned long cap_min;		/* capacity clamps of queued tasks */
+	unsigned long cap_max;
+	u64 last_update;
+};
+
+static DEFINE_PER_CPU(struct cpufreq_sched_cpu, sched_cpu);
+
+static DEFINE_MUTEX(gov_mutex);
+static unsigned int gov_users;
+
+static unsigned int up_rate_limit_us = DEFAULT_UP_RATE_LIMIT;
+static unsigned int down_rate_limit_us = DEFAULT_DOWN_RATE_LIMIT;
+
+/*
+ * The runnable average is not frequency invariant: a cpu fully busy at a
+ * low frequency reports the same utilization as one fully busy at the
+ * maximum.  Scale the current frequency so that the cpu ends up 80% busy,
+ * which makes a saturated cpu ramp up by 25% per allowed change.
+ *
+ * The capacity clamps of the queued tasks are absolute, so they bound the
+ * result as a fraction of the highest frequency; the minimum wins.
+ */
+static unsigned int cpufreq_sched_next_freq(struct cpufreq_policy *policy,
+					    unsigned long util,
+					    unsigned long max,
+					    unsigned long cap_min,
+					    unsigned long cap_max)
+{
+	unsigned int max_freq = policy->cpuinfo.max_freq;
+	unsigned int freq = policy->cur + (policy->cur >> 2);
+
+	freq = div_u64((u64)freq * util, max);
+	freq = min_t(unsigned int, freq,
+		     ((u64)max_freq * cap_max) >> SCHED_POWER_SHIFT);
+	freq = max_t(unsigned int, freq,
+		     ((u64)max_freq * cap_min) >> SCHED_POWER_SHIFT);
+
+	return clamp(freq, policy->min, policy->max);
+}
+
+static void cpufreq_sched_update(struct update_util_data *data, int cpu,
+				 u64 time, unsigned long util,
+				 unsigned long max)
+{
+	struct cpufreq_sched_cpu *sc = container_of(data,
+					struct cpufreq_sched_cpu, update_util);
+	struct cpufreq_sched_policy *sp = sc->sp;
+	struct cpufreq_policy *policy = sp->policy;
+	unsigned long cap_min, cap_max;
+	unsigned int next_freq;
+	unsigned int j;
+	s64 delta_ns;
+
+	raw_spin_lock(&sp->lock);
+
+	sc->util = util;
+	sc->max = max;
+	sched_capacity_clamp(cpu, &sc->cap_min, &sc->cap_max);
+	sc->last_update = time;
+	cap_min = sc->cap_min;
+	cap_max = sc->cap_max;
+
+	/* the busiest cpu of the policy decides */
+	for_each_cpu(j, policy->cpus) {
+		struct cpufreq_sched_cpu *jc = &per_cpu(sched_cpu, j);
+
+		if (j == cpu)
+			continue;
+		if ((s64)(time - jc->last_update) > STALE_UTIL_NS)
+			continue;
+		/* any boosted cpu holds the policy up */
+		cap_min = max(cap_min, jc->cap_min);
+		if (jc->util * max > util * jc->max) {
+			util = jc->util;
+			max = jc->max;
+			cap_max = jc->cap_max;
+		}
+	}
+
+	next_freq = cpufreq_sched_next_freq(policy, util, max,
+					    cap_min, cap_max);
+	if (next_freq == sp->next_freq)
+		goto out;
+
+	delta_ns = time - sp->last_freq_update_time;
+	if (next_freq > sp->next_freq) {
+		if (delta_ns < (s64)up_rate_limit_us * NSEC_PER_USEC)
+			goto out;
+	} else {
+		if (delta_ns < (s64)down_rate_limit_us * NSEC_PER_USEC)
+			goto out;
+	}
+
+	sp->next_freq = next_freq;
+	sp->last_freq_update_time = time;
+	if (!sp->work_pending) {
+		sp->work_pending = true;
+		irq_work_queue(&sp->irq_work);
+	}
+out:
+	raw_spin_unlock(&sp->lock);
+}
+
+static void cpufreq_sched_irq_work(struct irq_work *irq_work)
+{
+	struct cpufreq_sched_policy *sp = container_of(irq_work,
+					struct cpufreq_sched_policy, irq_work);
+
+	wake_up_process(sp->thread);
+}
+
+static int cpufreq_sched_thread(void *data)
+{
+	struct cpufreq_sched_policy *sp = data;
+	unsigned long flags;
+	unsigned int freq;
+
+	while (1) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (kthread_should_stop())
+			break;
+
+		if (!ACCESS_ONCE(sp->work_pending)) {
+			schedule();
+			continue;
+		}
+		__set_current_state(TASK_RUNNING);
+
+		raw_spin_lock_irqsave(&sp->lock, flags);
+		freq = sp->next_freq;
+		sp->work_pending = false;
+		raw_spin_unlock_irqrestore(&sp->lock, flags);
+
+		mutex_lock(&sp->work_lock);
+		if (!sp->stopped && freq != sp->policy->cur)
+			__cpufreq_driver_target(sp->policy, freq,
+						CPUFREQ_RELATION_L);
+		mutex_unlock(&sp->work_lock);
+	}
+	__set_current_state(TASK_RUNNING);
+
+	return 0;
+}
+
+#define show_one(name)							\
+static ssize_t show_##name(struct kobject *kobj,			\
+			   struct attribute *attr, char *buf)		\
+{									\
+	return sprintf(buf, "%u\n", name);				\
+}
+
+#define store_one(name)							\
+static ssize_t store_##name(struct kobject *kobj,			\
+			    struct attribute *attr, const char *buf,	\
+			    size_t count)				\
+{									\
+	unsigned int val;						\
+	int ret;							\
+									\
+	ret = kstrtouint(buf, 0, &val);					\
+	if (ret < 0)							\
+		return ret;						\
+	name = val;							\
+	return count;							\
+}
+
+show_one(up_rate_limit_us);
+store_one(up_rate_limit_us);
+show_one(down_rate_limit_us);
+store_one(down_rate_limit_us);
+
+define_one_global_rw(up_rate_limit_us);
+define_one_global_rw(down_rate_limit_us);
+
+static struct attribute *cpufreq_sched_attributes[] = {
+	&up_rate_limit_us.attr,
+	&down_rate_limit_us.attr,
+	NULL,
+};
+
+static struct attribute_group cpufreq_sched_attr_group = {
+	.attrs = cpufreq_sched_attributes,
+	.name = "sched",
+};
+
+static int cpufreq_sched_policy_init(struct cpufreq_policy *policy)
+{
+	struct sched_param param = { .sched_priority = MAX_RT_PRIO - 1 };
+	struct cpufreq_sched_policy *sp;
+	int rc;
+
+	sp = kzalloc(sizeof(*sp), GFP_KERNEL);
+	if (!sp)
+		return -ENOMEM;
+
+	sp->policy = policy;
+	raw_spin_lock_init(&sp->lock);
+	mutex_init(&sp->work_lock);
+	init_irq_work(&sp->irq_work, cpufreq_sched_irq_work);
+
+	sp->thread = kthread_create(cpufreq_sched_thread, sp, "kschedfreq:%u",
+				    cpumask_first(policy->related_cpus));
+	if (IS_ERR(sp->thread)) {
+		rc = PTR_ERR(sp->thread);
+		goto err_free;
+	}
+	sched_setscheduler_nocheck(sp->thread, SCHED_FIFO, &param);
+
+	mutex_lock(&gov_mutex);
+	if (!gov_users) {
+		rc = cpufreq_get_global_kobject();
+		if (!rc) {
+			rc = sysfs_create_group(cpufreq_global_kobject,
+						&cpufreq_sched_attr_group);
+			if (rc)
+				cpufreq_put_global_kobject();
+		}
+		if (rc) {
+			mutex_unlock(&gov_mutex);
+			goto err_stop;
+		}
+	}
+	gov_users++;
+	mutex_unlock(&gov_mutex);
+
+	policy->governor_data = sp;
+	wake_up_process(sp->thread);
+
+	return 0;
+
+err_stop:
+	kthread_stop(sp->thread);
+err_free:
+	kfree(sp);
+	return rc;
+}
+
+static void cpufreq_sched_policy_exit(struct cpufreq_policy *policy)
+{
+	struct cpufreq_sched_policy *sp = policy->governor_data;
+
+	mutex_lock(&gov_mutex);
+	if (!--gov_users) {
+		sysfs_remove_group(cpufreq_global_kobject,
+				   &cpufreq_sched_attr_group);
+		cpufreq_put_global_kobject();
+	}
+	mutex_unlock(&gov_mutex);
+
+	kthread_stop(sp->thread);
+	policy->governor_data = NULL;
+	kfree(sp);
+}
+
+static void cpufreq_sched_start(struct cpufreq_policy *policy)
+{
+	struct cpufreq_sched_policy *sp = policy->governor_data;
+	unsigned int cpu;
+
+	sp->next_freq = policy->cur;
+	sp->last_freq_update_time = 0;
+	sp->work_pending = false;
+
+	mutex_lock(&sp->work_lock);
+	sp->stopped = false;
+	mutex_unlock(&sp->work_lock);
+
+	for_each_cpu(cpu, policy->cpus) {
+		struct cpufreq_sched_cpu *sc = &per_cpu(sched_cpu, cpu);
+
+		sc->sp = sp;
+		sc->util = 0;
+		sc->max = SCHED_POWER_SCALE;
+		sc->cap_min = 0;
+		sc->cap_max = SCHED_POWER_SCALE;
+		sc->last_update = 0;
+		sc->update_util.func = cpufreq_sched_update;
+		cpufreq_set_update_util_data(cpu, &sc->update_util);
+	}
+}
+
+static void cpufreq_sched_stop(struct cpufreq_policy *policy)
+{
+	struct cpufreq_sched_policy *sp = policy->governor_data;
+	unsigned int cpu;
+
+	for_each_cpu(cpu, policy->cpus)
+		cpufreq_set_update_util_data(cpu, NULL);
+
+	synchronize_sched();
+	irq_work_sync(&sp->irq_work);
+
+	/*
+	 * The thread may still hold a frequency it picked up before the
+	 * hooks went away; wait for a switch in progress and make it drop
+	 * anything it hasn't started.
+	 */
+	mutex_lock(&sp->work_lock);
+	sp->stopped = true;
+	mutex_unlock(&sp->work_lock);
+}
+
+static void cpufreq_sched_limits(struct cpufreq_policy *policy)
+{
+	struct cpufreq_sched_policy *sp = policy->governor_data;
+
+	mutex_lock(&sp->work_lock);
+	if (policy->max < policy->cur)
+		__cpufreq_driver_target(policy, policy->max,
+					CPUFREQ_RELATION_H);
+	else if (policy->min > policy->cur)
+		__cpufreq_driver_target(policy, policy->min,
+					CPUFREQ_RELATION_L);
+	mutex_unlock(&sp->work_lock);
+}
+
+static int cpufreq_governor_sched(struct cpufreq_policy *policy,
+				  unsigned int event)
+{
+	switch (event) {
+	case CPUFREQ_GOV_POLICY_INIT:
+		return cpufreq_sched_policy_init(policy);
+	case CPUFREQ_GOV_POLICY_EXIT:
+		cpufreq_sched_policy_exit(policy);
+		break;
+	case CPUFREQ_GOV_START:
+		cpufreq_sched_start(policy);
+		break;
+	case CPUFREQ_GOV_STOP:
+		cpufreq_sched_stop(policy);
+		break;
+	case CPUFREQ_GOV_LIMITS:
+		cpufreq_sched_limits(policy);
+		break;
+	}
+	return 0;
+}
+
+#ifndef CONFIG_CPU_FREQ_DEFAULT_GOV_SCHED
+static
+#endif
+struct cpufreq_governor cpufreq_gov_sched = {
+	.name = "sched",
+	.governor = cpufreq_governor_sched,
+	.max_transition_latency = 10000000,
+	.owner = THIS_MODULE,
+};
+
+static int __init cpufreq_sched_init(void)
+{
+	return cpufreq_register_governor(&cpufreq_gov_sched);
+}
+
+static void __exit cpufreq_sched_exit(void)
+{
+	cpufreq_unregister_governor(&cpufreq_gov_sched);
+}
+
+#ifdef CONFIG_CPU_FREQ_DEFAULT_GOV_SCHED
+fs_initcall(cpufreq_sched_init);
+#else
+module_init(cpufreq_sched_init);
+#endif
+module_exit(cpufreq_sched_exit);
+
+MODULE_DESCRIPTION("'cpufreq_sched' - scheduler driven cpufreq governor");
+MODULE_LICENSE("GPL");
@@ -17,6 +17,10 @@
 #include <linux/err.h>
 #include <linux/of.h>
 #include <linux/sched.h>
+#include <linux/hashtable.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/cred.h>
 #include <asm/cputime.h>
 
 static spinlock_t cpufreq_stats_lock;
@@ -58,6 +62,51 @@ static DEFINE_PER_CPU(struct all_cpufreq_stats *, all_cpufreq_stats);
 static DEFINE_PER_CPU(struct cpufreq_stats *, cpufreq_stats_table);
 static DEFINE_PER_CPU(struct cpufreq_power_stats *, cpufreq_power_stats);
 
+/*
+ * Time in state per task and per UID.  At every context switch and tick
+ * the running task is charged, on its own cpu with interrupts off, for
+ * the time since the previous charge on that cpu, so the counters need
+ * no lock.  The UID times keep one cache line aligned row per cpu;
+ * readers add the rows up.
+ *
+ * The counters are indexed by position in task_freq_table, which only
+ * grows at the end.  all_freq_table is re-sorted when a policy brings
+ * new frequencies, so it can't be used for that.  A task or UID that was
+ * allocated before a frequency was added doesn't count time at it.  The
+ * table is replaced under cpufreq_stats_lock and read under RCU.
+ */
+struct task_freq_table {
+	struct rcu_head rcu;
+	unsigned int nr_freqs;
+	unsigned int freq[0];
+};
+
+static struct task_freq_table __rcu *task_freq_table;
+
+#define UID_HASH_BITS	10
+
+struct uid_entry {
+	uid_t uid;
+	unsigned int max_state;
+	unsigned int stride;		/* u64s per cpu row */
+	struct hlist_node hash;
+	/* nsecs, nr_cpu_ids rows, each starting on its own cache line */
+	u64 time_in_state[0] ____cacheline_aligned_in_smp;
+};
+
+/* kmalloc alignment may fall short of a cache line on some arches */
+#define UID_ENTRY_PAD	(SMP_CACHE_BYTES > ARCH_KMALLOC_MINALIGN ? \
+			 SMP_CACHE_BYTES - ARCH_KMALLOC_MINALIGN : 0)
+
+static DECLARE_HASHTABLE(uid_hash_table, UID_HASH_BITS);
+static DEFINE_SPINLOCK(uid_lock);	/* serializes uid_entry insertion */
+
+/* 1 + index of each cpu's current frequency in task_freq_table, 0 if none */
+static DEFINE_PER_CPU(int, cpu_task_freq_index);
+static DEFINE_PER_CPU(unsigned int, cpu_cur_freq);
+/* local_clock() at the last time in state charge on each cpu */
+static DEFINE_PER_CPU(u64, cpu_time_in_state_stamp);
+
 struct cpufreq_stats_attribute {
 	struct attribute attr;
 	ssize_t(*show) (struct cpufreq_stats *, char *);
@@ -127,13 +176,12 @@ static int get_index_all_cpufreq_stat(struct all_cpufreq_stats *all_stat,
 	return -1;
 }
 
-void acct_update_power(struct task_struct *task, cputime_t cputime) {
+static void __acct_update_power(struct task_struct *task, cputime_t cputime)
+{
 	struct cpufreq_power_stats *powerstats;
 	struct cpufreq_stats *stats;
 	unsigned int cpu_num, curr;
 
-	if (!task)
-		return;
 	cpu_num = task_cpu(task);
 	powerstats = per_cpu(cpufreq_power_stats, cpu_num);
 	stats = per_cpu(cpufreq_stats_table, cpu_num);
@@ -144,8 +192,335 @@ void acct_update_power(struct task_struct *task, cputime_t cputime) {
 	if (task->cpu_power != ULLONG_MAX)
 		task->cpu_power += curr * cputime_to_usecs(cputime);
 }
+
+static int task_freq_table_find(struct task_freq_table *t, unsigned int freq)
+{
+	int i;
+
+	if (!t)
+		return -1;
+	for (i = 0; i < t->nr_freqs; i++) {
+		if (t->freq[i] == freq)
+			return i;
+	}
+	return -1;
+}
+
+/*
+ * Append the frequencies of @table that task_freq_table doesn't have yet.
+ * Returns true if any were added.  Called with cpufreq_stats_lock held.
+ */
+static bool task_freq_table_add(struct cpufreq_frequency_table *table)
+{
+	struct task_freq_table *old, *new;
+	unsigned int nr_old, count = 0;
+	int i;
+
+	old = rcu_dereference_protected(task_freq_table,
+			lockdep_is_held(&cpufreq_stats_lock));
+	nr_old = old ? old->nr_freqs : 0;
+	for (i = 0; table[i].frequency != CPUFREQ_TABLE_END; i++)
+		count++;
+
+	new = kmalloc(sizeof(*new) + (nr_old + count) * sizeof(unsigned int),
+		      GFP_ATOMIC);
+	if (!new) {
+		pr_warn("Could not grow the task time_in_state freq table\n");
+		return false;
+	}
+	if (old)
+		memcpy(new->freq, old->freq, nr_old * sizeof(unsigned int));
+	new->nr_freqs = nr_old;
+
+	for (i = 0; table[i].frequency != CPUFREQ_TABLE_END; i++) {
+		unsigned int freq = table[i].frequency;
+
+		if (freq == CPUFREQ_ENTRY_INVALID)
+			continue;
+		if (task_freq_table_find(new, freq) == -1)
+			new->freq[new->nr_freqs++] = freq;
+	}
+	if (new->nr_freqs == nr_old) {
+		kfree(new);
+		return false;
+	}
+
+	rcu_assign_pointer(task_freq_table, new);
+	if (old)
+		kfree_rcu(old, rcu);
+	return true;
+}
+
+/* Called with cpufreq_stats_lock held */
+static void cpufreq_stats_set_cpu_freq(unsigned int cpu, unsigned int freq)
+{
+	struct task_freq_table *t;
+
+	t = rcu_dereference_protected(task_freq_table,
+			lockdep_is_held(&cpufreq_stats_lock));
+	per_cpu(cpu_cur_freq, cpu) = freq;
+	per_cpu(cpu_task_freq_index, cpu) = task_freq_table_find(t, freq) + 1;
+}
+
+static struct uid_entry *find_uid_entry(uid_t uid)
+{
+	struct uid_entry *uid_entry;
+
+	hash_for_each_possible_rcu(uid_hash_table, uid_entry, hash, uid) {
+		if (uid_entry->uid == uid)
+			return uid_entry;
+	}
+	return NULL;
+}
+
+/* Called from the tick, with interrupts disabled and under rcu_read_lock */
+static struct uid_entry *find_or_register_uid(uid_t uid)
+{
+	struct task_freq_table *t;
+	struct uid_entry *uid_entry;
+	unsigned int max_state, stride;
+	void *buf;
+
+	uid_entry = find_uid_entry(uid);
+	if (uid_entry)
+		return uid_entry;
+
+	spin_lock(&uid_lock);
+	uid_entry = find_uid_entry(uid);
+	if (uid_entry)
+		goto out;
+
+	t = rcu_dereference(task_freq_table);
+	max_state = t ? t->nr_freqs : 0;
+	stride = ALIGN(max_state * sizeof(u64), SMP_CACHE_BYTES) /
+		sizeof(u64);
+	/* entries are never freed, so the pointer may be moved up to align */
+	buf = kzalloc(sizeof(*uid_entry) + UID_ENTRY_PAD +
+		      nr_cpu_ids * stride * sizeof(u64), GFP_ATOMIC);
+	if (!buf)
+		goto out;
+	uid_entry = PTR_ALIGN(buf, SMP_CACHE_BYTES);
+
+	uid_entry->uid = uid;
+	uid_entry->max_state = max_state;
+	uid_entry->stride = stride;
+	hash_add_rcu(uid_hash_table, &uid_entry->hash, uid);
+out:
+	spin_unlock(&uid_lock);
+	return uid_entry;
+}
+
+/*
+ * Charge @task, which is running on this cpu, for the time since the last
+ * charge here.  Called with interrupts disabled.  The context switch path
+ * holds the rq lock, so it can't allocate: a UID that hasn't been seen yet
+ * is registered from the next tick instead.  Time spent in the idle task
+ * isn't charged to anyone.
+ */
+static void acct_update_time_in_state(struct task_struct *task, bool tick)
+{
+	unsigned int cpu = smp_processor_id();
+	int index = per_cpu(cpu_task_freq_index, cpu) - 1;
+	u64 now = local_clock();
+	u64 last = per_cpu(cpu_time_in_state_stamp, cpu);
+	struct uid_entry *uid_entry;
+	u64 delta;
+	uid_t uid;
+
+	per_cpu(cpu_time_in_state_stamp, cpu) = now;
+	if (index < 0 || !last || (s64)(now - last) <= 0 ||
+	    is_idle_task(task))
+		return;
+	delta = now - last;
+
+	if (task->time_in_state && index < task->max_state)
+		task->time_in_state[index] += delta;
+
+	rcu_read_lock();
+	uid = from_kuid_munged(&init_user_ns, task_uid(task));
+	if (tick)
+		uid_entry = find_or_register_uid(uid);
+	else
+		uid_entry = find_uid_entry(uid);
+	if (uid_entry && index < uid_entry->max_state)
+		uid_entry->time_in_state[cpu * uid_entry->stride + index] +=
+			delta;
+	rcu_read_unlock();
+}
+
+void acct_update_power(struct task_struct *task, cputime_t cputime)
+{
+	if (!task)
+		return;
+
+	acct_update_time_in_state(task, true);
+	__acct_update_power(task, cputime);
+}
 EXPORT_SYMBOL_GPL(acct_update_power);
 
+void cpufreq_task_stats_switch(struct task_struct *prev)
+{
+	acct_update_time_in_state(prev, false);
+}
+
+void cpufreq_task_stats_init(struct task_struct *p)
+{
+	p->time_in_state = NULL;
+	p->max_state = 0;
+}
+
+void cpufreq_task_stats_alloc(struct task_struct *p)
+{
+	struct task_freq_table *t;
+	unsigned int max_state;
+
+	rcu_read_lock();
+	t = rcu_dereference(task_freq_table);
+	max_state = t ? t->nr_freqs : 0;
+	rcu_read_unlock();
+	if (!max_state)
+		return;
+
+	p->time_in_state = kcalloc(max_state, sizeof(u64), GFP_KERNEL);
+	if (p->time_in_state)
+		p->max_state = max_state;
+}
+
+void cpufreq_task_stats_free(struct task_struct *p)
+{
+	kfree(p->time_in_state);
+	p->time_in_state = NULL;
+}
+
+int proc_time_in_state_show(struct seq_file *m, struct pid_namespace *ns,
+		struct pid *pid, struct task_struct *p)
+{
+	struct task_freq_table *t;
+	unsigned int i;
+
+	if (!p->time_in_state)
+		return 0;
+
+	/* the table only grows, so it covers p->max_state */
+	rcu_read_lock();
+	t = rcu_dereference(task_freq_table);
+	for (i = 0; i < p->max_state; i++)
+		seq_printf(m, "%u %llu\n", t->freq[i], (unsigned long long)
+			   div_u64(p->time_in_state[i], NSEC_PER_USEC));
+	rcu_read_unlock();
+	return 0;
+}
+
+/*
+ * /proc/uid_time_in_state is binary, so that thousands of UIDs read in a
+ * few milliseconds without formatting numbers.  In native endianness:
+ *
+ *	u32 nr_freqs, u32 reserved
+ *	u32 freq[nr_freqs] in kHz, padded with a zero to a multiple of 8 bytes
+ *	then per UID: u32 uid, u32 reserved, u64 usecs[nr_freqs]
+ *
+ * nr_freqs is sampled at open, so every record of one open file has the
+ * same length even if a policy adds frequencies meanwhile.
+ */
+struct uid_time_in_state_hdr {
+	u32 nr_freqs;
+	u32 reserved;
+};
+
+static void *uid_seq_start(struct seq_file *m, loff_t *pos)
+{
+	rcu_read_lock();
+	if (*pos >= HASH_SIZE(uid_hash_table) + 1)
+		return NULL;
+	return pos;
+}
+
+static void *uid_seq_next(struct seq_file *m, void *v, loff_t *pos)
+{
+	(*pos)++;
+	if (*pos >= HASH_SIZE(uid_hash_table) + 1)
+		return NULL;
+	return pos;
+}
+
+static void uid_seq_stop(struct seq_file *m, void *v)
+{
+	rcu_read_unlock();
+}
+
+/* Position 0 is the header, position n the UIDs of bucket n - 1 */
+static int uid_seq_show(struct seq_file *m, void *v)
+{
+	unsigned int nr_freqs = *(unsigned int *)m->private;
+	loff_t pos = *(loff_t *)v;
+	struct uid_entry *uid_entry;
+	unsigned int cpu, i;
+
+	if (!nr_freqs)
+		return 0;
+
+	if (!pos) {
+		struct uid_time_in_state_hdr hdr = { .nr_freqs = nr_freqs };
+		struct task_freq_table *t = rcu_dereference(task_freq_table);
+		u32 pad = 0;
+
+		seq_write(m, &hdr, sizeof(hdr));
+		seq_write(m, t->freq, nr_freqs * sizeof(u32));
+		if (nr_freqs & 1)
+			seq_write(m, &pad, sizeof(pad));
+		return 0;
+	}
+
+	hlist_for_each_entry_rcu(uid_entry, &uid_hash_table[pos - 1], hash) {
+		u32 rec[2] = { uid_entry->uid, 0 };
+
+		seq_write(m, rec, sizeof(rec));
+		for (i = 0; i < nr_freqs; i++) {
+			u64 time = 0;
+
+			if (i < uid_entry->max_state) {
+				for_each_possible_cpu(cpu)
+					time += uid_entry->time_in_state[
+						cpu * uid_entry->stride + i];
+				time = div_u64(time, NSEC_PER_USEC);
+			}
+			seq_write(m, &time, sizeof(time));
+		}
+	}
+	return 0;
+}
+
+static const struct seq_operations uid_time_in_state_seq_ops = {
+	.start = uid_seq_start,
+	.next = uid_seq_next,
+	.stop = uid_seq_stop,
+	.show = uid_seq_show,
+};
+
+static int uid_time_in_state_open(struct inode *inode, struct file *file)
+{
+	struct task_freq_table *t;
+	unsigned int *nr_freqs;
+
+	nr_freqs = __seq_open_private(file, &uid_time_in_state_seq_ops,
+				      sizeof(*nr_freqs));
+	if (!nr_freqs)
+		return -ENOMEM;
+
+	rcu_read_lock();
+	t = rcu_dereference(task_freq_table);
+	*nr_freqs = t ? t->nr_freqs : 0;
+	rcu_read_unlock();
+	return 0;
+}
+
+static const struct file_operations uid_time_in_state_fops = {
+	.open		= uid_time_in_state_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= seq_release_private,
+};
+
 static ssize_t show_current_in_state(struct kobject *kobj,
 		struct kobj_attribute *attr, char *buf)
 {
@@ -185,6 +560,8 @@ static ssize_t show_all_time_in_state(struct kobject *kobj,
 
 	if (!all_freq_table)
 		goto out;
+	/* add_all_freq_table() may move the table */
+	spin_lock(&cpufreq_stats_lock);
 	for (i = 0; i < all_freq_table->table_size; i++) {
 		freq = all_freq_table->freq_table[i];
 		len += scnprintf(buf + len, PAGE_SIZE - len, "\n%u\t\t", freq);
@@ -201,6 +578,7 @@ static ssize_t show_all_time_in_state(struct kobject *kobj,
 			}
 		}
 	}
+	spin_unlock(&cpufreq_stats_lock);
 
 out:
 	len += scnprintf(buf + len, PAGE_SIZE - len, "\n");
@@ -318,6 +696,7 @@ static void cpufreq_allstats_free(void)
 {
 	int cpu;
 	struct all_cpufreq_stats *all_stat;
+	struct task_freq_table *t;
 
 	sysfs_remove_file(cpufreq_global_kobject,
 						&_attr_all_time_in_state.attr);
@@ -335,6 +714,10 @@ static void cpufreq_allstats_free(void)
 		kfree(all_freq_table);
 		all_freq_table = NULL;
 	}
+	t = rcu_dereference_protected(task_freq_table, 1);
+	RCU_INIT_POINTER(task_freq_table, NULL);
+	if (t)
+		kfree_rcu(t, rcu);
 }
 
 static void cpufreq_powerstats_free(void)
@@ -578,6 +961,10 @@ static void cpufreq_allstats_create(unsigned int cpu,
 	if (sort_needed)
 		sort(all_freq_table->freq_table, all_freq_table->table_size,
 				sizeof(unsigned int), &compare_for_sort, NULL);
+	if (task_freq_table_add(table)) {
+		for_each_possible_cpu(i)
+			cpufreq_stats_set_cpu_freq(i, per_cpu(cpu_cur_freq, i));
+	}
 	all_stat->state_num = j;
 	per_cpu(all_cpufreq_stats, cpu) = all_stat;
 	spin_unlock(&cpufreq_stats_lock);
@@ -614,6 +1001,11 @@ static int cpufreq_stat_notifier_policy(struct notifier_block *nb,
 	if (!per_cpu(cpufreq_power_stats, cpu))
 		cpufreq_powerstats_create(cpu, table, count);
 
+	spin_lock(&cpufreq_stats_lock);
+	for_each_cpu(i, policy->cpus)
+		cpufreq_stats_set_cpu_freq(i, policy->cur);
+	spin_unlock(&cpufreq_stats_lock);
+
 	if (val == CPUFREQ_CREATE_POLICY)
 		ret = __cpufreq_stats_create_table(policy, table, count);
 	else if (val == CPUFREQ_REMOVE_POLICY)
@@ -651,6 +1043,10 @@ static void cpufreq_stats_create_table(unsigned int cpu)
 		if (!per_cpu(cpufreq_power_stats, cpu))
 			cpufreq_powerstats_create(cpu, table, count);
 
+		spin_lock(&cpufreq_stats_lock);
+		cpufreq_stats_set_cpu_freq(cpu, policy->cur);
+		spin_unlock(&cpufreq_stats_lock);
+
 		__cpufreq_stats_create_table(policy, table, count);
 	}
 	cpufreq_cpu_put(policy);
@@ -666,6 +1062,10 @@ static int cpufreq_stat_notifier_trans(struct notifier_block *nb,
 	if (val != CPUFREQ_POSTCHANGE)
 		return 0;
 
+	spin_lock(&cpufreq_stats_lock);
+	cpufreq_stats_set_cpu_freq(freq->cpu, freq->new);
+	spin_unlock(&cpufreq_stats_lock);
+
 	stat = per_cpu(cpufreq_stats_table, freq->cpu);
 	if (!stat)
 		return 0;
@@ -735,6 +1135,10 @@ static int __init cpufreq_stats_init(void)
 	if (ret)
 		pr_warn("Cannot create sysfs file for cpufreq current stats\n");
 
+	if (!proc_create("uid_time_in_state", S_IRUGO, NULL,
+			 &uid_time_in_state_fops))
+		pr_warn("Cannot create proc file for uid time in state\n");
+
 	return 0;
 }
 static void __exit cpufreq_stats_exit(void)
@@ -33,6 +33,8 @@
 #include <linux/coresight-cti.h>
 #include <linux/moduleparam.h>
 #include <linux/sched.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 #include <soc/qcom/spm.h>
 #include <soc/qcom/pm.h>
 #include <soc/qcom/rpm-notifier.h>
@@ -125,6 +127,18 @@ static bool sleep_disabled;
 module_param_named(sleep_disabled,
 	sleep_disabled, bool, S_IRUGO | S_IWUSR | S_IWGRP);
 
+static bool lpm_prediction = true;
+module_param_named(lpm_prediction,
+	lpm_prediction, bool, S_IRUGO | S_IWUSR | S_IWGRP);
+
+static unsigned int ref_stddev = 100;
+module_param_named(ref_stddev,
+	ref_stddev, uint, S_IRUGO | S_IWUSR | S_IWGRP);
+
+static unsigned int tmr_add = 100;
+module_param_named(tmr_add,
+	tmr_add, uint, S_IRUGO | S_IWUSR | S_IWGRP);
+
 s32 msm_cpuidle_get_deep_idle_latency(void)
 {
 	return 10;
@@ -200,6 +214,228 @@ static void msm_pm_set_timer(uint32_t modified_time_us)
 	hrtimer_start(&lpm_hrtimer, modified_ktime, HRTIMER_MODE_REL_PINNED);
 }
 
+/*
+ * Wakeup prediction
+ *
+ * Interrupts that fire at a fixed interval (display vsync, audio) wake a
+ * cpu long before its next timer, so a choice based on the timer alone
+ * picks states that do not pay off.  Each cpu keeps its last
+ * LPM_HIST_SAMPLES sleep lengths.  When they repeat, i.e. their standard
+ * deviation is below ref_stddev or a sixth of their average, the average
+ * is taken as the next wakeup.  A wrong guess costs at most tmr_add us in
+ * a shallow state: a timer armed past the prediction wakes the cpu to
+ * choose again, this time from the timer alone.
+ */
+#define LPM_HIST_SAMPLES	8
+
+struct lpm_history {
+	uint32_t resi[LPM_HIST_SAMPLES];
+	int hptr;
+	int nsamp;
+	bool hinvalid;		/* next choice ignores the history */
+	bool htmr_fired;
+	atomic64_t pred_wakeup;	/* ns, 0 when none was predicted; read remotely */
+	struct hrtimer histtimer;
+};
+
+struct lpm_pred_stats {
+	u64 samples;
+	u64 predicted;
+	u64 too_shallow;	/* a deeper allowed level would have paid off */
+	u64 too_deep;		/* the level did not pay off */
+	u64 htmr_wakeups;
+};
+
+static DEFINE_PER_CPU(struct lpm_history, lpm_history);
+static DEFINE_PER_CPU(struct lpm_pred_stats, lpm_pred_stats);
+
+static enum hrtimer_restart histtimer_fn(struct hrtimer *h)
+{
+	struct lpm_history *history = container_of(h, struct lpm_history,
+						   histtimer);
+
+	history->htmr_fired = true;
+	return HRTIMER_NORESTART;
+}
+
+static uint32_t lpm_cpuidle_predict(unsigned int cpu)
+{
+	struct lpm_history *history = &per_cpu(lpm_history, cpu);
+	uint32_t thresh = UINT_MAX;
+	uint64_t avg, variance;
+	uint32_t max;
+	int i, divisor;
+
+	if (!lpm_prediction || history->hinvalid ||
+			history->nsamp < LPM_HIST_SAMPLES)
+		return 0;
+
+again:
+	avg = 0;
+	max = 0;
+	divisor = 0;
+	for (i = 0; i < LPM_HIST_SAMPLES; i++) {
+		uint32_t value = history->resi[i];
+
+		if (value <= thresh) {
+			avg += value;
+			divisor++;
+			if (value > max)
+				max = value;
+		}
+	}
+	do_div(avg, divisor);
+
+	variance = 0;
+	for (i = 0; i < LPM_HIST_SAMPLES; i++) {
+		uint32_t value = history->resi[i];
+
+		if (value <= thresh) {
+			int64_t diff = (int64_t)value - (int64_t)avg;
+
+			variance += diff * diff;
+		}
+	}
+	do_div(variance, divisor);
+
+	if (variance <= (uint64_t)ref_stddev * ref_stddev ||
+			avg * avg > variance * 36)
+		return (uint32_t)avg;
+
+	/* drop the longest sleep as an outlier, while 3/4 are left */
+	if (divisor * 4 > LPM_HIST_SAMPLES * 3) {
+		thresh = max - 1;
+		goto again;
+	}
+
+	return 0;
+}
+
+/* Earliest predicted wakeup of the cpus voting for a cluster level */
+static uint32_t lpm_cluster_predict(struct lpm_cluster *cluster)
+{
+	int64_t now = ktime_to_ns(ktime_get());
+	int64_t next = LLONG_MAX;
+	int cpu;
+
+	if (!lpm_prediction)
+		return 0;
+
+	for_each_cpu(cpu, &cluster->num_childs_in_sync) {
+		int64_t pred = atomic64_read(&per_cpu(lpm_history,
+						cpu).pred_wakeup);
+
+		if (pred && pred < next)
+			next = pred;
+	}
+
+	if (next == LLONG_MAX)
+		return 0;
+	if (next <= now)
+		return 1;
+
+	return (uint32_t)div64_u64(next - now, NSEC_PER_USEC);
+}
+
+static void lpm_cpuidle_pred_start(unsigned int cpu, struct lpm_cpu *lpm_cpu,
+		int idx, uint32_t pred_us)
+{
+	struct lpm_history *history = &per_cpu(lpm_history, cpu);
+	u64 tmr_ns = (u64)(pred_us + tmr_add) * NSEC_PER_USEC;
+
+	per_cpu(lpm_pred_stats, cpu).predicted++;
+
+	/*
+	 * The deepest level has nothing better to wake up for, so no timer
+	 * backs the prediction there; don't let the cluster plan on it.
+	 */
+	if (idx >= lpm_cpu->nlevels - 1)
+		return;
+
+	atomic64_set(&history->pred_wakeup, ktime_to_ns(ktime_get()) +
+			pred_us * NSEC_PER_USEC);
+	hrtimer_start(&history->histtimer, ns_to_ktime(tmr_ns),
+			HRTIMER_MODE_REL_PINNED);
+}
+
+static void lpm_cpuidle_pred_cancel(unsigned int cpu)
+{
+	struct lpm_history *history = &per_cpu(lpm_history, cpu);
+
+	atomic64_set(&history->pred_wakeup, 0);
+	hrtimer_try_to_cancel(&history->histtimer);
+}
+
+static void lpm_cpuidle_pred_update(unsigned int cpu, struct lpm_cpu *lpm_cpu,
+		int idx, uint32_t resi_us)
+{
+	struct lpm_history *history = &per_cpu(lpm_history, cpu);
+	struct lpm_pred_stats *stats = &per_cpu(lpm_pred_stats, cpu);
+	int i;
+
+	lpm_cpuidle_pred_cancel(cpu);
+
+	/* the sleep was cut short by us, it tells nothing */
+	if (history->htmr_fired) {
+		history->htmr_fired = false;
+		history->hinvalid = true;
+		stats->htmr_wakeups++;
+		return;
+	}
+	history->hinvalid = false;
+
+	stats->samples++;
+	if (resi_us < lpm_cpu->levels[idx].pwr.time_overhead_us) {
+		stats->too_deep++;
+	} else {
+		for (i = idx + 1; i < lpm_cpu->nlevels; i++) {
+			struct lpm_cpu_level *level = &lpm_cpu->levels[i];
+
+			if (!lpm_cpu_mode_allow(cpu, level->mode, true))
+				continue;
+			if (resi_us >= level->pwr.time_overhead_us)
+				stats->too_shallow++;
+			break;
+		}
+	}
+
+	history->resi[history->hptr] = min_t(uint32_t, resi_us,
+			USEC_PER_SEC);
+	history->hptr = (history->hptr + 1) % LPM_HIST_SAMPLES;
+	if (history->nsamp < LPM_HIST_SAMPLES)
+		history->nsamp++;
+}
+
+static int lpm_pred_stats_show(struct seq_file *m, void *v)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct lpm_pred_stats *stats = &per_cpu(lpm_pred_stats, cpu);
+
+		seq_printf(m, "cpu%d: samples=%llu predicted=%llu "
+				"too_shallow=%llu too_deep=%llu "
+				"timer_wakeups=%llu\n", cpu,
+				stats->samples, stats->predicted,
+				stats->too_shallow, stats->too_deep,
+				stats->htmr_wakeups);
+	}
+
+	return 0;
+}
+
+static int lpm_pred_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, lpm_pred_stats_show, NULL);
+}
+
+static const struct file_operations lpm_pred_stats_fops = {
+	.open		= lpm_pred_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 int set_l2_mode(struct low_power_ops *ops, int mode, bool notify_rpm)
 {
 	int lpm = mode;
@@ -261,6 +497,7 @@ static int cpu_power_select(struct cpuidle_device *dev,
 		(uint32_t)(ktime_to_us(tick_nohz_get_sleep_length()));
 	uint32_t modified_time_us = 0;
 	uint32_t next_event_us = 0;
+	uint32_t pred_us;
 	uint32_t pwr;
 	int i;
 	uint32_t lvl_latency_us = 0;
@@ -281,6 +518,10 @@ static int cpu_power_select(struct cpuidle_device *dev,
 	if (!dev->cpu)
 		next_event_us = (uint32_t)(ktime_to_us(get_next_event_time()));
 
+	pred_us = lpm_cpuidle_predict(dev->cpu);
+	if (pred_us >= sleep_us)
+		pred_us = 0;
+
 	for (i = 0; i < cpu->nlevels; i++) {
 		struct lpm_cpu_level *level = &cpu->levels[i];
 		struct power_params *pwr_params = &level->pwr;
@@ -311,6 +552,9 @@ static int cpu_power_select(struct cpuidle_device *dev,
 				next_wakeup_us = next_event_us - lvl_latency_us;
 		}
 
+		if (pred_us && pred_us < next_wakeup_us)
+			next_wakeup_us = pred_us;
+
 		if (next_wakeup_us <= pwr_params->time_overhead_us)
 			continue;
 
@@ -343,6 +587,9 @@ static int cpu_power_select(struct cpuidle_device *dev,
 	if (modified_time_us && !dev->cpu)
 		msm_pm_set_timer(modified_time_us);
 
+	if (pred_us && best_level >= 0)
+		lpm_cpuidle_pred_start(dev->cpu, cpu, best_level, pred_us);
+
 	return best_level;
 }
 
@@ -396,12 +643,20 @@ static int cluster_select(struct lpm_cluster *cluster, bool from_idle)
 	struct cpumask mask;
 	uint32_t latency_us = ~0U;
 	uint32_t sleep_us;
+	uint32_t pred_us;
 
 	if (!cluster)
 		return -EINVAL;
 
 	sleep_us = (uint32_t)get_cluster_sleep_time(cluster, NULL, from_idle);
 
+	/* a cpu expecting an early interrupt holds the cluster back */
+	if (from_idle) {
+		pred_us = lpm_cluster_predict(cluster);
+		if (pred_us && pred_us < sleep_us)
+			sleep_us = pred_us;
+	}
+
 	if (cpumask_and(&mask, cpu_online_mask, &cluster->child_cpus))
 		latency_us = pm_qos_request_for_cpumask(PM_QOS_CPU_DMA_LATENCY,
 							&mask);
@@ -686,6 +941,7 @@ static int lpm_cpuidle_enter(struct cpuidle_device *dev,
 	trace_cpu_idle_rcuidle(idx, dev->cpu);
 
 	if (need_resched()) {
+		lpm_cpuidle_pred_cancel(dev->cpu);
 		dev->last_residency = 0;
 		goto exit;
 	}
@@ -710,6 +966,7 @@ static int lpm_cpuidle_enter(struct cpuidle_device *dev,
 	time = ktime_to_ns(ktime_get()) - time;
 	do_div(time, 1000);
 	dev->last_residency = (int)time;
+	lpm_cpuidle_pred_update(dev->cpu, cluster->cpu, idx, (uint32_t)time);
 
 exit:
 	local_irq_enable();
@@ -957,6 +1214,7 @@ static int lpm_probe(struct platform_device *pdev)
 {
 	int ret;
 	int size;
+	int cpu;
 	struct kobject *module_kobj = NULL;
 
 	lpm_root_node = lpm_of_parse_cluster(pdev);
@@ -982,6 +1240,16 @@ static int lpm_probe(struct platform_device *pdev)
 	suspend_set_ops(&lpm_suspend_ops);
 	hrtimer_init(&lpm_hrtimer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
 
+	for_each_possible_cpu(cpu) {
+		struct lpm_history *history = &per_cpu(lpm_history, cpu);
+
+		hrtimer_init(&history->histtimer, CLOCK_MONOTONIC,
+				HRTIMER_MODE_REL);
+		history->histtimer.function = histtimer_fn;
+	}
+	debugfs_create_file("lpm_prediction", S_IRUGO, NULL, NULL,
+			&lpm_pred_stats_fops);
+
 	ret = remote_spin_lock_init(&scm_handoff_lock, SCM_HANDOFF_LOCK_ID);
 	if (ret) {
 		pr_err("%s: Failed initializing scm_handoff_lock (%d)\n",
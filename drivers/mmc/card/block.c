@@ -100,6 +100,12 @@ static int cprm_ake_retry_flag;
 #define PCKD_TRGR_LOWER_BOUND		5
 #define PCKD_TRGR_PRECISION_MULTIPLIER	100
 
+#define PACK_CTRL_WINDOW		32	/* write samples per decision */
+#define PACK_CTRL_GAIN_PCT		10	/* packing must beat single by */
+#define PACK_CTRL_RD_SLACK_PCT		50	/* tolerated read slowdown */
+#define PACK_CTRL_MIN_PACKED		2
+#define PACK_CTRL_STEP			4
+
 static DEFINE_MUTEX(block_mutex);
 
 /*
@@ -655,6 +661,7 @@ static int ioctl_do_sanitize(struct mmc_card *card)
 
         pr_debug("%s: %s - SANITIZE IN PROGRESS...\n",
                 mmc_hostname(card->host), __func__);
+        mmc_queue_count_cmd(card, MMC_QCMD_SANITIZE);
 
         err = mmc_switch(card, EXT_CSD_CMD_SET_NORMAL,
                                         EXT_CSD_SANITIZE_START, 1,
@@ -2232,6 +2239,10 @@ static int get_packed_trigger(int potential, struct mmc_card *card,
 	unsigned int trigger = curr_trigger;
 	unsigned int pckd_trgr_upper_bound = card->ext_csd.max_packed_writes;
 
+	/* the adaptive controller owns the trigger while it is enabled */
+	if (card->wr_pack_ctrl.enabled)
+		return trigger;
+
 	/* scale down the upper bound to 75% */
 	pckd_trgr_upper_bound = (pckd_trgr_upper_bound * 3) / 4;
 
@@ -2353,6 +2364,150 @@ static void mmc_blk_write_packing_control(struct mmc_queue *mq,
 		mq->wr_packing_enabled = true;
 }
 
+static inline unsigned int mmc_blk_pack_ctrl_ewma(unsigned int avg,
+						  unsigned int sample)
+{
+	if (!avg)
+		return sample;
+	return avg - (avg >> 3) + (sample >> 3);
+}
+
+/*
+ * Called with the controller lock held once per PACK_CTRL_WINDOW write
+ * completions.  Reads waiting behind packed writes take priority; after
+ * that, packing is made more eager when it measurably beats single writes
+ * on this card and less eager when it does not.
+ */
+static void mmc_blk_pack_ctrl_adjust(struct mmc_queue *mq,
+				     struct mmc_wr_pack_ctrl *ctrl)
+{
+	unsigned int max_packed = mq->card->ext_csd.max_packed_writes;
+	int upper = max_t(int, (max_packed * 3) / 4, PCKD_TRGR_LOWER_BOUND);
+	int trigger = mq->num_wr_reqs_to_start_packing;
+	enum mmc_pack_ctrl_decisions decision;
+
+	if (ctrl->rd_lat_us && ctrl->rd_lat_packed_us &&
+	    ctrl->rd_lat_packed_us * 100 >
+	    ctrl->rd_lat_us * (100 + PACK_CTRL_RD_SLACK_PCT)) {
+		ctrl->max_packed = max_t(unsigned int, ctrl->max_packed / 2,
+					 PACK_CTRL_MIN_PACKED);
+		trigger += PCKD_TRGR_URGENT_PENALTY;
+		/* has to be observed again before it limits packing further */
+		ctrl->rd_lat_packed_us = 0;
+		decision = PACK_CTRL_READ_PROTECT;
+	} else if (!ctrl->packed_kbps) {
+		/* no packed writes seen yet, give packing a chance */
+		trigger--;
+		decision = PACK_CTRL_MORE;
+	} else if (!ctrl->single_kbps) {
+		decision = PACK_CTRL_HOLD;
+	} else if (ctrl->packed_kbps * 100 >
+		   ctrl->single_kbps * (100 + PACK_CTRL_GAIN_PCT)) {
+		ctrl->max_packed = min_t(unsigned int,
+					 ctrl->max_packed + PACK_CTRL_STEP,
+					 max_packed);
+		trigger--;
+		decision = PACK_CTRL_MORE;
+	} else {
+		/* max_packed may already be below a step after READ_PROTECT */
+		if (ctrl->max_packed > PACK_CTRL_MIN_PACKED + PACK_CTRL_STEP)
+			ctrl->max_packed -= PACK_CTRL_STEP;
+		else
+			ctrl->max_packed = PACK_CTRL_MIN_PACKED;
+		trigger++;
+		decision = PACK_CTRL_LESS;
+	}
+
+	trigger = clamp_t(int, trigger, PCKD_TRGR_LOWER_BOUND, upper);
+	mq->num_wr_reqs_to_start_packing = trigger;
+	ctrl->trigger = trigger;
+	ctrl->last_decision = decision;
+	ctrl->decisions[decision]++;
+}
+
+/*
+ * Account a completed read or write to the adaptive packing controller.
+ * Relies on the service window recorded by mmc_queue_account_done().
+ */
+static void mmc_blk_pack_ctrl_sample(struct mmc_queue *mq,
+				     struct mmc_queue_req *mq_rq)
+{
+	struct mmc_blk_data *md = mq->data;
+	struct mmc_wr_pack_ctrl *ctrl = &mq->card->wr_pack_ctrl;
+	unsigned int bytes, kbps, lat_us;
+	s64 ns;
+
+	if (!(md->flags & MMC_BLK_PACKED_CMD) || !ctrl->enabled)
+		return;
+
+	if (rq_data_dir(mq_rq->req) == READ) {
+		lat_us = ktime_us_delta(mq_rq->done_time, mq_rq->issue_time);
+		spin_lock(&ctrl->lock);
+		if (mq_rq->behind_packed)
+			ctrl->rd_lat_packed_us = mmc_blk_pack_ctrl_ewma(
+					ctrl->rd_lat_packed_us, lat_us);
+		else
+			ctrl->rd_lat_us = mmc_blk_pack_ctrl_ewma(
+					ctrl->rd_lat_us, lat_us);
+		spin_unlock(&ctrl->lock);
+		return;
+	}
+
+	ns = ktime_to_ns(ktime_sub(mq_rq->done_time, mq_rq->service_start));
+	if (ns <= 0)
+		return;
+	if (mmc_packed_cmd(mq_rq->cmd_type))
+		bytes = mq_rq->packed->blocks << 9;
+	else
+		bytes = mq_rq->brq.data.bytes_xfered;
+	kbps = div64_u64((u64)bytes * NSEC_PER_SEC, ns) >> 10;
+
+	spin_lock(&ctrl->lock);
+	if (mmc_packed_cmd(mq_rq->cmd_type))
+		ctrl->packed_kbps = mmc_blk_pack_ctrl_ewma(ctrl->packed_kbps,
+							   kbps);
+	else
+		ctrl->single_kbps = mmc_blk_pack_ctrl_ewma(ctrl->single_kbps,
+							   kbps);
+	if (++ctrl->samples >= PACK_CTRL_WINDOW) {
+		mmc_blk_pack_ctrl_adjust(mq, ctrl);
+		ctrl->samples = 0;
+	}
+	spin_unlock(&ctrl->lock);
+}
+
+/*
+ * (Re)arm the adaptive packing controller.  What it learned is dropped;
+ * the packing trigger is left as it is on the queue, so a value set via
+ * sysfs survives and the controller starts over from it.  The block device
+ * is not registered yet at probe time, the caller seeds the trigger then.
+ */
+void mmc_blk_init_pack_ctrl(struct mmc_card *card)
+{
+	struct mmc_blk_data *md;
+	struct mmc_wr_pack_ctrl *ctrl;
+
+	if (!card)
+		return;
+
+	md = mmc_get_drvdata(card);
+	ctrl = &card->wr_pack_ctrl;
+	spin_lock(&ctrl->lock);
+	if (md)
+		ctrl->trigger = md->queue.num_wr_reqs_to_start_packing;
+	ctrl->max_packed = card->ext_csd.max_packed_writes;
+	ctrl->packed_kbps = 0;
+	ctrl->single_kbps = 0;
+	ctrl->rd_lat_us = 0;
+	ctrl->rd_lat_packed_us = 0;
+	ctrl->samples = 0;
+	ctrl->last_decision = PACK_CTRL_HOLD;
+	memset(ctrl->decisions, 0, sizeof(ctrl->decisions));
+	ctrl->enabled = true;
+	spin_unlock(&ctrl->lock);
+}
+EXPORT_SYMBOL(mmc_blk_init_pack_ctrl);
+
 struct mmc_wr_pack_stats *mmc_blk_get_packed_statistics(struct mmc_card *card)
 {
 	if (!card)
@@ -2407,6 +2562,10 @@ static u8 mmc_blk_prep_packed_list(struct mmc_queue *mq, struct request *req)
 	    mmc_host_packed_wr(card->host))
 		max_packed_rw = card->ext_csd.max_packed_writes;
 
+	if (card->wr_pack_ctrl.enabled &&
+	    card->wr_pack_ctrl.max_packed < max_packed_rw)
+		max_packed_rw = card->wr_pack_ctrl.max_packed;
+
 	if (max_packed_rw == 0)
 		goto no_packed;
 
@@ -2781,11 +2940,20 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *rqc)
 				goto cmd_abort;
 			}
 
-			if (reqs >= packed_nr)
+			if (reqs >= packed_nr) {
 				mmc_blk_packed_hdr_wrq_prep(mq->mqrq_cur,
 							    card, mq);
-			else
+				mmc_queue_count_cmd(card, MMC_QCMD_PACKED);
+			} else {
 				mmc_blk_rw_rq_prep(mq->mqrq_cur, card, 0, mq);
+				mmc_queue_count_cmd(card,
+						    rq_data_dir(rqc) == READ ?
+						    MMC_QCMD_READ :
+						    MMC_QCMD_WRITE);
+			}
+			mq->mqrq_cur->issue_time = ktime_get();
+			mq->mqrq_cur->behind_packed = mq->mqrq_prev->req &&
+				mmc_packed_cmd(mq->mqrq_prev->cmd_type);
 			areq = &mq->mqrq_cur->mmc_active;
 		} else
 			areq = NULL;
@@ -2804,6 +2972,10 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *rqc)
 
 		switch (status) {
 		case MMC_BLK_URGENT:
+			trace_mmc_blk_urgent_preempt(req->rq_disk->disk_name,
+					blk_rq_pos(req), blk_rq_sectors(req),
+					mmc_packed_cmd(mq_rq->cmd_type));
+			mmc_queue_count_urgent(card, true);
 			if (mq_rq->cmd_type != MMC_PACKED_NONE) {
 				/* complete successfully transmitted part */
 				if (mmc_blk_end_packed_req(mq_rq))
@@ -2823,6 +2995,8 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *rqc)
 			 * A block was successfully transferred.
 			 */
 			mmc_blk_reset_success(md, type);
+			mmc_queue_account_done(mq, mq_rq);
+			mmc_blk_pack_ctrl_sample(mq, mq_rq);
 
 			if (mmc_packed_cmd(mq_rq->cmd_type)) {
 				ret = mmc_blk_end_packed_req(mq_rq);
@@ -3008,14 +3182,18 @@ static int mmc_blk_issue_rq(struct mmc_queue *mq, struct request *req)
 		if (card->host->areq)
 			mmc_blk_issue_rw_rq(mq, NULL);
 		if (cmd_flags & REQ_SECURE &&
-			!(card->quirks & MMC_QUIRK_SEC_ERASE_TRIM_BROKEN))
+			!(card->quirks & MMC_QUIRK_SEC_ERASE_TRIM_BROKEN)) {
+			mmc_queue_count_cmd(card, MMC_QCMD_SECDISCARD);
 			ret = mmc_blk_issue_secdiscard_rq(mq, req);
-		else
+		} else {
+			mmc_queue_count_cmd(card, MMC_QCMD_DISCARD);
 			ret = mmc_blk_issue_discard_rq(mq, req);
+		}
 	} else if (cmd_flags & REQ_FLUSH) {
 		/* complete ongoing async transfer before issuing flush */
 		if (card->host->areq)
 			mmc_blk_issue_rw_rq(mq, NULL);
+		mmc_queue_count_cmd(card, MMC_QCMD_FLUSH);
 		ret = mmc_blk_issue_flush(mq, req);
 	} else {
 		if (!req && host->areq) {
@@ -3175,8 +3353,14 @@ static struct mmc_blk_data *mmc_blk_alloc_req(struct mmc_card *card,
 	    (area_type == MMC_BLK_DATA_AREA_MAIN) &&
 	    (md->flags & MMC_BLK_CMD23) &&
 	    card->ext_csd.packed_event_en) {
-		if (!mmc_packed_init(&md->queue, card))
+		if (!mmc_packed_init(&md->queue, card)) {
 			md->flags |= MMC_BLK_PACKED_CMD;
+			if (card->host->caps2 & MMC_CAP2_PACKED_WR_CONTROL) {
+				mmc_blk_init_pack_ctrl(card);
+				card->wr_pack_ctrl.trigger =
+				    md->queue.num_wr_reqs_to_start_packing;
+			}
+		}
 	}
 
 	return md;
@@ -19,6 +19,7 @@
 
 #include <linux/mmc/card.h>
 #include <linux/mmc/host.h>
+#include <trace/events/mmc.h>
 #include "queue.h"
 
 #define MMC_QUEUE_BOUNCESZ	65536
@@ -73,6 +74,11 @@ static int mmc_queue_thread(void *d)
 		set_current_state(TASK_INTERRUPTIBLE);
 		req = blk_fetch_request(q);
 		mq->mqrq_cur->req = req;
+		if (req) {
+			mq->mqrq_cur->fetch_time = ktime_get();
+			mq->mqrq_cur->notify_time = mq->notify_time;
+			mq->notify_time = ktime_set(0, 0);
+		}
 		spin_unlock_irq(q->queue_lock);
 
 		if (req || mq->mqrq_prev->req) {
@@ -151,12 +157,17 @@ static void mmc_request_fn(struct request_queue *q)
 		 */
 		spin_lock_irqsave(&cntx->lock, flags);
 		if (cntx->is_waiting_last_req) {
+			if (!mq->notify_time.tv64)
+				mq->notify_time = ktime_get();
 			cntx->is_new_req = true;
 			wake_up_interruptible(&cntx->wait);
 		}
 		spin_unlock_irqrestore(&cntx->lock, flags);
-	} else if (!mq->mqrq_cur->req && !mq->mqrq_prev->req)
+	} else if (!mq->mqrq_cur->req && !mq->mqrq_prev->req) {
+		if (!mq->notify_time.tv64)
+			mq->notify_time = ktime_get();
 		wake_up_process(mq->thread);
+	}
 }
 
 /*
@@ -193,13 +204,108 @@ static void mmc_urgent_request(struct request_queue *q)
 		mmc_blk_disable_wr_packing(mq);
 		cntx->is_urgent = true;
 		spin_unlock_irqrestore(&cntx->lock, flags);
+		trace_mmc_blk_urgent_notify(mmc_hostname(mq->card->host), 1);
+		mmc_queue_count_urgent(mq->card, false);
 		wake_up_interruptible(&cntx->wait);
 	} else {
 		spin_unlock_irqrestore(&cntx->lock, flags);
+		trace_mmc_blk_urgent_notify(mmc_hostname(mq->card->host), 0);
 		mmc_request_fn(q);
 	}
 }
 
+static void mmc_queue_lat_add(struct mmc_queue_stats *stats,
+			      enum mmc_queue_stages stage, s64 us)
+{
+	u32 val = clamp_t(s64, us, 0, U32_MAX);
+	int bucket = min_t(int, fls(val), MMC_QUEUE_LAT_BUCKETS - 1);
+
+	stats->lat[stage][bucket]++;
+	stats->lat_sum_us[stage] += val;
+	stats->lat_cnt[stage]++;
+	if (val > stats->lat_max_us[stage])
+		stats->lat_max_us[stage] = val;
+}
+
+/**
+ * mmc_queue_account_done() - account a completed read/write request
+ * @mq: queue the request was served on
+ * @mqrq: the completed request
+ *
+ * Splits the life of the request into the time it waited for the queue
+ * thread, the time spent preparing it and the time the card was busy with
+ * it.  Requests are pipelined, so the card only starts on a request once
+ * the previous one completed.  Must be called once per completion, before
+ * the request is ended towards the block layer.
+ */
+void mmc_queue_account_done(struct mmc_queue *mq, struct mmc_queue_req *mqrq)
+{
+	struct mmc_queue_stats *stats = &mq->card->queue_stats;
+	struct request *req = mqrq->req;
+	bool notified = mqrq->notify_time.tv64 != 0;
+	s64 wakeup_us = 0, prep_us, card_us;
+	unsigned long flags;
+
+	mqrq->done_time = ktime_get();
+	mqrq->service_start = ktime_compare(mqrq->issue_time,
+					    mq->last_done) > 0 ?
+			      mqrq->issue_time : mq->last_done;
+	mq->last_done = mqrq->done_time;
+
+	if (notified)
+		wakeup_us = ktime_us_delta(mqrq->fetch_time, mqrq->notify_time);
+	prep_us = ktime_us_delta(mqrq->issue_time, mqrq->fetch_time);
+	card_us = ktime_us_delta(mqrq->done_time, mqrq->service_start);
+
+	trace_mmc_blk_rq_latency(req->rq_disk->disk_name, blk_rq_pos(req),
+				 blk_rq_sectors(req),
+				 rq_data_dir(req) == WRITE,
+				 mmc_packed_cmd(mqrq->cmd_type),
+				 wakeup_us, prep_us, card_us);
+
+	if (!stats->enabled)
+		return;
+
+	spin_lock_irqsave(&stats->lock, flags);
+	if (notified)
+		mmc_queue_lat_add(stats, MMC_QSTAGE_WAKEUP, wakeup_us);
+	mmc_queue_lat_add(stats, MMC_QSTAGE_PREP, prep_us);
+	mmc_queue_lat_add(stats, MMC_QSTAGE_CARD, card_us);
+	mmc_queue_lat_add(stats, MMC_QSTAGE_TOTAL,
+			  ktime_us_delta(mqrq->done_time, notified ?
+					 mqrq->notify_time : mqrq->fetch_time));
+	spin_unlock_irqrestore(&stats->lock, flags);
+}
+
+void mmc_queue_count_cmd(struct mmc_card *card, enum mmc_queue_cmds cmd)
+{
+	struct mmc_queue_stats *stats = &card->queue_stats;
+	unsigned long flags;
+
+	if (!stats->enabled)
+		return;
+
+	spin_lock_irqsave(&stats->lock, flags);
+	stats->cmds[cmd]++;
+	spin_unlock_irqrestore(&stats->lock, flags);
+}
+
+void mmc_queue_count_urgent(struct mmc_card *card, bool preempted)
+{
+	struct mmc_queue_stats *stats = &card->queue_stats;
+	unsigned long flags;
+
+	if (!stats->enabled)
+		return;
+
+	spin_lock_irqsave(&stats->lock, flags);
+	if (preempted)
+		stats->urgent_preempt++;
+	else
+		stats->urgent_notify++;
+	spin_unlock_irqrestore(&stats->lock, flags);
+}
+
 static struct scatterlist *mmc_alloc_sg(int sg_len, int *err)
 {
 	struct scatterlist *sg;
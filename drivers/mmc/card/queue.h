@@ -41,6 +41,12 @@ struct mmc_queue_req {
 	struct mmc_async_req	mmc_active;
 	enum mmc_packed_type	cmd_type;
 	struct mmc_packed	*packed;
+	ktime_t			notify_time;	/* request_fn kicked the thread */
+	ktime_t			fetch_time;
+	ktime_t			issue_time;
+	ktime_t			service_start;	/* card started on it */
+	ktime_t			done_time;
+	bool			behind_packed;
 };
 
 struct mmc_queue {
@@ -62,6 +68,8 @@ struct mmc_queue {
 	int			num_of_potential_packed_wr_reqs;
 	int			num_wr_reqs_to_start_packing;
 	bool			no_pack_for_random;
+	ktime_t			last_done;
+	ktime_t			notify_time;
 	int (*err_check_fn) (struct mmc_card *, struct mmc_async_req *);
 	void (*packed_test_fn) (struct request_queue *, struct mmc_queue_req *);
 };
@@ -84,4 +92,8 @@ extern void print_mmc_packing_stats(struct mmc_card *card);
 
 extern int mmc_access_rpmb(struct mmc_queue *);
 
+extern void mmc_queue_account_done(struct mmc_queue *, struct mmc_queue_req *);
+extern void mmc_queue_count_cmd(struct mmc_card *, enum mmc_queue_cmds);
+extern void mmc_queue_count_urgent(struct mmc_card *, bool);
+
 #endif
@@ -338,6 +338,8 @@ struct mmc_card *mmc_alloc_card(struct mmc_host *host, struct device_type *type)
 
 	spin_lock_init(&card->bkops_info.bkops_stats.lock);
 	spin_lock_init(&card->wr_pack_stats.lock);
+	spin_lock_init(&card->wr_pack_ctrl.lock);
+	spin_lock_init(&card->queue_stats.lock);
 
 	return card;
 }
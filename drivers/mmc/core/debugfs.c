@@ -573,6 +573,164 @@ static const struct file_operations mmc_dbg_wr_pack_stats_fops = {
 	.write		= mmc_wr_pack_stats_write,
 };
 
+static int mmc_wr_pack_ctrl_show(struct seq_file *s, void *data)
+{
+	static const char * const decision_str[PACK_CTRL_MAX_DECISIONS] = {
+		[PACK_CTRL_HOLD]		= "hold",
+		[PACK_CTRL_MORE]		= "more",
+		[PACK_CTRL_LESS]		= "less",
+		[PACK_CTRL_READ_PROTECT]	= "read protect",
+	};
+	struct mmc_card *card = s->private;
+	struct mmc_wr_pack_ctrl *ctrl = &card->wr_pack_ctrl;
+	int i;
+
+	spin_lock(&ctrl->lock);
+	seq_printf(s, "enabled:\t\t%d\n", ctrl->enabled);
+	seq_printf(s, "trigger:\t\t%u\n", ctrl->trigger);
+	seq_printf(s, "max packed:\t\t%u\n", ctrl->max_packed);
+	seq_printf(s, "packed throughput:\t%u KB/s\n", ctrl->packed_kbps);
+	seq_printf(s, "single throughput:\t%u KB/s\n", ctrl->single_kbps);
+	seq_printf(s, "read latency:\t\t%u us\n", ctrl->rd_lat_us);
+	seq_printf(s, "read latency (packed):\t%u us\n",
+		   ctrl->rd_lat_packed_us);
+	seq_printf(s, "last decision:\t\t%s\n",
+		   decision_str[ctrl->last_decision]);
+	for (i = 0; i < PACK_CTRL_MAX_DECISIONS; i++)
+		seq_printf(s, "decision %s:\t%u\n", decision_str[i],
+			   ctrl->decisions[i]);
+	spin_unlock(&ctrl->lock);
+
+	return 0;
+}
+
+static int mmc_wr_pack_ctrl_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, mmc_wr_pack_ctrl_show, inode->i_private);
+}
+
+static ssize_t mmc_wr_pack_ctrl_write(struct file *filp,
+				      const char __user *ubuf, size_t cnt,
+				      loff_t *ppos)
+{
+	struct mmc_card *card = ((struct seq_file *)filp->private_data)->private;
+	int value;
+	int ret;
+
+	ret = kstrtoint_from_user(ubuf, cnt, 0, &value);
+	if (ret)
+		return ret;
+
+	if (value) {
+		mmc_blk_init_pack_ctrl(card);
+	} else {
+		spin_lock(&card->wr_pack_ctrl.lock);
+		card->wr_pack_ctrl.enabled = false;
+		spin_unlock(&card->wr_pack_ctrl.lock);
+	}
+
+	return cnt;
+}
+
+static const struct file_operations mmc_dbg_wr_pack_ctrl_fops = {
+	.open		= mmc_wr_pack_ctrl_open,
+	.read		= seq_read,
+	.write		= mmc_wr_pack_ctrl_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int mmc_queue_stats_show(struct seq_file *s, void *data)
+{
+	static const char * const stage_str[MMC_QSTAGE_MAX] = {
+		[MMC_QSTAGE_WAKEUP]	= "wakeup",
+		[MMC_QSTAGE_PREP]	= "prep",
+		[MMC_QSTAGE_CARD]	= "card",
+		[MMC_QSTAGE_TOTAL]	= "total",
+	};
+	static const char * const cmd_str[MMC_QCMD_MAX] = {
+		[MMC_QCMD_READ]		= "read",
+		[MMC_QCMD_WRITE]	= "write",
+		[MMC_QCMD_PACKED]	= "packed",
+		[MMC_QCMD_DISCARD]	= "discard",
+		[MMC_QCMD_SECDISCARD]	= "secure discard",
+		[MMC_QCMD_FLUSH]	= "flush",
+		[MMC_QCMD_SANITIZE]	= "sanitize",
+	};
+	struct mmc_card *card = s->private;
+	struct mmc_queue_stats *stats = &card->queue_stats;
+	int i, j;
+
+	spin_lock_irq(&stats->lock);
+	seq_printf(s, "enabled: %d\n", stats->enabled);
+	for (i = 0; i < MMC_QCMD_MAX; i++)
+		seq_printf(s, "%s: %u\n", cmd_str[i], stats->cmds[i]);
+	seq_printf(s, "urgent notifications: %u\n", stats->urgent_notify);
+	seq_printf(s, "urgent preemptions: %u\n", stats->urgent_preempt);
+
+	seq_puts(s, "\nlatency (usecs)\n");
+	for (i = 0; i < MMC_QSTAGE_MAX; i++) {
+		seq_printf(s, "%s: count %u avg %llu max %u\n", stage_str[i],
+			   stats->lat_cnt[i], stats->lat_cnt[i] ?
+			   div_u64(stats->lat_sum_us[i], stats->lat_cnt[i]) : 0,
+			   stats->lat_max_us[i]);
+		for (j = 0; j < MMC_QUEUE_LAT_BUCKETS; j++) {
+			if (!stats->lat[i][j])
+				continue;
+			if (j == MMC_QUEUE_LAT_BUCKETS - 1)
+				seq_printf(s, "\t>= %u: %u\n", 1U << (j - 1),
+					   stats->lat[i][j]);
+			else
+				seq_printf(s, "\t< %u: %u\n", 1U << j,
+					   stats->lat[i][j]);
+		}
+	}
+	spin_unlock_irq(&stats->lock);
+
+	return 0;
+}
+
+static int mmc_queue_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, mmc_queue_stats_show, inode->i_private);
+}
+
+static ssize_t mmc_queue_stats_write(struct file *filp,
+				     const char __user *ubuf, size_t cnt,
+				     loff_t *ppos)
+{
+	struct mmc_card *card = ((struct seq_file *)filp->private_data)->private;
+	struct mmc_queue_stats *stats = &card->queue_stats;
+	int value;
+	int ret;
+
+	ret = kstrtoint_from_user(ubuf, cnt, 0, &value);
+	if (ret)
+		return ret;
+
+	/* any write resets the statistics, non-zero (re)enables them */
+	spin_lock_irq(&stats->lock);
+	memset(stats->lat, 0, sizeof(stats->lat));
+	memset(stats->lat_sum_us, 0, sizeof(stats->lat_sum_us));
+	memset(stats->lat_max_us, 0, sizeof(stats->lat_max_us));
+	memset(stats->lat_cnt, 0, sizeof(stats->lat_cnt));
+	memset(stats->cmds, 0, sizeof(stats->cmds));
+	stats->urgent_notify = 0;
+	stats->urgent_preempt = 0;
+	stats->enabled = !!value;
+	spin_unlock_irq(&stats->lock);
+
+	return cnt;
+}
+
+static const struct file_operations mmc_dbg_queue_stats_fops = {
+	.open		= mmc_queue_stats_open,
+	.read		= seq_read,
+	.write		= mmc_queue_stats_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 static int mmc_bkops_stats_open(struct inode *inode, struct file *filp)
 {
 	struct mmc_card *card = inode->i_private;
@@ -724,6 +882,18 @@ void mmc_add_card_debugfs(struct mmc_card *card)
 					 &mmc_dbg_wr_pack_stats_fops))
 			goto err;
 
+	if (mmc_card_mmc(card) && (card->ext_csd.rev >= 6) &&
+	    (card->host->caps2 & MMC_CAP2_PACKED_WR) &&
+	    (card->host->caps2 & MMC_CAP2_PACKED_WR_CONTROL))
+		if (!debugfs_create_file("wr_pack_ctrl", S_IRUSR | S_IWUSR,
+					 root, card, &mmc_dbg_wr_pack_ctrl_fops))
+			goto err;
+
+	if (mmc_card_mmc(card) || mmc_card_sd(card))
+		if (!debugfs_create_file("queue_stats", S_IRUSR | S_IWUSR,
+					 root, card, &mmc_dbg_queue_stats_fops))
+			goto err;
+
 	if (mmc_card_mmc(card) && (card->ext_csd.rev >= 5) &&
 	    card->ext_csd.bkops_en)
 		if (!debugfs_create_file("bkops_stats", S_IRUSR, root, card,
@@ -0,0 +1,812 @@
+/*
+ *  linux/drivers/mmc/host/mmc_sim.c - RAM backed eMMC emulating host
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * The host does not drive any hardware.  It answers the command set of an
+ * eMMC 4.5 device (CMD23, packed writes, HPI, trim/discard) from a buffer
+ * in RAM and delays each completion according to a simple latency plus
+ * bandwidth model.  This allows the card, queue and block layers to be
+ * exercised and measured on any machine, including the async request
+ * pipeline, packed commands and the urgent request (stop/HPI) path.
+ *
+ * Commands are executed from an ordered workqueue under a mutex, since
+ * copying a request can take a while; the spinlock only covers the
+ * request in flight and its timer.  A request completes when the timing
+ * model says it would have, counted from when it was issued.
+ *
+ * Module parameters set the card size and the initial timing model; the
+ * timing can be changed at runtime through <debugfs>/mmcN/sim/.
+ */
+
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/platform_device.h>
+#include <linux/debugfs.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/spinlock.h>
+#include <linux/mutex.h>
+#include <linux/workqueue.h>
+#include <linux/vmalloc.h>
+#include <linux/scatterlist.h>
+#include <linux/seq_file.h>
+#include <linux/mmc/host.h>
+#include <linux/mmc/card.h>
+#include <linux/mmc/mmc.h>
+#include <linux/mmc/sd.h>
+#include <linux/mmc/sdio.h>
+
+#define DRIVER_NAME		"mmc_sim"
+
+#define SIM_SECTOR_SHIFT	9
+#define SIM_MAX_REQ_SIZE	(512 * 1024)
+#define SIM_MAX_PACKED		63
+
+static unsigned int size_mb = 64;
+module_param(size_mb, uint, S_IRUGO);
+MODULE_PARM_DESC(size_mb, "Capacity of the emulated card in MiB");
+
+static unsigned int cmd_latency_us = 20;
+module_param(cmd_latency_us, uint, S_IRUGO);
+MODULE_PARM_DESC(cmd_latency_us, "Latency of a command without data (us)");
+
+static unsigned int read_latency_us = 100;
+module_param(read_latency_us, uint, S_IRUGO);
+MODULE_PARM_DESC(read_latency_us, "Access latency of a read (us)");
+
+static unsigned int write_latency_us = 250;
+module_param(write_latency_us, uint, S_IRUGO);
+MODULE_PARM_DESC(write_latency_us, "Programming latency of a write (us)");
+
+static unsigned int erase_latency_us = 1000;
+module_param(erase_latency_us, uint, S_IRUGO);
+MODULE_PARM_DESC(erase_latency_us, "Latency of an erase/trim/discard (us)");
+
+static unsigned int read_kbps = 80000;
+module_param(read_kbps, uint, S_IRUGO);
+MODULE_PARM_DESC(read_kbps, "Read bandwidth in KiB/s, 0 for unlimited");
+
+static unsigned int write_kbps = 30000;
+module_param(write_kbps, uint, S_IRUGO);
+MODULE_PARM_DESC(write_kbps, "Write bandwidth in KiB/s, 0 for unlimited");
+
+struct mmc_sim_stats {
+	u64	cmds;
+	u64	reads;
+	u64	writes;
+	u64	packed_writes;
+	u64	erases;
+	u64	flushes;
+	u64	stopped;
+	u64	read_bytes;
+	u64	write_bytes;
+};
+
+struct mmc_sim_host {
+	struct mmc_host		*mmc;
+
+	/* request in flight, executed by @work and completed from @timer */
+	spinlock_t		lock;
+	struct mmc_request	*mrq;
+	struct hrtimer		timer;
+	ktime_t			start;
+	u64			delay_ns;
+	struct workqueue_struct	*wq;
+	struct work_struct	work;
+
+	/* serializes command execution, protects everything below */
+	struct mutex		mutex;
+	unsigned int		xfer_blocks;
+
+	/* card state */
+	u8			*storage;
+	sector_t		sectors;
+	u8			*bounce;
+	u32			cid[4];
+	u32			csd[4];
+	u8			ext_csd[512];
+	unsigned int		state;
+	u16			rca;
+	u32			status_err;
+	bool			packed;
+	u32			erase_start;
+	u32			erase_end;
+
+	/* timing model, tunable through debugfs */
+	u32			cmd_latency_us;
+	u32			read_latency_us;
+	u32			write_latency_us;
+	u32			erase_latency_us;
+	u32			read_kbps;
+	u32			write_kbps;
+
+	struct mmc_sim_stats	stats;
+	struct dentry		*debugfs;
+};
+
+/* Inverse of UNSTUFF_BITS() used by the core to decode CID/CSD */
+static void mmc_sim_stuff_bits(u32 *resp, int start, int size, u32 val)
+{
+	int off = 3 - (start / 32);
+	int shft = start & 31;
+
+	resp[off] |= val << shft;
+	if (size + shft > 32)
+		resp[off - 1] |= val >> (32 - shft);
+}
+
+static void mmc_sim_init_regs(struct mmc_sim_host *sim)
+{
+	u32 *cid = sim->cid, *csd = sim->csd;
+	u8 *ext_csd = sim->ext_csd;
+	const char *name = "MMCSIM";
+	int i;
+
+	memset(cid, 0, sizeof(sim->cid));
+	mmc_sim_stuff_bits(cid, 120, 8, 0xfe);		/* MID */
+	mmc_sim_stuff_bits(cid, 104, 16, 0x5349);	/* OID */
+	for (i = 0; i < 6; i++)				/* PNM */
+		mmc_sim_stuff_bits(cid, 96 - i * 8, 8, name[i]);
+	mmc_sim_stuff_bits(cid, 48, 8, 0x10);		/* PRV */
+	mmc_sim_stuff_bits(cid, 16, 32, 0x12345678);	/* PSN */
+	mmc_sim_stuff_bits(cid, 12, 4, 1);		/* MDT month */
+	mmc_sim_stuff_bits(cid, 8, 4, 0);		/* MDT year */
+
+	memset(csd, 0, sizeof(sim->csd));
+	mmc_sim_stuff_bits(csd, 126, 2, 3);	/* version in EXT_CSD */
+	mmc_sim_stuff_bits(csd, 122, 4, 4);	/* SPEC_VERS 4.x */
+	mmc_sim_stuff_bits(csd, 112, 7, 0x27);	/* TAAC 1.5ms */
+	mmc_sim_stuff_bits(csd, 96, 7, 0x32);	/* TRAN_SPEED 26MHz */
+	mmc_sim_stuff_bits(csd, 84, 12, 0x8f5);	/* CCC */
+	mmc_sim_stuff_bits(csd, 80, 4, 9);	/* READ_BL_LEN 512 */
+	mmc_sim_stuff_bits(csd, 62, 12, 0xfff);	/* C_SIZE: use SEC_COUNT */
+	mmc_sim_stuff_bits(csd, 47, 3, 7);	/* C_SIZE_MULT */
+	mmc_sim_stuff_bits(csd, 42, 5, 31);	/* ERASE_GRP_SIZE */
+	mmc_sim_stuff_bits(csd, 37, 5, 31);	/* ERASE_GRP_MULT */
+	mmc_sim_stuff_bits(csd, 26, 3, 2);	/* R2W_FACTOR */
+	mmc_sim_stuff_bits(csd, 22, 4, 9);	/* WRITE_BL_LEN 512 */
+
+	memset(ext_csd, 0, sizeof(sim->ext_csd));
+	ext_csd[EXT_CSD_REV] = 6;		/* eMMC 4.5 */
+	ext_csd[EXT_CSD_STRUCTURE] = 2;
+	ext_csd[EXT_CSD_CARD_TYPE] = EXT_CSD_CARD_TYPE_26 |
+				     EXT_CSD_CARD_TYPE_52;
+	ext_csd[EXT_CSD_SEC_CNT + 0] = sim->sectors >> 0;
+	ext_csd[EXT_CSD_SEC_CNT + 1] = sim->sectors >> 8;
+	ext_csd[EXT_CSD_SEC_CNT + 2] = sim->sectors >> 16;
+	ext_csd[EXT_CSD_SEC_CNT + 3] = sim->sectors >> 24;
+	ext_csd[EXT_CSD_S_A_TIMEOUT] = 0x11;
+	ext_csd[EXT_CSD_PART_SWITCH_TIME] = 1;
+	ext_csd[EXT_CSD_OUT_OF_INTERRUPT_TIME] = 10;
+	ext_csd[EXT_CSD_HC_WP_GRP_SIZE] = 1;
+	ext_csd[EXT_CSD_REL_WR_SEC_C] = 1;
+	ext_csd[EXT_CSD_WR_REL_PARAM] = EXT_CSD_WR_REL_PARAM_EN;
+	ext_csd[EXT_CSD_ERASE_TIMEOUT_MULT] = 1;
+	ext_csd[EXT_CSD_HC_ERASE_GRP_SIZE] = 1;	/* 512KiB */
+	ext_csd[EXT_CSD_SEC_FEATURE_SUPPORT] = EXT_CSD_SEC_GB_CL_EN;
+	ext_csd[EXT_CSD_TRIM_MULT] = 1;
+	ext_csd[EXT_CSD_POWER_OFF_LONG_TIME] = 10;
+	ext_csd[EXT_CSD_GENERIC_CMD6_TIME] = 1;
+	ext_csd[EXT_CSD_MAX_PACKED_WRITES] = SIM_MAX_PACKED;
+	ext_csd[EXT_CSD_MAX_PACKED_READS] = SIM_MAX_PACKED;
+	ext_csd[EXT_CSD_HPI_FEATURES] = 0x1;	/* HPI through CMD13 */
+}
+
+static inline u32 mmc_sim_r1(struct mmc_sim_host *sim)
+{
+	u32 status = sim->status_err | (sim->state << 9);
+
+	if (sim->state == R1_STATE_TRAN)
+		status |= R1_READY_FOR_DATA;
+	sim->status_err = 0;
+	return status;
+}
+
+static u64 mmc_sim_xfer_ns(u32 latency_us, u32 kbps, u64 bytes)
+{
+	u64 ns = (u64)latency_us * NSEC_PER_USEC;
+
+	if (kbps)
+		ns += div_u64(bytes * NSEC_PER_SEC, (u64)kbps * 1024);
+	return ns;
+}
+
+static bool mmc_sim_range_ok(struct mmc_sim_host *sim, u32 addr, u32 blocks)
+{
+	return addr < sim->sectors && blocks <= sim->sectors - addr;
+}
+
+static void mmc_sim_switch(struct mmc_sim_host *sim, u32 arg)
+{
+	unsigned int mode = (arg >> 24) & 0x3;
+	unsigned int index = (arg >> 16) & 0xff;
+	u8 value = (arg >> 8) & 0xff;
+
+	/* everything from EXT_CSD_REV on is read only */
+	if (mode == 0 || index >= EXT_CSD_REV) {
+		sim->status_err |= R1_SWITCH_ERROR;
+		return;
+	}
+
+	switch (index) {
+	case EXT_CSD_FLUSH_CACHE:
+		sim->stats.flushes++;
+		return;
+	case EXT_CSD_BKOPS_START:
+	case EXT_CSD_SANITIZE_START:
+		return;
+	}
+
+	if (mode == MMC_SWITCH_MODE_SET_BITS)
+		sim->ext_csd[index] |= value;
+	else if (mode == MMC_SWITCH_MODE_CLEAR_BITS)
+		sim->ext_csd[index] &= ~value;
+	else
+		sim->ext_csd[index] = value;
+}
+
+static void mmc_sim_erase(struct mmc_sim_host *sim, struct mmc_command *cmd)
+{
+	u32 start = sim->erase_start, end = sim->erase_end;
+
+	if (end < start || !mmc_sim_range_ok(sim, start, end - start + 1)) {
+		cmd->error = -EIO;
+		cmd->resp[0] |= R1_ERASE_PARAM;
+		return;
+	}
+
+	/* ERASED_MEM_CONT is 0: erased, trimmed and discarded data reads 0 */
+	memset(sim->storage + ((size_t)start << SIM_SECTOR_SHIFT), 0,
+	       (size_t)(end - start + 1) << SIM_SECTOR_SHIFT);
+	sim->stats.erases++;
+}
+
+static int mmc_sim_packed_write(struct mmc_sim_host *sim, unsigned int len)
+{
+	u32 *hdr = (u32 *)sim->bounce;
+	unsigned int nr = (hdr[0] >> 16) & 0xff;
+	unsigned int off = 1 << SIM_SECTOR_SHIFT;
+	unsigned int i;
+
+	if ((hdr[0] & 0xffff) != 0x0201 || !nr || nr > SIM_MAX_PACKED)
+		return -EIO;
+
+	for (i = 1; i <= nr; i++) {
+		u32 blocks = hdr[i * 2] & 0xffff;
+		u32 addr = hdr[i * 2 + 1];
+		unsigned int bytes = blocks << SIM_SECTOR_SHIFT;
+
+		if (off + bytes > len || !mmc_sim_range_ok(sim, addr, blocks))
+			return -EIO;
+		memcpy(sim->storage + ((size_t)addr << SIM_SECTOR_SHIFT),
+		       sim->bounce + off, bytes);
+		off += bytes;
+	}
+	sim->stats.packed_writes++;
+	return 0;
+}
+
+static u64 mmc_sim_data(struct mmc_sim_host *sim, struct mmc_command *cmd,
+			struct mmc_data *data)
+{
+	unsigned int len = data->blocks * data->blksz;
+	u32 addr = cmd->arg;
+	u8 *ptr;
+
+	if (cmd->opcode == MMC_SEND_EXT_CSD) {
+		sg_copy_from_buffer(data->sg, data->sg_len, sim->ext_csd,
+				    min_t(unsigned int, len,
+					  sizeof(sim->ext_csd)));
+		data->bytes_xfered = len;
+		return mmc_sim_xfer_ns(sim->cmd_latency_us, sim->read_kbps,
+				       len);
+	}
+
+	if (data->blksz != (1 << SIM_SECTOR_SHIFT) ||
+	    !mmc_sim_range_ok(sim, addr, data->blocks)) {
+		cmd->resp[0] |= R1_OUT_OF_RANGE;
+		data->error = -EIO;
+		return 0;
+	}
+	ptr = sim->storage + ((size_t)addr << SIM_SECTOR_SHIFT);
+	sim->xfer_blocks = data->blocks;
+
+	if (data->flags & MMC_DATA_READ) {
+		sg_copy_from_buffer(data->sg, data->sg_len, ptr, len);
+		sim->stats.reads++;
+		sim->stats.read_bytes += len;
+		data->bytes_xfered = len;
+		return mmc_sim_xfer_ns(sim->read_latency_us, sim->read_kbps,
+				       len);
+	}
+
+	if (sim->packed) {
+		sg_copy_to_buffer(data->sg, data->sg_len, sim->bounce, len);
+		data->error = mmc_sim_packed_write(sim, len);
+	} else {
+		sg_copy_to_buffer(data->sg, data->sg_len, ptr, len);
+	}
+	sim->stats.writes++;
+	sim->stats.write_bytes += len;
+	if (!data->error)
+		data->bytes_xfered = len;
+	return mmc_sim_xfer_ns(sim->write_latency_us, sim->write_kbps, len);
+}
+
+static u64 mmc_sim_cmd(struct mmc_sim_host *sim, struct mmc_command *cmd,
+		       struct mmc_data *data)
+{
+	u64 ns = (u64)sim->cmd_latency_us * NSEC_PER_USEC;
+	bool sleep_awake = false;
+
+	sim->stats.cmds++;
+	cmd->error = 0;
+	memset(cmd->resp, 0, sizeof(cmd->resp));
+
+	switch (cmd->opcode) {
+	case MMC_GO_IDLE_STATE:
+		sim->state = R1_STATE_IDLE;
+		return ns;
+	case MMC_SEND_OP_COND:
+		/* sector addressed, powered up, 2.7-3.6V and 1.7-1.95V */
+		cmd->resp[0] = MMC_CARD_BUSY | (1 << 30) | 0x00ff8080;
+		if (sim->state == R1_STATE_IDLE && cmd->arg)
+			sim->state = R1_STATE_READY;
+		return ns;
+	case MMC_ALL_SEND_CID:
+		memcpy(cmd->resp, sim->cid, sizeof(sim->cid));
+		sim->state = R1_STATE_IDENT;
+		return ns;
+	case MMC_SET_RELATIVE_ADDR:
+		sim->rca = cmd->arg >> 16;
+		cmd->resp[0] = mmc_sim_r1(sim);
+		sim->state = R1_STATE_STBY;
+		return ns;
+	case MMC_SEND_CSD:
+		memcpy(cmd->resp, sim->csd, sizeof(sim->csd));
+		return ns;
+	case MMC_SEND_CID:
+		memcpy(cmd->resp, sim->cid, sizeof(sim->cid));
+		return ns;
+	case MMC_SELECT_CARD:
+		cmd->resp[0] = mmc_sim_r1(sim);
+		sim->state = (cmd->arg >> 16) == sim->rca ?
+			R1_STATE_TRAN : R1_STATE_STBY;
+		return ns;
+	case MMC_SLEEP_AWAKE:
+		/* CMD5 is IO_SEND_OP_COND for SDIO probing in idle state */
+		sleep_awake = sim->state >= R1_STATE_STBY;
+		break;
+	case MMC_SWITCH:
+		cmd->resp[0] = mmc_sim_r1(sim);
+		mmc_sim_switch(sim, cmd->arg);
+		return ns;
+	case MMC_SEND_STATUS:
+		cmd->resp[0] = mmc_sim_r1(sim);
+		return ns;
+	case MMC_STOP_TRANSMISSION:
+		cmd->resp[0] = mmc_sim_r1(sim);
+		sim->state = R1_STATE_TRAN;
+		return ns;
+	case MMC_SET_BLOCKLEN:
+		cmd->resp[0] = mmc_sim_r1(sim);
+		if (cmd->arg != (1 << SIM_SECTOR_SHIFT))
+			cmd->resp[0] |= R1_BLOCK_LEN_ERROR;
+		return ns;
+	case MMC_SET_BLOCK_COUNT:
+		cmd->resp[0] = mmc_sim_r1(sim);
+		sim->packed = !!(cmd->arg & MMC_CMD23_ARG_PACKED);
+		return ns;
+	case MMC_ERASE_GROUP_START:
+		cmd->resp[0] = mmc_sim_r1(sim);
+		sim->erase_start = cmd->arg;
+		return ns;
+	case MMC_ERASE_GROUP_END:
+		cmd->resp[0] = mmc_sim_r1(sim);
+		sim->erase_end = cmd->arg;
+		return ns;
+	case MMC_ERASE:
+		cmd->resp[0] = mmc_sim_r1(sim);
+		mmc_sim_erase(sim, cmd);
+		return (u64)sim->erase_latency_us * NSEC_PER_USEC;
+	case MMC_SEND_EXT_CSD:
+	case MMC_READ_SINGLE_BLOCK:
+	case MMC_READ_MULTIPLE_BLOCK:
+	case MMC_WRITE_BLOCK:
+	case MMC_WRITE_MULTIPLE_BLOCK:
+		/* CMD8 without data is SD_SEND_IF_COND, not for us */
+		if (!data)
+			break;
+		cmd->resp[0] = mmc_sim_r1(sim);
+		ns = mmc_sim_data(sim, cmd, data);
+		sim->packed = false;
+		return ns;
+	}
+
+	if (sleep_awake) {
+		/* sleep is not modelled, the card stays in standby */
+		cmd->resp[0] = mmc_sim_r1(sim);
+		sim->state = R1_STATE_STBY;
+		return ns;
+	}
+
+	/* SD/SDIO probing and anything else unsupported: no response */
+	cmd->error = -ETIMEDOUT;
+	return ns;
+}
+
+static void mmc_sim_request(struct mmc_host *mmc, struct mmc_request *mrq)
+{
+	struct mmc_sim_host *sim = mmc_priv(mmc);
+	unsigned long flags;
+
+	spin_lock_irqsave(&sim->lock, flags);
+	WARN_ON(sim->mrq);
+	sim->mrq = mrq;
+	sim->start = ktime_get();
+	spin_unlock_irqrestore(&sim->lock, flags);
+
+	queue_work(sim->wq, &sim->work);
+}
+
+static void mmc_sim_request_work(struct work_struct *work)
+{
+	struct mmc_sim_host *sim = container_of(work, struct mmc_sim_host,
+						work);
+	struct mmc_request *mrq;
+	unsigned long flags;
+	ktime_t start;
+	u64 ns = 0;
+
+	mutex_lock(&sim->mutex);
+	spin_lock_irqsave(&sim->lock, flags);
+	mrq = sim->mrq;
+	start = sim->start;
+	spin_unlock_irqrestore(&sim->lock, flags);
+	if (!mrq)
+		goto out;
+
+	sim->xfer_blocks = 0;
+	if (mrq->sbc) {
+		ns += mmc_sim_cmd(sim, mrq->sbc, NULL);
+		if (mrq->sbc->error)
+			goto done;
+	}
+	ns += mmc_sim_cmd(sim, mrq->cmd, mrq->data);
+	if (mrq->cmd->error)
+		goto done;
+	if (mrq->data && mrq->stop && !mrq->sbc)
+		ns += mmc_sim_cmd(sim, mrq->stop, NULL);
+	else if (mrq->data)
+		sim->state = R1_STATE_TRAN;
+done:
+	spin_lock_irqsave(&sim->lock, flags);
+	sim->delay_ns = ns;
+	hrtimer_start(&sim->timer, ktime_add_ns(start, ns), HRTIMER_MODE_ABS);
+	spin_unlock_irqrestore(&sim->lock, flags);
+out:
+	mutex_unlock(&sim->mutex);
+}
+
+static enum hrtimer_restart mmc_sim_timer(struct hrtimer *timer)
+{
+	struct mmc_sim_host *sim = container_of(timer, struct mmc_sim_host,
+						timer);
+	struct mmc_request *mrq;
+	unsigned long flags;
+
+	spin_lock_irqsave(&sim->lock, flags);
+	mrq = sim->mrq;
+	sim->mrq = NULL;
+	spin_unlock_irqrestore(&sim->lock, flags);
+
+	if (mrq)
+		mmc_request_done(sim->mmc, mrq);
+	return HRTIMER_NORESTART;
+}
+
+/*
+ * Stop the request in flight as if the host aborted the transfer.  The
+ * data was already copied, but only the share of the blocks that the
+ * timing model says went out before now is reported as programmed.  A
+ * request that the work hasn't executed yet can't be stopped.
+ */
+static int mmc_sim_stop_request(struct mmc_host *mmc)
+{
+	struct mmc_sim_host *sim = mmc_priv(mmc);
+	unsigned long flags;
+	u64 elapsed, delay;
+	u32 done = 0;
+	int ret = 0;
+
+	mutex_lock(&sim->mutex);
+	spin_lock_irqsave(&sim->lock, flags);
+	if (!sim->mrq || !sim->mrq->data ||
+	    hrtimer_try_to_cancel(&sim->timer) != 1) {
+		spin_unlock_irqrestore(&sim->lock, flags);
+		ret = MMC_BLK_NO_REQ_TO_STOP;
+		goto out;
+	}
+	elapsed = ktime_to_ns(ktime_sub(ktime_get(), sim->start));
+	delay = sim->delay_ns;
+	sim->mrq = NULL;
+	spin_unlock_irqrestore(&sim->lock, flags);
+
+	if (delay)
+		done = div64_u64((u64)sim->xfer_blocks * min(elapsed, delay),
+				 delay);
+	sim->ext_csd[EXT_CSD_CORRECTLY_PRG_SECTORS_NUM + 0] = done >> 0;
+	sim->ext_csd[EXT_CSD_CORRECTLY_PRG_SECTORS_NUM + 1] = done >> 8;
+	sim->ext_csd[EXT_CSD_CORRECTLY_PRG_SECTORS_NUM + 2] = done >> 16;
+	sim->ext_csd[EXT_CSD_CORRECTLY_PRG_SECTORS_NUM + 3] = done >> 24;
+
+	sim->state = R1_STATE_RCV;
+	sim->stats.stopped++;
+out:
+	mutex_unlock(&sim->mutex);
+	return ret;
+}
+
+static unsigned int mmc_sim_get_xfer_remain(struct mmc_host *mmc)
+{
+	struct mmc_sim_host *sim = mmc_priv(mmc);
+	unsigned long flags;
+	unsigned int remain = 0;
+
+	mutex_lock(&sim->mutex);
+	spin_lock_irqsave(&sim->lock, flags);
+	if (sim->mrq && sim->mrq->data &&
+	    (sim->mrq->data->flags & MMC_DATA_WRITE))
+		remain = sim->xfer_blocks;
+	spin_unlock_irqrestore(&sim->lock, flags);
+	mutex_unlock(&sim->mutex);
+
+	return remain;
+}
+
+static void mmc_sim_set_ios(struct mmc_host *mmc, struct mmc_ios *ios)
+{
+	struct mmc_sim_host *sim = mmc_priv(mmc);
+
+	if (ios->power_mode != MMC_POWER_OFF)
+		return;
+
+	/* power cycle: card forgets its state and volatile EXT_CSD bytes */
+	mutex_lock(&sim->mutex);
+	sim->state = R1_STATE_IDLE;
+	sim->rca = 0;
+	mmc_sim_init_regs(sim);
+	mutex_unlock(&sim->mutex);
+}
+
+static int mmc_sim_get_ro(struct mmc_host *mmc)
+{
+	return 0;
+}
+
+static int mmc_sim_get_cd(struct mmc_host *mmc)
+{
+	return 1;
+}
+
+static const struct mmc_host_ops mmc_sim_ops = {
+	.request		= mmc_sim_request,
+	.set_ios		= mmc_sim_set_ios,
+	.get_ro			= mmc_sim_get_ro,
+	.get_cd			= mmc_sim_get_cd,
+	.stop_request		= mmc_sim_stop_request,
+	.get_xfer_remain	= mmc_sim_get_xfer_remain,
+};
+
+static int mmc_sim_stats_show(struct seq_file *s, void *unused)
+{
+	struct mmc_sim_host *sim = s->private;
+	struct mmc_sim_stats st;
+
+	mutex_lock(&sim->mutex);
+	st = sim->stats;
+	mutex_unlock(&sim->mutex);
+
+	seq_printf(s, "commands:      %llu\n", st.cmds);
+	seq_printf(s, "reads:         %llu\n", st.reads);
+	seq_printf(s, "writes:        %llu\n", st.writes);
+	seq_printf(s, "packed_writes: %llu\n", st.packed_writes);
+	seq_printf(s, "erases:        %llu\n", st.erases);
+	seq_printf(s, "cache_flushes: %llu\n", st.flushes);
+	seq_printf(s, "stopped:       %llu\n", st.stopped);
+	seq_printf(s, "read_bytes:    %llu\n", st.read_bytes);
+	seq_printf(s, "write_bytes:   %llu\n", st.write_bytes);
+	return 0;
+}
+
+static int mmc_sim_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, mmc_sim_stats_show, inode->i_private);
+}
+
+static ssize_t mmc_sim_stats_write(struct file *file, const char __user *ubuf,
+				   size_t count, loff_t *ppos)
+{
+	struct mmc_sim_host *sim =
+		((struct seq_file *)file->private_data)->private;
+
+	mutex_lock(&sim->mutex);
+	memset(&sim->stats, 0, sizeof(sim->stats));
+	mutex_unlock(&sim->mutex);
+	return count;
+}
+
+static const struct file_operations mmc_sim_stats_fops = {
+	.open		= mmc_sim_stats_open,
+	.read		= seq_read,
+	.write		= mmc_sim_stats_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void mmc_sim_debugfs_init(struct mmc_sim_host *sim)
+{
+	struct dentry *root = sim->mmc->debugfs_root;
+
+	if (!root)
+		return;
+
+	sim->debugfs = debugfs_create_dir("sim", root);
+	if (IS_ERR_OR_NULL(sim->debugfs)) {
+		sim->debugfs = NULL;
+		return;
+	}
+
+	debugfs_create_u32("cmd_latency_us", S_IRUSR | S_IWUSR,
+			   sim->debugfs, &sim->cmd_latency_us);
+	debugfs_create_u32("read_latency_us", S_IRUSR | S_IWUSR,
+			   sim->debugfs, &sim->read_latency_us);
+	debugfs_create_u32("write_latency_us", S_IRUSR | S_IWUSR,
+			   sim->debugfs, &sim->write_latency_us);
+	debugfs_create_u32("erase_latency_us", S_IRUSR | S_IWUSR,
+			   sim->debugfs, &sim->erase_latency_us);
+	debugfs_create_u32("read_kbps", S_IRUSR | S_IWUSR,
+			   sim->debugfs, &sim->read_kbps);
+	debugfs_create_u32("write_kbps", S_IRUSR | S_IWUSR,
+			   sim->debugfs, &sim->write_kbps);
+	debugfs_create_file("stats", S_IRUSR | S_IWUSR, sim->debugfs, sim,
+			    &mmc_sim_stats_fops);
+}
+
+static int mmc_sim_probe(struct platform_device *pdev)
+{
+	struct mmc_host *mmc;
+	struct mmc_sim_host *sim;
+	int ret;
+
+	/* the whole card is one vmalloc area, it must fit in a size_t */
+	if (!size_mb || (u64)size_mb << 20 > SIZE_MAX)
+		return -EINVAL;
+
+	mmc = mmc_alloc_host(sizeof(struct mmc_sim_host), &pdev->dev);
+	if (!mmc)
+		return -ENOMEM;
+
+	sim = mmc_priv(mmc);
+	sim->mmc = mmc;
+	spin_lock_init(&sim->lock);
+	mutex_init(&sim->mutex);
+	hrtimer_init(&sim->timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	sim->timer.function = mmc_sim_timer;
+	INIT_WORK(&sim->work, mmc_sim_request_work);
+
+	sim->cmd_latency_us = cmd_latency_us;
+	sim->read_latency_us = read_latency_us;
+	sim->write_latency_us = write_latency_us;
+	sim->erase_latency_us = erase_latency_us;
+	sim->read_kbps = read_kbps;
+	sim->write_kbps = write_kbps;
+
+	sim->sectors = (sector_t)size_mb << (20 - SIM_SECTOR_SHIFT);
+	sim->storage = vzalloc((size_t)size_mb << 20);
+	sim->bounce = vmalloc(SIM_MAX_REQ_SIZE);
+	if (!sim->storage || !sim->bounce) {
+		dev_err(&pdev->dev, "cannot allocate %u MiB card\n", size_mb);
+		ret = -ENOMEM;
+		goto err_free;
+	}
+	sim->wq = alloc_ordered_workqueue("%s", WQ_MEM_RECLAIM | WQ_HIGHPRI,
+					  mmc_hostname(mmc));
+	if (!sim->wq) {
+		ret = -ENOMEM;
+		goto err_free;
+	}
+	mmc_sim_init_regs(sim);
+
+	mmc->ops = &mmc_sim_ops;
+	mmc->f_min = 400000;
+	mmc->f_max = 52000000;
+	mmc->ocr_avail = MMC_VDD_165_195 | MMC_VDD_32_33 | MMC_VDD_33_34;
+	mmc->caps = MMC_CAP_4_BIT_DATA | MMC_CAP_8_BIT_DATA |
+		    MMC_CAP_MMC_HIGHSPEED | MMC_CAP_NONREMOVABLE |
+		    MMC_CAP_WAIT_WHILE_BUSY | MMC_CAP_ERASE | MMC_CAP_CMD23;
+	mmc->caps2 = MMC_CAP2_PACKED_WR | MMC_CAP2_PACKED_WR_CONTROL |
+		     MMC_CAP2_STOP_REQUEST | MMC_CAP2_NO_SLEEP_CMD;
+
+	mmc->max_segs = 128;
+	mmc->max_blk_size = 1 << SIM_SECTOR_SHIFT;
+	mmc->max_blk_count = SIM_MAX_REQ_SIZE >> SIM_SECTOR_SHIFT;
+	mmc->max_req_size = SIM_MAX_REQ_SIZE;
+	mmc->max_seg_size = mmc->max_req_size;
+
+	platform_set_drvdata(pdev, sim);
+
+	ret = mmc_add_host(mmc);
+	if (ret)
+		goto err_free;
+
+	mmc_sim_debugfs_init(sim);
+	dev_info(&pdev->dev, "%s: emulated eMMC, %u MiB\n",
+		 mmc_hostname(mmc), size_mb);
+	return 0;
+
+err_free:
+	if (sim->wq)
+		destroy_workqueue(sim->wq);
+	vfree(sim->bounce);
+	vfree(sim->storage);
+	mmc_free_host(mmc);
+	return ret;
+}
+
+static int mmc_sim_remove(struct platform_device *pdev)
+{
+	struct mmc_sim_host *sim = platform_get_drvdata(pdev);
+
+	debugfs_remove_recursive(sim->debugfs);
+	mmc_remove_host(sim->mmc);
+	destroy_workqueue(sim->wq);
+	hrtimer_cancel(&sim->timer);
+	vfree(sim->bounce);
+	vfree(sim->storage);
+	mmc_free_host(sim->mmc);
+	return 0;
+}
+
+static struct platform_driver mmc_sim_driver = {
+	.probe		= mmc_sim_probe,
+	.remove		= mmc_sim_remove,
+	.driver		= {
+		.name	= DRIVER_NAME,
+		.owner	= THIS_MODULE,
+	},
+};
+
+static struct platform_device *mmc_sim_pdev;
+
+static int __init mmc_sim_init(void)
+{
+	int ret;
+
+	ret = platform_driver_register(&mmc_sim_driver);
+	if (ret)
+		return ret;
+
+	mmc_sim_pdev = platform_device_register_simple(DRIVER_NAME, -1,
+						       NULL, 0);
+	if (IS_ERR(mmc_sim_pdev)) {
+		platform_driver_unregister(&mmc_sim_driver);
+		return PTR_ERR(mmc_sim_pdev);
+	}
+	return 0;
+}
+
+static void __exit mmc_sim_exit(void)
+{
+	platform_device_unregister(mmc_sim_pdev);
+	platform_driver_unregister(&mmc_sim_driver);
+}
+
+module_init(mmc_sim_init);
+module_exit(mmc_sim_exit);
+
+MODULE_DESCRIPTION("RAM backed eMMC host emulation for benchmarking");
+MODULE_LICENSE("GPL v2");
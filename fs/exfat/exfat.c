@@ -40,6 +40,8 @@
 #include "exfat.h"
 
 #include <linux/blkdev.h>
+#include <linux/bitops.h>
+#include <linux/ktime.h>
 
 #define THERE_IS_MBR        0
 
@@ -93,22 +95,6 @@ static INT8 *reserved_names[] = {
 	NULL
 };
 
-static UINT8 free_bit[] = {
-	0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0, 4, 0, 1, 0, 2,
-	0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0, 5, 0, 1, 0, 2, 0, 1, 0, 3,
-	0, 1, 0, 2, 0, 1, 0, 4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2,
-	0, 1, 0, 6, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0, 4,
-	0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0, 5, 0, 1, 0, 2,
-	0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0, 4, 0, 1, 0, 2, 0, 1, 0, 3,
-	0, 1, 0, 2, 0, 1, 0, 7, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2,
-	0, 1, 0, 4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0, 5,
-	0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0, 4, 0, 1, 0, 2,
-	0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0, 6, 0, 1, 0, 2, 0, 1, 0, 3,
-	0, 1, 0, 2, 0, 1, 0, 4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2,
-	0, 1, 0, 5, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0, 4,
-	0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0
-};
-
 static UINT8 used_bit[] = {
 	0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 1, 2, 2, 3,
 	2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5, 1, 2, 2, 3, 2, 3, 3, 4,
@@ -234,6 +220,12 @@ INT32 ffsMountVol(struct super_block *sb, INT32 drv)
 		return ret;
 	}
 
+	ret = FAT_cache_init(sb);
+	if (ret) {
+		bdev_close(sb);
+		return ret;
+	}
+
 	if (p_fs->vol_type == EXFAT) {
 		ret = load_alloc_bitmap(sb);
 		if (ret) {
@@ -349,6 +341,7 @@ INT32 ffsLookupFile(struct inode *inode, UINT8 *path, FILE_ID_T *fid)
 		fid->type = TYPE_DIR;
 		fid->rwoffset = 0;
 		fid->hint_last_off = -1;
+		clu_cache_inval(&(fid->clu_cache));
 
 		fid->attr = ATTR_SUBDIR;
 		fid->flags = 0x01;
@@ -370,6 +363,7 @@ INT32 ffsLookupFile(struct inode *inode, UINT8 *path, FILE_ID_T *fid)
 		fid->type = p_fs->fs_func->get_entry_type(ep);
 		fid->rwoffset = 0;
 		fid->hint_last_off = -1;
+		clu_cache_inval(&(fid->clu_cache));
 		fid->attr = p_fs->fs_func->get_entry_attr(ep);
 
 		fid->size = p_fs->fs_func->get_entry_size(ep2);
@@ -801,6 +795,7 @@ INT32 ffsTruncateFile(struct inode *inode, UINT64 old_size, UINT64 new_size)
 	p_fs->fs_func->free_cluster(sb, &clu, 0);
 
 	fid->hint_last_off = -1;
+	clu_cache_inval(&(fid->clu_cache));
 	if (fid->rwoffset > fid->size) {
 		fid->rwoffset = fid->size;
 	}
@@ -932,6 +927,7 @@ INT32 ffsMoveFile(struct inode *old_parent_inode, FILE_ID_T *fid, struct inode *
 			new_fid->size = 0;
 			new_fid->start_clu = CLUSTER_32(~0);
 			new_fid->flags = (p_fs->vol_type == EXFAT) ? 0x03 : 0x01;
+			clu_cache_inval(&(new_fid->clu_cache));
 		}
 
 		new_fid->dir.dir = DIR_DELETED;
@@ -985,6 +981,7 @@ INT32 ffsRemoveFile(struct inode *inode, FILE_ID_T *fid)
 	fid->start_clu = CLUSTER_32(~0);
 	fid->flags = (p_fs->vol_type == EXFAT)? 0x03: 0x01;
 	fid->dir.dir = DIR_DELETED;
+	clu_cache_inval(&(fid->clu_cache));
 
 #if (DELAYED_SYNC == 0)
 	fs_sync(sb, 0);
@@ -1267,8 +1264,9 @@ INT32 ffsSetStat(struct inode *inode, DIR_ENTRY_T *info)
 
 INT32 ffsMapCluster(struct inode *inode, INT32 clu_offset, UINT32 *clu)
 {
-	INT32 num_clusters, num_alloced, modified = FALSE;
+	INT32 num_clusters, num_alloced, modified = FALSE, fclu;
 	UINT32 last_clu, sector;
+	CLU_RUN_T run;
 	CHAIN_T new_clu;
 	DENTRY_T *ep;
 	ENTRY_SET_CACHE_T *es = NULL;
@@ -1295,18 +1293,47 @@ INT32 ffsMapCluster(struct inode *inode, INT32 clu_offset, UINT32 *clu)
 				*clu += clu_offset;
 		}
 	} else {
-		if ((clu_offset > 0) && (fid->hint_last_off > 0) &&
+		fclu = 0;
+		run.fclu = 0;
+		run.dclu = *clu;
+		p_fs->map_stat.map_calls++;
+
+		if ((clu_offset > 0) &&
+			clu_cache_lookup(&fid->clu_cache, clu_offset, &run)) {
+			if (clu_offset < run.fclu + run.len) {
+				p_fs->map_stat.run_hits++;
+				fclu = clu_offset;
+				*clu = run.dclu + (clu_offset - run.fclu);
+			} else {
+				fclu = run.fclu + run.len - 1;
+				*clu = run.dclu + run.len - 1;
+			}
+		}
+
+		if ((clu_offset > 0) && (fid->hint_last_off > fclu) &&
 			(clu_offset >= fid->hint_last_off)) {
-			clu_offset -= fid->hint_last_off;
+			fclu = fid->hint_last_off;
 			*clu = fid->hint_last_clu;
+			run.fclu = fclu;
+			run.dclu = *clu;
 		}
 
-		while ((clu_offset > 0) && (*clu != CLUSTER_32(~0))) {
+		while ((fclu < clu_offset) && (*clu != CLUSTER_32(~0))) {
 			last_clu = *clu;
 			if (FAT_read(sb, *clu, clu) == -1)
 				return FFS_MEDIAERR;
-			clu_offset--;
+			p_fs->map_stat.fat_reads++;
+			fclu++;
+			if (*clu != last_clu + 1) {
+				run.fclu = fclu;
+				run.dclu = *clu;
+			}
 		}
+
+		/* remember the run we ended in, so the next lookup can start there */
+		if ((clu_offset > 0) && (*clu != CLUSTER_32(~0)))
+			clu_cache_add(&fid->clu_cache, run.fclu, run.dclu,
+					fclu - run.fclu + 1);
 	}
 
 	if (*clu == CLUSTER_32(~0)) {
@@ -1613,6 +1640,7 @@ INT32 ffsRemoveDir(struct inode *inode, FILE_ID_T *fid)
 	fid->start_clu = CLUSTER_32(~0);
 	fid->flags = (p_fs->vol_type == EXFAT)? 0x03: 0x01;
 	fid->dir.dir = DIR_DELETED;
+	clu_cache_inval(&(fid->clu_cache));
 
 #if (DELAYED_SYNC == 0)
 	fs_sync(sb, 0);
@@ -1839,20 +1867,35 @@ INT32 fat_alloc_cluster(struct super_block *sb, INT32 num_alloc, CHAIN_T *p_chai
 	return(num_clusters);
 }
 
-INT32 exfat_alloc_cluster(struct super_block *sb, INT32 num_alloc, CHAIN_T *p_chain)
+static INT32 __exfat_alloc_cluster(struct super_block *sb, INT32 num_alloc, CHAIN_T *p_chain)
 {
 	INT32 num_clusters = 0;
 	UINT32 hint_clu, new_clu, last_clu = CLUSTER_32(~0);
+	UINT32 run_clu = CLUSTER_32(~0), window;
 	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
 
+	window = (num_alloc > EXFAT_ALLOC_WINDOW) ? (UINT32) num_alloc : EXFAT_ALLOC_WINDOW;
+
 	hint_clu = p_chain->dir;
 	if (hint_clu == CLUSTER_32(~0)) {
-		hint_clu = test_alloc_bitmap(sb, p_fs->clu_srch_ptr-2);
+		run_clu = find_free_run(sb, p_fs->clu_srch_ptr-2, window);
+		hint_clu = run_clu;
+		if (hint_clu == CLUSTER_32(~0))
+			hint_clu = test_alloc_bitmap(sb, p_fs->clu_srch_ptr-2);
 		if (hint_clu == CLUSTER_32(~0))
 			return 0;
 	} else if (hint_clu >= p_fs->num_clusters) {
 		hint_clu = 2;
 		p_chain->flags = 0x01;
+	} else if (test_alloc_bitmap(sb, hint_clu-2) != hint_clu) {
+		/* the chain cannot grow in place, so move on to a run with room to grow */
+		p_fs->alloc_stat.frag_breaks++;
+
+		run_clu = find_free_run(sb, hint_clu-2, window);
+		if (run_clu != CLUSTER_32(~0)) {
+			hint_clu = run_clu;
+			p_chain->flags = 0x01;
+		}
 	}
 
 	__set_sb_dirty(sb);
@@ -1887,14 +1930,8 @@ INT32 exfat_alloc_cluster(struct super_block *sb, INT32 num_alloc, CHAIN_T *p_ch
 		}
 		last_clu = new_clu;
 
-		if ((--num_alloc) == 0) {
-			p_fs->clu_srch_ptr = hint_clu;
-			if (p_fs->used_clusters != (UINT32) ~0)
-				p_fs->used_clusters += num_clusters;
-
-			p_chain->size += num_clusters;
-			return(num_clusters);
-		}
+		if ((--num_alloc) == 0)
+			break;
 
 		hint_clu = new_clu + 1;
 		if (hint_clu >= p_fs->num_clusters) {
@@ -1907,6 +1944,27 @@ INT32 exfat_alloc_cluster(struct super_block *sb, INT32 num_alloc, CHAIN_T *p_ch
 		}
 	}
 
+	if ((run_clu != CLUSTER_32(~0)) && (num_clusters > 0)) {
+		p_fs->alloc_stat.run_allocs++;
+
+		/* keep the rest of the run free for this chain to grow into */
+		if ((last_clu >= run_clu) && (last_clu < run_clu + window)) {
+			if (run_clu + window >= p_fs->clu_rsv_end) {
+				p_fs->clu_rsv_start = run_clu;
+				p_fs->clu_rsv_end = run_clu + window;
+			}
+			hint_clu = run_clu + window;
+			if (hint_clu >= p_fs->num_clusters)
+				hint_clu = 2;
+		}
+	} else if ((hint_clu >= p_fs->clu_rsv_start) &&
+		   (hint_clu < p_fs->clu_rsv_end)) {
+		/* grew in place inside a kept run, don't hand the rest of it out */
+		hint_clu = p_fs->clu_rsv_end;
+		if (hint_clu >= p_fs->num_clusters)
+			hint_clu = 2;
+	}
+
 	p_fs->clu_srch_ptr = hint_clu;
 	if (p_fs->used_clusters != (UINT32) ~0)
 		p_fs->used_clusters += num_clusters;
@@ -1915,6 +1973,28 @@ INT32 exfat_alloc_cluster(struct super_block *sb, INT32 num_alloc, CHAIN_T *p_ch
 	return(num_clusters);
 }
 
+INT32 exfat_alloc_cluster(struct super_block *sb, INT32 num_alloc, CHAIN_T *p_chain)
+{
+	INT32 num_clusters;
+	UINT64 delta;
+	ktime_t start;
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+	ALLOC_STAT_T *stat = &(p_fs->alloc_stat);
+
+	start = ktime_get();
+	num_clusters = __exfat_alloc_cluster(sb, num_alloc, p_chain);
+	delta = (UINT64) ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	stat->alloc_calls++;
+	if (num_clusters > 0)
+		stat->alloc_clusters += num_clusters;
+	stat->alloc_ns += delta;
+	if (delta > stat->alloc_max_ns)
+		stat->alloc_max_ns = delta;
+
+	return(num_clusters);
+}
+
 void fat_free_cluster(struct super_block *sb, CHAIN_T *p_chain, INT32 do_relse)
 {
 	INT32 num_clusters = 0;
@@ -2081,27 +2161,17 @@ INT32 fat_count_used_clusters(struct super_block *sb)
 
 INT32 exfat_count_used_clusters(struct super_block *sb)
 {
-	INT32 i, map_i, map_b, count = 0;
-	UINT8 k;
+	INT32 i;
+	UINT32 num_free = 0;
 	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
-	BD_INFO_T *p_bd = &(EXFAT_SB(sb)->bd_info);
 
-	map_i = map_b = 0;
+	for (i = 0; i < p_fs->map_sectors; i++)
+		num_free += p_fs->vol_amap_free[i];
 
-	for (i = 2; i < p_fs->num_clusters; i += 8) {
-		k = *(((UINT8 *) p_fs->vol_amap[map_i]->b_data) + map_b);
-		count += used_bit[k];
+	if ((p_fs->num_clusters - 2) < num_free)
+		return(0);
 
-		if ((++map_b) >= p_bd->sector_size) {
-			map_i++;
-			map_b = 0;
-		}
-	}
-
-	if ((p_fs->num_clusters - 2) < (UINT32)count)
-		count = p_fs->num_clusters - 2;
-
-	return(count);
+	return((INT32)(p_fs->num_clusters - 2 - num_free));
 }
 
 void exfat_chain_cont_cluster(struct super_block *sb, UINT32 chain, INT32 len)
@@ -2118,6 +2188,86 @@ void exfat_chain_cont_cluster(struct super_block *sb, UINT32 chain, INT32 len)
 	FAT_write(sb, chain, CLUSTER_32(~0));
 }
 
+/* number of bits of bitmap sector i that describe a real cluster */
+static UINT32 amap_valid_bits(FS_INFO_T *p_fs, BD_INFO_T *p_bd, INT32 i)
+{
+	UINT32 base, total = p_fs->num_clusters - 2;
+
+	base = (UINT32) i << (p_bd->sector_size_bits + 3);
+	if (base >= total)
+		return 0;
+	if ((total - base) < (p_bd->sector_size << 3))
+		return(total - base);
+
+	return(p_bd->sector_size << 3);
+}
+
+static UINT32 amap_count_free(FS_INFO_T *p_fs, BD_INFO_T *p_bd, INT32 i)
+{
+	UINT32 b, bits, count = 0;
+	UINT8 *map = (UINT8 *) p_fs->vol_amap[i]->b_data;
+
+	bits = amap_valid_bits(p_fs, p_bd, i);
+
+	for (b = 0; b < (bits >> 3); b++)
+		count += used_bit[map[b]];
+	if (bits & 0x7)
+		count += used_bit[map[b] & ((1 << (bits & 0x7)) - 1)];
+
+	return(bits - count);
+}
+
+/*
+ * first free (or used) cluster at or after relative cluster clu, without
+ * wrapping; sectors that are entirely used (or free) are skipped by their
+ * free count. returns num_clusters-2 when there is none.
+ */
+static UINT32 amap_next_free(struct super_block *sb, UINT32 clu)
+{
+	INT32 i;
+	UINT32 b, bits;
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+	BD_INFO_T *p_bd = &(EXFAT_SB(sb)->bd_info);
+
+	for (i = clu >> (p_bd->sector_size_bits + 3); i < p_fs->map_sectors; i++) {
+		bits = amap_valid_bits(p_fs, p_bd, i);
+		if (bits == 0)
+			break;
+
+		if (p_fs->vol_amap_free[i] > 0) {
+			b = ((UINT32) i << (p_bd->sector_size_bits + 3)) < clu ? clu & ((p_bd->sector_size << 3) - 1) : 0;
+			b = find_next_zero_bit_le(p_fs->vol_amap[i]->b_data, bits, b);
+			if (b < bits)
+				return(((UINT32) i << (p_bd->sector_size_bits + 3)) + b);
+		}
+	}
+
+	return(p_fs->num_clusters - 2);
+}
+
+static UINT32 amap_next_used(struct super_block *sb, UINT32 clu)
+{
+	INT32 i;
+	UINT32 b, bits;
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+	BD_INFO_T *p_bd = &(EXFAT_SB(sb)->bd_info);
+
+	for (i = clu >> (p_bd->sector_size_bits + 3); i < p_fs->map_sectors; i++) {
+		bits = amap_valid_bits(p_fs, p_bd, i);
+		if (bits == 0)
+			break;
+
+		if (p_fs->vol_amap_free[i] < bits) {
+			b = ((UINT32) i << (p_bd->sector_size_bits + 3)) < clu ? clu & ((p_bd->sector_size << 3) - 1) : 0;
+			b = find_next_bit_le(p_fs->vol_amap[i]->b_data, bits, b);
+			if (b < bits)
+				return(((UINT32) i << (p_bd->sector_size_bits + 3)) + b);
+		}
+	}
+
+	return(p_fs->num_clusters - 2);
+}
+
 INT32 load_alloc_bitmap(struct super_block *sb)
 {
 	INT32 i, j, ret;
@@ -2173,6 +2323,19 @@ INT32 load_alloc_bitmap(struct super_block *sb)
 					}
 				}
 
+				p_fs->vol_amap_free = (UINT32 *) MALLOC(sizeof(UINT32) * p_fs->map_sectors);
+				if (p_fs->vol_amap_free == NULL) {
+					for (j = 0; j < p_fs->map_sectors; j++)
+						brelse(p_fs->vol_amap[j]);
+
+					FREE(p_fs->vol_amap);
+					p_fs->vol_amap = NULL;
+					return FFS_MEMORYERR;
+				}
+
+				for (j = 0; j < p_fs->map_sectors; j++)
+					p_fs->vol_amap_free[j] = amap_count_free(p_fs, p_bd, j);
+
 				p_fs->pbr_bh = NULL;
 				return FFS_SUCCESS;
 			}
@@ -2198,6 +2361,9 @@ void free_alloc_bitmap(struct super_block *sb)
 
 	FREE(p_fs->vol_amap);
 	p_fs->vol_amap = NULL;
+
+	FREE(p_fs->vol_amap_free);
+	p_fs->vol_amap_free = NULL;
 }
 
 INT32 set_alloc_bitmap(struct super_block *sb, UINT32 clu)
@@ -2212,7 +2378,10 @@ INT32 set_alloc_bitmap(struct super_block *sb, UINT32 clu)
 
 	sector = START_SECTOR(p_fs->map_clu) + i;
 
-	Bitmap_set((UINT8 *) p_fs->vol_amap[i]->b_data, b);
+	if (!test_bit_le(b, p_fs->vol_amap[i]->b_data)) {
+		Bitmap_set((UINT8 *) p_fs->vol_amap[i]->b_data, b);
+		p_fs->vol_amap_free[i]--;
+	}
 
 	return (sector_write(sb, sector, p_fs->vol_amap[i], 0));
 }
@@ -2234,7 +2403,10 @@ INT32 clr_alloc_bitmap(struct super_block *sb, UINT32 clu)
 
 	sector = START_SECTOR(p_fs->map_clu) + i;
 
-	Bitmap_clear((UINT8 *) p_fs->vol_amap[i]->b_data, b);
+	if (test_bit_le(b, p_fs->vol_amap[i]->b_data)) {
+		Bitmap_clear((UINT8 *) p_fs->vol_amap[i]->b_data, b);
+		p_fs->vol_amap_free[i]++;
+	}
 
 	return (sector_write(sb, sector, p_fs->vol_amap[i], 0));
 
@@ -2255,37 +2427,53 @@ INT32 clr_alloc_bitmap(struct super_block *sb, UINT32 clu)
 
 UINT32 test_alloc_bitmap(struct super_block *sb, UINT32 clu)
 {
-	INT32 i, map_i, map_b;
-	UINT32 clu_base, clu_free;
-	UINT8 k, clu_mask;
+	UINT32 clu_free;
 	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
-	BD_INFO_T *p_bd = &(EXFAT_SB(sb)->bd_info);
 
-	clu_base = (clu & ~(0x7)) + 2;
-	clu_mask = (1 << (clu - clu_base + 2)) - 1;
+	if (clu >= (p_fs->num_clusters - 2))
+		clu = 0;
 
-	map_i = clu >> (p_bd->sector_size_bits + 3);
-	map_b = (clu >> 3) & p_bd->sector_size_mask;
+	clu_free = amap_next_free(sb, clu);
+	if (clu_free < (p_fs->num_clusters - 2))
+		return(clu_free + 2);
 
-	for (i = 2; i < p_fs->num_clusters; i += 8) {
-		k = *(((UINT8 *) p_fs->vol_amap[map_i]->b_data) + map_b);
-		if (clu_mask > 0) {
-			k |= clu_mask;
-			clu_mask = 0;
-		}
-		if (k < 0xFF) {
-			clu_free = clu_base + free_bit[k];
-			if (clu_free < p_fs->num_clusters)
-				return(clu_free);
-		}
-		clu_base += 8;
+	if (clu > 0) {
+		clu_free = amap_next_free(sb, 0);
+		if (clu_free < clu)
+			return(clu_free + 2);
+	}
 
-		if (((++map_b) >= p_bd->sector_size) || (clu_base >= p_fs->num_clusters)) {
-			if ((++map_i) >= p_fs->map_sectors) {
-				clu_base = 2;
-				map_i = 0;
-			}
-			map_b = 0;
+	return(CLUSTER_32(~0));
+}
+
+/*
+ * find a free run of at least len clusters, searching from relative cluster
+ * clu and wrapping once. only the first EXFAT_RUN_SEARCH_MAX runs are looked
+ * at so a badly fragmented volume does not make every allocation expensive.
+ */
+UINT32 find_free_run(struct super_block *sb, UINT32 clu, UINT32 len)
+{
+	INT32 pass, runs = 0;
+	UINT32 start, end, limit;
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+
+	if (clu >= (p_fs->num_clusters - 2))
+		clu = 0;
+
+	for (pass = 0; pass < 2; pass++) {
+		start = (pass == 0) ? clu : 0;
+		limit = (pass == 0) ? (p_fs->num_clusters - 2) : clu;
+
+		while ((start < limit) && (runs++ < EXFAT_RUN_SEARCH_MAX)) {
+			start = amap_next_free(sb, start);
+			if (start >= limit)
+				break;
+
+			end = amap_next_used(sb, start);
+			if ((end - start) >= len)
+				return(start + 2);
+
+			start = end;
 		}
 	}
 
@@ -4603,6 +4791,7 @@ INT32 exfat_mount(struct super_block *sb, PBR_SECTOR_T *p_pbr)
 
 	p_fs->vol_flag = (UINT32) GET16(p_bpb->vol_flags);
 	p_fs->clu_srch_ptr = 2;
+	p_fs->clu_rsv_start = p_fs->clu_rsv_end = 0;
 	p_fs->used_clusters = (UINT32) ~0;
 
 	p_fs->fs_func = &exfat_fs_func;
@@ -4693,6 +4882,7 @@ INT32 create_dir(struct inode *inode, CHAIN_T *p_dir, UNI_NAME_T *p_uniname, FIL
 	fid->type= TYPE_DIR;
 	fid->rwoffset = 0;
 	fid->hint_last_off = -1;
+	clu_cache_inval(&(fid->clu_cache));
 
 	return FFS_SUCCESS;
 }
@@ -4733,6 +4923,7 @@ INT32 create_file(struct inode *inode, CHAIN_T *p_dir, UNI_NAME_T *p_uniname, UI
 	fid->type= TYPE_FILE;
 	fid->rwoffset = 0;
 	fid->hint_last_off = -1;
+	clu_cache_inval(&(fid->clu_cache));
 
 	return FFS_SUCCESS;
 }
@@ -42,6 +42,17 @@ extern "C" {
 #define EXFAT_DEBUGFLAGS_ERROR_RW              0x02
 #endif
 
+#define EXFAT_IOC_GET_ALLOC_STAT       _IOR('f', 102, ALLOC_STAT_T)
+#define EXFAT_IOC_GET_MAP_STAT         _IOR('f', 103, MAP_STAT_T)
+
+/*
+ * a chain that is new, or cannot grow in place, starts on a free run of at
+ * least this many clusters and the search pointer skips past it, so that
+ * files written side by side each keep room to grow contiguously
+ */
+#define EXFAT_ALLOC_WINDOW      32
+#define EXFAT_RUN_SEARCH_MAX    256
+
 #define MAX_VOLUME              4
 
 #define DENTRY_SIZE             32
@@ -423,20 +434,28 @@ extern "C" {
 		UINT32      map_clu;
 		UINT32      map_sectors;
 		struct buffer_head **vol_amap;
+		UINT32      *vol_amap_free;
 
 		UINT16      **vol_utbl;
 
 		UINT32      clu_srch_ptr;
+		UINT32      clu_rsv_start;  /* highest run kept free for a chain */
+		UINT32      clu_rsv_end;
 		UINT32      used_clusters;
 		UENTRY_T    hint_uentry;
 
 		UINT32      dev_ejected;
 
+		ALLOC_STAT_T alloc_stat;
+		MAP_STAT_T  map_stat;
+
 		FS_FUNC_T	*fs_func;
 
-		BUF_CACHE_T FAT_cache_array[FAT_CACHE_SIZE];
+		BUF_CACHE_T *FAT_cache_array;
 		BUF_CACHE_T FAT_cache_lru_list;
-		BUF_CACHE_T FAT_cache_hash_list[FAT_CACHE_HASH_SIZE];
+		BUF_CACHE_T *FAT_cache_hash_list;
+		UINT32      FAT_cache_size;
+		UINT32      FAT_cache_hash_size;
 
 		BUF_CACHE_T buf_cache_array[BUF_CACHE_SIZE];
 		BUF_CACHE_T buf_cache_lru_list;
@@ -504,6 +523,7 @@ extern "C" {
 	INT32   set_alloc_bitmap(struct super_block *sb, UINT32 clu);
 	INT32   clr_alloc_bitmap(struct super_block *sb, UINT32 clu);
 	UINT32 test_alloc_bitmap(struct super_block *sb, UINT32 clu);
+	UINT32 find_free_run(struct super_block *sb, UINT32 clu, UINT32 len);
 	void   sync_alloc_bitmap(struct super_block *sb);
 
 	INT32  load_upcase_table(struct super_block *sb);
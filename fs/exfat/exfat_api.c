@@ -136,6 +136,36 @@ INT32 FsGetVolInfo(struct super_block *sb, VOL_INFO_T *info)
 	return(err);
 }
 
+INT32 FsGetAllocStat(struct super_block *sb, ALLOC_STAT_T *stat)
+{
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+
+	if (stat == NULL) return(FFS_ERROR);
+
+	sm_P(&(fs_struct[p_fs->drv].v_sem));
+
+	*stat = p_fs->alloc_stat;
+
+	sm_V(&(fs_struct[p_fs->drv].v_sem));
+
+	return(FFS_SUCCESS);
+}
+
+INT32 FsGetMapStat(struct super_block *sb, MAP_STAT_T *stat)
+{
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+
+	if (stat == NULL) return(FFS_ERROR);
+
+	sm_P(&(fs_struct[p_fs->drv].v_sem));
+
+	*stat = p_fs->map_stat;
+
+	sm_V(&(fs_struct[p_fs->drv].v_sem));
+
+	return(FFS_SUCCESS);
+}
+
 INT32 FsSyncVol(struct super_block *sb, INT32 do_sync)
 {
 	INT32 err;
@@ -417,6 +447,7 @@ INT32 FsRemoveEntry(struct inode *inode, FILE_ID_T *fid)
 EXPORT_SYMBOL(FsMountVol);
 EXPORT_SYMBOL(FsUmountVol);
 EXPORT_SYMBOL(FsGetVolInfo);
+EXPORT_SYMBOL(FsGetAllocStat);
 EXPORT_SYMBOL(FsSyncVol);
 EXPORT_SYMBOL(FsLookupFile);
 EXPORT_SYMBOL(FsCreateFile);
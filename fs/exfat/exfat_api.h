@@ -21,6 +21,7 @@
 
 #include "exfat_config.h"
 #include "exfat_global.h"
+#include "exfat_cache.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -104,6 +105,23 @@ extern "C" {
 		UINT32      UsedClusters;
 	} VOL_INFO_T;
 
+	typedef struct {
+		UINT64      alloc_calls;
+		UINT64      alloc_clusters;
+		UINT64      alloc_ns;
+		UINT64      alloc_max_ns;
+		UINT64      run_allocs;
+		UINT64      frag_breaks;
+	} ALLOC_STAT_T;
+
+	typedef struct {
+		UINT64      map_calls;       /* lookups walking a FAT chain */
+		UINT64      run_hits;        /* served by the cluster run cache */
+		UINT64      fat_reads;       /* FAT entries read by the walks */
+		UINT64      fat_cache_hits;
+		UINT64      fat_cache_misses;
+	} MAP_STAT_T;
+
 	typedef struct {
 		UINT32      dir;
 		INT32       size;
@@ -121,6 +139,7 @@ extern "C" {
 		INT64       rwoffset;
 		INT32       hint_last_off;
 		UINT32      hint_last_clu;
+		CLU_CACHE_T clu_cache;
 	} FILE_ID_T;
 
 	typedef struct {
@@ -140,6 +159,8 @@ extern "C" {
 	INT32 FsMountVol(struct super_block *sb);
 	INT32 FsUmountVol(struct super_block *sb);
 	INT32 FsGetVolInfo(struct super_block *sb, VOL_INFO_T *info);
+	INT32 FsGetAllocStat(struct super_block *sb, ALLOC_STAT_T *stat);
+	INT32 FsGetMapStat(struct super_block *sb, MAP_STAT_T *stat);
 	INT32 FsSyncVol(struct super_block *sb, INT32 do_sync);
 
 	INT32 FsLookupFile(struct inode *inode, UINT8 *path, FILE_ID_T *fid);
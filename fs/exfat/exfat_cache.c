@@ -16,6 +16,8 @@
  *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 
+#include <linux/vmalloc.h>
+
 #include "exfat_config.h"
 #include "exfat_global.h"
 #include "exfat_data.h"
@@ -49,22 +51,36 @@ static void push_to_lru(BUF_CACHE_T *bp, BUF_CACHE_T *list);
 static void move_to_mru(BUF_CACHE_T *bp, BUF_CACHE_T *list);
 static void move_to_lru(BUF_CACHE_T *bp, BUF_CACHE_T *list);
 
+static void *cache_alloc(size_t size)
+{
+	void *p;
+
+	p = kzalloc(size, GFP_KERNEL | __GFP_NOWARN);
+	if (!p)
+		p = vzalloc(size);
+	return p;
+}
+
+static void cache_free(void *p)
+{
+	if (is_vmalloc_addr(p))
+		vfree(p);
+	else
+		kfree(p);
+}
+
 INT32 buf_init(struct super_block *sb)
 {
 	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
 
 	INT32 i;
 
+	/* the FAT cache is sized in FAT_cache_init() once the geometry is known */
 	p_fs->FAT_cache_lru_list.next = p_fs->FAT_cache_lru_list.prev = &p_fs->FAT_cache_lru_list;
-
-	for (i = 0; i < FAT_CACHE_SIZE; i++) {
-		p_fs->FAT_cache_array[i].drv = -1;
-		p_fs->FAT_cache_array[i].sec = ~0;
-		p_fs->FAT_cache_array[i].flag = 0;
-		p_fs->FAT_cache_array[i].buf_bh = NULL;
-		p_fs->FAT_cache_array[i].prev = p_fs->FAT_cache_array[i].next = NULL;
-		push_to_mru(&(p_fs->FAT_cache_array[i]), &p_fs->FAT_cache_lru_list);
-	}
+	p_fs->FAT_cache_array = NULL;
+	p_fs->FAT_cache_hash_list = NULL;
+	p_fs->FAT_cache_size = 0;
+	p_fs->FAT_cache_hash_size = 0;
 
 	p_fs->buf_cache_lru_list.next = p_fs->buf_cache_lru_list.prev = &p_fs->buf_cache_lru_list;
 
@@ -77,16 +93,6 @@ INT32 buf_init(struct super_block *sb)
 		push_to_mru(&(p_fs->buf_cache_array[i]), &p_fs->buf_cache_lru_list);
 	}
 
-	for (i = 0; i < FAT_CACHE_HASH_SIZE; i++) {
-		p_fs->FAT_cache_hash_list[i].drv = -1;
-		p_fs->FAT_cache_hash_list[i].sec = ~0;
-		p_fs->FAT_cache_hash_list[i].hash_next = p_fs->FAT_cache_hash_list[i].hash_prev = &(p_fs->FAT_cache_hash_list[i]);
-	}
-
-	for (i = 0; i < FAT_CACHE_SIZE; i++) {
-		FAT_cache_insert_hash(sb, &(p_fs->FAT_cache_array[i]));
-	}
-
 	for (i = 0; i < BUF_CACHE_HASH_SIZE; i++) {
 		p_fs->buf_cache_hash_list[i].drv = -1;
 		p_fs->buf_cache_hash_list[i].sec = ~0;
@@ -102,6 +108,73 @@ INT32 buf_init(struct super_block *sb)
 
 INT32 buf_shutdown(struct super_block *sb)
 {
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+
+	if (p_fs->FAT_cache_array) {
+		FAT_release_all(sb);
+		p_fs->FAT_cache_lru_list.next = p_fs->FAT_cache_lru_list.prev = &p_fs->FAT_cache_lru_list;
+		cache_free(p_fs->FAT_cache_array);
+		cache_free(p_fs->FAT_cache_hash_list);
+		p_fs->FAT_cache_array = NULL;
+		p_fs->FAT_cache_hash_list = NULL;
+	}
+
+	return(FFS_SUCCESS);
+}
+
+/*
+ * Size the FAT cache from the FAT itself: one entry per 8 FAT sectors,
+ * between FAT_CACHE_SIZE and FAT_CACHE_MAX_SIZE. A 128 GB card with 128 KB
+ * clusters has a 4 MB FAT and gets the maximum, where a fixed 128 entries
+ * covered 64 KB of it. The buffers themselves live in the block device
+ * page cache, so the entries only pin what was recently used.
+ */
+INT32 FAT_cache_init(struct super_block *sb)
+{
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+	UINT32 size, hash_size;
+	INT32 i;
+
+	size = p_fs->num_FAT_sectors >> 3;
+	if (size < FAT_CACHE_SIZE)
+		size = FAT_CACHE_SIZE;
+	if (size > FAT_CACHE_MAX_SIZE)
+		size = FAT_CACHE_MAX_SIZE;
+	hash_size = rounddown_pow_of_two(size >> 1);
+
+	p_fs->FAT_cache_array = cache_alloc(size * sizeof(BUF_CACHE_T));
+	p_fs->FAT_cache_hash_list = cache_alloc(hash_size * sizeof(BUF_CACHE_T));
+	if (!p_fs->FAT_cache_array || !p_fs->FAT_cache_hash_list) {
+		if (p_fs->FAT_cache_array)
+			cache_free(p_fs->FAT_cache_array);
+		if (p_fs->FAT_cache_hash_list)
+			cache_free(p_fs->FAT_cache_hash_list);
+		p_fs->FAT_cache_array = NULL;
+		p_fs->FAT_cache_hash_list = NULL;
+		return FFS_MEMORYERR;
+	}
+	p_fs->FAT_cache_size = size;
+	p_fs->FAT_cache_hash_size = hash_size;
+
+	for (i = 0; i < size; i++) {
+		p_fs->FAT_cache_array[i].drv = -1;
+		p_fs->FAT_cache_array[i].sec = ~0;
+		p_fs->FAT_cache_array[i].flag = 0;
+		p_fs->FAT_cache_array[i].buf_bh = NULL;
+		p_fs->FAT_cache_array[i].prev = p_fs->FAT_cache_array[i].next = NULL;
+		push_to_mru(&(p_fs->FAT_cache_array[i]), &p_fs->FAT_cache_lru_list);
+	}
+
+	for (i = 0; i < hash_size; i++) {
+		p_fs->FAT_cache_hash_list[i].drv = -1;
+		p_fs->FAT_cache_hash_list[i].sec = ~0;
+		p_fs->FAT_cache_hash_list[i].hash_next = p_fs->FAT_cache_hash_list[i].hash_prev = &(p_fs->FAT_cache_hash_list[i]);
+	}
+
+	for (i = 0; i < size; i++) {
+		FAT_cache_insert_hash(sb, &(p_fs->FAT_cache_array[i]));
+	}
+
 	return(FFS_SUCCESS);
 }
 
@@ -357,10 +430,12 @@ UINT8 *FAT_getblk(struct super_block *sb, UINT32 sec)
 
 	bp = FAT_cache_find(sb, sec);
 	if (bp != NULL) {
+		p_fs->map_stat.fat_cache_hits++;
 		move_to_mru(bp, &p_fs->FAT_cache_lru_list);
 		return(bp->buf_bh->b_data);
 	}
 
+	p_fs->map_stat.fat_cache_misses++;
 	bp = FAT_cache_get(sb, sec);
 
 	FAT_cache_remove_hash(bp);
@@ -445,7 +520,7 @@ static BUF_CACHE_T *FAT_cache_find(struct super_block *sb, UINT32 sec)
 	BUF_CACHE_T *bp, *hp;
 	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
 
-	off = (sec + (sec >> p_fs->sectors_per_clu_bits)) & (FAT_CACHE_HASH_SIZE - 1);
+	off = (sec + (sec >> p_fs->sectors_per_clu_bits)) & (p_fs->FAT_cache_hash_size - 1);
 
 	hp = &(p_fs->FAT_cache_hash_list[off]);
 	for (bp = hp->hash_next; bp != hp; bp = bp->hash_next) {
@@ -480,7 +555,7 @@ static void FAT_cache_insert_hash(struct super_block *sb, BUF_CACHE_T *bp)
 	FS_INFO_T *p_fs;
 
 	p_fs = &(EXFAT_SB(sb)->fs_info);
-	off = (bp->sec + (bp->sec >> p_fs->sectors_per_clu_bits)) & (FAT_CACHE_HASH_SIZE-1);
+	off = (bp->sec + (bp->sec >> p_fs->sectors_per_clu_bits)) & (p_fs->FAT_cache_hash_size-1);
 
 	hp = &(p_fs->FAT_cache_hash_list[off]);
 	bp->hash_next = hp->hash_next;
@@ -709,6 +784,61 @@ static void buf_cache_remove_hash(BUF_CACHE_T *bp)
 	(bp->hash_next)->hash_prev = bp->hash_prev;
 }
 
+/*
+ * Per-file cache of contiguous cluster runs, looked up by file cluster
+ * offset. ffsMapCluster() uses it to skip the FAT walk from start_clu for
+ * FAT-chained files; callers serialise on the volume semaphore.
+ */
+void clu_cache_inval(CLU_CACHE_T *cc)
+{
+	cc->nr = 0;
+	cc->clock = 0;
+}
+
+/* find the cached run starting closest below (or at) fclu */
+INT32 clu_cache_lookup(CLU_CACHE_T *cc, UINT32 fclu, CLU_RUN_T *run)
+{
+	INT32 i, best = -1;
+
+	for (i = 0; i < cc->nr; i++) {
+		if (cc->run[i].fclu > fclu)
+			continue;
+		if ((best < 0) || (cc->run[i].fclu > cc->run[best].fclu))
+			best = i;
+	}
+
+	if (best < 0)
+		return FALSE;
+
+	cc->run[best].stamp = ++cc->clock;
+	*run = cc->run[best];
+	return TRUE;
+}
+
+void clu_cache_add(CLU_CACHE_T *cc, UINT32 fclu, UINT32 dclu, UINT32 len)
+{
+	INT32 i, victim = 0;
+
+	for (i = 0; i < cc->nr; i++) {
+		if (cc->run[i].fclu == fclu) {
+			if (len > cc->run[i].len)
+				cc->run[i].len = len;
+			cc->run[i].stamp = ++cc->clock;
+			return;
+		}
+		if (cc->run[i].stamp < cc->run[victim].stamp)
+			victim = i;
+	}
+
+	if (cc->nr < CLU_CACHE_SIZE)
+		victim = cc->nr++;
+
+	cc->run[victim].fclu = fclu;
+	cc->run[victim].dclu = dclu;
+	cc->run[victim].len = len;
+	cc->run[victim].stamp = ++cc->clock;
+}
+
 static void push_to_mru(BUF_CACHE_T *bp, BUF_CACHE_T *list)
 {
 	bp->next = list->next;
@@ -40,8 +40,25 @@ extern "C" {
 		struct buffer_head   *buf_bh;
 	} BUF_CACHE_T;
 
+#define CLU_CACHE_SIZE          8
+
+	/* clusters [fclu, fclu + len) of a file sit at [dclu, dclu + len) */
+	typedef struct {
+		UINT32               fclu;
+		UINT32               dclu;
+		UINT32               len;
+		UINT32               stamp;
+	} CLU_RUN_T;
+
+	typedef struct {
+		CLU_RUN_T            run[CLU_CACHE_SIZE];
+		UINT32               nr;
+		UINT32               clock;
+	} CLU_CACHE_T;
+
 	INT32  buf_init(struct super_block *sb);
 	INT32  buf_shutdown(struct super_block *sb);
+	INT32  FAT_cache_init(struct super_block *sb);
 	INT32  FAT_read(struct super_block *sb, UINT32 loc, UINT32 *content);
 	INT32  FAT_write(struct super_block *sb, UINT32 loc, UINT32 content);
 	UINT8 *FAT_getblk(struct super_block *sb, UINT32 sec);
@@ -55,6 +72,9 @@ extern "C" {
 	void   buf_release(struct super_block *sb, UINT32 sec);
 	void   buf_release_all(struct super_block *sb);
 	void   buf_sync(struct super_block *sb);
+	void   clu_cache_inval(CLU_CACHE_T *cc);
+	INT32  clu_cache_lookup(CLU_CACHE_T *cc, UINT32 fclu, CLU_RUN_T *run);
+	void   clu_cache_add(CLU_CACHE_T *cc, UINT32 fclu, UINT32 dclu, UINT32 len);
 
 #ifdef __cplusplus
 }
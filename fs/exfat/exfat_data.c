@@ -30,9 +30,6 @@
 FS_STRUCT_T fs_struct[MAX_DRIVE];
 
 DECLARE_MUTEX(f_sem);
-BUF_CACHE_T FAT_cache_array[FAT_CACHE_SIZE];
-BUF_CACHE_T FAT_cache_lru_list;
-BUF_CACHE_T FAT_cache_hash_list[FAT_CACHE_HASH_SIZE];
 
 DECLARE_MUTEX(b_sem);
 BUF_CACHE_T buf_cache_array[BUF_CACHE_SIZE];
@@ -28,7 +28,7 @@ extern "C" {
 #define MAX_OPEN                20
 #define MAX_DENTRY              512
 #define FAT_CACHE_SIZE          128
-#define FAT_CACHE_HASH_SIZE     64
+#define FAT_CACHE_MAX_SIZE      1024
 #define BUF_CACHE_SIZE          256
 #define BUF_CACHE_HASH_SIZE     64
 #define DEFAULT_CODEPAGE        437
@@ -745,16 +745,38 @@ static long exfat_generic_ioctl(struct file *filp,
 								unsigned int cmd, unsigned long arg)
 #endif
 {
-#if EXFAT_CONFIG_KERNEL_DEBUG
 #if !(LINUX_VERSION_CODE < KERNEL_VERSION(2,6,36))
 	struct inode *inode = filp->f_dentry->d_inode;
 #endif
+#if EXFAT_CONFIG_KERNEL_DEBUG
 	unsigned int flags;
 #endif
 
 	switch (cmd) {
 	case EXFAT_IOCTL_GET_VOLUME_ID:
 		return exfat_ioctl_volume_id(inode);
+	case EXFAT_IOC_GET_ALLOC_STAT: {
+		ALLOC_STAT_T stat;
+
+		if (FsGetAllocStat(inode->i_sb, &stat))
+			return -EIO;
+
+		if (copy_to_user((ALLOC_STAT_T __user *) arg, &stat, sizeof(stat)))
+			return -EFAULT;
+
+		return 0;
+	}
+	case EXFAT_IOC_GET_MAP_STAT: {
+		MAP_STAT_T stat;
+
+		if (FsGetMapStat(inode->i_sb, &stat))
+			return -EIO;
+
+		if (copy_to_user((MAP_STAT_T __user *) arg, &stat, sizeof(stat)))
+			return -EFAULT;
+
+		return 0;
+	}
 #if EXFAT_CONFIG_KERNEL_DEBUG
 	case EXFAT_IOC_GET_DEBUGFLAGS: {
 		struct super_block *sb = inode->i_sb;
@@ -2460,6 +2482,7 @@ static int exfat_read_root(struct inode *inode)
 	EXFAT_I(inode)->fid.type = TYPE_DIR;
 	EXFAT_I(inode)->fid.rwoffset = 0;
 	EXFAT_I(inode)->fid.hint_last_off = -1;
+	clu_cache_inval(&(EXFAT_I(inode)->fid.clu_cache));
 
 	EXFAT_I(inode)->target = NULL;
 
@@ -16,6 +16,7 @@
 #include <linux/f2fs_fs.h>
 #include <linux/pagevec.h>
 #include <linux/swap.h>
+#include <linux/workqueue.h>
 
 #include "f2fs.h"
 #include "node.h"
@@ -25,6 +26,7 @@
 
 static struct kmem_cache *ino_entry_slab;
 struct kmem_cache *inode_entry_slab;
+static struct workqueue_struct *f2fs_cp_wq;
 
 /*
  * We guarantee no failure on the returned page.
@@ -843,7 +845,7 @@ retry:
 /*
  * Freeze all the FS-operations for checkpoint.
  */
-static int block_operations(struct f2fs_sb_info *sbi)
+static int block_operations(struct f2fs_sb_info *sbi, ktime_t *blocked)
 {
 	struct writeback_control wbc = {
 		.sync_mode = WB_SYNC_ALL,
@@ -865,6 +867,8 @@ retry_flush_dents:
 			goto out;
 		goto retry_flush_dents;
 	}
+	/* every writer is held off from here to unblock_operations() */
+	*blocked = ktime_get();
 
 	/*
 	 * POR: we should ensure that there are no dirty node pages
@@ -925,6 +929,7 @@ static int do_checkpoint(struct f2fs_sb_info *sbi, struct cp_control *cpc)
 	struct super_block *sb = sbi->sb;
 	struct curseg_info *seg_i = CURSEG_I(sbi, CURSEG_HOT_NODE);
 	u64 kbytes_written;
+	struct blk_plug plug;
 
 	/*
 	 * This avoids to conduct wrong roll-forward operations and uses
@@ -933,12 +938,20 @@ static int do_checkpoint(struct f2fs_sb_info *sbi, struct cp_control *cpc)
 	if (discard_next_dnode(sbi, discard_blk))
 		invalidate = true;
 
-	/* Flush all the NAT/SIT pages */
+	/*
+	 * Flush all the NAT/SIT pages. They are written in index order, so
+	 * the merged META bio keeps growing across runs of adjacent blocks;
+	 * the plug holds the bios back until the whole set is queued.
+	 */
+	blk_start_plug(&plug);
 	while (get_pages(sbi, F2FS_DIRTY_META)) {
 		sync_meta_pages(sbi, META, LONG_MAX);
-		if (unlikely(f2fs_cp_error(sbi)))
+		if (unlikely(f2fs_cp_error(sbi))) {
+			blk_finish_plug(&plug);
 			return -EIO;
+		}
 	}
+	blk_finish_plug(&plug);
 
 	next_free_nid(sbi, &last_nid);
 
@@ -1092,6 +1105,47 @@ static int do_checkpoint(struct f2fs_sb_info *sbi, struct cp_control *cpc)
 	return 0;
 }
 
+struct nat_flush_work {
+	struct work_struct work;
+	struct f2fs_sb_info *sbi;
+};
+
+static void flush_nat_entries_work(struct work_struct *work)
+{
+	struct nat_flush_work *nfw = container_of(work,
+					struct nat_flush_work, work);
+
+	flush_nat_entries(nfw->sbi);
+}
+
+/*
+ * NAT and SIT entries live in separate meta areas and are journalled in
+ * different cursegs (hot and cold data), so the two flushes share no
+ * state. Most of their time goes into reading in the NAT/SIT blocks they
+ * update, so run the NAT side on a worker while the SIT side runs here.
+ */
+static void flush_nat_sit_entries(struct f2fs_sb_info *sbi,
+						struct cp_control *cpc)
+{
+	struct nat_flush_work nfw;
+
+	if (!f2fs_cp_wq || !NM_I(sbi)->dirty_nat_cnt ||
+					!SIT_I(sbi)->dirty_sentries) {
+		flush_nat_entries(sbi);
+		flush_sit_entries(sbi, cpc);
+		return;
+	}
+
+	nfw.sbi = sbi;
+	INIT_WORK_ONSTACK(&nfw.work, flush_nat_entries_work);
+	queue_work(f2fs_cp_wq, &nfw.work);
+
+	flush_sit_entries(sbi, cpc);
+
+	flush_work(&nfw.work);
+	destroy_work_on_stack(&nfw.work);
+}
+
 /*
  * We guarantee that this checkpoint procedure will not fail.
  */
@@ -1099,6 +1153,7 @@ int write_checkpoint(struct f2fs_sb_info *sbi, struct cp_control *cpc)
 {
 	struct f2fs_checkpoint *ckpt = F2FS_CKPT(sbi);
 	unsigned long long ckpt_ver;
+	ktime_t start_time, blocked_time, end_time;
 	int err = 0;
 
 	mutex_lock(&sbi->cp_mutex);
@@ -1118,7 +1173,8 @@ int write_checkpoint(struct f2fs_sb_info *sbi, struct cp_control *cpc)
 
 	trace_f2fs_write_checkpoint(sbi->sb, cpc->reason, "start block_ops");
 
-	err = block_operations(sbi);
+	start_time = ktime_get();
+	err = block_operations(sbi, &blocked_time);
 	if (err)
 		goto out;
 
@@ -1137,14 +1193,16 @@ int write_checkpoint(struct f2fs_sb_info *sbi, struct cp_control *cpc)
 	ckpt->checkpoint_ver = cpu_to_le64(++ckpt_ver);
 
 	/* write cached NAT/SIT entries to NAT/SIT area */
-	flush_nat_entries(sbi);
-	flush_sit_entries(sbi, cpc);
+	flush_nat_sit_entries(sbi, cpc);
 
 	/* unlock all the fs_lock[] in do_checkpoint() */
 	err = do_checkpoint(sbi, cpc);
 
 	unblock_operations(sbi);
 	stat_inc_cp_count(sbi->stat_info);
+	end_time = ktime_get();
+	stat_cp_latency(sbi, ktime_to_ms(ktime_sub(end_time, blocked_time)),
+			ktime_to_ms(ktime_sub(end_time, start_time)));
 
 	if (cpc->reason == CP_RECOVERY)
 		f2fs_msg(sbi->sb, KERN_NOTICE,
@@ -1188,11 +1246,20 @@ int __init create_checkpoint_caches(void)
 		kmem_cache_destroy(ino_entry_slab);
 		return -ENOMEM;
 	}
+	/*
+	 * NAT flush worker; it runs with every fs operation blocked, so it
+	 * needs a rescuer rather than waiting on a new kworker under reclaim.
+	 * Without it checkpoints just flush NAT and SIT in turn.
+	 */
+	f2fs_cp_wq = alloc_workqueue("f2fs_cp",
+					WQ_MEM_RECLAIM | WQ_UNBOUND, 0);
 	return 0;
 }
 
 void destroy_checkpoint_caches(void)
 {
+	if (f2fs_cp_wq)
+		destroy_workqueue(f2fs_cp_wq);
 	kmem_cache_destroy(ino_entry_slab);
 	kmem_cache_destroy(inode_entry_slab);
 }
@@ -41,6 +41,8 @@ static void update_general_status(struct f2fs_sb_info *sbi)
 	si->ext_tree = atomic_read(&sbi->total_ext_tree);
 	si->zombie_tree = atomic_read(&sbi->total_zombie_tree);
 	si->ext_node = atomic_read(&sbi->total_ext_node);
+	si->ext_evict = atomic64_read(&sbi->ext_cache_evict);
+	si->ext_precache = atomic64_read(&sbi->ext_cache_precache);
 	si->ndirty_node = get_pages(sbi, F2FS_DIRTY_NODES);
 	si->ndirty_dent = get_pages(sbi, F2FS_DIRTY_DENTS);
 	si->ndirty_meta = get_pages(sbi, F2FS_DIRTY_META);
@@ -274,6 +276,20 @@ static int stat_show(struct seq_file *s, void *v)
 			   si->prefree_count, si->free_segs, si->free_secs);
 		seq_printf(s, "CP calls: %d (BG: %d)\n",
 				si->cp_count, si->bg_cp_count);
+		seq_printf(s, "  - blocked : %u ms (max: %u ms)\n",
+				si->last_cp_blocked_ms, si->max_cp_blocked_ms);
+		seq_puts(s, "  - latency (ms) : blocked / total\n");
+		for (j = 0; j < CP_LAT_BUCKETS; j++) {
+			if (j == 0)
+				seq_puts(s, "        <1 : ");
+			else if (j == CP_LAT_BUCKETS - 1)
+				seq_printf(s, "    >=%-5u: ", 1U << (j - 1));
+			else
+				seq_printf(s, "  %4u-%-4u: ", 1U << (j - 1),
+						(1U << j) - 1);
+			seq_printf(s, "%u / %u\n", si->cp_blocked_hist[j],
+					si->cp_total_hist[j]);
+		}
 		seq_printf(s, "GC calls: %d (BG: %d)\n",
 			   si->call_count, si->bg_gc);
 		seq_printf(s, "  - data segments : %d (%d)\n",
@@ -286,6 +302,13 @@ static int stat_show(struct seq_file *s, void *v)
 				si->bg_data_blks);
 		seq_printf(s, "  - node blocks : %d (%d)\n", si->node_blks,
 				si->bg_node_blks);
+		seq_printf(s, "Last GC run: %u segments, %u blocks, %u ms\n",
+				si->last_gc_segs, si->last_gc_blks,
+				si->last_gc_ms);
+		seq_printf(s, "  - GC time : %llu ms (max run: %u ms)\n",
+				si->tot_gc_ms, si->max_gc_ms);
+		seq_printf(s, "  - victims : %u cached, %u scans\n",
+				si->victim_hits, si->victim_scans);
 		seq_puts(s, "\nExtent Cache:\n");
 		seq_printf(s, "  - Hit Count: L1-1:%llu L1-2:%llu L2:%llu\n",
 				si->hit_largest, si->hit_cached,
@@ -296,6 +319,8 @@ static int stat_show(struct seq_file *s, void *v)
 				si->hit_total, si->total_ext);
 		seq_printf(s, "  - Inner Struct Count: tree: %d(%d), node: %d\n",
 				si->ext_tree, si->zombie_tree, si->ext_node);
+		seq_printf(s, "  - Shrunk: %llu, Preloaded: %llu\n",
+				si->ext_evict, si->ext_precache);
 		seq_puts(s, "\nBalancing F2FS Async:\n");
 		seq_printf(s, "  - inmem: %4d, wb: %4d\n",
 			   si->inmem_pages, si->wb_pages);
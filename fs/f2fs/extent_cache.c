@@ -249,6 +249,10 @@ static bool f2fs_lookup_extent_tree(struct inode *inode, pgoff_t pgofs,
 	}
 out:
 	stat_inc_total_hit(sbi);
+	if (ret)
+		atomic64_inc(&sbi->ext_cache_hit);
+	else
+		atomic64_inc(&sbi->ext_cache_miss);
 	read_unlock(&et->lock);
 
 	trace_f2fs_lookup_extent_tree_end(inode, pgofs, ei);
@@ -597,6 +601,7 @@ free_node:
 		spin_unlock(&sbi->extent_lock);
 
 		__detach_extent_node(sbi, et, en);
+		et->precached = false;
 
 		write_unlock(&et->lock);
 		node_cnt++;
@@ -607,6 +612,7 @@ free_node:
 unlock_out:
 	up_write(&sbi->extent_tree_lock);
 out:
+	atomic64_add(node_cnt + tree_cnt, &sbi->ext_cache_evict);
 	trace_f2fs_shrink_extent_tree(sbi, node_cnt, tree_cnt);
 
 	return node_cnt + tree_cnt;
@@ -699,6 +705,76 @@ void f2fs_update_extent_cache_range(struct dnode_of_data *dn,
 		sync_inode_page(dn);
 }
 
+/*
+ * Load the whole block map of @inode into its extent tree, so the first
+ * faults on a freshly exec-mapped file find their blocks without walking
+ * node pages. Only the in-memory tree is filled; i_ext on disk is left
+ * alone, so this never dirties the inode.
+ */
+void f2fs_precache_extents(struct inode *inode)
+{
+	struct f2fs_sb_info *sbi = F2FS_I_SB(inode);
+	struct extent_tree *et = F2FS_I(inode)->extent_tree;
+	struct dnode_of_data dn;
+	pgoff_t pgofs = 0, start = 0, end;
+	block_t blkaddr, start_blk = NULL_ADDR;
+	unsigned int len = 0, end_offset, count = 0;
+	int err;
+
+	if (!sbi->extent_precache || !et || et->precached ||
+					!f2fs_may_extent_tree(inode))
+		return;
+
+	end = DIV_ROUND_UP(i_size_read(inode), PAGE_CACHE_SIZE);
+
+	while (pgofs < end) {
+		set_new_dnode(&dn, inode, NULL, NULL, 0);
+		err = get_dnode_of_data(&dn, pgofs, LOOKUP_NODE_RA);
+		if (err == -ENOENT) {
+			pgofs = PGOFS_OF_NEXT_DNODE(pgofs, inode);
+			continue;
+		} else if (err) {
+			return;
+		}
+
+		/* extents may run on across dnodes; the tree merges them */
+		end_offset = ADDRS_PER_PAGE(dn.node_page, inode);
+		for (; dn.ofs_in_node < end_offset && pgofs < end;
+					dn.ofs_in_node++, pgofs++) {
+			blkaddr = datablock_addr(dn.node_page, dn.ofs_in_node);
+			if (len && blkaddr == start_blk + len) {
+				len++;
+				continue;
+			}
+			if (len) {
+				f2fs_update_extent_tree_range(inode, start,
+							start_blk, len);
+				count++;
+				len = 0;
+			}
+			if (blkaddr == NULL_ADDR || blkaddr == NEW_ADDR)
+				continue;
+			start = pgofs;
+			start_blk = blkaddr;
+			len = 1;
+		}
+		if (len) {
+			f2fs_update_extent_tree_range(inode, start,
+							start_blk, len);
+			count++;
+			len = 0;
+		}
+		f2fs_put_dnode(&dn);
+		cond_resched();
+	}
+
+	write_lock(&et->lock);
+	et->precached = true;
+	write_unlock(&et->lock);
+
+	atomic64_add(count, &sbi->ext_cache_precache);
+}
+
 void init_extent_cache_info(struct f2fs_sb_info *sbi)
 {
 	INIT_RADIX_TREE(&sbi->extent_tree_root, GFP_NOIO);
@@ -709,6 +785,11 @@ void init_extent_cache_info(struct f2fs_sb_info *sbi)
 	INIT_LIST_HEAD(&sbi->zombie_list);
 	atomic_set(&sbi->total_zombie_tree, 0);
 	atomic_set(&sbi->total_ext_node, 0);
+	atomic64_set(&sbi->ext_cache_hit, 0);
+	atomic64_set(&sbi->ext_cache_miss, 0);
+	atomic64_set(&sbi->ext_cache_evict, 0);
+	atomic64_set(&sbi->ext_cache_precache, 0);
+	sbi->extent_precache = 1;
 }
 
 int __init create_extent_cache(void)
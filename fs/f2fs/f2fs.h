@@ -385,6 +385,7 @@ struct extent_tree {
 	struct list_head list;		/* to be used by sbi->zombie_list */
 	rwlock_t lock;			/* protect extent info rb-tree */
 	atomic_t node_cnt;		/* # of extent node in rb-tree*/
+	bool precached;			/* whole block map loaded */
 };
 
 /*
@@ -625,6 +626,38 @@ struct flush_cmd_control {
 	struct llist_node *dispatch_list;	/* list for command dispatch */
 };
 
+#define DEF_DISCARD_INTERVAL		50	/* ms between issue rounds */
+#define DEF_MAX_DISCARD_ISSUE		8	/* commands per round */
+#define DEF_MAX_DISCARD_LEN		2048	/* blocks per command */
+#define DEF_DISCARD_URGENT_BLOCKS	262144	/* issue even when busy */
+
+struct discard_cmd {
+	struct rb_node rb_node;		/* in discard_cmd_control's tree */
+	block_t lstart;			/* start block address */
+	block_t len;			/* # of blocks */
+};
+
+struct discard_cmd_control {
+	struct task_struct *f2fs_issue_discard;	/* discard thread */
+	wait_queue_head_t discard_wait_queue;	/* waiting queue for wake-up */
+	wait_queue_head_t issue_wait_queue;	/* waiting on an issued range */
+	struct mutex issue_mutex;		/* one issuer at a time */
+	spinlock_t lock;			/* protects the fields below */
+	struct rb_root root;			/* merged pending ranges */
+	block_t issuing_start;			/* range being issued */
+	block_t issuing_len;
+	unsigned int nr_pending;		/* # of pending extents */
+	unsigned int pending_blks;		/* # of pending blocks */
+	unsigned int nr_issued;			/* # of issued commands */
+	unsigned int issued_blks;		/* # of issued blocks */
+
+	/* tunables, exported in sysfs */
+	unsigned int discard_interval;
+	unsigned int max_discard_issue;
+	unsigned int max_discard_len;
+	unsigned int discard_urgent_blks;
+};
+
 struct f2fs_sm_info {
 	struct sit_info *sit_info;		/* whole segment information */
 	struct free_segmap_info *free_info;	/* free segment information */
@@ -660,6 +693,8 @@ struct f2fs_sm_info {
 	/* for flush command control */
 	struct flush_cmd_control *cmd_control_info;
 
+	/* for asynchronous discard */
+	struct discard_cmd_control *dcc_info;
 };
 
 /*
@@ -798,6 +833,11 @@ struct f2fs_sb_info {
 	struct list_head zombie_list;		/* extent zombie tree list */
 	atomic_t total_zombie_tree;		/* extent zombie tree count */
 	atomic_t total_ext_node;		/* extent info count */
+	atomic64_t ext_cache_hit;		/* # of extent cache hits */
+	atomic64_t ext_cache_miss;		/* # of extent cache misses */
+	atomic64_t ext_cache_evict;		/* # of nodes/trees shrunk */
+	atomic64_t ext_cache_precache;		/* # of extents preloaded */
+	unsigned int extent_precache;		/* preload on exec mmap */
 
 	/* basic filesystem units */
 	unsigned int log_sectors_per_block;	/* log2 sectors per block */
@@ -1859,12 +1899,14 @@ void f2fs_balance_fs_bg(struct f2fs_sb_info *);
 int f2fs_issue_flush(struct f2fs_sb_info *);
 int create_flush_cmd_control(struct f2fs_sb_info *);
 void destroy_flush_cmd_control(struct f2fs_sb_info *);
+int create_discard_cmd_control(struct f2fs_sb_info *);
 void invalidate_blocks(struct f2fs_sb_info *, block_t);
 bool is_checkpointed_data(struct f2fs_sb_info *, block_t);
 void refresh_sit_entry(struct f2fs_sb_info *, block_t, block_t);
 void clear_prefree_segments(struct f2fs_sb_info *, struct cp_control *);
 void release_discard_addrs(struct f2fs_sb_info *);
 bool discard_next_dnode(struct f2fs_sb_info *, block_t);
+void f2fs_flush_discards(struct f2fs_sb_info *);
 int npages_for_summary_flush(struct f2fs_sb_info *, bool);
 void allocate_new_segments(struct f2fs_sb_info *);
 int f2fs_trim_fs(struct f2fs_sb_info *, struct fstrim_range *);
@@ -1959,6 +2001,17 @@ bool space_for_roll_forward(struct f2fs_sb_info *);
  * debug.c
  */
 #ifdef CONFIG_F2FS_STAT_FS
+/*
+ * checkpoint latency histogram: bucket 0 counts runs under 1ms, bucket n
+ * counts [2^(n-1), 2^n) ms and the last one everything from 1s up.
+ */
+#define CP_LAT_BUCKETS		12
+
+static inline unsigned int cp_lat_bucket(unsigned int ms)
+{
+	return min_t(unsigned int, fls(ms), CP_LAT_BUCKETS - 1);
+}
+
 struct f2fs_stat_info {
 	struct list_head stat_list;
 	struct f2fs_sb_info *sbi;
@@ -1967,6 +2020,7 @@ struct f2fs_stat_info {
 	unsigned long long hit_largest, hit_cached, hit_rbtree;
 	unsigned long long hit_total, total_ext;
 	int ext_tree, zombie_tree, ext_node;
+	unsigned long long ext_evict, ext_precache;
 	int ndirty_node, ndirty_meta;
 	int ndirty_dent, ndirty_dirs, ndirty_data, ndirty_files;
 	int nats, dirty_nats, sits, dirty_sits, fnids;
@@ -1983,6 +2037,12 @@ struct f2fs_stat_info {
 	int bg_node_segs, bg_data_segs;
 	int tot_blks, data_blks, node_blks;
 	int bg_data_blks, bg_node_blks;
+	unsigned int last_gc_segs, last_gc_blks, last_gc_ms, max_gc_ms;
+	unsigned long long tot_gc_ms;
+	unsigned int victim_hits, victim_scans;
+	unsigned int last_cp_blocked_ms, max_cp_blocked_ms;
+	unsigned int cp_blocked_hist[CP_LAT_BUCKETS];
+	unsigned int cp_total_hist[CP_LAT_BUCKETS];
 	int curseg[NR_CURSEG_TYPE];
 	int cursec[NR_CURSEG_TYPE];
 	int curzone[NR_CURSEG_TYPE];
@@ -2002,6 +2062,27 @@ static inline struct f2fs_stat_info *F2FS_STAT(struct f2fs_sb_info *sbi)
 #define stat_inc_bg_cp_count(si)	((si)->bg_cp_count++)
 #define stat_inc_call_count(si)		((si)->call_count++)
 #define stat_inc_bggc_count(sbi)	((sbi)->bg_gc++)
+#define stat_inc_victim_hit(sbi)	((F2FS_STAT(sbi))->victim_hits++)
+#define stat_inc_victim_scan(sbi)	((F2FS_STAT(sbi))->victim_scans++)
+#define stat_tot_blk_count(sbi)		((F2FS_STAT(sbi))->tot_blks)
+#define stat_gc_run(sbi, segs, blks, ms)				\
+	do {								\
+		struct f2fs_stat_info *si = F2FS_STAT(sbi);		\
+		si->last_gc_segs = (segs);				\
+		si->last_gc_blks = (blks);				\
+		si->last_gc_ms = (ms);					\
+		si->max_gc_ms = max(si->max_gc_ms, si->last_gc_ms);	\
+		si->tot_gc_ms += si->last_gc_ms;			\
+	} while (0)
+#define stat_cp_latency(sbi, blocked, total)				\
+	do {								\
+		struct f2fs_stat_info *si = F2FS_STAT(sbi);		\
+		si->last_cp_blocked_ms = (blocked);			\
+		si->max_cp_blocked_ms = max(si->max_cp_blocked_ms,	\
+					si->last_cp_blocked_ms);	\
+		si->cp_blocked_hist[cp_lat_bucket(si->last_cp_blocked_ms)]++; \
+		si->cp_total_hist[cp_lat_bucket(total)]++;		\
+	} while (0)
 #define stat_inc_dirty_inode(sbi, type)	((sbi)->ndirty_inode[type]++)
 #define stat_dec_dirty_inode(sbi, type)	((sbi)->ndirty_inode[type]--)
 #define stat_inc_total_hit(sbi)		(atomic64_inc(&(sbi)->total_hit_ext))
@@ -2085,6 +2166,11 @@ void f2fs_destroy_root_stats(void);
 #define stat_inc_bg_cp_count(si)
 #define stat_inc_call_count(si)
 #define stat_inc_bggc_count(si)
+#define stat_inc_victim_hit(sbi)
+#define stat_inc_victim_scan(sbi)
+#define stat_tot_blk_count(sbi)		0
+#define stat_gc_run(sbi, segs, blks, ms)
+#define stat_cp_latency(sbi, blocked, total)
 #define stat_inc_dirty_inode(sbi, type)
 #define stat_dec_dirty_inode(sbi, type)
 #define stat_inc_total_hit(sb)
@@ -2167,6 +2253,7 @@ bool f2fs_lookup_extent_cache(struct inode *, pgoff_t, struct extent_info *);
 void f2fs_update_extent_cache(struct dnode_of_data *);
 void f2fs_update_extent_cache_range(struct dnode_of_data *dn,
 						pgoff_t, block_t, unsigned int);
+void f2fs_precache_extents(struct inode *);
 void init_extent_cache_info(struct f2fs_sb_info *);
 int __init create_extent_cache(void);
 void destroy_extent_cache(void);
@@ -449,6 +449,10 @@ static int f2fs_file_mmap(struct file *file, struct vm_area_struct *vma)
 	if (err)
 		return err;
 
+	/* code is faulted in randomly, so have its block map ready */
+	if (vma->vm_flags & VM_EXEC)
+		f2fs_precache_extents(inode);
+
 	file_accessed(file);
 	vma->vm_ops = &f2fs_file_vm_ops;
 	return 0;
@@ -64,7 +64,10 @@ static int gc_thread_func(void *data)
 			continue;
 
 		if (!is_idle(sbi)) {
-			increase_sleep_time(gc_th, &wait_ms);
+			if (has_enough_invalid_blocks(sbi))
+				wait_ms = idle_wait_time(sbi, gc_th);
+			else
+				increase_sleep_time(gc_th, &wait_ms);
 			mutex_unlock(&sbi->gc_mutex);
 			continue;
 		}
@@ -105,6 +108,7 @@ int start_gc_thread(struct f2fs_sb_info *sbi)
 	gc_th->min_sleep_time = DEF_GC_THREAD_MIN_SLEEP_TIME;
 	gc_th->max_sleep_time = DEF_GC_THREAD_MAX_SLEEP_TIME;
 	gc_th->no_gc_sleep_time = DEF_GC_THREAD_NOGC_SLEEP_TIME;
+	gc_th->idle_poll_time = DEF_GC_THREAD_IDLE_POLL_TIME;
 
 	gc_th->gc_idle = 0;
 
@@ -257,6 +261,70 @@ static unsigned int count_bits(const unsigned long *addr,
 	return sum;
 }
 
+static void insert_cached_victim(struct victim_cache *vc, unsigned int segno,
+				unsigned int vblocks, unsigned int cost)
+{
+	unsigned int i;
+
+	if (vc->nr == VICTIM_CACHE_SIZE &&
+			cost >= vc->entry[VICTIM_CACHE_SIZE - 1].cost)
+		return;
+
+	for (i = 0; i < vc->nr; i++)
+		if (cost < vc->entry[i].cost)
+			break;
+
+	if (vc->nr < VICTIM_CACHE_SIZE)
+		vc->nr++;
+	memmove(&vc->entry[i + 1], &vc->entry[i],
+			(vc->nr - 1 - i) * sizeof(struct victim_entry));
+	vc->entry[i].segno = segno;
+	vc->entry[i].vblocks = vblocks;
+	vc->entry[i].cost = cost;
+}
+
+/*
+ * Take the cheapest cached section that is still a valid victim.  A
+ * section whose valid blocks changed since it was costed goes back in
+ * with its new cost, so only the sections actually looked at here are
+ * recomputed.
+ */
+static unsigned int get_cached_victim(struct f2fs_sb_info *sbi,
+				struct victim_sel_policy *p, int gc_type)
+{
+	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
+	struct victim_cache *vc = &dirty_i->vcache[p->gc_mode];
+
+	if (time_after(jiffies, vc->expires))
+		vc->nr = 0;
+
+	while (vc->nr) {
+		struct victim_entry ve = vc->entry[0];
+		unsigned int secno = GET_SECNO(sbi, ve.segno);
+		unsigned int vblocks;
+
+		vc->nr--;
+		memmove(&vc->entry[0], &vc->entry[1],
+				vc->nr * sizeof(struct victim_entry));
+
+		if (!count_bits(p->dirty_segmap, ve.segno, p->ofs_unit))
+			continue;
+		if (sec_usage_check(sbi, secno))
+			continue;
+		if (gc_type == BG_GC && test_bit(secno, dirty_i->victim_secmap))
+			continue;
+
+		vblocks = get_valid_blocks(sbi, ve.segno, sbi->segs_per_sec);
+		if (vblocks != ve.vblocks) {
+			insert_cached_victim(vc, ve.segno, vblocks,
+					get_gc_cost(sbi, ve.segno, p));
+			continue;
+		}
+		return ve.segno;
+	}
+	return NULL_SEGNO;
+}
+
 /*
  * This function is called from two paths.
  * One is garbage collection and the other is SSR segment selection.
@@ -291,6 +359,15 @@ static int get_victim_by_default(struct f2fs_sb_info *sbi,
 			goto got_it;
 	}
 
+	if (p.alloc_mode == LFS) {
+		p.min_segno = get_cached_victim(sbi, &p, gc_type);
+		if (p.min_segno != NULL_SEGNO) {
+			stat_inc_victim_hit(sbi);
+			goto got_it;
+		}
+		stat_inc_victim_scan(sbi);
+	}
+
 	while (1) {
 		unsigned long cost;
 		unsigned int segno;
@@ -326,6 +403,14 @@ static int get_victim_by_default(struct f2fs_sb_info *sbi,
 
 		cost = get_gc_cost(sbi, segno, &p);
 
+		if (p.alloc_mode == LFS && cost < max_cost) {
+			unsigned int start = segno - segno % p.ofs_unit;
+
+			insert_cached_victim(&dirty_i->vcache[p.gc_mode], start,
+				get_valid_blocks(sbi, start, sbi->segs_per_sec),
+				cost);
+		}
+
 		if (p.min_cost > cost) {
 			p.min_segno = segno;
 			p.min_cost = cost;
@@ -336,6 +421,13 @@ next:
 			break;
 		}
 	}
+
+	/* the cheapest one found is at the head of the fresh cache */
+	if (p.alloc_mode == LFS) {
+		dirty_i->vcache[p.gc_mode].expires = jiffies + VICTIM_CACHE_TTL;
+		p.min_segno = get_cached_victim(sbi, &p, gc_type);
+	}
+
 	if (p.min_segno != NULL_SEGNO) {
 got_it:
 		if (p.alloc_mode == LFS) {
@@ -847,6 +939,9 @@ int f2fs_gc(struct f2fs_sb_info *sbi, bool sync)
 	unsigned int segno;
 	int gc_type = sync ? FG_GC : BG_GC;
 	int sec_freed = 0, seg_freed;
+	unsigned long start_time = jiffies;
+	unsigned int nr_segs = 0;
+	int start_blks = stat_tot_blk_count(sbi);
 	int ret = -EINVAL;
 	struct cp_control cpc;
 	struct gc_inode_list gc_list = {
@@ -883,6 +978,7 @@ gc_more:
 	ret = 0;
 
 	seg_freed = do_garbage_collect(sbi, segno, &gc_list, gc_type);
+	nr_segs += sbi->segs_per_sec;
 
 	if (gc_type == FG_GC && seg_freed == sbi->segs_per_sec)
 		sec_freed++;
@@ -902,6 +998,10 @@ stop:
 
 	put_gc_inode(&gc_list);
 
+	if (nr_segs)
+		stat_gc_run(sbi, nr_segs, stat_tot_blk_count(sbi) - start_blks,
+				jiffies_to_msecs(jiffies - start_time));
+
 	if (sync)
 		ret = sec_freed ? 0 : -EAGAIN;
 	return ret;
@@ -16,6 +16,7 @@
 #define DEF_GC_THREAD_MIN_SLEEP_TIME	30000	/* milliseconds */
 #define DEF_GC_THREAD_MAX_SLEEP_TIME	60000
 #define DEF_GC_THREAD_NOGC_SLEEP_TIME	300000	/* wait 5 min */
+#define DEF_GC_THREAD_IDLE_POLL_TIME	200	/* recheck idleness */
 #define LIMIT_INVALID_BLOCK	40 /* percentage over total user space */
 #define LIMIT_FREE_BLOCK	40 /* percentage over invalid + free space */
 
@@ -30,6 +31,7 @@ struct f2fs_gc_kthread {
 	unsigned int min_sleep_time;
 	unsigned int max_sleep_time;
 	unsigned int no_gc_sleep_time;
+	unsigned int idle_poll_time;
 
 	/* for changing gc mode */
 	unsigned int gc_idle;
@@ -86,6 +88,24 @@ static inline void decrease_sleep_time(struct f2fs_gc_kthread *gc_th,
 		*wait = gc_th->min_sleep_time;
 }
 
+/*
+ * With garbage to collect but foreground I/O going on, sleep only until
+ * idle_interval has passed since the last request, when is_idle() can
+ * first succeed, instead of backing off towards max_sleep_time.
+ */
+static inline long idle_wait_time(struct f2fs_sb_info *sbi,
+					struct f2fs_gc_kthread *gc_th)
+{
+	struct timespec ts = {sbi->interval_time[REQ_TIME], 0};
+	unsigned long idle_at = sbi->last_time[REQ_TIME] +
+					timespec_to_jiffies(&ts);
+	long wait = 0;
+
+	if (time_before(jiffies, idle_at))
+		wait = jiffies_to_msecs(idle_at - jiffies);
+	return max_t(long, wait, gc_th->idle_poll_time);
+}
+
 static inline bool has_enough_invalid_blocks(struct f2fs_sb_info *sbi)
 {
 	block_t invalid_user_blocks = sbi->user_block_count -
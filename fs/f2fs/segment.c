@@ -16,6 +16,7 @@
 #include <linux/kthread.h>
 #include <linux/swap.h>
 #include <linux/timer.h>
+#include <linux/freezer.h>
 
 #include "f2fs.h"
 #include "segment.h"
@@ -26,6 +27,7 @@
 #define __reverse_ffz(x) __reverse_ffs(~(x))
 
 static struct kmem_cache *discard_entry_slab;
+static struct kmem_cache *discard_cmd_slab;
 static struct kmem_cache *sit_entry_set_slab;
 static struct kmem_cache *inmem_entry_slab;
 
@@ -541,11 +543,9 @@ static void locate_dirty_segment(struct f2fs_sb_info *sbi, unsigned int segno)
 	mutex_unlock(&dirty_i->seglist_lock);
 }
 
-static int f2fs_issue_discard(struct f2fs_sb_info *sbi,
+static void __mark_discarded(struct f2fs_sb_info *sbi,
 				block_t blkstart, block_t blklen)
 {
-	sector_t start = SECTOR_FROM_BLOCK(blkstart);
-	sector_t len = SECTOR_FROM_BLOCK(blklen);
 	struct seg_entry *se;
 	unsigned int offset;
 	block_t i;
@@ -557,10 +557,336 @@ static int f2fs_issue_discard(struct f2fs_sb_info *sbi,
 		if (!f2fs_test_and_set_bit(offset, se->discard_map))
 			sbi->discard_blks--;
 	}
+}
+
+static int __issue_discard_sync(struct f2fs_sb_info *sbi,
+				block_t blkstart, block_t blklen)
+{
+	sector_t start = SECTOR_FROM_BLOCK(blkstart);
+	sector_t len = SECTOR_FROM_BLOCK(blklen);
+
 	trace_f2fs_issue_discard(sbi->sb, blkstart, blklen);
 	return blkdev_issue_discard(sbi->sb->s_bdev, start, len, GFP_NOFS, 0);
 }
 
+/*
+ * Pending discards are kept as non-overlapping ranges sorted by start
+ * address.  Return the first one ending at or after @blkaddr.
+ */
+static struct discard_cmd *__lookup_discard_cmd(
+			struct discard_cmd_control *dcc, block_t blkaddr)
+{
+	struct rb_node *node = dcc->root.rb_node;
+	struct discard_cmd *dc, *found = NULL;
+
+	while (node) {
+		dc = rb_entry(node, struct discard_cmd, rb_node);
+		if (dc->lstart + dc->len >= blkaddr) {
+			found = dc;
+			node = node->rb_left;
+		} else {
+			node = node->rb_right;
+		}
+	}
+	return found;
+}
+
+static void __insert_discard_cmd(struct discard_cmd_control *dcc,
+						struct discard_cmd *new)
+{
+	struct rb_node **p = &dcc->root.rb_node, *parent = NULL;
+	struct discard_cmd *dc;
+
+	while (*p) {
+		parent = *p;
+		dc = rb_entry(parent, struct discard_cmd, rb_node);
+		if (new->lstart < dc->lstart)
+			p = &(*p)->rb_left;
+		else
+			p = &(*p)->rb_right;
+	}
+	rb_link_node(&new->rb_node, parent, p);
+	rb_insert_color(&new->rb_node, &dcc->root);
+	dcc->nr_pending++;
+}
+
+static void __erase_discard_cmd(struct discard_cmd_control *dcc,
+						struct discard_cmd *dc)
+{
+	rb_erase(&dc->rb_node, &dcc->root);
+	dcc->nr_pending--;
+}
+
+/*
+ * Queue [blkstart, blkstart + blklen) for the discard thread, merging
+ * it with any pending range it touches.
+ */
+static void __queue_discard_cmd(struct f2fs_sb_info *sbi,
+				block_t blkstart, block_t blklen)
+{
+	struct discard_cmd_control *dcc = SM_I(sbi)->dcc_info;
+	struct discard_cmd *new, *dc, *next;
+	block_t end = blkstart + blklen;
+	bool wake;
+
+	new = f2fs_kmem_cache_alloc(discard_cmd_slab, GFP_NOFS);
+
+	spin_lock(&dcc->lock);
+	wake = !dcc->nr_pending;
+	dc = __lookup_discard_cmd(dcc, blkstart);
+	while (dc && dc->lstart <= end) {
+		struct rb_node *node = rb_next(&dc->rb_node);
+
+		next = node ? rb_entry(node, struct discard_cmd, rb_node) :
+									NULL;
+		blkstart = min(blkstart, dc->lstart);
+		end = max(end, dc->lstart + dc->len);
+		dcc->pending_blks -= dc->len;
+		__erase_discard_cmd(dcc, dc);
+		kmem_cache_free(discard_cmd_slab, dc);
+		dc = next;
+	}
+	new->lstart = blkstart;
+	new->len = end - blkstart;
+	__insert_discard_cmd(dcc, new);
+	dcc->pending_blks += new->len;
+	spin_unlock(&dcc->lock);
+
+	if (wake)
+		wake_up(&dcc->discard_wait_queue);
+}
+
+static bool __discard_issuing(struct discard_cmd_control *dcc,
+				block_t blkstart, block_t blklen)
+{
+	bool ret;
+
+	spin_lock(&dcc->lock);
+	ret = dcc->issuing_len &&
+		blkstart < dcc->issuing_start + dcc->issuing_len &&
+		dcc->issuing_start < blkstart + blklen;
+	spin_unlock(&dcc->lock);
+	return ret;
+}
+
+/*
+ * Blocks in [blkstart, blkstart + blklen) are about to be reused: drop
+ * their pending discards and wait for one already sent to the device,
+ * so that it cannot wipe out new data.  Dropped blocks lose their
+ * discard_map bit, so that a later FITRIM still covers them.
+ */
+static void f2fs_wait_discard(struct f2fs_sb_info *sbi,
+				block_t blkstart, block_t blklen)
+{
+	struct discard_cmd_control *dcc = SM_I(sbi)->dcc_info;
+	struct discard_cmd *dc, *next;
+	block_t end = blkstart + blklen;
+
+	if (!dcc)
+		return;
+
+	spin_lock(&dcc->lock);
+	dc = __lookup_discard_cmd(dcc, blkstart + 1);
+	while (dc && dc->lstart < end) {
+		struct rb_node *node = rb_next(&dc->rb_node);
+		block_t dc_end = dc->lstart + dc->len;
+		block_t from = dc->lstart, to = dc_end, i;
+
+		next = node ? rb_entry(node, struct discard_cmd, rb_node) :
+									NULL;
+		if (dc->lstart < blkstart) {
+			/* keep the head, drop the rest including any tail */
+			from = blkstart;
+			dc->len = blkstart - dc->lstart;
+		} else if (dc_end > end) {
+			to = end;
+			dc->len = dc_end - end;
+			dc->lstart = end;
+		} else {
+			__erase_discard_cmd(dcc, dc);
+			kmem_cache_free(discard_cmd_slab, dc);
+		}
+		dcc->pending_blks -= to - from;
+
+		for (i = from; i < to; i++) {
+			struct seg_entry *se = get_seg_entry(sbi,
+						GET_SEGNO(sbi, i));
+			unsigned int offset = GET_BLKOFF_FROM_SEG0(sbi, i);
+
+			if (f2fs_test_and_clear_bit(offset, se->discard_map))
+				sbi->discard_blks++;
+		}
+		dc = next;
+	}
+	spin_unlock(&dcc->lock);
+
+	wait_event(dcc->issue_wait_queue,
+			!__discard_issuing(dcc, blkstart, blklen));
+}
+
+/*
+ * Send up to @max_issue pending discards, or all of them if it is zero,
+ * in address order and at most max_discard_len blocks each.
+ */
+static void __issue_discard_cmds(struct f2fs_sb_info *sbi,
+					unsigned int max_issue)
+{
+	struct discard_cmd_control *dcc = SM_I(sbi)->dcc_info;
+	unsigned int issued = 0;
+
+	mutex_lock(&dcc->issue_mutex);
+	while (!max_issue || issued < max_issue) {
+		struct discard_cmd *dc = NULL;
+		struct rb_node *node;
+		block_t start, len;
+
+		spin_lock(&dcc->lock);
+		node = rb_first(&dcc->root);
+		if (!node) {
+			spin_unlock(&dcc->lock);
+			break;
+		}
+		dc = rb_entry(node, struct discard_cmd, rb_node);
+		start = dc->lstart;
+		len = min_t(block_t, dc->len,
+				max_t(unsigned int, dcc->max_discard_len, 1));
+		if (len == dc->len) {
+			__erase_discard_cmd(dcc, dc);
+		} else {
+			dc->lstart += len;
+			dc->len -= len;
+			dc = NULL;
+		}
+		dcc->pending_blks -= len;
+		dcc->issuing_start = start;
+		dcc->issuing_len = len;
+		spin_unlock(&dcc->lock);
+
+		if (dc)
+			kmem_cache_free(discard_cmd_slab, dc);
+
+		__issue_discard_sync(sbi, start, len);
+
+		spin_lock(&dcc->lock);
+		dcc->issuing_len = 0;
+		dcc->nr_issued++;
+		dcc->issued_blks += len;
+		spin_unlock(&dcc->lock);
+		wake_up_all(&dcc->issue_wait_queue);
+		issued++;
+	}
+	mutex_unlock(&dcc->issue_mutex);
+}
+
+/* Issue every pending discard now, for FITRIM and umount */
+void f2fs_flush_discards(struct f2fs_sb_info *sbi)
+{
+	if (SM_I(sbi)->dcc_info)
+		__issue_discard_cmds(sbi, 0);
+}
+
+/*
+ * Background discard thread: while the device is idle, send a few
+ * discards every discard_interval ms.  A backlog larger than
+ * discard_urgent_blks is drained even when foreground I/O is running.
+ */
+static int issue_discard_thread(void *data)
+{
+	struct f2fs_sb_info *sbi = data;
+	struct discard_cmd_control *dcc = SM_I(sbi)->dcc_info;
+	wait_queue_head_t *q = &dcc->discard_wait_queue;
+
+	set_freezable();
+
+	do {
+		if (try_to_freeze())
+			continue;
+		else if (!dcc->nr_pending)
+			wait_event_interruptible(*q, kthread_should_stop() ||
+					freezing(current) || dcc->nr_pending);
+		else
+			wait_event_interruptible_timeout(*q,
+				kthread_should_stop() || freezing(current),
+				msecs_to_jiffies(max_t(unsigned int,
+						dcc->discard_interval, 1)));
+		if (kthread_should_stop())
+			break;
+
+		if (!dcc->nr_pending)
+			continue;
+		if (sbi->sb->s_writers.frozen >= SB_FREEZE_WRITE)
+			continue;
+		if (!is_idle(sbi) &&
+				dcc->pending_blks < dcc->discard_urgent_blks)
+			continue;
+
+		__issue_discard_cmds(sbi, max_t(unsigned int,
+						dcc->max_discard_issue, 1));
+	} while (!kthread_should_stop());
+	return 0;
+}
+
+int create_discard_cmd_control(struct f2fs_sb_info *sbi)
+{
+	dev_t dev = sbi->sb->s_bdev->bd_dev;
+	struct discard_cmd_control *dcc;
+	int err;
+
+	dcc = kzalloc(sizeof(struct discard_cmd_control), GFP_KERNEL);
+	if (!dcc)
+		return -ENOMEM;
+
+	init_waitqueue_head(&dcc->discard_wait_queue);
+	init_waitqueue_head(&dcc->issue_wait_queue);
+	mutex_init(&dcc->issue_mutex);
+	spin_lock_init(&dcc->lock);
+	dcc->root = RB_ROOT;
+	dcc->discard_interval = DEF_DISCARD_INTERVAL;
+	dcc->max_discard_issue = DEF_MAX_DISCARD_ISSUE;
+	dcc->max_discard_len = DEF_MAX_DISCARD_LEN;
+	dcc->discard_urgent_blks = DEF_DISCARD_URGENT_BLOCKS;
+	SM_I(sbi)->dcc_info = dcc;
+
+	dcc->f2fs_issue_discard = kthread_run(issue_discard_thread, sbi,
+				"f2fs_discard-%u:%u", MAJOR(dev), MINOR(dev));
+	if (IS_ERR(dcc->f2fs_issue_discard)) {
+		err = PTR_ERR(dcc->f2fs_issue_discard);
+		kfree(dcc);
+		SM_I(sbi)->dcc_info = NULL;
+		return err;
+	}
+	return 0;
+}
+
+static void destroy_discard_cmd_control(struct f2fs_sb_info *sbi)
+{
+	struct discard_cmd_control *dcc = SM_I(sbi)->dcc_info;
+
+	if (!dcc)
+		return;
+
+	kthread_stop(dcc->f2fs_issue_discard);
+	f2fs_flush_discards(sbi);
+	kfree(dcc);
+	SM_I(sbi)->dcc_info = NULL;
+}
+
+/*
+ * Discards of freed space go to the discard thread; without one (e.g.
+ * read-only mount) they are still sent synchronously.
+ */
+static int f2fs_issue_discard(struct f2fs_sb_info *sbi,
+				block_t blkstart, block_t blklen)
+{
+	__mark_discarded(sbi, blkstart, blklen);
+
+	if (!SM_I(sbi)->dcc_info)
+		return __issue_discard_sync(sbi, blkstart, blklen);
+
+	__queue_discard_cmd(sbi, blkstart, blklen);
+	return 0;
+}
+
 bool discard_next_dnode(struct f2fs_sb_info *sbi, block_t blkaddr)
 {
 	int err = -ENOTSUPP;
@@ -573,7 +899,12 @@ bool discard_next_dnode(struct f2fs_sb_info *sbi, block_t blkaddr)
 		if (f2fs_test_bit(offset, se->discard_map))
 			return false;
 
-		err = f2fs_issue_discard(sbi, blkaddr, 1);
+		/*
+		 * Roll-forward recovery stops at this block, so it must be
+		 * gone before the checkpoint is written: don't defer it.
+		 */
+		__mark_discarded(sbi, blkaddr, 1);
+		err = __issue_discard_sync(sbi, blkaddr, 1);
 	}
 
 	if (err) {
@@ -1015,6 +1346,9 @@ static void reset_curseg(struct f2fs_sb_info *sbi, int type, int modified)
 	curseg->next_blkoff = 0;
 	curseg->next_segno = NULL_SEGNO;
 
+	f2fs_wait_discard(sbi, START_BLOCK(sbi, curseg->segno),
+						sbi->blocks_per_seg);
+
 	sum_footer = &(curseg->sum_blk->footer);
 	memset(sum_footer, 0, sizeof(struct summary_footer));
 	if (IS_DATASEG(type))
@@ -1215,6 +1549,7 @@ int f2fs_trim_fs(struct f2fs_sb_info *sbi, struct fstrim_range *range)
 		err = write_checkpoint(sbi, &cpc);
 		mutex_unlock(&sbi->gc_mutex);
 	}
+	f2fs_flush_discards(sbi);
 out:
 	range->len = F2FS_BLK_TO_BYTES(cpc.trimmed);
 	return err;
@@ -1309,6 +1644,13 @@ void allocate_data_block(struct f2fs_sb_info *sbi, struct page *page,
 
 	*new_blkaddr = NEXT_FREE_BLKADDR(sbi, curseg);
 
+	/*
+	 * SSR reuses blocks freed by the last checkpoint inside the current
+	 * segment, which may have been queued for discard since then.
+	 */
+	if (curseg->alloc_type == SSR)
+		f2fs_wait_discard(sbi, *new_blkaddr, 1);
+
 	/*
 	 * __add_sum_entry should be resided under the curseg_mutex
 	 * because, this function updates a summary entry in the
@@ -2351,6 +2693,12 @@ int build_segment_manager(struct f2fs_sb_info *sbi)
 		return err;
 
 	init_min_max_mtime(sbi);
+
+	if (!f2fs_readonly(sbi->sb)) {
+		err = create_discard_cmd_control(sbi);
+		if (err)
+			return err;
+	}
 	return 0;
 }
 
@@ -2444,6 +2792,7 @@ void destroy_segment_manager(struct f2fs_sb_info *sbi)
 
 	if (!sm_info)
 		return;
+	destroy_discard_cmd_control(sbi);
 	destroy_flush_cmd_control(sbi);
 	destroy_dirty_segmap(sbi);
 	destroy_curseg(sbi);
@@ -2469,8 +2818,15 @@ int __init create_segment_manager_caches(void)
 			sizeof(struct inmem_pages));
 	if (!inmem_entry_slab)
 		goto destroy_sit_entry_set;
+
+	discard_cmd_slab = f2fs_kmem_cache_create("discard_cmd",
+			sizeof(struct discard_cmd));
+	if (!discard_cmd_slab)
+		goto destroy_inmem_entry;
 	return 0;
 
+destroy_inmem_entry:
+	kmem_cache_destroy(inmem_entry_slab);
 destroy_sit_entry_set:
 	kmem_cache_destroy(sit_entry_set_slab);
 destory_discard_entry:
@@ -2484,4 +2840,5 @@ void destroy_segment_manager_caches(void)
 	kmem_cache_destroy(sit_entry_set_slab);
 	kmem_cache_destroy(discard_entry_slab);
 	kmem_cache_destroy(inmem_entry_slab);
+	kmem_cache_destroy(discard_cmd_slab);
 }
@@ -238,12 +238,33 @@ enum dirty_type {
 	NR_DIRTY_TYPE
 };
 
+/*
+ * The cheapest sections found by the last victim scan of a gc_mode,
+ * sorted by cost.  GC takes victims from here until it runs dry or
+ * VICTIM_CACHE_TTL passes, instead of rescanning the dirty segmap.
+ */
+#define VICTIM_CACHE_SIZE	32
+#define VICTIM_CACHE_TTL	(10 * HZ)
+
+struct victim_entry {
+	unsigned int segno;		/* first segment of the section */
+	unsigned int vblocks;		/* valid blocks when costed */
+	unsigned int cost;
+};
+
+struct victim_cache {
+	unsigned long expires;		/* jiffies after which to rescan */
+	unsigned int nr;		/* # of cached entries */
+	struct victim_entry entry[VICTIM_CACHE_SIZE];
+};
+
 struct dirty_seglist_info {
 	const struct victim_selection *v_ops;	/* victim selction operation */
 	unsigned long *dirty_segmap[NR_DIRTY_TYPE];
 	struct mutex seglist_lock;		/* lock for segment bitmaps */
 	int nr_dirty[NR_DIRTY_TYPE];		/* # of dirty segments */
 	unsigned long *victim_secmap;		/* background GC victims */
+	struct victim_cache vcache[2];		/* per gc_mode, seglist_lock */
 };
 
 /* victim selection function for cleaning and SSR */
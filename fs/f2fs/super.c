@@ -101,6 +101,7 @@ enum {
 	SM_INFO,	/* struct f2fs_sm_info */
 	NM_INFO,	/* struct f2fs_nm_info */
 	F2FS_SBI,	/* struct f2fs_sb_info */
+	DCC_INFO,	/* struct discard_cmd_control */
 };
 
 struct f2fs_attr {
@@ -122,6 +123,8 @@ static unsigned char *__struct_ptr(struct f2fs_sb_info *sbi, int struct_type)
 		return (unsigned char *)NM_I(sbi);
 	else if (struct_type == F2FS_SBI)
 		return (unsigned char *)sbi;
+	else if (struct_type == DCC_INFO)
+		return (unsigned char *)SM_I(sbi)->dcc_info;
 	return NULL;
 }
 
@@ -138,6 +141,61 @@ static ssize_t lifetime_write_kbytes_show(struct f2fs_attr *a,
 			BD_PART_WRITTEN(sbi)));
 }
 
+/* "<# of extents> <# of blocks>" waiting for the discard thread */
+static ssize_t pending_discard_show(struct f2fs_attr *a,
+		struct f2fs_sb_info *sbi, char *buf)
+{
+	struct discard_cmd_control *dcc = SM_I(sbi)->dcc_info;
+	unsigned int nr = 0, blks = 0;
+
+	if (dcc) {
+		spin_lock(&dcc->lock);
+		nr = dcc->nr_pending;
+		blks = dcc->pending_blks;
+		spin_unlock(&dcc->lock);
+	}
+	return snprintf(buf, PAGE_SIZE, "%u %u\n", nr, blks);
+}
+
+/* "<# of commands> <# of blocks>" sent by the discard thread or FITRIM */
+static ssize_t issued_discard_show(struct f2fs_attr *a,
+		struct f2fs_sb_info *sbi, char *buf)
+{
+	struct discard_cmd_control *dcc = SM_I(sbi)->dcc_info;
+	unsigned int nr = 0, blks = 0;
+
+	if (dcc) {
+		spin_lock(&dcc->lock);
+		nr = dcc->nr_issued;
+		blks = dcc->issued_blks;
+		spin_unlock(&dcc->lock);
+	}
+	return snprintf(buf, PAGE_SIZE, "%u %u\n", nr, blks);
+}
+
+/* "<# of hits> <# of misses> <# shrunk> <# of extents preloaded>" */
+static ssize_t extent_cache_stat_show(struct f2fs_attr *a,
+		struct f2fs_sb_info *sbi, char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%llu %llu %llu %llu\n",
+		(unsigned long long)atomic64_read(&sbi->ext_cache_hit),
+		(unsigned long long)atomic64_read(&sbi->ext_cache_miss),
+		(unsigned long long)atomic64_read(&sbi->ext_cache_evict),
+		(unsigned long long)atomic64_read(&sbi->ext_cache_precache));
+}
+
+/* "<# of trees> <# of nodes> <bytes>" held by the extent cache */
+static ssize_t extent_cache_mem_show(struct f2fs_attr *a,
+		struct f2fs_sb_info *sbi, char *buf)
+{
+	unsigned int trees = atomic_read(&sbi->total_ext_tree);
+	unsigned int nodes = atomic_read(&sbi->total_ext_node);
+
+	return snprintf(buf, PAGE_SIZE, "%u %u %llu\n", trees, nodes,
+		(unsigned long long)trees * sizeof(struct extent_tree) +
+		(unsigned long long)nodes * sizeof(struct extent_node));
+}
+
 static ssize_t f2fs_sbi_show(struct f2fs_attr *a,
 			struct f2fs_sb_info *sbi, char *buf)
 {
@@ -223,6 +281,7 @@ F2FS_RW_ATTR(GC_THREAD, f2fs_gc_kthread, gc_min_sleep_time, min_sleep_time);
 F2FS_RW_ATTR(GC_THREAD, f2fs_gc_kthread, gc_max_sleep_time, max_sleep_time);
 F2FS_RW_ATTR(GC_THREAD, f2fs_gc_kthread, gc_no_gc_sleep_time, no_gc_sleep_time);
 F2FS_RW_ATTR(GC_THREAD, f2fs_gc_kthread, gc_idle, gc_idle);
+F2FS_RW_ATTR(GC_THREAD, f2fs_gc_kthread, gc_idle_poll_time, idle_poll_time);
 F2FS_RW_ATTR(SM_INFO, f2fs_sm_info, reclaim_segments, rec_prefree_segments);
 F2FS_RW_ATTR(SM_INFO, f2fs_sm_info, max_small_discards, max_discards);
 F2FS_RW_ATTR(SM_INFO, f2fs_sm_info, batched_trim_sections, trim_sections);
@@ -236,7 +295,18 @@ F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, max_victim_search, max_victim_search);
 F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, dir_level, dir_level);
 F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, cp_interval, interval_time[CP_TIME]);
 F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, idle_interval, interval_time[REQ_TIME]);
+F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, extent_precache, extent_precache);
+F2FS_RW_ATTR(DCC_INFO, discard_cmd_control, discard_interval, discard_interval);
+F2FS_RW_ATTR(DCC_INFO, discard_cmd_control, max_discard_issue,
+						max_discard_issue);
+F2FS_RW_ATTR(DCC_INFO, discard_cmd_control, max_discard_len, max_discard_len);
+F2FS_RW_ATTR(DCC_INFO, discard_cmd_control, discard_urgent_blocks,
+						discard_urgent_blks);
 F2FS_GENERAL_RO_ATTR(lifetime_write_kbytes);
+F2FS_GENERAL_RO_ATTR(pending_discard);
+F2FS_GENERAL_RO_ATTR(issued_discard);
+F2FS_GENERAL_RO_ATTR(extent_cache_stat);
+F2FS_GENERAL_RO_ATTR(extent_cache_mem);
 
 #define ATTR_LIST(name) (&f2fs_attr_##name.attr)
 static struct attribute *f2fs_attrs[] = {
@@ -244,6 +314,7 @@ static struct attribute *f2fs_attrs[] = {
 	ATTR_LIST(gc_max_sleep_time),
 	ATTR_LIST(gc_no_gc_sleep_time),
 	ATTR_LIST(gc_idle),
+	ATTR_LIST(gc_idle_poll_time),
 	ATTR_LIST(reclaim_segments),
 	ATTR_LIST(max_small_discards),
 	ATTR_LIST(batched_trim_sections),
@@ -257,7 +328,16 @@ static struct attribute *f2fs_attrs[] = {
 	ATTR_LIST(dirty_nats_ratio),
 	ATTR_LIST(cp_interval),
 	ATTR_LIST(idle_interval),
+	ATTR_LIST(extent_precache),
+	ATTR_LIST(discard_interval),
+	ATTR_LIST(max_discard_issue),
+	ATTR_LIST(max_discard_len),
+	ATTR_LIST(discard_urgent_blocks),
 	ATTR_LIST(lifetime_write_kbytes),
+	ATTR_LIST(pending_discard),
+	ATTR_LIST(issued_discard),
+	ATTR_LIST(extent_cache_stat),
+	ATTR_LIST(extent_cache_mem),
 	NULL,
 };
 
@@ -840,6 +920,17 @@ static int f2fs_remount(struct super_block *sb, int *flags, char *data)
 		need_stop_gc = true;
 	}
 
+	/*
+	 * A read-only mount has no discard thread; start it on the way
+	 * to read-write.  It is kept across a later switch back to RO,
+	 * where it has nothing to do.
+	 */
+	if (!(*flags & MS_RDONLY) && !SM_I(sbi)->dcc_info) {
+		err = create_discard_cmd_control(sbi);
+		if (err)
+			goto restore_gc;
+	}
+
 	/*
 	 * We stop issue flush thread if FS is mounted as RO
 	 * or if flush_merge is not passed in mount option.
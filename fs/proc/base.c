@@ -88,6 +88,7 @@
 #include <linux/flex_array.h>
 #include <linux/posix-timers.h>
 #include <linux/qmp_sphinx_instrumentation.h>
+#include <linux/cpufreq.h>
 #ifdef CONFIG_HARDWALL
 #include <asm/hardwall.h>
 #endif
@@ -1314,6 +1315,69 @@ static const struct file_operations proc_pid_sched_operations = {
 
 #endif
 
+#ifdef CONFIG_SCHEDSTATS
+/*
+ * Runnable delay histograms of a single thread: write 1 to start
+ * collecting or to clear them, 0 to stop.
+ */
+static int sched_latency_show(struct seq_file *m, void *v)
+{
+	struct inode *inode = m->private;
+	struct task_struct *p;
+
+	p = get_proc_task(inode);
+	if (!p)
+		return -ESRCH;
+	proc_sched_lat_show_task(p, m);
+
+	put_task_struct(p);
+
+	return 0;
+}
+
+static ssize_t
+sched_latency_write(struct file *file, const char __user *buf,
+		    size_t count, loff_t *offset)
+{
+	struct inode *inode = file_inode(file);
+	struct task_struct *p;
+	char buffer[PROC_NUMBUF];
+	int enable, err;
+
+	memset(buffer, 0, sizeof(buffer));
+	if (count > sizeof(buffer) - 1)
+		count = sizeof(buffer) - 1;
+	if (copy_from_user(buffer, buf, count))
+		return -EFAULT;
+
+	err = kstrtoint(strstrip(buffer), 0, &enable);
+	if (err)
+		return err;
+
+	p = get_proc_task(inode);
+	if (!p)
+		return -ESRCH;
+	err = proc_sched_lat_set_task(p, enable);
+
+	put_task_struct(p);
+
+	return err < 0 ? err : count;
+}
+
+static int sched_latency_open(struct inode *inode, struct file *filp)
+{
+	return single_open(filp, sched_latency_show, inode);
+}
+
+static const struct file_operations proc_pid_sched_latency_operations = {
+	.open		= sched_latency_open,
+	.read		= seq_read,
+	.write		= sched_latency_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+#endif
+
 
 #ifdef CONFIG_SCHED_AUTOGROUP
 /*
@@ -3085,8 +3149,14 @@ static const struct pid_entry tid_base_stuff[] = {
 	INF("syscall",   S_IRUGO, proc_pid_syscall),
 #endif
 	INF("cmdline",   S_IRUGO, proc_pid_cmdline),
+#ifdef CONFIG_SCHEDSTATS
+	REG("sched_latency", S_IRUGO|S_IWUSR, proc_pid_sched_latency_operations),
+#endif
 	ONE("stat",      S_IRUGO, proc_tid_stat),
 	ONE("statm",     S_IRUGO, proc_pid_statm),
+#ifdef CONFIG_CPU_FREQ_STAT
+	ONE("time_in_state", S_IRUGO, proc_time_in_state_show),
+#endif
 	REG("maps",      S_IRUGO, proc_tid_maps_operations),
 #ifdef CONFIG_CHECKPOINT_RESTORE
 	REG("children",  S_IRUGO, proc_tid_children_operations),
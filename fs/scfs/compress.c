@@ -28,6 +28,8 @@
  */
 
 #include <linux/crypto.h>
+#include <linux/percpu.h>
+#include <linux/lz4.h>
 #include "scfs.h"
 
 /* Fake description object for the "none" compressor */
@@ -37,47 +39,83 @@ static struct scfs_compressor none_compr = {
 //	.capi_name = "",
 };
 
-static DEFINE_MUTEX(lzo_mutex);
-
 static struct scfs_compressor lzo_compr = {
 	.compr_type = SCFS_COMP_LZO,
-	.comp_mutex = &lzo_mutex,
 	.name = "lzo",
 	.capi_name = "lzo",
 };
 
-static DEFINE_MUTEX(deflate_mutex);
-static DEFINE_MUTEX(inflate_mutex);
-
 static struct scfs_compressor zlib_compr = {
 	.compr_type = SCFS_COMP_ZLIB,
-	.comp_mutex = &deflate_mutex,
-	.decomp_mutex = &inflate_mutex,
 	.name = "zlib",
 	.capi_name = "deflate",
 };
 
+#ifdef CONFIG_CRYPTO_LZ4
+static struct scfs_compressor lz4_compr = {
+	.compr_type = SCFS_COMP_LZ4,
+	.name = "lz4",
+	.capi_name = "lz4",
+};
+#endif
+
 /* All SCFS compressors */
 struct scfs_compressor *scfs_compressors[SCFS_COMP_TOTAL_TYPES];
 
+/* serializes the lazy allocation of compressor contexts */
+static DEFINE_MUTEX(compr_ctx_mutex);
+
+/*
+ * Every CPU has its own tfm, so clusters on different CPUs are
+ * (de)compressed in parallel. The mutex only matters when a task sleeps or
+ * migrates while holding the context of the CPU it started on.
+ * Contexts are allocated on first use, returns NULL if that fails.
+ */
+static struct scfs_comp_ctx *get_comp_ctx(struct scfs_compressor *compr)
+{
+	struct scfs_comp_ctx __percpu *pctx = ACCESS_ONCE(compr->ctx);
+	struct scfs_comp_ctx *ctx;
+
+	if (unlikely(!pctx)) {
+		if (scfs_compressor_get(compr->compr_type))
+			return NULL;
+		pctx = ACCESS_ONCE(compr->ctx);
+	}
+	smp_read_barrier_depends();
+
+	ctx = per_cpu_ptr(pctx, raw_smp_processor_id());
+	mutex_lock(&ctx->mutex);
+	return ctx;
+}
+
+static void put_comp_ctx(struct scfs_comp_ctx *ctx)
+{
+	mutex_unlock(&ctx->mutex);
+}
+
 int scfs_compress_crypto(const void *in_buf, size_t in_len, void *out_buf, size_t *out_len,
 		    int compr_type)
 {
 	int err = 0;
 	struct scfs_compressor *compr = scfs_compressors[compr_type];
+	struct scfs_comp_ctx *ctx;
 	unsigned int tmp_len;
 
 	if (compr_type == SCFS_COMP_NONE)
 		goto no_compr;
 
-	if (compr->comp_mutex)
-		mutex_lock(compr->comp_mutex);
+	/* lz4 trusts the output buffer to hold the worst case */
+	if (compr_type == SCFS_COMP_LZ4 && *out_len < lz4_compressbound(in_len))
+		goto no_compr;
+
+	ctx = get_comp_ctx(compr);
+	if (unlikely(!ctx))
+		goto no_compr;
 	tmp_len = (unsigned int)*out_len;
-	err = crypto_comp_compress(compr->cc, in_buf, in_len, out_buf,
+	err = crypto_comp_compress(ctx->cc, in_buf, in_len, out_buf,
 				   &tmp_len);
 	*out_len = (size_t)tmp_len;
-	if (compr->comp_mutex)
-		mutex_unlock(compr->comp_mutex);
+	put_comp_ctx(ctx);
 	if (unlikely(err)) {
 		SCFS_PRINT_ERROR("cannot compress %d bytes, compressor %s, "
 			   "error %d, leave data uncompressed",
@@ -100,6 +138,7 @@ int scfs_decompress_crypto(const void *in_buf, size_t in_len, void *out_buf,
 {
 	int err;
 	struct scfs_compressor *compr;
+	struct scfs_comp_ctx *ctx;
 	unsigned int tmp_len;
 
 	if (unlikely(compr_type < 0 || compr_type >= SCFS_COMP_TOTAL_TYPES)) {
@@ -109,6 +148,11 @@ int scfs_decompress_crypto(const void *in_buf, size_t in_len, void *out_buf,
 
 	compr = scfs_compressors[compr_type];
 
+	if (unlikely(!compr)) {
+		SCFS_PRINT_ERROR("compression type %d is not compiled in", compr_type);
+		return -EINVAL;
+	}
+
 	if (unlikely(!compr->capi_name)) {
 		SCFS_PRINT_ERROR("%s compression is not compiled in", compr->name);
 		return -EINVAL;
@@ -120,14 +164,14 @@ int scfs_decompress_crypto(const void *in_buf, size_t in_len, void *out_buf,
 		return 0;
 	}
 
-	if (compr->decomp_mutex)
-		mutex_lock(compr->decomp_mutex);
+	ctx = get_comp_ctx(compr);
+	if (unlikely(!ctx))
+		return -ENOMEM;
 	tmp_len = (unsigned int)*out_len;
-	err = crypto_comp_decompress(compr->cc, in_buf, in_len, out_buf,
+	err = crypto_comp_decompress(ctx->cc, in_buf, in_len, out_buf,
 				     &tmp_len);
 	*out_len = (size_t)tmp_len;
-	if (compr->decomp_mutex)
-		mutex_unlock(compr->decomp_mutex);
+	put_comp_ctx(ctx);
 	if (err)
 		SCFS_PRINT_ERROR("cannot decompress %d bytes, compressor %s, "
 			  "error %d", in_len, compr->name, err);
@@ -135,28 +179,78 @@ int scfs_decompress_crypto(const void *in_buf, size_t in_len, void *out_buf,
 	return err;
 }
 
+static void free_comp_ctx(struct scfs_comp_ctx __percpu *pctx)
+{
+	struct scfs_comp_ctx *ctx;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		ctx = per_cpu_ptr(pctx, cpu);
+		if (ctx->cc)
+			crypto_free_comp(ctx->cc);
+	}
+	free_percpu(pctx);
+}
+
 /**
- * compr_init - initialize a compressor.
- * @compr: compressor description object
+ * scfs_compressor_get - make a compressor ready for use.
+ * @compr_type: compressor type
  *
- * This function initializes the requested compressor and returns zero in case
- * of success or a negative error code in case of failure.
+ * This function allocates one tfm per possible CPU for the requested
+ * compressor, unless that was done before. It is called when a mount
+ * selects the compressor and on the first use by a file written with
+ * another one, so deflate contexts are not paid for by lzo users. Returns
+ * zero in case of success or a negative error code in case of failure.
  */
-static int compr_init(struct scfs_compressor *compr)
+int scfs_compressor_get(int compr_type)
 {
-	if (compr->capi_name) {
-		compr->cc = crypto_alloc_comp(compr->capi_name, 0, 0);
-		if (IS_ERR(compr->cc)) {
-			SCFS_PRINT_ERROR("cannot initialize compressor %s, error %ld",
-				  compr->name, PTR_ERR(compr->cc));
-			return PTR_ERR(compr->cc);
+	struct scfs_compressor *compr;
+	struct scfs_comp_ctx __percpu *pctx;
+	struct scfs_comp_ctx *ctx;
+	int cpu, err = 0;
+
+	if (compr_type < 0 || compr_type >= SCFS_COMP_TOTAL_TYPES)
+		return -EINVAL;
+	compr = scfs_compressors[compr_type];
+	if (!compr)
+		return -EINVAL;
+	if (!compr->capi_name || ACCESS_ONCE(compr->ctx))
+		return 0;
+
+	mutex_lock(&compr_ctx_mutex);
+	if (compr->ctx)
+		goto out;
+
+	pctx = alloc_percpu(struct scfs_comp_ctx);
+	if (!pctx) {
+		SCFS_PRINT_ERROR("cannot allocate contexts for compressor %s",
+			  compr->name);
+		err = -ENOMEM;
+		goto out;
+	}
+
+	for_each_possible_cpu(cpu) {
+		ctx = per_cpu_ptr(pctx, cpu);
+		mutex_init(&ctx->mutex);
+		ctx->cc = crypto_alloc_comp(compr->capi_name, 0, 0);
+		if (IS_ERR(ctx->cc)) {
+			err = PTR_ERR(ctx->cc);
+			ctx->cc = NULL;
+			SCFS_PRINT_ERROR("cannot initialize compressor %s, error %d",
+				  compr->name, err);
+			free_comp_ctx(pctx);
+			goto out;
 		}
 	}
 
-	scfs_compressors[compr->compr_type] = compr;
-	SCFS_PRINT("compr name %s(%d) got cc(%x)\n",
-		compr->capi_name, compr->compr_type, compr->cc); 
-	return 0;
+	/* the contexts are complete before anyone can see them */
+	smp_wmb();
+	compr->ctx = pctx;
+	SCFS_PRINT("compr name %s(%d) got %d contexts\n",
+		compr->capi_name, compr->compr_type, num_possible_cpus());
+out:
+	mutex_unlock(&compr_ctx_mutex);
+	return err;
 }
 
 /**
@@ -165,11 +259,26 @@ static int compr_init(struct scfs_compressor *compr)
  */
 static void compr_exit(struct scfs_compressor *compr)
 {
-	if (compr->capi_name)
-		crypto_free_comp(compr->cc);
+	if (!compr->capi_name || !compr->ctx)
+		return;
+
+	free_comp_ctx(compr->ctx);
+	compr->ctx = NULL;
 	return;
 }
 
+/**
+ * compr_init - register a compressor.
+ * @compr: compressor description object
+ *
+ * Its contexts are allocated later by scfs_compressor_get().
+ */
+static int compr_init(struct scfs_compressor *compr)
+{
+	scfs_compressors[compr->compr_type] = compr;
+	return 0;
+}
+
 int scfs_compressors_init(void)
 {
 	int err;
@@ -182,9 +291,19 @@ int scfs_compressors_init(void)
 	if (err)
 		goto out_lzo;
 
+#ifdef CONFIG_CRYPTO_LZ4
+	err = compr_init(&lz4_compr);
+	if (err)
+		goto out_zlib;
+#endif
+
 	scfs_compressors[SCFS_COMP_NONE] = &none_compr;
 	return 0;
 
+#ifdef CONFIG_CRYPTO_LZ4
+out_zlib:
+	compr_exit(&zlib_compr);
+#endif
 out_lzo:
 	compr_exit(&lzo_compr);
 	return err;
@@ -194,4 +313,7 @@ void scfs_compressors_exit(void)
 {
 	compr_exit(&lzo_compr);
 	compr_exit(&zlib_compr);
+#ifdef CONFIG_CRYPTO_LZ4
+	compr_exit(&lz4_compr);
+#endif
 }
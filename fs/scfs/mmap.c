@@ -45,6 +45,12 @@
 extern struct kmem_cache *scfs_cbm_cache;
 #endif
 
+/*
+ * pref_index passed by scfs_readpage: no preferred buffer_cache slot, and
+ * the decompressed cluster is worth keeping in the cluster cache
+ */
+#define SCFS_CCACHE_FILL	(-2)
+
 /**
  * scfs_readpage
  *
@@ -62,6 +68,8 @@ extern struct kmem_cache *scfs_cbm_cache;
  *    other pages in that same cluster is accessed later, and only incurs
  *    memcpy from the cached cluster buffer.)
  * - Recently accessed clusters ("buffer_cache") are cached for later reads.
+ * - Clusters decompressed for single page reads are also kept in the
+ *   shrinkable cluster cache, which outlives the buffer_cache slot rotation.
  */
 static inline int _scfs_readpage(struct file *file, struct page *page, int pref_index)
 {
@@ -73,6 +81,9 @@ static inline int _scfs_readpage(struct file *file, struct page *page, int pref_
 	int allocated_index = -1;
 	int i;
 	char *virt;
+#ifdef SCFS_CLUSTER_CACHE
+	unsigned int ccache_seq;
+#endif
 
 	SCFS_PRINT("f:%s i:%d c:0x%x u:0x%x\n",
 		file->f_path.dentry->d_name.name,
@@ -130,9 +141,10 @@ static inline int _scfs_readpage(struct file *file, struct page *page, int pref_
 				PAGE_TO_CLUSTER_INDEX(page, sii) &&
 			atomic_read(&sbi->buffer_cache[i].is_used) != 1) {
 			spin_lock(&sbi->buffer_cache_lock);
-			if (sbi->buffer_cache[i].ino == sii->vfs_inode.i_ino &&
-					sbi->buffer_cache[i].clust_num ==
-					PAGE_TO_CLUSTER_INDEX(page, sii) &&
+			/* this slot is reclaimed or in use for another page */
+			if (sbi->buffer_cache[i].ino != sii->vfs_inode.i_ino ||
+					sbi->buffer_cache[i].clust_num !=
+					PAGE_TO_CLUSTER_INDEX(page, sii) ||
 					atomic_read(&sbi->buffer_cache[i].is_used) == 1) {
 				spin_unlock(&sbi->buffer_cache_lock);
 				goto pick_slot;
@@ -159,6 +171,20 @@ static inline int _scfs_readpage(struct file *file, struct page *page, int pref_
 		}
 	}
 
+#ifdef SCFS_CLUSTER_CACHE
+	/* only compressed clusters are ever inserted */
+	if (sii->compressed && scfs_ccache_read_page(sbi, sii->vfs_inode.i_ino,
+			PAGE_TO_CLUSTER_INDEX(page, sii), page,
+			PGOFF_IN_CLUSTER(page, sii))) {
+		SetPageUptodate(page);
+		unlock_page(page);
+		SCFS_PRINT("%s<c> %d\n",
+			file->f_path.dentry->d_name.name, page->index);
+
+		return 0;
+	}
+#endif
+
 pick_slot:
 	/* pick a slot in buffer_cache to use */
 	if (atomic_read(&sbi->buffer_cache[sbi->read_buffer_index].is_used) != 1) {
@@ -257,6 +283,9 @@ real_io:
 		ret = -ENOMEM;
 		goto out;
 	}
+#ifdef SCFS_CLUSTER_CACHE
+	ccache_seq = scfs_ccache_seq(sii);
+#endif
 	/* read cluster from lower */
 	ret = scfs_read_cluster(file, page, buffer.c_buffer, &buffer.u_buffer, &compressed);
 
@@ -271,6 +300,14 @@ real_io:
 		goto out;
 	}
 
+#ifdef SCFS_CLUSTER_CACHE
+	/* random single page reads come back for the rest of the cluster */
+	if (compressed && pref_index == SCFS_CCACHE_FILL)
+		scfs_ccache_insert(sii, PAGE_TO_CLUSTER_INDEX(page, sii),
+			page_address(buffer.u_page), sii->cluster_size,
+			ccache_seq);
+#endif
+
 #if MAX_BUFFER_CACHE
 	/* don't need to spinlock, we have is_used=1 for this buffer */
 	if (alloc_membuffer != 1)
@@ -348,7 +385,7 @@ static int scfs_readpage(struct file *file, struct page *page)
 
 	atomic_inc(&sbi->scfs_standby_readpage_count);
 #endif
-	ret = _scfs_readpage(file, page, -1);
+	ret = _scfs_readpage(file, page, SCFS_CCACHE_FILL);
 #ifdef SCFS_ASYNC_READ_PROFILE
 	atomic_dec(&sbi->scfs_standby_readpage_count);
 #endif
@@ -399,39 +436,43 @@ void smb_destroy(struct scfs_sb_info *sbi)
 }
 
 
+/* number of queued pages, called with spinlock_smb held */
+static u32 smb_queue_length(struct scfs_sb_info *sbi)
+{
+	u32 io_index = sbi->page_buffer_next_io_index_smb;
+	u32 filling_index = sbi->page_buffer_next_filling_index_smb;
+
+	if (filling_index == MAX_PAGE_BUFFER_SIZE_SMB)
+		return MAX_PAGE_BUFFER_SIZE_SMB;
+	else if (filling_index > io_index)
+		return filling_index - io_index;
+	else if (filling_index < io_index)
+		return (MAX_PAGE_BUFFER_SIZE_SMB - io_index) + filling_index;
+
+	return 0;
+}
+
 /* scaling # of threads will be woken up, on-demand */
 void wakeup_smb_thread(struct scfs_sb_info *sbi)
 {
-	u32 length = 0, io_index, filling_index;
+	u32 length, threshold = 0;
+	int i;
 
 	spin_lock(&sbi->spinlock_smb);
-	io_index = sbi->page_buffer_next_io_index_smb;
-	filling_index = sbi->page_buffer_next_filling_index_smb;
+	length = smb_queue_length(sbi);
 	spin_unlock(&sbi->spinlock_smb);
 
-	if (filling_index == MAX_PAGE_BUFFER_SIZE_SMB)
-		length = MAX_PAGE_BUFFER_SIZE_SMB;
-	else if (filling_index > io_index)
-		length = filling_index - io_index;
-	else if (filling_index < io_index)
-		length = (MAX_PAGE_BUFFER_SIZE_SMB - io_index) + filling_index;
-	else if (filling_index == io_index) 
-		length = 0;
-
-	if (length > 0 && sbi->smb_task[0] && !sbi->smb_task_status[0])
-		wake_up_process(sbi->smb_task[0]);
-#if (NR_CPUS > 1)
-	if (length >= SMB_THREAD_THRESHOLD_2 &&sbi->smb_task[1] && !sbi->smb_task_status[1])
-		wake_up_process(sbi->smb_task[1]);
-#if (NR_CPUS > 2)
-	if (length >= SMB_THREAD_THRESHOLD_3 && sbi->smb_task[2] && !sbi->smb_task_status[2])
-		wake_up_process(sbi->smb_task[2]);
-#if (NR_CPUS > 3)
-	if (length >= SMB_THREAD_THRESHOLD_4 && sbi->smb_task[3] && !sbi->smb_task_status[3])
-		wake_up_process(sbi->smb_task[3]);
-#endif
-#endif
-#endif
+	/*
+	 * one thread for any backlog, then one more each time it doubles
+	 * past SMB_THREAD_THRESHOLD_2, up to one per online cpu
+	 */
+	for (i = 0; i < NR_CPUS && i < num_online_cpus(); i++) {
+		if (!length || length < threshold)
+			break;
+		if (sbi->smb_task[i] && !sbi->smb_task_status[i])
+			wake_up_process(sbi->smb_task[i]);
+		threshold = threshold ? threshold << 1 : SMB_THREAD_THRESHOLD_2;
+	}
 }
 
 int smb_thread(void *data)
@@ -545,6 +586,10 @@ int smb_thread(void *data)
  * Description:
  * - Asynchronously read pages for readahead. A scaling number of background threads
  *   will read & decompress them in a slightly deferred but parallelized manner.
+ * - The cluster of the first page, which the reader is waiting on, is
+ *   decompressed here once the rest of the request has been queued, so the
+ *   following clusters are decompressed by the helpers at the same time.
+ *   Other synchronous pages are queued as well while the queue is short.
  */
 static int
 scfs_readpages(struct file *file, struct address_space *mapping,
@@ -560,8 +605,10 @@ scfs_readpages(struct file *file, struct address_space *mapping,
 	int page_idx, page_idx_readahead = 1024, ret = 0;
 	int readahead_page = 0;
 	int prev_cbi = 0;
-	int prev_cluster = -1, cur_cluster = -1;
+	int prev_cluster = -1, cur_cluster = -1, first_cluster = -1;
 	int cluster_idx = 0;
+	struct page *sync_pages[SCFS_CLUSTER_PAGES_MAX];
+	int nr_sync = 0, queue_page, i;
 
 	i_size = i_size_read(&sii->vfs_inode);
 	if (!i_size) {
@@ -669,11 +716,26 @@ scfs_readpages(struct file *file, struct address_space *mapping,
 			continue;
 		}
 
-		/* memory buffer is full or synchronous read request -
-		   call scfs_readpage to read now */
-		if (sbi->page_buffer_next_filling_index_smb ==
-				MAX_PAGE_BUFFER_SIZE_SMB || page_idx < page_idx_readahead) {
-			cur_cluster = PAGE_TO_CLUSTER_INDEX(page, sii);
+		cur_cluster = PAGE_TO_CLUSTER_INDEX(page, sii);
+		if (first_cluster < 0)
+			first_cluster = cur_cluster;
+
+		/* the reader waits on this cluster, read it after queueing the rest */
+		if (page_idx < page_idx_readahead && cur_cluster == first_cluster &&
+				nr_sync < SCFS_CLUSTER_PAGES_MAX) {
+			sync_pages[nr_sync++] = page;
+			continue;
+		}
+
+		/* memory buffer is full, or a synchronous read request while
+		   the helpers are busy - call scfs_readpage to read now */
+		spin_lock(&sbi->spinlock_smb);
+		queue_page = sbi->page_buffer_next_filling_index_smb !=
+				MAX_PAGE_BUFFER_SIZE_SMB &&
+			(page_idx >= page_idx_readahead ||
+				smb_queue_length(sbi) < SMB_THREAD_THRESHOLD_2);
+		if (!queue_page) {
+			spin_unlock(&sbi->spinlock_smb);
 
 			if (prev_cluster == cur_cluster && prev_cbi > 0)
 				prev_cbi = _scfs_readpage(file, page, prev_cbi - 1);
@@ -683,8 +745,6 @@ scfs_readpages(struct file *file, struct address_space *mapping,
 			prev_cluster = cur_cluster;
 			page_cache_release(page); /* refer line 701 */
 		} else {
-			spin_lock(&sbi->spinlock_smb);
-
 			/* Queue is not full so add the page into the queue.
 			   Also, here we increase file->f_count to protect
 			   the file structs from multi-threaded accesses */
@@ -710,6 +770,14 @@ scfs_readpages(struct file *file, struct address_space *mapping,
 	if (readahead_page > 0)
 		wakeup_smb_thread(sbi);
 
+	for (i = 0; i < nr_sync; i++) {
+		if (i > 0 && prev_cbi > 0)
+			prev_cbi = _scfs_readpage(file, sync_pages[i], prev_cbi - 1);
+		else
+			prev_cbi = _scfs_readpage(file, sync_pages[i], -1);
+		page_cache_release(sync_pages[i]);
+	}
+
 	SCFS_PRINT("<e>\n");
 
 #ifdef SCFS_ASYNC_READ_PROFILE
@@ -809,6 +877,9 @@ static int scfs_write_begin(struct file *file, struct address_space *mapping,
 					SCFS_PRINT_ERROR("Fail to get lower data.");
 					goto out;
 				}				
+				/* this cluster is about to be rewritten in place */
+				scfs_invalidate_read_cluster(mapping->host,
+					PAGE_TO_CLUSTER_INDEX(page,sii));
 
 				if (!PageUptodate(page))
 					sync_page_from_buffer(page, sii->cluster_buffer.u_buffer);
@@ -1121,6 +1192,8 @@ static int scfs_write_end(struct file *file, struct address_space *mapping,
 				}
 	    		}	    	
 			atomic64_sub(sii->cluster_buffer.original_size,&sb_info->current_data_size);
+			scfs_invalidate_read_cluster(mapping->host,
+				info_entry->current_cluster_idx);
 			sii->cluster_buffer.original_size = 0;
 #endif
  		}
@@ -1474,6 +1547,8 @@ int scfs_write_one_compress_cluster(struct scfs_inode_info *sii,
 		__free_pages(cb->u_page, SCFS_MEMPOOL_ORDER + 1);
 	}	    	
 	atomic64_sub(cb->original_size, &sbi->current_data_size);
+	scfs_invalidate_read_cluster(&sii->vfs_inode,
+		info_entry->current_cluster_idx);
 
 	spin_lock(&sbi->sii_list_lock);
 	cbm->is_compress_write_done = 2;
@@ -1588,6 +1663,8 @@ int scfs_write_compress_all_cluster(struct scfs_inode_info *sii, struct file *lo
 			}
     		}	    	
 		atomic64_sub(cb->original_size, &sbi->current_data_size);
+		scfs_invalidate_read_cluster(&sii->vfs_inode,
+			info_entry->current_cluster_idx);
 
 		/* clear this cbm */
 		__free_pages(cb->u_page, SCFS_MEMPOOL_ORDER + 1);
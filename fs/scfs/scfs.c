@@ -36,7 +36,9 @@
 #include <linux/statfs.h>
 #include "scfs.h"
 #include <linux/lzo.h>
+#include <linux/lz4.h>
 #include <linux/ctype.h>
+#include <linux/jhash.h>
 
 struct kmem_cache *scfs_file_info_cache;
 struct kmem_cache *scfs_dentry_info_cache;
@@ -59,7 +61,8 @@ const char *tfm_names[SCFS_COMP_TOTAL_TYPES] =
 	"lzo",		/* lzo */
 	"zlib",		/* zlib */ 
 	"deflate",
-	"fastlzo"	/* lzo */
+	"fastlzo",	/* lzo */
+	"lz4"		/* lz4 */
 };
 
 extern struct scfs_compressor *scfs_compressors[SCFS_COMP_TOTAL_TYPES];
@@ -140,6 +143,7 @@ int scfs_reload_meta(struct file *file)
 
 	if (sii->cinfo_array)
 		scfs_cinfo_free(sii, sii->cinfo_array);
+	scfs_invalidate_read_cache(dentry->d_inode);
 
 	ret = scfs_load_cinfo(sii, lower_file);
 	if (ret) {
@@ -315,6 +319,10 @@ int scfs_parse_options(struct scfs_sb_info *sbi, char *options)
 #ifdef CONFIG_CRYPTO_FASTLZO
 			else if (!strcmp(type, "fastlzo"))
 				sbi->options.comp_type = SCFS_COMP_FASTLZO;
+#endif
+#ifdef CONFIG_CRYPTO_LZ4
+			else if (!strcmp(type, "lz4"))
+				sbi->options.comp_type = SCFS_COMP_LZ4;
 #endif
 			else {
 				SCFS_PRINT_ERROR("invalid compression type\n");
@@ -584,6 +592,17 @@ int scfs_decompress(enum comp_type algo, char *buf_c, char *buf_u, size_t len,
 			ret = -EIO;
 		}
 		break;
+#ifdef CONFIG_CRYPTO_LZ4
+	case SCFS_COMP_LZ4:
+		ret = lz4_decompress_unknownoutputsize(buf_c, len, buf_u, actual);
+		if (ret) {
+			SCFS_PRINT_ERROR("lz4 decompress error! "
+					"ret %d len %d tmp_len %d\n",
+					ret, len, *actual);
+			ret = -EIO;
+		}
+		break;
+#endif
 	default:
 		ret = scfs_decompress_crypto((void *)buf_c, len, (void *)buf_u, actual, (int)algo);
 		if (ret) {
@@ -651,6 +670,31 @@ int scfs_compress(enum comp_type algo, char *buf_c, char *buf_u, size_t len,
 			ret = -EIO;
 		}
 		break;
+#ifdef CONFIG_CRYPTO_LZ4
+	case SCFS_COMP_LZ4:
+		/* lz4 writes up to the worst case, store it raw if that won't fit */
+		if (*actual < lz4_compressbound(len)) {
+			*actual = len;
+			break;
+		}
+
+		if (!workdata) {
+			spin_lock(&sbi->workdata_lock);
+			memset(sbi->scfs_workdata, 0, LZ4_MEM_COMPRESS);
+			ret = lz4_compress(buf_u, len, buf_c, actual, sbi->scfs_workdata);
+			spin_unlock(&sbi->workdata_lock);
+		} else {
+			memset(workdata, 0, LZ4_MEM_COMPRESS);
+			ret = lz4_compress(buf_u, len, buf_c, actual, workdata);
+		}
+
+		if (ret) {
+			SCFS_PRINT("lz4 compress error! "
+				"ret %d len %d tmp_len %d\n", ret, len, *actual);
+			ret = -EIO;
+		}
+		break;
+#endif
 	default:
 		ret = scfs_compress_crypto((void *)buf_u, len, (void *)buf_c, actual, (int)algo);
 		if (ret) {
@@ -686,6 +730,243 @@ void scfs_free_mempool_buffer(struct page *p, struct scfs_sb_info *sbi)
 	profile_sub_mempooled(SCFS_MEMPOOL_SIZE, sbi);
 }
 
+#ifdef SCFS_CLUSTER_CACHE
+/*
+ * Cluster cache
+ *
+ * The buffer_cache slots are recycled round-robin by every reader on the
+ * mount, so a random reader rarely finds its cluster still there when it
+ * comes back for the neighbouring page. Decompressed clusters filled by
+ * single page reads are copied here instead, looked up by (ino, cluster),
+ * kept in LRU order and trimmed through the sb shrinker.
+ */
+static inline struct hlist_head *ccache_bucket(struct scfs_sb_info *sbi,
+	unsigned long ino, int clust_num)
+{
+	return &sbi->ccache_hash[jhash_2words(ino, clust_num, 0) &
+		((1 << SCFS_CLUSTER_CACHE_HASH_BITS) - 1)];
+}
+
+static struct scfs_ccache_entry *ccache_find(struct scfs_sb_info *sbi,
+	unsigned long ino, int clust_num)
+{
+	struct scfs_ccache_entry *ce;
+
+	hlist_for_each_entry(ce, ccache_bucket(sbi, ino, clust_num), hash)
+		if (ce->ino == ino && ce->clust_num == clust_num)
+			return ce;
+
+	return NULL;
+}
+
+static void ccache_free_list(struct list_head *head)
+{
+	struct scfs_ccache_entry *ce, *tmp;
+
+	list_for_each_entry_safe(ce, tmp, head, lru) {
+		list_del(&ce->lru);
+		__free_pages(ce->page, SCFS_MEMPOOL_ORDER);
+		kfree(ce);
+	}
+}
+
+void scfs_ccache_init(struct scfs_sb_info *sbi)
+{
+	int i;
+
+	for (i = 0; i < (1 << SCFS_CLUSTER_CACHE_HASH_BITS); i++)
+		INIT_HLIST_HEAD(&sbi->ccache_hash[i]);
+	INIT_LIST_HEAD(&sbi->ccache_lru);
+	spin_lock_init(&sbi->ccache_lock);
+	sbi->ccache_count = 0;
+}
+
+/* sample before reading a cluster from lower, pass to scfs_ccache_insert */
+unsigned int scfs_ccache_seq(struct scfs_inode_info *sii)
+{
+	struct scfs_sb_info *sbi = SCFS_S(sii->vfs_inode.i_sb);
+	unsigned int seq;
+
+	spin_lock(&sbi->ccache_lock);
+	seq = sii->ccache_seq;
+	spin_unlock(&sbi->ccache_lock);
+
+	return seq;
+}
+
+/* copy one page of a cached cluster into @page, returns 1 on a hit */
+int scfs_ccache_read_page(struct scfs_sb_info *sbi, unsigned long ino,
+	int clust_num, struct page *page, int pgoff)
+{
+	struct scfs_ccache_entry *ce;
+	char *virt;
+
+	spin_lock(&sbi->ccache_lock);
+	ce = ccache_find(sbi, ino, clust_num);
+	if (!ce) {
+		sbi->ccache_miss_count++;
+		spin_unlock(&sbi->ccache_lock);
+		return 0;
+	}
+	list_move(&ce->lru, &sbi->ccache_lru);
+	virt = kmap_atomic(page);
+	memcpy(virt, page_address(ce->page) + pgoff * PAGE_SIZE, PAGE_SIZE);
+	kunmap_atomic(virt);
+	sbi->ccache_hit_count++;
+	spin_unlock(&sbi->ccache_lock);
+
+	return 1;
+}
+
+void scfs_ccache_insert(struct scfs_inode_info *sii, int clust_num,
+	const void *buf, size_t len, unsigned int seq)
+{
+	struct scfs_sb_info *sbi = SCFS_S(sii->vfs_inode.i_sb);
+	unsigned long ino = sii->vfs_inode.i_ino;
+	struct scfs_ccache_entry *ce, *victim;
+	LIST_HEAD(dispose);
+
+	ASSERT(len <= SCFS_MEMPOOL_SIZE);
+
+	/* a cache fill is never worth reclaim effort */
+	ce = kmalloc(sizeof(*ce), GFP_NOFS | __GFP_NOWARN);
+	if (!ce)
+		return;
+	ce->page = alloc_pages(GFP_NOFS | __GFP_NORETRY | __GFP_NOWARN,
+		SCFS_MEMPOOL_ORDER);
+	if (!ce->page) {
+		kfree(ce);
+		return;
+	}
+	ce->ino = ino;
+	ce->clust_num = clust_num;
+	memcpy(page_address(ce->page), buf, len);
+
+	spin_lock(&sbi->ccache_lock);
+	if (seq != sii->ccache_seq || ccache_find(sbi, ino, clust_num)) {
+		/*
+		 * The lower cluster may have been rewritten since we read it,
+		 * or another reader of the same cluster got here first.
+		 */
+		list_add(&ce->lru, &dispose);
+	} else {
+		hlist_add_head(&ce->hash, ccache_bucket(sbi, ino, clust_num));
+		list_add(&ce->lru, &sbi->ccache_lru);
+		if (++sbi->ccache_count > SCFS_CLUSTER_CACHE_MAX) {
+			victim = list_entry(sbi->ccache_lru.prev,
+				struct scfs_ccache_entry, lru);
+			hlist_del(&victim->hash);
+			list_move(&victim->lru, &dispose);
+			sbi->ccache_count--;
+		}
+	}
+	spin_unlock(&sbi->ccache_lock);
+
+	ccache_free_list(&dispose);
+}
+
+/*
+ * Drop up to @nr_to_scan clusters from the cold end of the LRU and return
+ * how many are left; nr_to_scan < 0 empties the cache.
+ */
+int scfs_ccache_shrink(struct scfs_sb_info *sbi, int nr_to_scan)
+{
+	struct scfs_ccache_entry *ce;
+	LIST_HEAD(dispose);
+	int ret;
+
+	spin_lock(&sbi->ccache_lock);
+	while (nr_to_scan-- && !list_empty(&sbi->ccache_lru)) {
+		ce = list_entry(sbi->ccache_lru.prev,
+			struct scfs_ccache_entry, lru);
+		hlist_del(&ce->hash);
+		list_move(&ce->lru, &dispose);
+		sbi->ccache_count--;
+	}
+	ret = sbi->ccache_count;
+	spin_unlock(&sbi->ccache_lock);
+
+	ccache_free_list(&dispose);
+
+	return ret;
+}
+#endif
+
+/*
+ * Forget the decompressed copies of cluster @clust_num of @inode, or of all
+ * of its clusters when @clust_num is negative.
+ */
+static void __scfs_invalidate_read_cache(struct inode *inode, int clust_num)
+{
+	struct scfs_sb_info *sbi = SCFS_S(inode->i_sb);
+	unsigned long ino = inode->i_ino;
+#ifdef SCFS_CLUSTER_CACHE
+	struct scfs_ccache_entry *ce, *tmp;
+	LIST_HEAD(dispose);
+#endif
+#if MAX_BUFFER_CACHE
+	int i;
+
+	spin_lock(&sbi->buffer_cache_lock);
+	for (i = 0; i < MAX_BUFFER_CACHE; i++) {
+		/* a slot being filled right now is left to its reader */
+		if (sbi->buffer_cache[i].ino != (int)ino ||
+				(clust_num >= 0 &&
+				 sbi->buffer_cache[i].clust_num != clust_num) ||
+				atomic_read(&sbi->buffer_cache[i].is_used) == 1)
+			continue;
+		sbi->buffer_cache[i].ino = -1;
+		sbi->buffer_cache[i].clust_num = -1;
+		sbi->buffer_cache[i].is_compressed = -1;
+		atomic_set(&sbi->buffer_cache[i].is_used, -1);
+	}
+	spin_unlock(&sbi->buffer_cache_lock);
+#endif
+
+#ifdef SCFS_CLUSTER_CACHE
+	spin_lock(&sbi->ccache_lock);
+	SCFS_I(inode)->ccache_seq++;
+	if (clust_num >= 0) {
+		ce = ccache_find(sbi, ino, clust_num);
+		if (ce) {
+			hlist_del(&ce->hash);
+			list_move(&ce->lru, &dispose);
+			sbi->ccache_count--;
+		}
+	} else {
+		list_for_each_entry_safe(ce, tmp, &sbi->ccache_lru, lru) {
+			if (ce->ino != ino)
+				continue;
+			hlist_del(&ce->hash);
+			list_move(&ce->lru, &dispose);
+			sbi->ccache_count--;
+		}
+	}
+	spin_unlock(&sbi->ccache_lock);
+
+	ccache_free_list(&dispose);
+#endif
+}
+
+/*
+ * Forget every decompressed cluster of @inode; called whenever the lower
+ * clusters of the file may have changed (meta reload, truncate, evict).
+ */
+void scfs_invalidate_read_cache(struct inode *inode)
+{
+	__scfs_invalidate_read_cache(inode, -1);
+}
+
+/*
+ * Forget the decompressed copies of one cluster of @inode; called when an
+ * append rewrites the last cluster in place, before and after the lower
+ * write.
+ */
+void scfs_invalidate_read_cluster(struct inode *inode, int clust_num)
+{
+	__scfs_invalidate_read_cache(inode, clust_num);
+}
+
 int scfs_check_space(struct scfs_sb_info *sbi, struct dentry *dentry)
 {
 	struct dentry *lower_dentry = scfs_lower_dentry(dentry);
@@ -890,6 +1171,8 @@ int scfs_write_meta(struct file *file)
 
 			atomic64_sub(sii->cluster_buffer.original_size ,&sbi->current_data_size);
 			sii->cluster_buffer.original_size = 0;
+			scfs_invalidate_read_cluster(&sii->vfs_inode,
+				last->current_cluster_idx);
 		}
 		pos = ALIGN(last->cinfo.offset + last->cinfo.size, SCFS_CLUSTER_ALIGN_BYTE);
 
@@ -1144,6 +1427,7 @@ int scfs_truncate(struct dentry *dentry, loff_t size)
 		scfs_cinfo_free(sii, sii->cinfo_array);
 		sii->cinfo_array = NULL;
 	}
+	scfs_invalidate_read_cache(inode);
 	sii->cinfo_array_size = 0;
 	sii->upper_file_size = 0;
 	sii->cluster_buffer.original_size = 0;
@@ -89,6 +89,7 @@ extern struct kmem_cache *scfs_sb_info_cache;
 #define SCFS_CLUSTER_SIZE_DEF		(16 * 1024)
 #define SCFS_CLUSTER_SIZE_MAX		(16 * 1024)
 #define SCFS_CLUSTER_SIZE_MIN		(4 * 1024)
+#define SCFS_CLUSTER_PAGES_MAX		((SCFS_CLUSTER_SIZE_MAX + PAGE_SIZE - 1) / PAGE_SIZE)
 
 /* mount option & file status flags */
 #define SCFS_DATA_RAW			0x00000001
@@ -121,6 +122,11 @@ extern struct kmem_cache *scfs_sb_info_cache;
 #define SCFS_ASYNC_READ_PROFILE
 #endif
 
+/* decompressed clusters kept for random reads, trimmed by the sb shrinker */
+#define SCFS_CLUSTER_CACHE
+#define SCFS_CLUSTER_CACHE_MAX		64
+#define SCFS_CLUSTER_CACHE_HASH_BITS	5
+
 #ifdef SCFS_ASYNC_READ_PAGES
 //#define SCFS_SMB_THREAD_CPU_AFFINITY
 #define MAX_PAGE_BUFFER_SIZE_SMB	2048
@@ -152,12 +158,15 @@ extern struct kmem_cache *scfs_sb_info_cache;
 /*******************************/
 /* compression & cluster stuff */
 /*******************************/
+struct scfs_comp_ctx {
+	struct mutex mutex;
+	struct crypto_comp *cc;
+};
+
 struct scfs_compressor {
 	int compr_type;
 	const char *name;
-	struct crypto_comp *cc;
-	struct mutex *comp_mutex;
-	struct mutex *decomp_mutex;
+	struct scfs_comp_ctx __percpu *ctx;
 	const char *capi_name;
 };
 
@@ -167,6 +176,7 @@ enum comp_type {
 	SCFS_COMP_ZLIB,
 	SCFS_COMP_BZIP2,
 	SCFS_COMP_FASTLZO,
+	SCFS_COMP_LZ4,
 	SCFS_COMP_TOTAL_TYPES,
 };
 
@@ -206,6 +216,16 @@ struct read_buffer_cache {
 	atomic_t is_used;
 };
 
+#ifdef SCFS_CLUSTER_CACHE
+struct scfs_ccache_entry {
+	struct list_head lru;
+	struct hlist_node hash;
+	unsigned long ino;
+	int clust_num;
+	struct page *page;
+};
+#endif
+
 struct scfs_mount_options
 {
 	int flags;
@@ -231,6 +251,15 @@ struct scfs_sb_info
 	int read_buffer_index;
 #endif
 
+#ifdef SCFS_CLUSTER_CACHE
+	struct hlist_head ccache_hash[1 << SCFS_CLUSTER_CACHE_HASH_BITS];
+	struct list_head ccache_lru;
+	spinlock_t ccache_lock;
+	int ccache_count;
+	u64 ccache_hit_count;
+	u64 ccache_miss_count;
+#endif
+
 #ifndef CONFIG_SCFS_USE_CRYPTO
 	void *scfs_workdata;
 	spinlock_t workdata_lock;
@@ -340,6 +369,10 @@ struct scfs_inode_info
 	int cbm_list_write_count;		/* the number of cbm to write */
 	struct list_head mtc_list;
 	int is_inserted_to_sii_list;
+#endif
+#ifdef SCFS_CLUSTER_CACHE
+	/* bumped under ccache_lock by every invalidation of this inode */
+	unsigned int ccache_seq;
 #endif
  	struct inode vfs_inode;
 	/* DO NOT ADD FIELDS BELOW vfs_inode */
@@ -606,6 +639,24 @@ struct page *scfs_alloc_mempool_buffer(struct scfs_sb_info *sbi);
 
 void scfs_free_mempool_buffer(struct page *p, struct scfs_sb_info *sbi);
 
+void scfs_invalidate_read_cache(struct inode *inode);
+
+void scfs_invalidate_read_cluster(struct inode *inode, int clust_num);
+
+#ifdef SCFS_CLUSTER_CACHE
+void scfs_ccache_init(struct scfs_sb_info *sbi);
+
+int scfs_ccache_read_page(struct scfs_sb_info *sbi, unsigned long ino,
+	int clust_num, struct page *page, int pgoff);
+
+unsigned int scfs_ccache_seq(struct scfs_inode_info *sii);
+
+void scfs_ccache_insert(struct scfs_inode_info *sii, int clust_num,
+	const void *buf, size_t len, unsigned int seq);
+
+int scfs_ccache_shrink(struct scfs_sb_info *sbi, int nr_to_scan);
+#endif
+
 struct scfs_cluster_buffer *scfs_get_cluster_buffer(struct page *page,
 	struct scfs_inode_info *sii, struct file *file);
 
@@ -693,6 +744,7 @@ extern void wakeup_smtc_writer_thread(struct scfs_sb_info *sb_info);
 /* compressor.c */
 int scfs_compressors_init(void);
 void scfs_compressors_exit(void);
+int scfs_compressor_get(int compr_type);
 int scfs_compress_crypto(const void *in_buf, size_t in_len, void *out_buf, size_t *out_len,
 		    int compr_type);
 int scfs_decompress_crypto(const void *buf, size_t len, void *out, size_t *out_len,
@@ -38,6 +38,7 @@
 #include "scfs.h"
 #include "../mount.h"
 #include <linux/lzo.h>
+#include <linux/lz4.h>
 
 #define SCFS_VERSION "1.2.19"
 
@@ -85,6 +86,9 @@ static const char * supported_comp_types = "lzo"
 #endif
 #ifdef CONFIG_CRYPTO_FASTLZO
 	",fastlzo"
+#endif
+#ifdef CONFIG_CRYPTO_LZ4
+	",lz4"
 #endif
 	"\n";
 
@@ -182,6 +186,7 @@ static void scfs_evict_inode(struct inode *inode)
 		scfs_cinfo_free(sii, sii->cinfo_array);
 		sii->cinfo_array = NULL;
 	}
+	scfs_invalidate_read_cache(inode);
 	if (!list_empty(&sii->cinfo_list))
 		SCFS_PRINT_ERROR("cinfo list is not empty!\n");
 
@@ -190,6 +195,18 @@ static void scfs_evict_inode(struct inode *inode)
 	iput(lower_inode);
 }
 
+#ifdef SCFS_CLUSTER_CACHE
+static int scfs_nr_cached_objects(struct super_block *sb)
+{
+	return SCFS_S(sb)->ccache_count;
+}
+
+static void scfs_free_cached_objects(struct super_block *sb, int nr_to_scan)
+{
+	scfs_ccache_shrink(SCFS_S(sb), nr_to_scan);
+}
+#endif
+
 static int scfs_statfs(struct dentry *dentry, struct kstatfs *buf)
 {
 	int ret;
@@ -229,6 +246,9 @@ static int scfs_show_options(struct seq_file *m, struct dentry *root)
 	case SCFS_COMP_FASTLZO:
 		seq_printf(m, ",comp_type=fastlzo");
 		break;
+	case SCFS_COMP_LZ4:
+		seq_printf(m, ",comp_type=lz4");
+		break;
 	default:
 		break;
 	}
@@ -320,6 +340,14 @@ static int scfs_debugfs_init(struct super_block *sb)
 	debugfs_create_u64("buffer_cache_reclaimed_before_used_count", S_IRUGO,
 		debugfs_root, &sbi->buffer_cache_reclaimed_before_used_count);
 
+#ifdef SCFS_CLUSTER_CACHE
+	debugfs_create_u64("ccache_hit_count", S_IRUGO,
+		debugfs_root, &sbi->ccache_hit_count);
+
+	debugfs_create_u64("ccache_miss_count", S_IRUGO,
+		debugfs_root, &sbi->ccache_miss_count);
+
+#endif
 	debugfs_create_atomic_t("scfs_standby_readpage_count", S_IRUGO,
 		debugfs_root, &sbi->scfs_standby_readpage_count);
 
@@ -389,6 +417,18 @@ static struct dentry *scfs_mount(struct file_system_type *fs_type, int flags,
 	if (!sbi->options.comp_type)
 		sbi->options.comp_type = SCFS_COMP_LZO;
 
+	/* allocate the contexts of the mount's compressor up front */
+#ifdef CONFIG_SCFS_USE_CRYPTO
+	ret = scfs_compressor_get(sbi->options.comp_type);
+#else
+	/* lzo and lz4 are called directly, the rest go through crypto */
+	if (sbi->options.comp_type != SCFS_COMP_LZO &&
+			sbi->options.comp_type != SCFS_COMP_LZ4)
+		ret = scfs_compressor_get(sbi->options.comp_type);
+#endif
+	if (ret)
+		goto out_free;
+
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(3,10,0)
 	sb = sget(fs_type, NULL, set_anon_super, flags, NULL);
 #else
@@ -405,6 +445,9 @@ static struct dentry *scfs_mount(struct file_system_type *fs_type, int flags,
 	sb->s_bdi = &sbi->bdi;
 	sb->s_bdi->ra_pages = VM_MAX_READAHEAD * 1024 / PAGE_CACHE_SIZE;
 	sb->s_fs_info = sbi;
+#ifdef SCFS_CLUSTER_CACHE
+	scfs_ccache_init(sbi);
+#endif
 
 	sb->s_op = &scfs_sops;
 	sb->s_d_op = &scfs_dops;
@@ -482,6 +525,17 @@ static struct dentry *scfs_mount(struct file_system_type *fs_type, int flags,
 			goto out_deactivate;
 		}
 		break;
+#ifdef CONFIG_CRYPTO_LZ4
+	case SCFS_COMP_LZ4:
+		sbi->scfs_workdata = vmalloc(LZ4_MEM_COMPRESS);
+		if (!sbi->scfs_workdata) {
+			SCFS_PRINT_ERROR("vmalloc for lz4 workmem failed, "
+					"len %d\n", LZ4_MEM_COMPRESS);
+			ret = -ENOMEM;
+			goto out_deactivate;
+		}
+		break;
+#endif
 	default:
 		break;
 	}
@@ -558,6 +612,10 @@ static void scfs_kill_block_super(struct super_block *sb)
 		vfree(sbi->scfs_workdata);
 #endif
 
+#ifdef SCFS_CLUSTER_CACHE
+	scfs_ccache_shrink(sbi, -1);
+#endif
+
 	if (sbi->mempool)
 		mempool_destroy(sbi->mempool);
 
@@ -710,6 +768,10 @@ const struct super_operations scfs_sops = {
 	 .statfs		= scfs_statfs,
 	 .remount_fs		= scfs_remount_fs,
 	 .show_options		= scfs_show_options,
+#ifdef SCFS_CLUSTER_CACHE
+	 .nr_cached_objects	= scfs_nr_cached_objects,
+	 .free_cached_objects	= scfs_free_cached_objects,
+#endif
  };
 
  const struct dentry_operations scfs_dops = {
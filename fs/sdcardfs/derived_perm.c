@@ -46,6 +46,42 @@ void setup_derived_state(struct inode *inode, perm_t perm,
 	info->under_android = under_android;
 }
 
+/* package directories keep their appid until packages.list is reloaded */
+static appid_t get_cached_appid(struct sdcardfs_sb_info *sbi,
+				struct dentry *dentry)
+{
+	struct sdcardfs_inode_info *info = SDCARDFS_I(dentry->d_inode);
+	const struct qstr *name = &dentry->d_name;
+	unsigned int gen = packagelist_generation(sbi->pkgl_id);
+	unsigned int seq;
+	appid_t appid;
+	bool hit;
+
+	/* only directories: a file could be reached under another name */
+	if (!S_ISDIR(dentry->d_inode->i_mode))
+		return get_appid(sbi->pkgl_id, name->name);
+
+	/* d_name.hash is the case insensitive sdcardfs_hash_ci() */
+	do {
+		seq = read_seqbegin(&info->appid_lock);
+		hit = info->pkgl_gen == gen &&
+		      info->appid_name_hash == name->hash &&
+		      info->appid_name_len == name->len;
+		appid = info->appid;
+	} while (read_seqretry(&info->appid_lock, seq));
+	if (hit)
+		return appid;
+
+	appid = get_appid(sbi->pkgl_id, name->name);
+	write_seqlock(&info->appid_lock);
+	info->appid = appid;
+	info->appid_name_hash = name->hash;
+	info->appid_name_len = name->len;
+	info->pkgl_gen = gen;
+	write_sequnlock(&info->appid_lock);
+	return appid;
+}
+
 void get_derived_permission(struct dentry *parent, struct dentry *dentry)
 {
 	struct sdcardfs_sb_info *sbi = SDCARDFS_SB(dentry->d_sb);
@@ -115,7 +151,7 @@ void get_derived_permission(struct dentry *parent, struct dentry *dentry)
 		case PERM_ANDROID_DATA:
 		case PERM_ANDROID_OBB:
 		case PERM_ANDROID_MEDIA:
-			appid = get_appid(sbi->pkgl_id, dentry->d_name.name);
+			appid = get_cached_appid(sbi, dentry);
 			if (appid != 0) {
 				info->d_uid = multiuser_get_uid(parent_info->userid, appid);
 			}
@@ -150,7 +186,7 @@ void get_derived_permission(struct dentry *parent, struct dentry *dentry)
 		break;
 
 		case PERM_ANDROID_KNOX_DATA:
-			appid = get_appid(sbi->pkgl_id, dentry->d_name.name);
+			appid = get_cached_appid(sbi, dentry);
 			info->perm = PERM_ANDROID_KNOX_PACKAGE_DATA;
 		if (appid != 0) {
 			info->d_uid = multiuser_get_uid(parent_info->userid, appid);
@@ -23,19 +23,12 @@
 #include <linux/backing-dev.h>
 #endif
 
-static ssize_t sdcardfs_read(struct file *file, char __user *buf,
-			   size_t count, loff_t *ppos)
-{
-	int err;
-	struct file *lower_file;
-	struct dentry *dentry = file->f_path.dentry;
 #ifdef CONFIG_SDCARD_FS_FADV_NOACTIVE
+/* pass a FADV_NOREUSE style hint on the upper file down to the lower one */
+static void sdcardfs_copy_noactive(struct file *file, struct file *lower_file)
+{
 	struct backing_dev_info *bdi;
-#endif
 
-	lower_file = sdcardfs_lower_file(file);
-
-#ifdef CONFIG_SDCARD_FS_FADV_NOACTIVE
 	if (file->f_mode & FMODE_NOACTIVE) {
 		if (!(lower_file->f_mode & FMODE_NOACTIVE)) {
 			bdi = lower_file->f_mapping->backing_dev_info;
@@ -45,8 +38,24 @@ static ssize_t sdcardfs_read(struct file *file, char __user *buf,
 			spin_unlock(&lower_file->f_lock);
 		}
 	}
+}
+#else
+static inline void sdcardfs_copy_noactive(struct file *file,
+					struct file *lower_file)
+{
+}
 #endif
 
+static ssize_t sdcardfs_read(struct file *file, char __user *buf,
+			   size_t count, loff_t *ppos)
+{
+	int err;
+	struct file *lower_file;
+	struct dentry *dentry = file->f_path.dentry;
+
+	lower_file = sdcardfs_lower_file(file);
+	sdcardfs_copy_noactive(file, lower_file);
+
 	err = vfs_read(lower_file, buf, count, ppos);
 	/* update our inode atime upon a successful lower read */
 	if (err >= 0)
@@ -82,6 +91,113 @@ static ssize_t sdcardfs_write(struct file *file, const char __user *buf,
 	return err;
 }
 
+/*
+ * readv/writev and io_submit land here; each segment goes straight to the
+ * lower file and the request completes synchronously.
+ */
+static ssize_t sdcardfs_aio_read(struct kiocb *iocb, const struct iovec *iov,
+				unsigned long nr_segs, loff_t pos)
+{
+	ssize_t err = 0, done = 0;
+	unsigned long seg;
+
+	for (seg = 0; seg < nr_segs; seg++) {
+		if (!iov[seg].iov_len)
+			continue;
+		err = sdcardfs_read(iocb->ki_filp, iov[seg].iov_base,
+				iov[seg].iov_len, &pos);
+		if (err <= 0)
+			break;
+		done += err;
+		if (err < iov[seg].iov_len)
+			break;
+	}
+	iocb->ki_pos = pos;
+
+	return done ? done : err;
+}
+
+static ssize_t sdcardfs_aio_write(struct kiocb *iocb, const struct iovec *iov,
+				unsigned long nr_segs, loff_t pos)
+{
+	ssize_t err = 0, done = 0;
+	unsigned long seg;
+
+	for (seg = 0; seg < nr_segs; seg++) {
+		if (!iov[seg].iov_len)
+			continue;
+		err = sdcardfs_write(iocb->ki_filp, iov[seg].iov_base,
+				iov[seg].iov_len, &pos);
+		if (err <= 0)
+			break;
+		done += err;
+		if (err < iov[seg].iov_len)
+			break;
+	}
+	iocb->ki_pos = pos;
+
+	return done ? done : err;
+}
+
+/* splice and sendfile move pages of the lower page cache, never ours */
+static ssize_t sdcardfs_splice_read(struct file *file, loff_t *ppos,
+				struct pipe_inode_info *pipe, size_t len,
+				unsigned int flags)
+{
+	ssize_t err;
+	struct file *lower_file;
+	struct dentry *dentry = file->f_path.dentry;
+
+	lower_file = sdcardfs_lower_file(file);
+	sdcardfs_copy_noactive(file, lower_file);
+	if (lower_file->f_op && lower_file->f_op->splice_read)
+		err = lower_file->f_op->splice_read(lower_file, ppos, pipe,
+						len, flags);
+	else
+		err = default_file_splice_read(lower_file, ppos, pipe,
+						len, flags);
+
+	if (err >= 0)
+		fsstack_copy_attr_atime(dentry->d_inode,
+					lower_file->f_path.dentry->d_inode);
+
+	return err;
+}
+
+static ssize_t sdcardfs_splice_write(struct pipe_inode_info *pipe,
+				struct file *file, loff_t *ppos, size_t len,
+				unsigned int flags)
+{
+	ssize_t err;
+	struct file *lower_file;
+	struct dentry *dentry = file->f_path.dentry;
+
+	/* check disk space */
+	if (!check_min_free_space(dentry, len, 0)) {
+		printk(KERN_INFO "No minimum free space.\n");
+		return -ENOSPC;
+	}
+
+	lower_file = sdcardfs_lower_file(file);
+	if (lower_file->f_op && lower_file->f_op->splice_write)
+		err = lower_file->f_op->splice_write(pipe, lower_file, ppos,
+						len, flags);
+	else if (lower_file->f_mapping->a_ops->write_begin)
+		err = generic_file_splice_write(pipe, lower_file, ppos,
+						len, flags);
+	else
+		err = -EINVAL;
+
+	if (err >= 0) {
+		fsstack_copy_inode_size(dentry->d_inode,
+					lower_file->f_path.dentry->d_inode);
+		fsstack_copy_attr_times(dentry->d_inode,
+					lower_file->f_path.dentry->d_inode);
+	}
+
+	return err;
+}
+
 static int sdcardfs_readdir(struct file *file, void *dirent, filldir_t filldir)
 {
 	int err = 0;
@@ -140,62 +256,31 @@ out:
 static int sdcardfs_mmap(struct file *file, struct vm_area_struct *vma)
 {
 	int err = 0;
-	bool willwrite;
 	struct file *lower_file;
-	const struct vm_operations_struct *saved_vm_ops = NULL;
-	/* this might be deferred to mmap's writepage */
-	willwrite = ((vma->vm_flags | VM_SHARED | VM_WRITE) == vma->vm_flags);
 
-	/*
-	 * File systems which do not implement ->writepage may use
-	 * generic_file_readonly_mmap as their ->mmap op.  If you call
-	 * generic_file_readonly_mmap with VM_WRITE, you'd get an -EINVAL.
-	 * But we cannot call the lower ->mmap op, so we can't tell that
-	 * writeable mappings won't work.  Therefore, our only choice is to
-	 * check if the lower file system supports the ->writepage, and if
-	 * not, return EINVAL (the same error that
-	 * generic_file_readonly_mmap returns in that case).
-	 */
 	lower_file = sdcardfs_lower_file(file);
-	if (willwrite && !lower_file->f_mapping->a_ops->writepage) {
-		err = -EINVAL;
-		printk(KERN_ERR "sdcardfs: lower file system does not "
-		       "support writeable mmap\n");
-		goto out;
-	}
+	if (!lower_file->f_op || !lower_file->f_op->mmap)
+		return -ENODEV;
 
 	/*
-	 * find and save lower vm_ops.
-	 *
-	 * XXX: the VFS should have a cleaner way of finding the lower vm_ops
+	 * Hand the vma over to the lower file, the way ashmem hands out its
+	 * shmem file: mmap_region() links whatever vm_file ->mmap leaves
+	 * behind.  Faults, page_mkwrite and writeback then all run on the
+	 * lower page cache, so mapped data is never cached twice, and the
+	 * lower ->mmap rejects writable mappings it cannot support.
 	 */
-	if (!SDCARDFS_F(file)->lower_vm_ops) {
-		err = lower_file->f_op->mmap(lower_file, vma);
-		if (err) {
-			printk(KERN_ERR "sdcardfs: lower mmap failed %d\n", err);
-			goto out;
-		}
-		saved_vm_ops = vma->vm_ops; /* save: came from lower ->mmap */
-		err = do_munmap(current->mm, vma->vm_start,
-				vma->vm_end - vma->vm_start);
-		if (err) {
-			printk(KERN_ERR "sdcardfs: do_munmap failed %d\n", err);
-			goto out;
-		}
+	vma->vm_file = get_file(lower_file);
+	err = lower_file->f_op->mmap(lower_file, vma);
+	if (err) {
+		vma->vm_file = file;
+		fput(lower_file);
+		printk(KERN_ERR "sdcardfs: lower mmap failed %d\n", err);
+		return err;
 	}
 
-	/*
-	 * Next 3 lines are all I need from generic_file_mmap.  I definitely
-	 * don't want its test for ->readpage which returns -ENOEXEC.
-	 */
 	file_accessed(file);
-	vma->vm_ops = &sdcardfs_vm_ops;
-
-	file->f_mapping->a_ops = &sdcardfs_aops; /* set our aops */
-	if (!SDCARDFS_F(file)->lower_vm_ops) /* save for our ->fault */
-		SDCARDFS_F(file)->lower_vm_ops = saved_vm_ops;
-
-out:
+	/* drop the reference mmap_region() took for the upper file */
+	fput(file);
 	return err;
 }
 
@@ -328,6 +413,10 @@ const struct file_operations sdcardfs_main_fops = {
 	.llseek		= generic_file_llseek,
 	.read		= sdcardfs_read,
 	.write		= sdcardfs_write,
+	.aio_read	= sdcardfs_aio_read,
+	.aio_write	= sdcardfs_aio_write,
+	.splice_read	= sdcardfs_splice_read,
+	.splice_write	= sdcardfs_splice_write,
 	.unlocked_ioctl	= sdcardfs_unlocked_ioctl,
 #ifdef CONFIG_COMPAT
 	.compat_ioctl	= sdcardfs_compat_ioctl,
@@ -562,6 +562,14 @@ static int sdcardfs_rename(struct inode *old_dir, struct dentry *old_dentry,
 			dput(new_parent);
 		}
 	}
+	/* the cached appid belongs to the old name */
+	if (old_dentry->d_inode) {
+		struct sdcardfs_inode_info *info = SDCARDFS_I(old_dentry->d_inode);
+
+		write_seqlock(&info->appid_lock);
+		info->pkgl_gen = 0;
+		write_sequnlock(&info->appid_lock);
+	}
 
 out_err:
 	mnt_drop_write(lower_new_path.mnt);
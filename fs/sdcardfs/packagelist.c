@@ -31,11 +31,19 @@ struct hashtable_entry {
         struct hlist_node hlist;
         void *key;
 	int value;
+	unsigned int generation;	/* last reload that saw this package */
+	struct rcu_head rcu;
 };
 
+/*
+ * package_to_appid is read under RCU only; hashtable_lock serializes the
+ * reader thread's updates. generation is bumped after every reload so that
+ * values cached from get_appid() can tell when they have gone stale.
+ */
 struct packagelist_data {
 	DECLARE_HASHTABLE(package_to_appid,8);
 	struct mutex hashtable_lock;
+	atomic_t generation;
 	struct task_struct *thread_id;
 	char read_buf[STRING_BUF_SIZE];
 	char event_buf[STRING_BUF_SIZE];
@@ -51,11 +59,11 @@ static const char* const kpackageslist_file = "/data/system/packages.list";
 static const gid_t kgroups[1] = { AID_PACKAGE_INFO };
 
 static unsigned int str_hash(void *key) {
-	int i;
-	unsigned int h = strlen(key);
+	int i, len = strlen(key);
+	unsigned int h = len;
 	char *data = (char *)key;
 
-	for (i = 0; i < strlen(key); i++) {
+	for (i = 0; i < len; i++) {
 		h = h * 31 + *data;
 		data++;
 	}
@@ -70,21 +78,28 @@ appid_t get_appid(void *pkgl_id, const char *app_name)
 	appid_t ret_id;
 
 	//printk(KERN_INFO "sdcardfs: %s: %s, %u\n", __func__, (char *)app_name, hash);
-	mutex_lock(&pkgl_dat->hashtable_lock);
-	hash_for_each_possible(pkgl_dat->package_to_appid, hash_cur, hlist, hash) {
+	rcu_read_lock();
+	hash_for_each_possible_rcu(pkgl_dat->package_to_appid, hash_cur, hlist, hash) {
 		//printk(KERN_INFO "sdcardfs: %s: %s\n", __func__, (char *)hash_cur->key);
 		if (!strcasecmp(app_name, hash_cur->key)) {
-			ret_id = (appid_t)hash_cur->value;
-			mutex_unlock(&pkgl_dat->hashtable_lock);
+			ret_id = (appid_t)ACCESS_ONCE(hash_cur->value);
+			rcu_read_unlock();
 			//printk(KERN_INFO "=> app_id: %d\n", (int)ret_id);
 			return ret_id;
 		}
 	}
-	mutex_unlock(&pkgl_dat->hashtable_lock);
+	rcu_read_unlock();
 	//printk(KERN_INFO "=> app_id: %d\n", 0);
 	return 0;
 }
 
+unsigned int packagelist_generation(void *pkgl_id)
+{
+	struct packagelist_data *pkgl_dat = (struct packagelist_data *)pkgl_id;
+
+	return (unsigned int)atomic_read(&pkgl_dat->generation);
+}
+
 /* Kernel has already enforced everything we returned through
  * derive_permissions_locked(), so this is used to lock down access
  * even further, such as enforcing that apps hold sdcard_rw. */
@@ -121,7 +136,8 @@ int open_flags_to_access_mode(int open_flags) {
 	}
 }
 
-static int insert_str_to_int(struct packagelist_data *pkgl_dat, void *key, int value) {
+static int insert_str_to_int(struct packagelist_data *pkgl_dat, void *key,
+				int value, unsigned int generation) {
 	struct hashtable_entry *hash_cur;
 	struct hashtable_entry *new_entry;
 	unsigned int hash = str_hash(key);
@@ -129,7 +145,8 @@ static int insert_str_to_int(struct packagelist_data *pkgl_dat, void *key, int v
 	//printk(KERN_INFO "sdcardfs: %s: %s: %d, %u\n", __func__, (char *)key, value, hash);
 	hash_for_each_possible(pkgl_dat->package_to_appid, hash_cur, hlist, hash) {
 		if (!strcasecmp(key, hash_cur->key)) {
-			hash_cur->value = value;
+			ACCESS_ONCE(hash_cur->value) = value;
+			hash_cur->generation = generation;
 			return 0;
 		}
 	}
@@ -137,17 +154,31 @@ static int insert_str_to_int(struct packagelist_data *pkgl_dat, void *key, int v
 	if (!new_entry)
 		return -ENOMEM;
 	new_entry->key = kstrdup(key, GFP_KERNEL);
+	if (!new_entry->key) {
+		kmem_cache_free(hashtable_entry_cachep, new_entry);
+		return -ENOMEM;
+	}
 	new_entry->value = value;
-	hash_add(pkgl_dat->package_to_appid, &new_entry->hlist, hash);
+	new_entry->generation = generation;
+	hash_add_rcu(pkgl_dat->package_to_appid, &new_entry->hlist, hash);
 	return 0;
 }
 
-static void remove_str_to_int(struct hashtable_entry *h_entry) {
-	//printk(KERN_INFO "sdcardfs: %s: %s: %d\n", __func__, (char *)h_entry->key, h_entry->value);
+static void free_hashtable_entry(struct rcu_head *head)
+{
+	struct hashtable_entry *h_entry =
+		container_of(head, struct hashtable_entry, rcu);
+
 	kfree(h_entry->key);
 	kmem_cache_free(hashtable_entry_cachep, h_entry);
 }
 
+static void remove_str_to_int(struct hashtable_entry *h_entry) {
+	//printk(KERN_INFO "sdcardfs: %s: %s: %d\n", __func__, (char *)h_entry->key, h_entry->value);
+	hash_del_rcu(&h_entry->hlist);
+	call_rcu(&h_entry->rcu, free_hashtable_entry);
+}
+
 /*static void remove_int_to_null(struct hashtable_entry *h_entry) {
 	//printk(KERN_INFO "sdcardfs: %s: %d: %d\n", __func__, (int)h_entry->key, h_entry->value);
 	kmem_cache_free(hashtable_entry_cachep, h_entry);
@@ -165,22 +196,43 @@ static void remove_all_hashentrys(struct packagelist_data *pkgl_dat)
 	hash_init(pkgl_dat->package_to_appid);
 }
 
+/* drop the packages that the last reload did not see */
+static void remove_stale_hashentrys(struct packagelist_data *pkgl_dat,
+					unsigned int generation)
+{
+	struct hashtable_entry *hash_cur;
+	struct hlist_node *h_t;
+	int i;
+
+	hash_for_each_safe(pkgl_dat->package_to_appid, i, h_t, hash_cur, hlist)
+		if (hash_cur->generation != generation)
+			remove_str_to_int(hash_cur);
+}
+
+/*
+ * Entries are updated in place and stale ones are dropped at the end, so
+ * lookups running concurrently never see a half-built table.
+ */
 static int read_package_list(struct packagelist_data *pkgl_dat) {
-	int ret;
+	int ret = 0;
 	int fd;
 	int read_amount;
+	unsigned int generation;
 
 	printk(KERN_INFO "sdcardfs: read_package_list\n");
 
 	mutex_lock(&pkgl_dat->hashtable_lock);
 
-	remove_all_hashentrys(pkgl_dat);
+	generation = (unsigned int)atomic_read(&pkgl_dat->generation) + 1;
+	if (!generation)
+		generation = 1;
 
 	fd = sys_open(kpackageslist_file, O_RDONLY, 0);
 	if (fd < 0) {
 		printk(KERN_ERR "sdcardfs: failed to open package list\n");
-		mutex_unlock(&pkgl_dat->hashtable_lock);
-		return fd;
+		remove_all_hashentrys(pkgl_dat);
+		ret = fd;
+		goto out;
 	}
 
 	while ((read_amount = sys_read(fd, pkgl_dat->read_buf,
@@ -203,18 +255,21 @@ static int read_package_list(struct packagelist_data *pkgl_dat) {
 		if (sscanf(pkgl_dat->read_buf, "%s %d %*d %*s %*s %s",
 				pkgl_dat->app_name_buf, &appid,
 				pkgl_dat->gids_buf) == 3) {
-			ret = insert_str_to_int(pkgl_dat, pkgl_dat->app_name_buf, appid);
+			ret = insert_str_to_int(pkgl_dat, pkgl_dat->app_name_buf,
+						appid, generation);
 			if (ret) {
 				sys_close(fd);
-				mutex_unlock(&pkgl_dat->hashtable_lock);
-				return ret;
+				goto out;
 			}
 		}
 	}
 
 	sys_close(fd);
+	remove_stale_hashentrys(pkgl_dat, generation);
+out:
+	atomic_set(&pkgl_dat->generation, generation);
 	mutex_unlock(&pkgl_dat->hashtable_lock);
-	return 0;
+	return ret;
 }
 
 static int packagelist_reader(void *thread_data)
@@ -312,6 +367,7 @@ void * packagelist_create(void)
 
 	mutex_init(&pkgl_dat->hashtable_lock);
 	hash_init(pkgl_dat->package_to_appid);
+	atomic_set(&pkgl_dat->generation, 1);
 
 	packagelist_thread = kthread_run(packagelist_reader, (void *)pkgl_dat, "pkgld");
 	if (IS_ERR(packagelist_thread)) {
@@ -354,6 +410,8 @@ int packagelist_init(void)
 
 void packagelist_exit(void)
 {
+	/* wait for entries still queued by remove_str_to_int() */
+	rcu_barrier();
 	if (hashtable_entry_cachep)
 		kmem_cache_destroy(hashtable_entry_cachep);
 }
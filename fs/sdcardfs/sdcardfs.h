@@ -165,7 +165,6 @@ extern const struct super_operations sdcardfs_sops;
 extern const struct super_operations sdcardfs_multimount_sops;
 extern const struct dentry_operations sdcardfs_ci_dops;
 extern const struct address_space_operations sdcardfs_aops, sdcardfs_dummy_aops;
-extern const struct vm_operations_struct sdcardfs_vm_ops;
 
 extern int sdcardfs_init_inode_cache(void);
 extern void sdcardfs_destroy_inode_cache(void);
@@ -187,7 +186,6 @@ extern int sdcardfs_removexattr(struct dentry *dentry, const char *name);
 /* file private data */
 struct sdcardfs_file_info {
 	struct file *lower_file;
-	const struct vm_operations_struct *lower_vm_ops;
 };
 
 /* sdcardfs inode data in memory */
@@ -200,6 +198,16 @@ struct sdcardfs_inode_info {
 	uid_t d_uid;
 	gid_t d_gid;
 	bool under_android;
+	/*
+	 * appid of a package directory, valid while pkgl_gen is current and
+	 * the directory is looked up under the name it was derived for: a
+	 * rename on the lower fs keeps this inode.
+	 */
+	seqlock_t appid_lock;
+	appid_t appid;
+	unsigned int appid_name_hash;
+	unsigned int appid_name_len;
+	unsigned int pkgl_gen;
 
 	struct inode vfs_inode;
 };
@@ -414,6 +422,7 @@ static inline void sdcardfs_put_real_lower(const struct dentry *dent,
 
 /* for packagelist.c */
 extern appid_t get_appid(void *pkgl_id, const char *app_name);
+extern unsigned int packagelist_generation(void *pkgl_id);
 extern int check_caller_access_to_name(struct inode *parent_node, const char* name);
 extern int open_flags_to_access_mode(int open_flags);
 extern void *packagelist_create(void);
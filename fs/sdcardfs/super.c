@@ -150,6 +150,7 @@ static struct inode *sdcardfs_alloc_inode(struct super_block *sb)
 
 	/* memset everything up to the inode to 0 */
 	memset(i, 0, offsetof(struct sdcardfs_inode_info, vfs_inode));
+	seqlock_init(&i->appid_lock);
 
 	i->vfs_inode.i_version = 1;
 	return &i->vfs_inode;
@@ -13,6 +13,7 @@
 #include <linux/blkdev.h>
 #include <linux/spinlock.h>
 #include <linux/mutex.h>
+#include <linux/workqueue.h>
 #include <uapi/linux/loop.h>
 
 /* Possible states of device */
@@ -61,6 +62,11 @@ struct loop_device {
 	/* wait queue for incoming requests */
 	wait_queue_head_t	lo_req_wait;
 
+	/* direct I/O mode: bios handed to lo_dio_wq, bounded in flight */
+	struct workqueue_struct	*lo_dio_wq;
+	atomic_t		lo_dio_inflight;
+	wait_queue_head_t	lo_dio_wait;
+
 	struct request_queue	*lo_queue;
 	struct gendisk		*lo_disk;
 };
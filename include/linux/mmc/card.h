@@ -249,6 +249,67 @@ struct mmc_wr_pack_stats {
 	bool print_in_read;
 };
 
+enum mmc_pack_ctrl_decisions {
+	PACK_CTRL_HOLD = 0,
+	PACK_CTRL_MORE,
+	PACK_CTRL_LESS,
+	PACK_CTRL_READ_PROTECT,
+	PACK_CTRL_MAX_DECISIONS,
+};
+
+/*
+ * Adaptive write packing: throughput of packed and single writes and the
+ * latency of reads issued behind them drive the packing trigger and the
+ * maximum number of requests per packed command.
+ */
+struct mmc_wr_pack_ctrl {
+	spinlock_t lock;
+	bool enabled;
+	unsigned int trigger;		/* writes before packing starts */
+	unsigned int max_packed;	/* requests per packed command */
+	unsigned int packed_kbps;	/* EWMA, packed write throughput */
+	unsigned int single_kbps;	/* EWMA, single write throughput */
+	unsigned int rd_lat_us;		/* EWMA, read latency */
+	unsigned int rd_lat_packed_us;	/* EWMA, read behind a packed write */
+	unsigned int samples;		/* write samples in this window */
+	enum mmc_pack_ctrl_decisions last_decision;
+	u32 decisions[PACK_CTRL_MAX_DECISIONS];
+};
+
+enum mmc_queue_stages {
+	MMC_QSTAGE_WAKEUP = 0,	/* request notified -> fetched by thread */
+	MMC_QSTAGE_PREP,	/* fetched -> handed to the host */
+	MMC_QSTAGE_CARD,	/* card busy with the request */
+	MMC_QSTAGE_TOTAL,	/* notified -> completed */
+	MMC_QSTAGE_MAX,
+};
+
+enum mmc_queue_cmds {
+	MMC_QCMD_READ = 0,
+	MMC_QCMD_WRITE,
+	MMC_QCMD_PACKED,
+	MMC_QCMD_DISCARD,
+	MMC_QCMD_SECDISCARD,
+	MMC_QCMD_FLUSH,
+	MMC_QCMD_SANITIZE,
+	MMC_QCMD_MAX,
+};
+
+/* log2(usecs) buckets, the last one is open ended */
+#define MMC_QUEUE_LAT_BUCKETS	20
+
+struct mmc_queue_stats {
+	spinlock_t lock;
+	bool enabled;
+	u32 lat[MMC_QSTAGE_MAX][MMC_QUEUE_LAT_BUCKETS];
+	u64 lat_sum_us[MMC_QSTAGE_MAX];
+	u32 lat_max_us[MMC_QSTAGE_MAX];
+	u32 lat_cnt[MMC_QSTAGE_MAX];
+	u32 cmds[MMC_QCMD_MAX];
+	u32 urgent_notify;	/* urgent request arrived while busy */
+	u32 urgent_preempt;	/* in-flight request interrupted for it */
+};
+
 /* The number of MMC physical partitions.  These consist of:
  * boot partitions (2), general purpose partitions (4) in MMC v4.4.
  */
@@ -411,6 +472,8 @@ struct mmc_card {
 	unsigned int	part_curr;
 
 	struct mmc_wr_pack_stats wr_pack_stats; /* packed commands stats*/
+	struct mmc_wr_pack_ctrl wr_pack_ctrl;	/* adaptive packing policy */
+	struct mmc_queue_stats	queue_stats;	/* block queue latencies */
 
 	struct mmc_bkops_info	bkops_info;
 
@@ -675,6 +738,7 @@ extern void mmc_fixup_device(struct mmc_card *card,
 extern struct mmc_wr_pack_stats *mmc_blk_get_packed_statistics(
 			struct mmc_card *card);
 extern void mmc_blk_init_packed_statistics(struct mmc_card *card);
+extern void mmc_blk_init_pack_ctrl(struct mmc_card *card);
 extern void mmc_blk_disable_wr_packing(struct mmc_queue *mq);
 extern int mmc_send_long_pon(struct mmc_card *card);
 #endif /* LINUX_MMC_CARD_H */
@@ -173,6 +173,17 @@ extern unsigned long this_cpu_loadx(int i);
 extern void sched_update_nr_prod(int cpu, unsigned long nr, bool inc);
 extern void sched_get_nr_running_avg(int *avg, int *iowait_avg);
 
+/* Sums as of a poller's previous poll, see sched_get_nr_running_avg_cpus() */
+struct sched_nr_avg_poll {
+	u64 last_time;
+	u64 nr_prod_seen[NR_CPUS];
+	u64 iowait_prod_seen[NR_CPUS];
+};
+
+extern void sched_get_nr_running_avg_cpus(struct sched_nr_avg_poll *poll,
+					  int *avg, int *iowait_avg,
+					  int *cpu_avg);
+
 extern void calc_global_load(unsigned long ticks);
 extern void update_cpu_load_nohz(void);
 
@@ -197,6 +208,11 @@ extern void proc_sched_set_task(struct task_struct *p);
 extern void
 print_cfs_rq(struct seq_file *m, int cpu, struct cfs_rq *cfs_rq);
 #endif
+#ifdef CONFIG_SCHEDSTATS
+extern void proc_sched_lat_show_task(struct task_struct *p, struct seq_file *m);
+extern int proc_sched_lat_set_task(struct task_struct *p, int enable);
+extern void sched_lat_hist_free(struct task_struct *p);
+#endif
 
 /*
  * Task state bitmask. NOTE! These bits are also
@@ -785,9 +801,32 @@ struct sched_info {
 	/* timestamps */
 	unsigned long long last_arrival,/* when we last ran on a cpu */
 			   last_queued;	/* when we were last queued to run */
+#ifdef CONFIG_SCHEDSTATS
+	unsigned long long lat_pending;	/* delay carried across migrations */
+	unsigned int lat_preempted;	/* queued by preemption, not wakeup */
+#endif
 };
 #endif /* defined(CONFIG_SCHEDSTATS) || defined(CONFIG_TASK_DELAY_ACCT) */
 
+#ifdef CONFIG_SCHEDSTATS
+/*
+ * log2 histogram of the time from being queued to running: bucket 0
+ * counts delays below 1024ns, bucket i delays in [512ns << i, 1024ns << i)
+ * and the last bucket everything longer.
+ */
+#define SCHED_LAT_BUCKETS	21
+
+enum sched_lat_type {
+	SCHED_LAT_WAKEUP,	/* woken up, waiting for a cpu */
+	SCHED_LAT_PREEMPT,	/* preempted, waiting to run again */
+	SCHED_LAT_NR_TYPES,
+};
+
+struct sched_lat_hist {
+	unsigned int count[SCHED_LAT_NR_TYPES][SCHED_LAT_BUCKETS];
+};
+#endif
+
 #ifdef CONFIG_TASK_DELAY_ACCT
 struct task_delay_info {
 	spinlock_t	lock;
@@ -847,6 +886,9 @@ enum cpu_idle_type {
 #define SCHED_POWER_SHIFT	10
 #define SCHED_POWER_SCALE	(1L << SCHED_POWER_SHIFT)
 
+/* Capacity constraints of task groups are expressed in the same scale */
+#define SCHED_CAPACITY_SCALE	SCHED_POWER_SCALE
+
 /*
  * Wake-queues are lists of tasks with a pending wakeup, whose
  * callers have already marked the task as woken internally,
@@ -1226,7 +1268,10 @@ struct task_struct {
 #ifdef CONFIG_CGROUP_SCHED
 	struct task_group *sched_task_group;
 #ifdef CONFIG_CAPACITY_CLAMPING
-	struct rb_node cap_clamp_node[2];
+	/* min, max and boost constraints, see CAP_CLAMP_* */
+	struct rb_node cap_clamp_node[3];
+	/* constraint each node is sorted on, sampled when it was queued */
+	unsigned int cap_clamp_value[3];
 #endif
 #endif
 
@@ -1267,6 +1312,9 @@ struct task_struct {
 #if defined(CONFIG_SCHEDSTATS) || defined(CONFIG_TASK_DELAY_ACCT)
 	struct sched_info sched_info;
 #endif
+#ifdef CONFIG_SCHEDSTATS
+	struct sched_lat_hist *lat_hist;	/* opt-in, see sched_latency */
+#endif
 
 	struct list_head tasks;
 #ifdef CONFIG_ANDROID_LMK_ADJ_RBTREE
@@ -1347,6 +1395,10 @@ struct task_struct {
 	cputime_t utime, stime, utimescaled, stimescaled;
 	cputime_t gtime;
 	unsigned long long cpu_power;
+#ifdef CONFIG_CPU_FREQ_STAT
+	u64 *time_in_state;
+	unsigned int max_state;
+#endif
 #ifndef CONFIG_VIRT_CPU_ACCOUNTING_NATIVE
 	struct cputime prev_cputime;
 #endif
@@ -1827,6 +1879,48 @@ static inline unsigned long sched_get_busy(int cpu)
 static inline void sched_set_io_is_busy(int val) {};
 #endif
 
+#ifdef CONFIG_CPU_FREQ
+/*
+ * Scheduler-side hook for cpufreq governors that choose the frequency from
+ * the utilization the scheduler tracks, rather than by sampling load.
+ */
+struct update_util_data {
+	void (*func)(struct update_util_data *data, int cpu, u64 time,
+		     unsigned long util, unsigned long max);
+};
+
+extern void cpufreq_set_update_util_data(int cpu,
+					 struct update_util_data *data);
+#endif
+
+#ifdef CONFIG_SCHED_CORE_CTL
+/*
+ * An isolated cpu stays online but gets no new tasks, unpinned timers or
+ * interrupts, so that it can sit in its deepest idle state.
+ */
+extern struct cpumask __cpu_isolated_mask;
+#define cpu_isolated_mask	(&__cpu_isolated_mask)
+#define cpu_isolated(cpu)	cpumask_test_cpu((cpu), &__cpu_isolated_mask)
+
+extern int sched_isolate_cpu(int cpu);
+extern void sched_unisolate_cpu(int cpu);
+#else
+#define cpu_isolated_mask	cpu_none_mask
+#define cpu_isolated(cpu)	0
+#endif
+
+#ifdef CONFIG_CAPACITY_CLAMPING
+extern void sched_capacity_clamp(int cpu, unsigned long *min,
+				 unsigned long *max);
+#else
+static inline void sched_capacity_clamp(int cpu, unsigned long *min,
+					unsigned long *max)
+{
+	*min = 0;
+	*max = SCHED_CAPACITY_SCALE;
+}
+#endif
+
 /*
  * Per process flags
  */
@@ -72,6 +72,10 @@ extern unsigned int sysctl_sched_boost;
 
 #endif /* CONFIG_SCHED_HMP */
 
+#ifdef CONFIG_SCHED_ENERGY_AWARE
+extern unsigned int sysctl_sched_energy_aware;
+#endif
+
 enum sched_tunable_scaling {
 	SCHED_TUNABLESCALING_NONE,
 	SCHED_TUNABLESCALING_LOG,
@@ -105,6 +105,9 @@ struct work_struct {
 #ifdef CONFIG_LOCKDEP
 	struct lockdep_map lockdep_map;
 #endif
+#ifdef CONFIG_WQ_STATS
+	u64 queued_time;	/* local_clock() at insertion into a pool */
+#endif
 };
 
 #define WORK_DATA_INIT()	ATOMIC_LONG_INIT(WORK_STRUCT_NO_POOL)
@@ -324,20 +327,30 @@ enum {
  * short queue flush time.  Don't queue works which can run for too
  * long.
  *
+ * system_highpri_wq is similar to system_wq but served by highpri
+ * worker pools.
+ *
  * system_long_wq is similar to system_wq but may host long running
  * works.  Queue flushing might take relatively long.
  *
  * system_unbound_wq is unbound workqueue.  Workers are not bound to
  * any specific CPU, not concurrency managed, and all queued works are
  * executed immediately as long as max_active limit is not reached and
- * resources are available.
+ * resources are available.  It is the place for CPU intensive works.
+ *
+ * system_highpri_unbound_wq is system_unbound_wq served by highpri
+ * workers.  An idle worker is woken as soon as a work is queued, so it
+ * suits short, latency sensitive works that shouldn't wait behind the
+ * concurrency management of a busy cpu.
  *
  * system_freezable_wq is equivalent to system_wq except that it's
  * freezable.
  */
 extern struct workqueue_struct *system_wq;
+extern struct workqueue_struct *system_highpri_wq;
 extern struct workqueue_struct *system_long_wq;
 extern struct workqueue_struct *system_unbound_wq;
+extern struct workqueue_struct *system_highpri_unbound_wq;
 extern struct workqueue_struct *system_freezable_wq;
 
 static inline struct workqueue_struct * __deprecated __system_nrt_wq(void)
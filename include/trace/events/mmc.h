@@ -176,6 +176,90 @@ TRACE_EVENT(mmc_clk,
 	)
 );
 
+/*
+ * Where a block request spent its time: waiting for the queue thread to
+ * pick it up, being prepared, and being served by the card.
+ */
+TRACE_EVENT(mmc_blk_rq_latency,
+	TP_PROTO(const char *dev_name, sector_t sector, unsigned int nr_sect,
+		 int write, int packed, s64 wakeup_us, s64 prep_us,
+		 s64 card_us),
+
+	TP_ARGS(dev_name, sector, nr_sect, write, packed, wakeup_us, prep_us,
+		card_us),
+
+	TP_STRUCT__entry(
+		__string(dev_name, dev_name)
+		__field(sector_t, sector)
+		__field(unsigned int, nr_sect)
+		__field(int, write)
+		__field(int, packed)
+		__field(s64, wakeup_us)
+		__field(s64, prep_us)
+		__field(s64, card_us)
+	),
+
+	TP_fast_assign(
+		__assign_str(dev_name, dev_name);
+		__entry->sector = sector;
+		__entry->nr_sect = nr_sect;
+		__entry->write = write;
+		__entry->packed = packed;
+		__entry->wakeup_us = wakeup_us;
+		__entry->prep_us = prep_us;
+		__entry->card_us = card_us;
+	),
+
+	TP_printk("%s %c%s sector=%llu nr=%u wakeup=%lldus prep=%lldus card=%lldus",
+		  __get_str(dev_name), __entry->write ? 'W' : 'R',
+		  __entry->packed ? " packed" : "",
+		  (unsigned long long)__entry->sector, __entry->nr_sect,
+		  __entry->wakeup_us, __entry->prep_us, __entry->card_us)
+);
+
+TRACE_EVENT(mmc_blk_urgent_notify,
+	TP_PROTO(const char *dev_name, int busy),
+
+	TP_ARGS(dev_name, busy),
+
+	TP_STRUCT__entry(
+		__string(dev_name, dev_name)
+		__field(int, busy)
+	),
+
+	TP_fast_assign(
+		__assign_str(dev_name, dev_name);
+		__entry->busy = busy;
+	),
+
+	TP_printk("%s busy=%d", __get_str(dev_name), __entry->busy)
+);
+
+TRACE_EVENT(mmc_blk_urgent_preempt,
+	TP_PROTO(const char *dev_name, sector_t sector, unsigned int nr_sect,
+		 int packed),
+
+	TP_ARGS(dev_name, sector, nr_sect, packed),
+
+	TP_STRUCT__entry(
+		__string(dev_name, dev_name)
+		__field(sector_t, sector)
+		__field(unsigned int, nr_sect)
+		__field(int, packed)
+	),
+
+	TP_fast_assign(
+		__assign_str(dev_name, dev_name);
+		__entry->sector = sector;
+		__entry->nr_sect = nr_sect;
+		__entry->packed = packed;
+	),
+
+	TP_printk("%s sector=%llu nr=%u packed=%d", __get_str(dev_name),
+		  (unsigned long long)__entry->sector, __entry->nr_sect,
+		  __entry->packed)
+);
+
 DECLARE_EVENT_CLASS(mmc_pm_template,
 	TP_PROTO(const char *dev_name, int err, s64 usecs),
 
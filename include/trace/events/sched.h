@@ -895,6 +895,62 @@ TRACE_EVENT(sched_pi_setprio,
 			__entry->oldprio, __entry->newprio)
 );
 
+/*
+ * Tracepoint for the utilization of a cpu after the capacity_boost of
+ * its RUNNABLE tasks was applied.
+ */
+TRACE_EVENT(sched_boost_cpu,
+
+	TP_PROTO(int cpu, unsigned long util, unsigned long boosted),
+
+	TP_ARGS(cpu, util, boosted),
+
+	TP_STRUCT__entry(
+		__field( int,		cpu			)
+		__field( unsigned long,	util			)
+		__field( unsigned long,	boosted			)
+	),
+
+	TP_fast_assign(
+		__entry->cpu		= cpu;
+		__entry->util		= util;
+		__entry->boosted	= boosted;
+	),
+
+	TP_printk("cpu=%d util=%lu boosted=%lu",
+			__entry->cpu, __entry->util, __entry->boosted)
+);
+
+/*
+ * Tracepoint for the utilization of a task after the capacity constraints
+ * of its group were applied.
+ */
+TRACE_EVENT(sched_boost_task,
+
+	TP_PROTO(struct task_struct *tsk, unsigned long util,
+		 unsigned long boosted),
+
+	TP_ARGS(tsk, util, boosted),
+
+	TP_STRUCT__entry(
+		__array( char,		comm,	TASK_COMM_LEN	)
+		__field( pid_t,		pid			)
+		__field( unsigned long,	util			)
+		__field( unsigned long,	boosted			)
+	),
+
+	TP_fast_assign(
+		memcpy(__entry->comm, tsk->comm, TASK_COMM_LEN);
+		__entry->pid		= tsk->pid;
+		__entry->util		= util;
+		__entry->boosted	= boosted;
+	),
+
+	TP_printk("comm=%s pid=%d util=%lu boosted=%lu",
+			__entry->comm, __entry->pid,
+			__entry->util, __entry->boosted)
+);
+
 #endif /* _TRACE_SCHED_H */
 
 /* This part must be outside protection */
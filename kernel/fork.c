@@ -73,6 +73,7 @@
 #include <linux/signalfd.h>
 #include <linux/uprobes.h>
 #include <linux/aio.h>
+#include <linux/cpufreq.h>
 
 #include <asm/pgtable.h>
 #include <asm/pgalloc.h>
@@ -218,6 +219,10 @@ void free_task(struct task_struct *tsk)
 	rt_mutex_debug_task_free(tsk);
 	ftrace_graph_exit_task(tsk);
 	put_seccomp_filter(tsk);
+	cpufreq_task_stats_free(tsk);
+#ifdef CONFIG_SCHEDSTATS
+	sched_lat_hist_free(tsk);
+#endif
 	arch_release_task_struct(tsk);
 	free_task_struct(tsk);
 }
@@ -338,6 +343,12 @@ static struct task_struct *dup_task_struct(struct task_struct *orig)
 	 */
 	tsk->seccomp.filter = NULL;
 #endif
+	/* Likewise, the parent's time_in_state must not be freed */
+	cpufreq_task_stats_init(tsk);
+#ifdef CONFIG_SCHEDSTATS
+	/* Latency histograms are opt-in per task, not inherited */
+	tsk->lat_hist = NULL;
+#endif
 
 	setup_thread_stack(tsk, orig);
 	clear_user_return_notifier(tsk);
@@ -1304,6 +1315,7 @@ static struct task_struct *copy_process(unsigned long clone_flags,
 	p->utime = p->stime = p->gtime = 0;
 	p->utimescaled = p->stimescaled = 0;
 	p->cpu_power = 0;
+	cpufreq_task_stats_alloc(p);
 #ifndef CONFIG_VIRT_CPU_ACCOUNTING_NATIVE
 	p->prev_cputime.utime = p->prev_cputime.stime = 0;
 #endif
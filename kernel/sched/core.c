@@ -668,7 +668,7 @@ int get_nohz_timer_target(void)
 	rcu_read_lock();
 	for_each_domain(cpu, sd) {
 		for_each_cpu(i, sched_domain_span(sd)) {
-			if (!idle_cpu(i)) {
+			if (!idle_cpu(i) && !cpu_isolated(i)) {
 				cpu = i;
 				goto unlock;
 			}
@@ -914,15 +914,19 @@ cap_clamp_insert_capacity(struct rq *rq, struct task_struct *p,
 	 * current TG the task belongs to. The TG's capacity constraints are
 	 * thus used to place the task within the rbtree used to track
 	 * the capacity_{min,max} for the CPU.
+	 *
+	 * The value is sampled into the task, so that the tree stays sorted
+	 * while a write to the TG's constraints is requeueing its tasks.
 	 */
 	capacity_new = tg->cap_clamp[cap_idx];
+	p->cap_clamp_value[cap_idx] = capacity_new;
 	root = &cgc->tree;
 	link = &root->rb_node;
 	while (*link) {
 		parent = *link;
 		entry = rb_entry(parent, struct task_struct,
 				 cap_clamp_node[cap_idx]);
-		capacity_cur = task_group(entry)->cap_clamp[cap_idx];
+		capacity_cur = entry->cap_clamp_value[cap_idx];
 		if (capacity_new <= capacity_cur) {
 			link = &parent->rb_left;
 			update_cache = 0;
@@ -961,8 +965,8 @@ cap_clamp_remove_capacity(struct rq *rq, struct task_struct *p,
 		struct rb_node *prev_node = rb_prev(node);
 
 		/* Reset value in case this was the last task */
-		cgc->value = (cap_idx == CAP_CLAMP_MIN)
-			? 0 : SCHED_CAPACITY_SCALE;
+		cgc->value = (cap_idx == CAP_CLAMP_MAX)
+			? SCHED_CAPACITY_SCALE : 0;
 
 		/* Update node and value, if there is another task */
 		cgc->node = prev_node;
@@ -971,7 +975,7 @@ cap_clamp_remove_capacity(struct rq *rq, struct task_struct *p,
 
 			entry = rb_entry(cgc->node, struct task_struct,
 					 cap_clamp_node[cap_idx]);
-			cgc->value = task_group(entry)->cap_clamp[cap_idx];
+			cgc->value = entry->cap_clamp_value[cap_idx];
 		}
 	}
 
@@ -983,18 +987,80 @@ cap_clamp_remove_capacity(struct rq *rq, struct task_struct *p,
 static inline void
 cap_clamp_enqueue_task(struct rq *rq, struct task_struct *p, int flags)
 {
-	/* Track task's min/max capacities */
+	/* Track task's min/max capacities and boost */
 	cap_clamp_insert_capacity(rq, p, CAP_CLAMP_MIN);
 	cap_clamp_insert_capacity(rq, p, CAP_CLAMP_MAX);
+	cap_clamp_insert_capacity(rq, p, CAP_CLAMP_BOOST);
 }
 
 static inline void
 cap_clamp_dequeue_task(struct rq *rq, struct task_struct *p, int flags)
 {
-	/* Track task's min/max capacities */
+	/* Track task's min/max capacities and boost */
 	cap_clamp_remove_capacity(rq, p, CAP_CLAMP_MIN);
 	cap_clamp_remove_capacity(rq, p, CAP_CLAMP_MAX);
+	cap_clamp_remove_capacity(rq, p, CAP_CLAMP_BOOST);
+}
+
+static inline unsigned long
+cap_clamp_boost(unsigned long util, unsigned int boost)
+{
+	if (util >= SCHED_CAPACITY_SCALE)
+		return util;
+
+	return util + (SCHED_CAPACITY_SCALE - util) * boost / 100;
+}
+
+/*
+ * Utilization of @rq as seen by frequency selection: the largest boost of
+ * its RUNNABLE tasks is added as a share of the capacity left above @util.
+ */
+unsigned long cap_clamp_cpu_util(struct rq *rq, unsigned long util)
+{
+	unsigned long boosted;
+
+	boosted = cap_clamp_boost(util,
+				  rq->cap_clamp_cpu[CAP_CLAMP_BOOST].value);
+	trace_sched_boost_cpu(cpu_of(rq), util, boosted);
+
+	return boosted;
 }
+
+/*
+ * Utilization of @p as seen by task placement: boosted and then clamped
+ * by the constraints of its task group.  Called under rcu_read_lock().
+ */
+unsigned long cap_clamp_task_util(struct task_struct *p, unsigned long util)
+{
+	struct task_group *tg = task_group(p);
+	unsigned long boosted;
+
+	boosted = cap_clamp_boost(util, tg->cap_clamp[CAP_CLAMP_BOOST]);
+	boosted = clamp_t(unsigned long, boosted,
+			  tg->cap_clamp[CAP_CLAMP_MIN],
+			  tg->cap_clamp[CAP_CLAMP_MAX]);
+	trace_sched_boost_task(p, util, boosted);
+
+	return boosted;
+}
+
+/**
+ * sched_capacity_clamp - capacity constraints of a cpu's RUNNABLE tasks
+ * @cpu: cpu to read the constraints of
+ * @min: set to the largest capacity_min of the tasks queued on @cpu
+ * @max: set to the largest capacity_max of the tasks queued on @cpu
+ *
+ * Both are in [0..SCHED_CAPACITY_SCALE].  Meant to be called from the
+ * cpufreq_update_util() callback, where @cpu's rq->lock is held.
+ */
+void sched_capacity_clamp(int cpu, unsigned long *min, unsigned long *max)
+{
+	struct rq *rq = cpu_rq(cpu);
+
+	*min = rq->cap_clamp_cpu[CAP_CLAMP_MIN].value;
+	*max = rq->cap_clamp_cpu[CAP_CLAMP_MAX].value;
+}
+EXPORT_SYMBOL_GPL(sched_capacity_clamp);
 #else
 static inline void
 cap_clamp_enqueue_task(struct rq *rq, struct task_struct *p, int flags) { }
@@ -2773,6 +2839,7 @@ void set_task_cpu(struct task_struct *p, unsigned int new_cpu)
 #ifdef CONFIG_CAPACITY_CLAMPING
 	RB_CLEAR_NODE(&p->cap_clamp_node[CAP_CLAMP_MIN]);
 	RB_CLEAR_NODE(&p->cap_clamp_node[CAP_CLAMP_MAX]);
+	RB_CLEAR_NODE(&p->cap_clamp_node[CAP_CLAMP_BOOST]);
 #endif
 
 	trace_sched_migrate_task(p, new_cpu, pct_task_load(p));
@@ -3012,6 +3079,34 @@ out:
 	return dest_cpu;
 }
 
+#ifdef CONFIG_SCHED_CORE_CTL
+/*
+ * @cpu is isolated: find an allowed cpu that is not, preferring @cpu's
+ * cluster.  Tasks that may only run on isolated cpus stay on @cpu.
+ */
+static int select_unisolated_rq(int cpu, struct task_struct *p)
+{
+	int i;
+
+	for_each_cpu_and(i, topology_core_cpumask(cpu), tsk_cpus_allowed(p)) {
+		if (cpu_active(i) && !cpu_isolated(i))
+			return i;
+	}
+
+	for_each_cpu_and(i, cpu_active_mask, tsk_cpus_allowed(p)) {
+		if (!cpu_isolated(i))
+			return i;
+	}
+
+	return cpu;
+}
+#else
+static inline int select_unisolated_rq(int cpu, struct task_struct *p)
+{
+	return cpu;
+}
+#endif
+
 /*
  * The caller (fork, wakeup) owns p->pi_lock, ->cpus_allowed is stable.
  */
@@ -3034,9 +3129,89 @@ int select_task_rq(struct task_struct *p, int sd_flags, int wake_flags)
 		     !cpu_online(cpu)))
 		cpu = select_fallback_rq(task_cpu(p), p);
 
+	if (unlikely(cpu_isolated(cpu)))
+		cpu = select_unisolated_rq(cpu, p);
+
 	return cpu;
 }
 
+#ifdef CONFIG_SCHED_CORE_CTL
+struct cpumask __cpu_isolated_mask __read_mostly;
+
+/* Most tasks an isolation pushes away; the rest follow on the next tick */
+#define ISOLATE_PUSH_MAX	32
+
+/**
+ * sched_isolate_cpu - stop placing work on a cpu without offlining it
+ * @cpu: cpu to isolate
+ *
+ * Wake-ups and forks are steered away from @cpu, it no longer pulls load,
+ * unpinned timers are not queued on it and its queued fair tasks are
+ * pushed to other cpus.  Tasks bound to @cpu alone keep running there.
+ * Returns -EBUSY rather than isolate the last usable cpu.  May sleep.
+ */
+int sched_isolate_cpu(int cpu)
+{
+	struct task_struct *push[ISOLATE_PUSH_MAX];
+	struct rq *rq = cpu_rq(cpu);
+	struct task_struct *p;
+	unsigned long flags;
+	int i, nr = 0;
+
+	if (!cpu_online(cpu))
+		return -EINVAL;
+	if (cpu_isolated(cpu))
+		return 0;
+
+	for_each_cpu(i, cpu_active_mask) {
+		if (i != cpu && !cpu_isolated(i))
+			break;
+	}
+	if (i >= nr_cpu_ids)
+		return -EBUSY;
+
+	cpumask_set_cpu(cpu, &__cpu_isolated_mask);
+	/* placement must see the mask before we look at the runqueue */
+	smp_mb();
+
+	raw_spin_lock_irqsave(&rq->lock, flags);
+	list_for_each_entry(p, &rq->cfs_tasks, se.group_node) {
+		if (nr == ISOLATE_PUSH_MAX)
+			break;
+		if (p->nr_cpus_allowed == 1)
+			continue;
+		get_task_struct(p);
+		push[nr++] = p;
+	}
+	raw_spin_unlock_irqrestore(&rq->lock, flags);
+
+	for (i = 0; i < nr; i++) {
+		struct migration_arg arg;
+
+		arg.task = push[i];
+		arg.dest_cpu = select_unisolated_rq(cpu, push[i]);
+		if (arg.dest_cpu != cpu)
+			stop_one_cpu(cpu, migration_cpu_stop, &arg);
+		put_task_struct(push[i]);
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(sched_isolate_cpu);
+
+/**
+ * sched_unisolate_cpu - let a cpu take work again
+ * @cpu: cpu to unisolate
+ *
+ * The cpu picks up load through the next balance of its domains.
+ */
+void sched_unisolate_cpu(int cpu)
+{
+	cpumask_clear_cpu(cpu, &__cpu_isolated_mask);
+}
+EXPORT_SYMBOL_GPL(sched_unisolate_cpu);
+#endif /* CONFIG_SCHED_CORE_CTL */
+
 static void update_avg(u64 *avg, u64 sample)
 {
 	s64 diff = sample - *avg;
@@ -3483,6 +3658,13 @@ static void __sched_fork(struct task_struct *p)
 
 	INIT_LIST_HEAD(&p->se.group_node);
 
+#ifdef CONFIG_CAPACITY_CLAMPING
+	/* the nodes were copied from the parent, which may be queued */
+	RB_CLEAR_NODE(&p->cap_clamp_node[CAP_CLAMP_MIN]);
+	RB_CLEAR_NODE(&p->cap_clamp_node[CAP_CLAMP_MAX]);
+	RB_CLEAR_NODE(&p->cap_clamp_node[CAP_CLAMP_BOOST]);
+#endif
+
 /*
  * Load-tracking only depends on SMP, FAIR_GROUP_SCHED dependency below may be
  * removed when useful for applications beyond shares distribution (e.g.
@@ -3725,6 +3907,7 @@ prepare_task_switch(struct rq *rq, struct task_struct *prev,
 	dlog("%s: end trace at %llu\n", __func__, sched_clock());
 #endif
 	sched_info_switch(prev, next);
+	cpufreq_task_stats_switch(prev);
 	perf_event_task_sched_out(prev, next);
 	fire_sched_out_preempt_notifiers(prev, next);
 	prepare_lock_switch(rq, next);
@@ -9315,6 +9498,7 @@ void __init sched_init(void)
 #ifdef CONFIG_CAPACITY_CLAMPING
 	root_task_group.cap_clamp[CAP_CLAMP_MIN] = 0;
 	root_task_group.cap_clamp[CAP_CLAMP_MAX] = SCHED_CAPACITY_SCALE;
+	root_task_group.cap_clamp[CAP_CLAMP_BOOST] = 0;
 #endif /* CONFIG_CAPACITY_CLAMPING */
 
 	for_each_possible_cpu(i) {
@@ -9357,8 +9541,13 @@ void __init sched_init(void)
 #ifdef CONFIG_CAPACITY_CLAMPING
 		rq->cap_clamp_cpu[CAP_CLAMP_MIN].tree = RB_ROOT;
 		rq->cap_clamp_cpu[CAP_CLAMP_MIN].node = NULL;
+		rq->cap_clamp_cpu[CAP_CLAMP_MIN].value = 0;
 		rq->cap_clamp_cpu[CAP_CLAMP_MAX].tree = RB_ROOT;
 		rq->cap_clamp_cpu[CAP_CLAMP_MAX].node = NULL;
+		rq->cap_clamp_cpu[CAP_CLAMP_MAX].value = SCHED_CAPACITY_SCALE;
+		rq->cap_clamp_cpu[CAP_CLAMP_BOOST].tree = RB_ROOT;
+		rq->cap_clamp_cpu[CAP_CLAMP_BOOST].node = NULL;
+		rq->cap_clamp_cpu[CAP_CLAMP_BOOST].value = 0;
 #endif
 
 		rq->rt.rt_runtime = def_rt_bandwidth.rt_runtime;
@@ -9658,6 +9847,7 @@ struct task_group *sched_create_group(struct task_group *parent)
 #ifdef CONFIG_CAPACITY_CLAMPING
 	tg->cap_clamp[CAP_CLAMP_MIN] = parent->cap_clamp[CAP_CLAMP_MIN];
 	tg->cap_clamp[CAP_CLAMP_MAX] = parent->cap_clamp[CAP_CLAMP_MAX];
+	tg->cap_clamp[CAP_CLAMP_BOOST] = parent->cap_clamp[CAP_CLAMP_BOOST];
 #endif
 
 	return tg;
@@ -10187,10 +10377,43 @@ static int cpu_notify_on_migrate_write_u64(struct cgroup *cgrp,
 
 static DEFINE_MUTEX(cap_clamp_mutex);
 
-static int cpu_capacity_min_write_u64(struct cgroup_subsys_state *css,
+/*
+ * Requeue the RUNNABLE tasks of @tg in every CPU's @cap_idx rbtree, so
+ * that they are sorted on the new constraint and each CPU's cached value
+ * follows it.  Called with cap_clamp_mutex held, after the TG's
+ * constraint has been written.
+ */
+static void cap_clamp_update_tg(struct task_group *tg, unsigned int cap_idx)
+{
+	struct rb_node *node, *next;
+	struct task_struct *p;
+	unsigned long flags;
+	struct rq *rq;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		rq = cpu_rq(cpu);
+		raw_spin_lock_irqsave(&rq->lock, flags);
+		node = rb_first(&rq->cap_clamp_cpu[cap_idx].tree);
+		for (; node; node = next) {
+			next = rb_next(node);
+			p = rb_entry(node, struct task_struct,
+				     cap_clamp_node[cap_idx]);
+			/* A task requeued past next is seen again, up to date */
+			if (task_group(p) != tg ||
+			    p->cap_clamp_value[cap_idx] == tg->cap_clamp[cap_idx])
+				continue;
+			cap_clamp_remove_capacity(rq, p, cap_idx);
+			cap_clamp_insert_capacity(rq, p, cap_idx);
+		}
+		raw_spin_unlock_irqrestore(&rq->lock, flags);
+	}
+}
+
+static int cpu_capacity_min_write_u64(struct cgroup *cgrp,
 				      struct cftype *cftype, u64 value)
 {
-	struct cgroup_subsys_state *pos;
+	struct cgroup *pos;
 	unsigned int min_value;
 	struct task_group *tg;
 	int ret = -EINVAL;
@@ -10200,7 +10423,7 @@ static int cpu_capacity_min_write_u64(struct cgroup_subsys_state *css,
 	mutex_lock(&cap_clamp_mutex);
 	rcu_read_lock();
 
-	tg = css_tg(css);
+	tg = cgroup_tg(cgrp);
 
 	/* Already at the required value */
 	if (tg->cap_clamp[CAP_CLAMP_MIN] == min_value)
@@ -10216,12 +10439,13 @@ static int cpu_capacity_min_write_u64(struct cgroup_subsys_state *css,
 		goto out;
 
 	/* Each child must be a subset of us */
-	css_for_each_child(pos, css) {
-		if (css_tg(pos)->cap_clamp[CAP_CLAMP_MIN] < min_value)
+	cgroup_for_each_child(pos, cgrp) {
+		if (cgroup_tg(pos)->cap_clamp[CAP_CLAMP_MIN] < min_value)
 			goto out;
 	}
 
 	tg->cap_clamp[CAP_CLAMP_MIN] = min_value;
+	cap_clamp_update_tg(tg, CAP_CLAMP_MIN);
 
 done:
 	ret = 0;
@@ -10232,10 +10456,10 @@ out:
 	return ret;
 }
 
-static int cpu_capacity_max_write_u64(struct cgroup_subsys_state *css,
+static int cpu_capacity_max_write_u64(struct cgroup *cgrp,
 				      struct cftype *cftype, u64 value)
 {
-	struct cgroup_subsys_state *pos;
+	struct cgroup *pos;
 	unsigned int max_value;
 	struct task_group *tg;
 	int ret = -EINVAL;
@@ -10245,7 +10469,7 @@ static int cpu_capacity_max_write_u64(struct cgroup_subsys_state *css,
 	mutex_lock(&cap_clamp_mutex);
 	rcu_read_lock();
 
-	tg = css_tg(css);
+	tg = cgroup_tg(cgrp);
 
 	/* Already at the required value */
 	if (tg->cap_clamp[CAP_CLAMP_MAX] == max_value)
@@ -10261,12 +10485,13 @@ static int cpu_capacity_max_write_u64(struct cgroup_subsys_state *css,
 		goto out;
 
 	/* Each child must be a subset of us */
-	css_for_each_child(pos, css) {
-		if (css_tg(pos)->cap_clamp[CAP_CLAMP_MAX] > max_value)
+	cgroup_for_each_child(pos, cgrp) {
+		if (cgroup_tg(pos)->cap_clamp[CAP_CLAMP_MAX] > max_value)
 			goto out;
 	}
 
 	tg->cap_clamp[CAP_CLAMP_MAX] = max_value;
+	cap_clamp_update_tg(tg, CAP_CLAMP_MAX);
 
 done:
 	ret = 0;
@@ -10277,32 +10502,39 @@ out:
 	return ret;
 }
 
-static u64 cpu_capacity_min_read_u64(struct cgroup_subsys_state *css,
-				     struct cftype *cft)
+/*
+ * The boost is a percentage of the spare capacity, so it needs no
+ * consistency with the parent: a child may be boosted more or less than
+ * the group it lives in.
+ */
+static int cpu_capacity_boost_write_u64(struct cgroup *cgrp,
+					struct cftype *cftype, u64 value)
 {
-	struct task_group *tg;
-	u64 min_capacity;
+	if (value > 100)
+		return -EINVAL;
 
-	rcu_read_lock();
-	tg = css_tg(css);
-	min_capacity = tg->cap_clamp[CAP_CLAMP_MIN];
-	rcu_read_unlock();
+	mutex_lock(&cap_clamp_mutex);
+	cgroup_tg(cgrp)->cap_clamp[CAP_CLAMP_BOOST] = value;
+	cap_clamp_update_tg(cgroup_tg(cgrp), CAP_CLAMP_BOOST);
+	mutex_unlock(&cap_clamp_mutex);
 
-	return min_capacity;
+	return 0;
 }
 
-static u64 cpu_capacity_max_read_u64(struct cgroup_subsys_state *css,
-				     struct cftype *cft)
+static u64 cpu_capacity_min_read_u64(struct cgroup *cgrp, struct cftype *cft)
 {
-	struct task_group *tg;
-	u64 max_capacity;
+	return cgroup_tg(cgrp)->cap_clamp[CAP_CLAMP_MIN];
+}
 
-	rcu_read_lock();
-	tg = css_tg(css);
-	max_capacity = tg->cap_clamp[CAP_CLAMP_MAX];
-	rcu_read_unlock();
+static u64 cpu_capacity_max_read_u64(struct cgroup *cgrp, struct cftype *cft)
+{
+	return cgroup_tg(cgrp)->cap_clamp[CAP_CLAMP_MAX];
+}
 
-	return max_capacity;
+static u64 cpu_capacity_boost_read_u64(struct cgroup *cgrp,
+				       struct cftype *cft)
+{
+	return cgroup_tg(cgrp)->cap_clamp[CAP_CLAMP_BOOST];
 }
 #endif /* CONFIG_CAPACITY_CLAMPING */
 
@@ -10607,6 +10839,11 @@ static struct cftype cpu_files[] = {
 		.read_u64 = cpu_capacity_max_read_u64,
 		.write_u64 = cpu_capacity_max_write_u64,
 	},
+	{
+		.name = "capacity_boost",
+		.read_u64 = cpu_capacity_boost_read_u64,
+		.write_u64 = cpu_capacity_boost_write_u64,
+	},
 #endif
 #ifdef CONFIG_CFS_BANDWIDTH
 	{
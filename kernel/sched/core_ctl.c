@@ -0,0 +1,586 @@
+/*
+ * Core control: keep as many cpus of each cluster usable as its load needs
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Every CORE_CTL_EVAL_MS the busy percentage of each online cpu and the
+ * average number of runnable tasks on it are sampled.  A cluster needs
+ * all of its busy cpus, one more once every active cpu is busy, and at
+ * least as many cpus as it has runnable tasks.  Spare cpus are isolated
+ * (see sched_isolate_cpu()) rather than hotplugged, which takes tens of
+ * microseconds instead of milliseconds and leaves the cpu ready to take
+ * work again at once.  More cpus are granted right away; fewer only once
+ * the need stayed lower for offline_delay_ms.
+ *
+ * Per cluster, under /sys/devices/system/cpu/cpuN/core_ctl/ of its first
+ * cpu:
+ *	min_cpus, max_cpus	bounds on the active cpus; min_cpus starts
+ *				at the cluster size, i.e. nothing is isolated
+ *				until userspace lowers it.  Nothing is
+ *				sampled either while every cluster's
+ *				min_cpus is its size
+ *	busy_thresholds		"up down": a cpu becomes busy at up% and
+ *				stops being busy below down%
+ *	offline_delay_ms	hysteresis before giving cpus up
+ *	need_cpus, active_cpus	current decision and state
+ *	latency			count, average and maximum time taken by
+ *				isolations and unisolations
+ */
+
+#include <linux/cpu.h>
+#include <linux/init.h>
+#include <linux/irq.h>
+#include <linux/irqdesc.h>
+#include <linux/irqnr.h>
+#include <linux/kobject.h>
+#include <linux/ktime.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/tick.h>
+#include <linux/workqueue.h>
+
+#include <trace/events/power.h>
+
+#include "sched.h"
+
+#define CORE_CTL_EVAL_MS		20
+#define DEFAULT_BUSY_UP_THRES		60
+#define DEFAULT_BUSY_DOWN_THRES		30
+#define DEFAULT_OFFLINE_DELAY_MS	100
+
+struct core_ctl_latency {
+	unsigned int count;
+	u64 total_us;
+	u64 max_us;
+};
+
+struct cluster_data {
+	struct cpumask cpus;
+	unsigned int first_cpu;
+	unsigned int num_cpus;
+	unsigned int min_cpus;
+	unsigned int max_cpus;
+	unsigned int busy_up_thres;
+	unsigned int busy_down_thres;
+	unsigned int offline_delay_ms;
+	unsigned int need_cpus;
+	unsigned int active_cpus;
+	/* last time the need was not below the active cpus */
+	u64 need_ts;
+	struct core_ctl_latency isolate;
+	struct core_ctl_latency unisolate;
+	unsigned int isolate_fail;
+	struct kobject kobj;
+};
+
+struct cpu_data {
+	struct cluster_data *cluster;
+	u64 prev_idle;
+	u64 prev_wall;
+	unsigned int busy;
+	bool is_busy;
+};
+
+static DEFINE_PER_CPU(struct cpu_data, core_ctl_cpu);
+static struct cluster_data clusters[NR_CPUS];
+static unsigned int nr_clusters;
+static int nr_avg_cpu[NR_CPUS];
+static struct sched_nr_avg_poll nr_avg_poll;
+
+/* Serializes evaluation, sysfs updates and hotplug */
+static DEFINE_MUTEX(core_ctl_lock);
+static struct delayed_work core_ctl_work;
+static struct cpumask irq_dest;
+
+static u64 core_ctl_now_ms(void)
+{
+	return ktime_to_ms(ktime_get());
+}
+
+static void core_ctl_account(struct core_ctl_latency *lat, ktime_t start)
+{
+	u64 us = ktime_to_us(ktime_sub(ktime_get(), start));
+
+	lat->count++;
+	lat->total_us += us;
+	lat->max_us = max(lat->max_us, us);
+}
+
+/* Whether any cluster may give up a cpu, i.e. there is anything to do */
+static bool core_ctl_enabled(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < nr_clusters; i++) {
+		if (clusters[i].min_cpus < clusters[i].num_cpus)
+			return true;
+	}
+
+	return false;
+}
+
+static unsigned int active_cpus(struct cluster_data *cluster)
+{
+	unsigned int cpu, nr = 0;
+
+	for_each_cpu(cpu, &cluster->cpus) {
+		if (cpu_online(cpu) && !cpu_isolated(cpu))
+			nr++;
+	}
+
+	return nr;
+}
+
+/*
+ * Interrupts that may go elsewhere are moved off an isolated cpu.  They
+ * are not moved back on unisolation; that is left to irq balancing.
+ */
+static void core_ctl_move_irqs(unsigned int cpu)
+{
+	struct irq_desc *desc;
+	unsigned long flags;
+	unsigned int irq;
+
+	for_each_irq_desc(irq, desc) {
+		struct irq_data *d = irq_desc_get_irq_data(desc);
+
+		raw_spin_lock_irqsave(&desc->lock, flags);
+		if (!irqd_is_per_cpu(d) && cpumask_test_cpu(cpu, d->affinity)) {
+			cpumask_and(&irq_dest, d->affinity, cpu_online_mask);
+			cpumask_andnot(&irq_dest, &irq_dest,
+				       &__cpu_isolated_mask);
+			if (!cpumask_empty(&irq_dest))
+				irq_set_affinity_locked(d, &irq_dest, false);
+		}
+		raw_spin_unlock_irqrestore(&desc->lock, flags);
+	}
+}
+
+static void core_ctl_update_busy(unsigned int cpu)
+{
+	struct cpu_data *cd = &per_cpu(core_ctl_cpu, cpu);
+	u64 idle, iowait, wall;
+	u64 idle_delta, wall_delta;
+
+	idle = get_cpu_idle_time_us(cpu, &wall);
+	iowait = get_cpu_iowait_time_us(cpu, NULL);
+	if (idle == -1ULL || iowait == -1ULL) {
+		/* no idle accounting without NO_HZ: never look idle */
+		cd->busy = 100;
+		return;
+	}
+	idle += iowait;
+
+	wall_delta = wall - cd->prev_wall;
+	idle_delta = idle - cd->prev_idle;
+	cd->prev_wall = wall;
+	cd->prev_idle = idle;
+
+	if (!wall_delta || idle_delta > wall_delta)
+		cd->busy = 0;
+	else
+		cd->busy = div64_u64((wall_delta - idle_delta) * 100,
+				     wall_delta);
+}
+
+static unsigned int eval_need(struct cluster_data *cluster)
+{
+	unsigned int cpu, busy_cpus = 0, nr = 0, need;
+
+	for_each_cpu(cpu, &cluster->cpus) {
+		struct cpu_data *cd = &per_cpu(core_ctl_cpu, cpu);
+		bool old_is_busy = cd->is_busy;
+
+		if (!cpu_online(cpu))
+			continue;
+
+		if (cd->busy >= cluster->busy_up_thres)
+			cd->is_busy = true;
+		else if (cd->busy < cluster->busy_down_thres)
+			cd->is_busy = false;
+		trace_core_ctl_set_busy(cpu, cd->busy, old_is_busy,
+					cd->is_busy);
+
+		busy_cpus += cd->is_busy;
+		nr += nr_avg_cpu[cpu];
+	}
+
+	need = busy_cpus;
+	if (busy_cpus && busy_cpus >= cluster->active_cpus)
+		need++;
+	need = max(need, DIV_ROUND_UP(nr, 100));
+
+	return clamp(need, cluster->min_cpus, cluster->max_cpus);
+}
+
+static void apply_need(struct cluster_data *cluster)
+{
+	struct cpu_data *cd;
+	unsigned int cpu;
+	ktime_t start;
+
+	for_each_cpu(cpu, &cluster->cpus) {
+		if (cluster->active_cpus >= cluster->need_cpus)
+			break;
+		if (!cpu_online(cpu) || !cpu_isolated(cpu))
+			continue;
+
+		start = ktime_get();
+		sched_unisolate_cpu(cpu);
+		core_ctl_account(&cluster->unisolate, start);
+		cluster->active_cpus++;
+	}
+
+	while (cluster->active_cpus > cluster->need_cpus) {
+		unsigned int idlest = nr_cpu_ids, min_busy = UINT_MAX;
+
+		for_each_cpu(cpu, &cluster->cpus) {
+			if (!cpu_online(cpu) || cpu_isolated(cpu))
+				continue;
+			cd = &per_cpu(core_ctl_cpu, cpu);
+			if (cd->busy < min_busy) {
+				min_busy = cd->busy;
+				idlest = cpu;
+			}
+		}
+		if (idlest >= nr_cpu_ids)
+			break;
+
+		start = ktime_get();
+		if (sched_isolate_cpu(idlest)) {
+			cluster->isolate_fail++;
+			break;
+		}
+		core_ctl_move_irqs(idlest);
+		core_ctl_account(&cluster->isolate, start);
+		cluster->active_cpus--;
+	}
+}
+
+static void core_ctl_eval(struct work_struct *work)
+{
+	int nr_avg, iowait_avg;
+	unsigned int cpu, i;
+	bool enabled;
+	u64 now;
+
+	/* hotplug notifiers take core_ctl_lock with the hotplug lock held */
+	get_online_cpus();
+	mutex_lock(&core_ctl_lock);
+
+	sched_get_nr_running_avg_cpus(&nr_avg_poll, &nr_avg, &iowait_avg,
+				      nr_avg_cpu);
+	for_each_online_cpu(cpu)
+		core_ctl_update_busy(cpu);
+
+	now = core_ctl_now_ms();
+	for (i = 0; i < nr_clusters; i++) {
+		struct cluster_data *cluster = &clusters[i];
+		unsigned int old_need = cluster->need_cpus;
+		unsigned int need;
+		bool updated = false;
+
+		cluster->active_cpus = active_cpus(cluster);
+		need = eval_need(cluster);
+
+		if (need >= cluster->active_cpus) {
+			cluster->need_ts = now;
+			updated = need != cluster->active_cpus;
+		} else if (now - cluster->need_ts >=
+			   cluster->offline_delay_ms) {
+			updated = true;
+		}
+		if (updated)
+			cluster->need_cpus = need;
+		trace_core_ctl_eval_need(cluster->first_cpu, old_need, need,
+					 updated);
+
+		if (cluster->need_cpus != cluster->active_cpus)
+			apply_need(cluster);
+	}
+
+	/* once min_cpus is back at the size, the run above unisolated all */
+	enabled = core_ctl_enabled();
+	mutex_unlock(&core_ctl_lock);
+	put_online_cpus();
+
+	if (enabled)
+		queue_delayed_work(system_unbound_wq, &core_ctl_work,
+				   msecs_to_jiffies(CORE_CTL_EVAL_MS));
+}
+
+/* ========================= sysfs interface =========================== */
+
+struct core_ctl_attr {
+	struct attribute attr;
+	ssize_t (*show)(struct cluster_data *, char *);
+	ssize_t (*store)(struct cluster_data *, const char *, size_t count);
+};
+
+#define to_cluster(k) container_of(k, struct cluster_data, kobj)
+#define to_attr(a) container_of(a, struct core_ctl_attr, attr)
+
+#define core_ctl_attr_ro(_name)				\
+static struct core_ctl_attr _name =			\
+__ATTR(_name, 0444, show_##_name, NULL)
+
+#define core_ctl_attr_rw(_name)				\
+static struct core_ctl_attr _name =			\
+__ATTR(_name, 0644, show_##_name, store_##_name)
+
+#define show_one(_name)							\
+static ssize_t show_##_name(struct cluster_data *cluster, char *buf)	\
+{									\
+	return snprintf(buf, PAGE_SIZE, "%u\n", cluster->_name);	\
+}
+
+show_one(min_cpus);
+show_one(max_cpus);
+show_one(offline_delay_ms);
+show_one(need_cpus);
+show_one(active_cpus);
+
+static ssize_t store_min_cpus(struct cluster_data *cluster,
+			      const char *buf, size_t count)
+{
+	unsigned int val;
+
+	if (sscanf(buf, "%u", &val) != 1)
+		return -EINVAL;
+
+	mutex_lock(&core_ctl_lock);
+	val = clamp(val, 1U, cluster->max_cpus);
+	/* the first samples cover the time we were off, keep cpus a while */
+	if (!core_ctl_enabled() && val < cluster->num_cpus)
+		cluster->need_ts = core_ctl_now_ms();
+	cluster->min_cpus = val;
+	mutex_unlock(&core_ctl_lock);
+
+	mod_delayed_work(system_unbound_wq, &core_ctl_work, 0);
+
+	return count;
+}
+
+static ssize_t store_max_cpus(struct cluster_data *cluster,
+			      const char *buf, size_t count)
+{
+	unsigned int val;
+
+	if (sscanf(buf, "%u", &val) != 1)
+		return -EINVAL;
+
+	mutex_lock(&core_ctl_lock);
+	cluster->max_cpus = clamp(val, cluster->min_cpus, cluster->num_cpus);
+	mutex_unlock(&core_ctl_lock);
+
+	mod_delayed_work(system_unbound_wq, &core_ctl_work, 0);
+
+	return count;
+}
+
+static ssize_t store_offline_delay_ms(struct cluster_data *cluster,
+				      const char *buf, size_t count)
+{
+	unsigned int val;
+
+	if (sscanf(buf, "%u", &val) != 1)
+		return -EINVAL;
+
+	cluster->offline_delay_ms = val;
+
+	return count;
+}
+
+static ssize_t show_busy_thresholds(struct cluster_data *cluster, char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%u %u\n", cluster->busy_up_thres,
+			cluster->busy_down_thres);
+}
+
+static ssize_t store_busy_thresholds(struct cluster_data *cluster,
+				     const char *buf, size_t count)
+{
+	unsigned int up, down;
+
+	if (sscanf(buf, "%u %u", &up, &down) != 2)
+		return -EINVAL;
+	if (up > 100 || down > up)
+		return -EINVAL;
+
+	mutex_lock(&core_ctl_lock);
+	cluster->busy_up_thres = up;
+	cluster->busy_down_thres = down;
+	mutex_unlock(&core_ctl_lock);
+
+	return count;
+}
+
+static ssize_t show_latency(struct cluster_data *cluster, char *buf)
+{
+	struct core_ctl_latency iso, uniso;
+	unsigned int fail;
+
+	mutex_lock(&core_ctl_lock);
+	iso = cluster->isolate;
+	uniso = cluster->unisolate;
+	fail = cluster->isolate_fail;
+	mutex_unlock(&core_ctl_lock);
+
+	return snprintf(buf, PAGE_SIZE,
+			"isolate: count=%u avg_us=%llu max_us=%llu failed=%u\n"
+			"unisolate: count=%u avg_us=%llu max_us=%llu\n",
+			iso.count,
+			iso.count ? div_u64(iso.total_us, iso.count) : 0,
+			iso.max_us, fail, uniso.count,
+			uniso.count ? div_u64(uniso.total_us, uniso.count) : 0,
+			uniso.max_us);
+}
+
+core_ctl_attr_rw(min_cpus);
+core_ctl_attr_rw(max_cpus);
+core_ctl_attr_rw(busy_thresholds);
+core_ctl_attr_rw(offline_delay_ms);
+core_ctl_attr_ro(need_cpus);
+core_ctl_attr_ro(active_cpus);
+core_ctl_attr_ro(latency);
+
+static struct attribute *default_attrs[] = {
+	&min_cpus.attr,
+	&max_cpus.attr,
+	&busy_thresholds.attr,
+	&offline_delay_ms.attr,
+	&need_cpus.attr,
+	&active_cpus.attr,
+	&latency.attr,
+	NULL
+};
+
+static ssize_t show(struct kobject *kobj, struct attribute *attr, char *buf)
+{
+	struct core_ctl_attr *cattr = to_attr(attr);
+
+	if (!cattr->show)
+		return -EIO;
+
+	return cattr->show(to_cluster(kobj), buf);
+}
+
+static ssize_t store(struct kobject *kobj, struct attribute *attr,
+		     const char *buf, size_t count)
+{
+	struct core_ctl_attr *cattr = to_attr(attr);
+
+	if (!cattr->store)
+		return -EIO;
+
+	return cattr->store(to_cluster(kobj), buf, count);
+}
+
+static const struct sysfs_ops sysfs_ops = {
+	.show	= show,
+	.store	= store,
+};
+
+static struct kobj_type ktype_core_ctl = {
+	.sysfs_ops	= &sysfs_ops,
+	.default_attrs	= default_attrs,
+};
+
+/* ==================== hotplug and initialization ===================== */
+
+static int __ref core_ctl_cpu_callback(struct notifier_block *nfb,
+				       unsigned long action, void *hcpu)
+{
+	unsigned int cpu = (unsigned long)hcpu;
+
+	switch (action & ~CPU_TASKS_FROZEN) {
+	case CPU_DEAD:
+		/* a cpu comes back online usable */
+		mutex_lock(&core_ctl_lock);
+		sched_unisolate_cpu(cpu);
+		mutex_unlock(&core_ctl_lock);
+		break;
+	case CPU_ONLINE:
+		if (core_ctl_enabled())
+			mod_delayed_work(system_unbound_wq, &core_ctl_work, 0);
+		break;
+	}
+
+	return NOTIFY_OK;
+}
+
+static struct notifier_block __refdata core_ctl_cpu_notifier = {
+	.notifier_call = core_ctl_cpu_callback,
+};
+
+static int __init cluster_init(const struct cpumask *mask)
+{
+	struct cluster_data *cluster = &clusters[nr_clusters];
+	struct device *dev;
+	unsigned int cpu;
+	int ret;
+
+	cpumask_copy(&cluster->cpus, mask);
+	cluster->first_cpu = cpumask_first(mask);
+	cluster->num_cpus = cpumask_weight(mask);
+	cluster->min_cpus = cluster->num_cpus;
+	cluster->max_cpus = cluster->num_cpus;
+	cluster->need_cpus = cluster->num_cpus;
+	cluster->active_cpus = cluster->num_cpus;
+	cluster->busy_up_thres = DEFAULT_BUSY_UP_THRES;
+	cluster->busy_down_thres = DEFAULT_BUSY_DOWN_THRES;
+	cluster->offline_delay_ms = DEFAULT_OFFLINE_DELAY_MS;
+
+	dev = get_cpu_device(cluster->first_cpu);
+	if (!dev)
+		return -ENODEV;
+
+	ret = kobject_init_and_add(&cluster->kobj, &ktype_core_ctl,
+				   &dev->kobj, "core_ctl");
+	if (ret)
+		return ret;
+
+	for_each_cpu(cpu, mask)
+		per_cpu(core_ctl_cpu, cpu).cluster = cluster;
+	nr_clusters++;
+
+	return 0;
+}
+
+static int __init core_ctl_init(void)
+{
+	unsigned int cpu;
+	int ret;
+
+	INIT_DEFERRABLE_WORK(&core_ctl_work, core_ctl_eval);
+
+	/* no cpu may come online between the setup and the registration */
+	cpu_notifier_register_begin();
+	for_each_online_cpu(cpu) {
+		if (per_cpu(core_ctl_cpu, cpu).cluster)
+			continue;
+
+		ret = cluster_init(topology_core_cpumask(cpu));
+		if (ret) {
+			cpu_notifier_register_done();
+			pr_err("core_ctl: cluster of cpu%u: %d\n", cpu, ret);
+			return ret;
+		}
+	}
+	__register_cpu_notifier(&core_ctl_cpu_notifier);
+	cpu_notifier_register_done();
+
+	/* min_cpus starts at the cluster sizes: the work waits for sysfs */
+
+	pr_info("core_ctl: managing %u clusters\n", nr_clusters);
+
+	return 0;
+}
+late_initcall(core_ctl_init);
@@ -0,0 +1,30 @@
+/*
+ * Scheduler code related to cpufreq governors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include "sched.h"
+
+DEFINE_PER_CPU(struct update_util_data *, cpufreq_update_util_data);
+
+/**
+ * cpufreq_set_update_util_data - set the utilization callback of a cpu
+ * @cpu: cpu to set the callback for
+ * @data: new callback, or NULL to remove the current one
+ *
+ * The callback is invoked from the scheduler on enqueue, dequeue and tick
+ * with the runnable average of @cpu's runqueue.  After removing a
+ * callback, the caller has to wait for synchronize_sched() before freeing
+ * @data, as a scheduler path may still be running it.
+ */
+void cpufreq_set_update_util_data(int cpu, struct update_util_data *data)
+{
+	if (WARN_ON(data && !data->func))
+		return;
+
+	rcu_assign_pointer(per_cpu(cpufreq_update_util_data, cpu), data);
+}
+EXPORT_SYMBOL_GPL(cpufreq_set_update_util_data);
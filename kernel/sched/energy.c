@@ -0,0 +1,405 @@
+/*
+ * Energy model for energy aware task placement
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * The model is read from the device tree.  Each cpu node points at a
+ * core and a cluster cost node; cpus sharing a cluster cost node are
+ * taken to share a clock and a power rail:
+ *
+ *	cpu@0 {
+ *		...
+ *		sched-energy-costs = <&CPU_COST_0 &CLUSTER_COST_0>;
+ *	};
+ *
+ *	energy-costs {
+ *		CPU_COST_0: core-cost0 {
+ *			busy-cost-data = <
+ *				 235  49	// capacity, power at OPP 0
+ *				 ...
+ *				1024 313	// capacity, power at max OPP
+ *			>;
+ *			idle-cost-data = <
+ *				6		// power in each idle state,
+ *				0		// shallowest first
+ *			>;
+ *		};
+ *		CLUSTER_COST_0: cluster-cost0 { ... };
+ *	};
+ *
+ * Capacities are relative to the fastest cpu of the system at its highest
+ * operating point, which is 1024.  Powers only need to be consistent with
+ * each other.  As nothing but the device tree is needed, the model can be
+ * tried on a fake two cluster topology under QEMU ("-smp 8" and a board
+ * device tree carrying the properties above).
+ */
+
+#include <linux/cpufreq.h>
+#include <linux/init.h>
+#include <linux/of.h>
+#include <linux/slab.h>
+
+#include "sched.h"
+
+/* A cpu is full when its utilization gets past 80% of its capacity */
+#define CAPACITY_MARGIN		1280
+
+struct capacity_state {
+	unsigned long cap;
+	unsigned long power;
+};
+
+struct sched_group_energy {
+	struct device_node *np;
+	unsigned int nr_cap_states;
+	struct capacity_state *cap_states;
+	unsigned int nr_idle_states;
+	unsigned long *idle_states;
+	struct cpumask span;		/* cpus sharing this cost node */
+};
+
+struct sched_energy_cpu {
+	struct sched_group_energy *core;
+	struct sched_group_energy *cluster;
+	unsigned long freq_scale;	/* cur freq / max freq, in 1024ths */
+	unsigned int max_freq;
+};
+
+static DEFINE_PER_CPU(struct sched_energy_cpu, sched_energy_cpu);
+
+unsigned int __read_mostly sysctl_sched_energy_aware = 1;
+bool __read_mostly sched_energy_ready;
+
+static unsigned long cap_max(int cpu)
+{
+	struct sched_group_energy *sge = per_cpu(sched_energy_cpu, cpu).core;
+
+	return sge->cap_states[sge->nr_cap_states - 1].cap;
+}
+
+/*
+ * The runnable averages are fractions of time, not of work.  Scale them by
+ * the capacity the cpu had at its current frequency.
+ */
+static unsigned long cap_cur(int cpu)
+{
+	return (cap_max(cpu) * per_cpu(sched_energy_cpu, cpu).freq_scale) >>
+		SCHED_POWER_SHIFT;
+}
+
+static unsigned long cpu_util(int cpu)
+{
+	struct sched_avg *sa = &cpu_rq(cpu)->avg;
+	u64 util = (u64)sa->runnable_avg_sum * cap_cur(cpu);
+
+	return div_u64(util, sa->runnable_avg_period + 1);
+}
+
+static unsigned long task_util(struct task_struct *p)
+{
+	struct sched_avg *sa = &p->se.avg;
+	u64 util = (u64)sa->runnable_avg_sum * cap_cur(task_cpu(p));
+
+	util = div_u64(util, sa->runnable_avg_period + 1);
+
+	/* top-app may ask for more than it uses, background for less */
+	return cap_clamp_task_util(p, util);
+}
+
+static bool cpu_overutilized(int cpu, unsigned long util)
+{
+	return util * CAPACITY_MARGIN > cap_max(cpu) * SCHED_POWER_SCALE;
+}
+
+/*
+ * Energy spent by the cluster of @cpu over a unit of time, with @util added
+ * to @dst_cpu's utilization and removed from @src_cpu's.  The cluster runs
+ * at the lowest operating point that fits its busiest cpu; busy time costs
+ * the operating point's power, idle time the power of the shallowest idle
+ * state for a cpu, and of the deepest one for the cluster.
+ */
+static unsigned long cluster_energy(int cpu, int src_cpu, int dst_cpu,
+				    unsigned long util)
+{
+	struct sched_energy_cpu *sec = &per_cpu(sched_energy_cpu, cpu);
+	struct sched_group_energy *cluster = sec->cluster;
+	struct sched_group_energy *core = sec->core;
+	unsigned long max_util = 0, cap, busy, energy = 0;
+	unsigned int idx;
+	int i;
+
+	for_each_cpu_and(i, &cluster->span, cpu_online_mask) {
+		unsigned long u = cpu_util(i);
+
+		if (i == src_cpu)
+			u = u > util ? u - util : 0;
+		if (i == dst_cpu)
+			u += util;
+		max_util = max(max_util, u);
+	}
+
+	for (idx = 0; idx < core->nr_cap_states - 1; idx++)
+		if (core->cap_states[idx].cap >= max_util)
+			break;
+	cap = core->cap_states[idx].cap;
+
+	for_each_cpu_and(i, &cluster->span, cpu_online_mask) {
+		unsigned long u = cpu_util(i);
+
+		if (i == src_cpu)
+			u = u > util ? u - util : 0;
+		if (i == dst_cpu)
+			u += util;
+
+		busy = (min(u, cap) << SCHED_POWER_SHIFT) / cap;
+		energy += busy * core->cap_states[idx].power;
+		energy += (SCHED_POWER_SCALE - busy) * core->idle_states[0];
+	}
+
+	busy = (min(max_util, cap) << SCHED_POWER_SHIFT) / cap;
+	idx = min(idx, cluster->nr_cap_states - 1);
+	energy += busy * cluster->cap_states[idx].power;
+	energy += (SCHED_POWER_SCALE - busy) *
+		  cluster->idle_states[cluster->nr_idle_states - 1];
+
+	return energy;
+}
+
+/*
+ * Pick the cpu where @p adds the least energy among those that can take
+ * its utilization without going over their capacity.  Returns -1 when no
+ * cpu fits, leaving the choice to the regular wake-up path.
+ */
+int energy_aware_wake_cpu(struct task_struct *p, int target)
+{
+	int prev_cpu = task_cpu(p);
+	unsigned long util = task_util(p);
+	unsigned long best_delta = ULONG_MAX;
+	int best_cpu = -1;
+	int cpu;
+
+	for_each_cpu_and(cpu, tsk_cpus_allowed(p), cpu_online_mask) {
+		unsigned long before, after, delta, cu;
+
+		cu = cpu_util(cpu);
+		if (cpu == prev_cpu)
+			cu = cu > util ? cu - util : 0;
+		if (cpu_overutilized(cpu, cu + util))
+			continue;
+
+		/* the task leaving prev_cpu is common to every candidate */
+		before = cluster_energy(cpu, prev_cpu, -1, util);
+		after = cluster_energy(cpu, prev_cpu, cpu, util);
+		delta = after > before ? after - before : 0;
+
+		/* on a tie keep the task where its cache is, then on target */
+		if (delta < best_delta ||
+		    (delta == best_delta &&
+		     (cpu == prev_cpu ||
+		      (cpu == target && best_cpu != prev_cpu)))) {
+			best_delta = delta;
+			best_cpu = cpu;
+		}
+	}
+
+	return best_cpu;
+}
+
+/*
+ * As long as every cpu of the domain has spare capacity, tasks sit where
+ * wake-up placement found them cheapest and there is nothing to balance.
+ */
+bool sd_overutilized(struct sched_domain *sd)
+{
+	int cpu;
+
+	for_each_cpu(cpu, sched_domain_span(sd))
+		if (cpu_overutilized(cpu, cpu_util(cpu)))
+			return true;
+
+	return false;
+}
+
+static int sched_energy_policy_notify(struct notifier_block *nb,
+				      unsigned long val, void *data)
+{
+	struct cpufreq_policy *policy = data;
+	int cpu;
+
+	if (val != CPUFREQ_NOTIFY || !policy->cpuinfo.max_freq)
+		return NOTIFY_OK;
+
+	for_each_cpu(cpu, policy->related_cpus) {
+		struct sched_energy_cpu *sec = &per_cpu(sched_energy_cpu, cpu);
+
+		sec->max_freq = policy->cpuinfo.max_freq;
+		if (policy->cur)
+			sec->freq_scale = min_t(unsigned long,
+				SCHED_POWER_SCALE,
+				(policy->cur << SCHED_POWER_SHIFT) /
+				policy->cpuinfo.max_freq);
+	}
+
+	return NOTIFY_OK;
+}
+
+static int sched_energy_transition_notify(struct notifier_block *nb,
+					  unsigned long val, void *data)
+{
+	struct cpufreq_freqs *freqs = data;
+	struct sched_energy_cpu *sec = &per_cpu(sched_energy_cpu, freqs->cpu);
+
+	if (val != CPUFREQ_POSTCHANGE || !sec->max_freq)
+		return NOTIFY_OK;
+
+	sec->freq_scale = min_t(unsigned long, SCHED_POWER_SCALE,
+			(freqs->new << SCHED_POWER_SHIFT) / sec->max_freq);
+
+	return NOTIFY_OK;
+}
+
+static struct notifier_block sched_energy_policy_nb = {
+	.notifier_call = sched_energy_policy_notify,
+};
+
+static struct notifier_block sched_energy_transition_nb = {
+	.notifier_call = sched_energy_transition_notify,
+};
+
+static struct sched_group_energy *sge_table[NR_CPUS * 2];
+static int nr_sge;
+
+static void __init sge_free(struct sched_group_energy *sge)
+{
+	kfree(sge->cap_states);
+	kfree(sge->idle_states);
+	kfree(sge);
+}
+
+/* Takes over the reference on @np, the table keeps one per cost node */
+static struct sched_group_energy * __init sge_get(struct device_node *np)
+{
+	struct sched_group_energy *sge;
+	const __be32 *val;
+	int i, len;
+
+	for (i = 0; i < nr_sge; i++) {
+		if (sge_table[i]->np == np) {
+			of_node_put(np);
+			return sge_table[i];
+		}
+	}
+
+	sge = kzalloc(sizeof(*sge), GFP_KERNEL);
+	if (!sge)
+		goto err_put;
+	sge->np = np;
+
+	val = of_get_property(np, "busy-cost-data", &len);
+	if (!val || !len || len % (2 * sizeof(u32))) {
+		pr_err("sched-energy: %s: bad busy-cost-data\n", np->full_name);
+		goto err;
+	}
+	sge->nr_cap_states = len / (2 * sizeof(u32));
+	sge->cap_states = kcalloc(sge->nr_cap_states,
+				  sizeof(*sge->cap_states), GFP_KERNEL);
+	if (!sge->cap_states)
+		goto err;
+	for (i = 0; i < sge->nr_cap_states; i++) {
+		sge->cap_states[i].cap = be32_to_cpup(val++);
+		sge->cap_states[i].power = be32_to_cpup(val++);
+		if (!sge->cap_states[i].cap ||
+		    (i && sge->cap_states[i].cap <=
+			  sge->cap_states[i - 1].cap)) {
+			pr_err("sched-energy: %s: capacities must be ascending\n",
+			       np->full_name);
+			goto err;
+		}
+	}
+
+	val = of_get_property(np, "idle-cost-data", &len);
+	if (!val || !len || len % sizeof(u32)) {
+		pr_err("sched-energy: %s: bad idle-cost-data\n", np->full_name);
+		goto err;
+	}
+	sge->nr_idle_states = len / sizeof(u32);
+	sge->idle_states = kcalloc(sge->nr_idle_states,
+				   sizeof(*sge->idle_states), GFP_KERNEL);
+	if (!sge->idle_states)
+		goto err;
+	for (i = 0; i < sge->nr_idle_states; i++)
+		sge->idle_states[i] = be32_to_cpup(val++);
+
+	sge_table[nr_sge++] = sge;
+	return sge;
+
+err:
+	sge_free(sge);
+err_put:
+	of_node_put(np);
+	return NULL;
+}
+
+static int __init sched_energy_init(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct sched_energy_cpu *sec = &per_cpu(sched_energy_cpu, cpu);
+		struct device_node *cn, *core_np, *cluster_np;
+
+		sec->freq_scale = SCHED_POWER_SCALE;
+
+		cn = of_get_cpu_node(cpu, NULL);
+		if (!cn)
+			goto fail;
+		core_np = of_parse_phandle(cn, "sched-energy-costs", 0);
+		cluster_np = of_parse_phandle(cn, "sched-energy-costs", 1);
+		of_node_put(cn);
+		if (!core_np || !cluster_np) {
+			of_node_put(core_np);
+			of_node_put(cluster_np);
+			goto fail;
+		}
+
+		sec->core = sge_get(core_np);
+		sec->cluster = sge_get(cluster_np);
+		if (!sec->core || !sec->cluster)
+			goto fail;
+		cpumask_set_cpu(cpu, &sec->cluster->span);
+	}
+
+	cpufreq_register_notifier(&sched_energy_policy_nb,
+				  CPUFREQ_POLICY_NOTIFIER);
+	cpufreq_register_notifier(&sched_energy_transition_nb,
+				  CPUFREQ_TRANSITION_NOTIFIER);
+
+	sched_energy_ready = true;
+	pr_info("sched-energy: energy model for %d cost nodes\n", nr_sge);
+
+	return 0;
+
+fail:
+	/* an incomplete model is no model */
+	pr_debug("sched-energy: no energy model for cpu%d\n", cpu);
+	for_each_possible_cpu(cpu) {
+		per_cpu(sched_energy_cpu, cpu).core = NULL;
+		per_cpu(sched_energy_cpu, cpu).cluster = NULL;
+	}
+	while (nr_sge) {
+		struct sched_group_energy *sge = sge_table[--nr_sge];
+
+		of_node_put(sge->np);
+		sge_free(sge);
+		sge_table[nr_sge] = NULL;
+	}
+	return 0;
+}
+core_initcall(sched_energy_init);
@@ -1744,6 +1744,7 @@ static int best_small_task_cpu(struct task_struct *p, int sync)
 	int cpu = smp_processor_id();
 
 	cpumask_and(&search_cpus,  tsk_cpus_allowed(p), cpu_online_mask);
+	cpumask_andnot(&search_cpus, &search_cpus, cpu_isolated_mask);
 
 	if (cpumask_empty(&search_cpus))
 		return prev_cpu;
@@ -1753,7 +1754,7 @@ static int best_small_task_cpu(struct task_struct *p, int sync)
 	 * running task, just run the waking small task on that CPU regardless
 	 * of what type of CPU it is.
 	 */
-	if (sync && cpu_rq(cpu)->nr_running == 1)
+	if (sync && cpu_rq(cpu)->nr_running == 1 && !cpu_isolated(cpu))
 		return cpu;
 
 	cluster_cost = power_cost_task(p, cpu);
@@ -1939,6 +1940,8 @@ static int select_best_cpu(struct task_struct *p, int target, int reason,
 
 	trq = task_rq(p);
 	cpumask_and(&search_cpus, tsk_cpus_allowed(p), cpu_online_mask);
+	/* isolated cpus take no new tasks, see sched_isolate_cpu() */
+	cpumask_andnot(&search_cpus, &search_cpus, cpu_isolated_mask);
 	for_each_cpu(i, &search_cpus) {
 		struct rq *rq = cpu_rq(i);
 
@@ -2463,7 +2466,8 @@ void check_for_migration(struct rq *rq, struct task_struct *p)
 	raw_spin_lock(&migration_lock);
 	new_cpu = select_best_cpu(p, cpu, reason, 0);
 
-	if (new_cpu != cpu) {
+	/* new_cpu may have been isolated since select_best_cpu() ran */
+	if (new_cpu != cpu && !cpu_isolated(new_cpu)) {
 		active_balance = kick_active_balance(rq, p, new_cpu);
 		if (active_balance)
 			mark_reserved(new_cpu);
@@ -4352,6 +4356,7 @@ enqueue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 		update_rq_runnable_avg(rq, rq->nr_running);
 		inc_nr_running(rq);
 		inc_nr_big_small_task(rq, p);
+		cpufreq_update_util(rq);
 	}
 	hrtick_update(rq);
 }
@@ -4414,6 +4419,7 @@ static void dequeue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 		dec_nr_running(rq);
 		update_rq_runnable_avg(rq, 1);
 		dec_nr_big_small_task(rq, p);
+		cpufreq_update_util(rq);
 	}
 	hrtick_update(rq);
 }
@@ -4781,6 +4787,13 @@ static int select_idle_sibling(struct task_struct *p, int target)
 	struct sched_group *sg;
 	int i = task_cpu(p);
 
+	if (energy_aware()) {
+		i = energy_aware_wake_cpu(p, target);
+		if (i >= 0)
+			return i;
+		i = task_cpu(p);
+	}
+
 	if (idle_cpu(target))
 		return target;
 
@@ -4846,6 +4859,14 @@ select_task_rq_fair(struct task_struct *p, int sd_flag, int wake_flags)
 	if (p->nr_cpus_allowed == 1)
 		return prev_cpu;
 
+	/* the energy model knows better than the HMP thresholds */
+	if (energy_aware() && (sd_flag & SD_BALANCE_WAKE)) {
+		rcu_read_lock();
+		new_cpu = select_idle_sibling(p, prev_cpu);
+		rcu_read_unlock();
+		return new_cpu;
+	}
+
 	if (sched_orig_load_balance_enable){
 		//8916 chipset goes to legacy load balancer code
 	if (sd_flag & SD_BALANCE_WAKE) {
@@ -6518,6 +6539,13 @@ find_busiest_group(struct lb_env *env, int *balance)
 	if (!(*balance))
 		goto ret;
 
+	/*
+	 * While every cpu has spare capacity, tasks are where wake-up
+	 * placement found them cheapest; spreading them would undo that.
+	 */
+	if (energy_aware() && !sd_overutilized(env->sd))
+		goto out_balanced;
+
 	if ((env->idle == CPU_IDLE || env->idle == CPU_NEWLY_IDLE) &&
 	    check_asym_packing(env, &sds))
 		return sds.busiest;
@@ -6983,6 +7011,10 @@ void idle_balance(int this_cpu, struct rq *this_rq)
 
 	this_rq->idle_stamp = this_rq->clock;
 
+	/* an isolated cpu is meant to stay idle */
+	if (cpu_isolated(this_cpu))
+		return;
+
 	if (this_rq->avg_idle < sysctl_sched_migration_cost ||
  !this_rq->rd->overload)
 		return;
@@ -7338,6 +7370,11 @@ static void rebalance_domains(int cpu, enum cpu_idle_type idle)
 
 	update_blocked_averages(cpu);
 
+	if (cpu_isolated(cpu)) {
+		rq->next_balance = next_balance;
+		return;
+	}
+
 	rcu_read_lock();
 	for_each_domain(cpu, sd) {
 		if (!(sd->flags & SD_LOAD_BALANCE))
@@ -7662,6 +7699,7 @@ static void task_tick_fair(struct rq *rq, struct task_struct *curr, int queued)
 		task_tick_numa(rq, curr);
 
 	update_rq_runnable_avg(rq, 1);
+	cpufreq_update_util(rq);
 }
 
 /*
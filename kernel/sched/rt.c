@@ -1553,6 +1553,9 @@ static int find_lowest_rq_hmp(struct task_struct *task)
 	if (!cpupri_find(&task_rq(task)->rd->cpupri, task, lowest_mask))
 		return best_cpu; /* No targets found */
 
+	/* Isolated cpus take no RT tasks */
+	cpumask_andnot(lowest_mask, lowest_mask, cpu_isolated_mask);
+
 	/*
 	 * At this point we have built a mask of cpus representing the
 	 * lowest priority tasks in the system.  Now we want to elect
@@ -1603,6 +1606,11 @@ static int find_lowest_rq(struct task_struct *task)
 	if (!cpupri_find(&task_rq(task)->rd->cpupri, task, lowest_mask))
 		return -1; /* No targets found */
 
+	/* Isolated cpus take no RT tasks */
+	cpumask_andnot(lowest_mask, lowest_mask, cpu_isolated_mask);
+	if (cpumask_empty(lowest_mask))
+		return -1;
+
 	/*
 	 * At this point we have built a mask of cpus representing the
 	 * lowest priority tasks in the system.  Now we want to elect
@@ -1840,6 +1848,10 @@ static int pull_rt_task(struct rq *this_rq)
 	if (likely(!rt_overloaded(this_rq)))
 		return 0;
 
+	/* An isolated cpu runs what is left on it, it doesn't pull more */
+	if (cpu_isolated(this_cpu))
+		return 0;
+
 	for_each_cpu(cpu, this_rq->rd->rto_mask) {
 		if (this_cpu == cpu)
 			continue;
@@ -153,9 +153,14 @@ struct task_group {
 #ifdef CONFIG_CAPACITY_CLAMPING
 #define CAP_CLAMP_MIN 0
 #define CAP_CLAMP_MAX 1
+#define CAP_CLAMP_BOOST 2
+#define CAP_CLAMP_NR 3
 
-	/* Min and Max capacity constraints for tasks in this group */
-	unsigned int cap_clamp[2];
+	/*
+	 * Min and Max capacity constraints for tasks in this group, and the
+	 * percentage of the spare capacity added to their utilization
+	 */
+	unsigned int cap_clamp[CAP_CLAMP_NR];
 #endif
 
 #ifdef CONFIG_RT_GROUP_SCHED
@@ -470,8 +475,8 @@ struct rq {
 #endif
 
 #ifdef CONFIG_CAPACITY_CLAMPING
-	/* Min and Max capacity constraints */
-	struct cap_clamp_cpu cap_clamp_cpu[2];
+	/* Min, Max and boost capacity constraints */
+	struct cap_clamp_cpu cap_clamp_cpu[CAP_CLAMP_NR];
 #endif /* CONFIG_CAPACITY_CLAMPING */
 
 	/*
@@ -586,6 +591,9 @@ struct rq {
 	/* try_to_wake_up() stats */
 	unsigned int ttwu_count;
 	unsigned int ttwu_local;
+
+	/* runnable delay of every task run here */
+	struct sched_lat_hist lat_hist;
 #endif
 
 #ifdef CONFIG_SMP
@@ -1746,3 +1754,75 @@ static inline u64 irq_time_read(int cpu)
 }
 #endif /* CONFIG_64BIT */
 #endif /* CONFIG_IRQ_TIME_ACCOUNTING */
+
+#ifdef CONFIG_CAPACITY_CLAMPING
+extern unsigned long cap_clamp_cpu_util(struct rq *rq, unsigned long util);
+extern unsigned long cap_clamp_task_util(struct task_struct *p,
+					 unsigned long util);
+#else
+static inline unsigned long cap_clamp_cpu_util(struct rq *rq,
+					       unsigned long util)
+{
+	return util;
+}
+
+static inline unsigned long cap_clamp_task_util(struct task_struct *p,
+						unsigned long util)
+{
+	return util;
+}
+#endif
+
+#ifdef CONFIG_CPU_FREQ
+DECLARE_PER_CPU(struct update_util_data *, cpufreq_update_util_data);
+
+/*
+ * Hand the rq's runnable average to a cpufreq governor, if one registered
+ * for this cpu.  Called with rq->lock held, so the callback must neither
+ * sleep nor take another rq lock.
+ */
+static inline void cpufreq_update_util(struct rq *rq)
+{
+	struct update_util_data *data;
+	unsigned long util;
+
+	data = rcu_dereference_sched(per_cpu(cpufreq_update_util_data,
+					     cpu_of(rq)));
+	if (!data)
+		return;
+
+	util = (rq->avg.runnable_avg_sum << SCHED_POWER_SHIFT) /
+	       (rq->avg.runnable_avg_period + 1);
+	util = cap_clamp_cpu_util(rq, util);
+	data->func(data, cpu_of(rq), rq->clock, util, SCHED_POWER_SCALE);
+}
+#else
+static inline void cpufreq_update_util(struct rq *rq) {}
+#endif
+
+#ifdef CONFIG_SCHED_ENERGY_AWARE
+extern bool sched_energy_ready;
+
+static inline bool energy_aware(void)
+{
+	return sysctl_sched_energy_aware && sched_energy_ready;
+}
+
+extern int energy_aware_wake_cpu(struct task_struct *p, int target);
+extern bool sd_overutilized(struct sched_domain *sd);
+#else
+static inline bool energy_aware(void)
+{
+	return false;
+}
+
+static inline int energy_aware_wake_cpu(struct task_struct *p, int target)
+{
+	return -1;
+}
+
+static inline bool sd_overutilized(struct sched_domain *sd)
+{
+	return true;
+}
+#endif
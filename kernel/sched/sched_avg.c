@@ -18,52 +18,98 @@
 #include <linux/hrtimer.h>
 #include <linux/sched.h>
 #include <linux/math64.h>
+#include <linux/seqlock.h>
+#include <linux/string.h>
 
-static DEFINE_PER_CPU(u64, nr_prod_sum);
-static DEFINE_PER_CPU(u64, last_time);
-static DEFINE_PER_CPU(u64, nr);
-static DEFINE_PER_CPU(unsigned long, iowait_prod_sum);
-static DEFINE_PER_CPU(spinlock_t, nr_lock) = __SPIN_LOCK_UNLOCKED(nr_lock);
-static s64 last_get_time;
+/*
+ * Running sums of nr_running and nr_iowait over time.  They are only ever
+ * updated with the cpu's rq->lock held, which serializes the writers; the
+ * poller reads them under the sequence count and never writes, so the
+ * enqueue and dequeue paths take no extra lock.
+ */
+struct nr_stats {
+	seqcount_t seq;
+	u64 nr_prod_sum;
+	u64 iowait_prod_sum;
+	u64 last_time;
+	unsigned long nr;
+};
+
+static DEFINE_PER_CPU(struct nr_stats, nr_stats);
+
+/* Poll state of sched_get_nr_running_avg() */
+static struct sched_nr_avg_poll nr_avg_poll;
 
 /**
- * sched_get_nr_running_avg
+ * sched_get_nr_running_avg_cpus
+ * @poll: State of the caller's polls, zeroed before the first one.
+ * @cpu_avg: Array of nr_cpu_ids entries, set to the average nr_running
+ *	     of each cpu since last poll (* 100), or NULL.
  * @return: Average nr_running and iowait value since last poll.
  *	    Returns the avg * 100 to return up to two decimal points
  *	    of accuracy.
  *
- * Obtains the average nr_running value since the last poll.
- * This function may not be called concurrently with itself
+ * Obtains the average nr_running value since the caller's last poll.
+ * Each poller keeps its own @poll, so pollers at different rates don't
+ * shorten each other's windows.  This function may not be called
+ * concurrently with the same @poll.
  */
-void sched_get_nr_running_avg(int *avg, int *iowait_avg)
+void sched_get_nr_running_avg_cpus(struct sched_nr_avg_poll *poll,
+				   int *avg, int *iowait_avg, int *cpu_avg)
 {
 	int cpu;
 	u64 curr_time = sched_clock();
-	u64 diff = curr_time - last_get_time;
+	u64 diff = curr_time - poll->last_time;
 	u64 tmp_avg = 0, tmp_iowait = 0;
 
 	*avg = 0;
 	*iowait_avg = 0;
+	if (cpu_avg)
+		memset(cpu_avg, 0, nr_cpu_ids * sizeof(*cpu_avg));
 
 	if (!diff)
 		return;
 
-	last_get_time = curr_time;
-	/* read and reset nr_running counts */
+	poll->last_time = curr_time;
+	/* snapshot the sums and extend them up to now */
 	for_each_possible_cpu(cpu) {
-		unsigned long flags;
-
-		spin_lock_irqsave(&per_cpu(nr_lock, cpu), flags);
-		tmp_avg += per_cpu(nr_prod_sum, cpu);
-		tmp_avg += per_cpu(nr, cpu) *
-			(curr_time - per_cpu(last_time, cpu));
-		tmp_iowait = per_cpu(iowait_prod_sum, cpu);
-		tmp_iowait +=  nr_iowait_cpu(cpu) *
-			(curr_time - per_cpu(last_time, cpu));
-		per_cpu(last_time, cpu) = curr_time;
-		per_cpu(nr_prod_sum, cpu) = 0;
-		per_cpu(iowait_prod_sum, cpu) = 0;
-		spin_unlock_irqrestore(&per_cpu(nr_lock, cpu), flags);
+		struct nr_stats *stats = &per_cpu(nr_stats, cpu);
+		u64 nr_prod, iowait_prod, last_time;
+		unsigned long nr;
+		unsigned int seq;
+
+		do {
+			seq = read_seqcount_begin(&stats->seq);
+			nr_prod = stats->nr_prod_sum;
+			iowait_prod = stats->iowait_prod_sum;
+			last_time = stats->last_time;
+			nr = stats->nr;
+		} while (read_seqcount_retry(&stats->seq, seq));
+
+		if ((s64)(curr_time - last_time) > 0) {
+			nr_prod += nr * (curr_time - last_time);
+			iowait_prod += nr_iowait_cpu(cpu) *
+				(curr_time - last_time);
+		}
+
+		/*
+		 * The extension uses this cpu's clock and the current iowait
+		 * count, the writer later folds in its own; don't let the
+		 * difference to the previous poll go negative.
+		 */
+		if (nr_prod > poll->nr_prod_seen[cpu]) {
+			u64 delta = nr_prod - poll->nr_prod_seen[cpu];
+
+			tmp_avg += delta;
+			if (cpu_avg)
+				cpu_avg[cpu] = (int)div64_u64(delta * 100,
+							      diff);
+		}
+		poll->nr_prod_seen[cpu] = nr_prod;
+
+		if (iowait_prod > poll->iowait_prod_seen[cpu])
+			tmp_iowait += iowait_prod - poll->iowait_prod_seen[cpu];
+		poll->iowait_prod_seen[cpu] = iowait_prod;
 	}
 
 	*avg = (int)div64_u64(tmp_avg * 100, diff);
@@ -74,6 +120,21 @@ void sched_get_nr_running_avg(int *avg, int *iowait_avg)
 	BUG_ON(*iowait_avg < 0);
 	pr_debug("%s - avg:%d\n", __func__, *iowait_avg);
 }
+EXPORT_SYMBOL(sched_get_nr_running_avg_cpus);
+
+/**
+ * sched_get_nr_running_avg
+ * @return: Average nr_running and iowait value since last poll.
+ *	    Returns the avg * 100 to return up to two decimal points
+ *	    of accuracy.
+ *
+ * Obtains the average nr_running value since the last poll.
+ * This function may not be called concurrently with itself
+ */
+void sched_get_nr_running_avg(int *avg, int *iowait_avg)
+{
+	sched_get_nr_running_avg_cpus(&nr_avg_poll, avg, iowait_avg, NULL);
+}
 EXPORT_SYMBOL(sched_get_nr_running_avg);
 
 /**
@@ -83,24 +144,25 @@ EXPORT_SYMBOL(sched_get_nr_running_avg);
  * @inc: Whether we are increasing or decreasing the count
  * @return: N/A
  *
- * Update average with latest nr_running value for CPU
+ * Update average with latest nr_running value for CPU.  Must be called
+ * with the cpu's rq->lock held.
  */
 void sched_update_nr_prod(int cpu, unsigned long nr_running, bool inc)
 {
-	int diff;
-	s64 curr_time;
-	unsigned long flags;
+	struct nr_stats *stats = &per_cpu(nr_stats, cpu);
+	s64 diff;
+	u64 curr_time;
 
-	spin_lock_irqsave(&per_cpu(nr_lock, cpu), flags);
+	write_seqcount_begin(&stats->seq);
 	curr_time = sched_clock();
-	diff = curr_time - per_cpu(last_time, cpu);
-	per_cpu(last_time, cpu) = curr_time;
-	per_cpu(nr, cpu) = nr_running + (inc ? 1 : -1);
-
-	BUG_ON(per_cpu(nr, cpu) < 0);
+	diff = curr_time - stats->last_time;
+	if (diff < 0)
+		diff = 0;
+	stats->last_time = curr_time;
+	stats->nr = nr_running + (inc ? 1 : -1);
 
-	per_cpu(nr_prod_sum, cpu) += nr_running * diff;
-	per_cpu(iowait_prod_sum, cpu) += nr_iowait_cpu(cpu) * diff;
-	spin_unlock_irqrestore(&per_cpu(nr_lock, cpu), flags);
+	stats->nr_prod_sum += nr_running * diff;
+	stats->iowait_prod_sum += nr_iowait_cpu(cpu) * diff;
+	write_seqcount_end(&stats->seq);
 }
 EXPORT_SYMBOL(sched_update_nr_prod);
@@ -137,9 +137,165 @@ static const struct file_operations proc_schedstat_operations = {
 	.release = seq_release,
 };
 
+static void sched_lat_show_hist(struct seq_file *m, const char *prefix,
+				struct sched_lat_hist *hist)
+{
+	static const char * const names[SCHED_LAT_NR_TYPES] = {
+		[SCHED_LAT_WAKEUP]	= "wakeup",
+		[SCHED_LAT_PREEMPT]	= "preempt",
+	};
+	int type, i;
+
+	for (type = 0; type < SCHED_LAT_NR_TYPES; type++) {
+		seq_printf(m, "%s%s", prefix, names[type]);
+		for (i = 0; i < SCHED_LAT_BUCKETS; i++)
+			seq_printf(m, " %u", hist->count[type][i]);
+		seq_printf(m, "\n");
+	}
+}
+
+/* lower bound of each bucket, in ns */
+static void sched_lat_show_header(struct seq_file *m)
+{
+	int i;
+
+	seq_printf(m, "ns 0");
+	for (i = 1; i < SCHED_LAT_BUCKETS; i++)
+		seq_printf(m, " %lu", 512UL << i);
+	seq_printf(m, "\n");
+}
+
+unsigned int sched_lat_hist_enabled __read_mostly;
+
+/*
+ * /proc/sched_latency: per-cpu histograms of the runnable delay of
+ * every task run on the cpu.  They cost a little on every context
+ * switch, so they are off by default: writing 1 clears and starts them,
+ * writing 0 stops them and keeps what was collected.
+ */
+static int sched_latency_show(struct seq_file *m, void *v)
+{
+	struct sched_lat_hist hist;
+	char prefix[16];
+	int cpu;
+
+	sched_lat_show_header(m);
+	for_each_online_cpu(cpu) {
+		struct rq *rq = cpu_rq(cpu);
+
+		raw_spin_lock_irq(&rq->lock);
+		hist = rq->lat_hist;
+		raw_spin_unlock_irq(&rq->lock);
+
+		snprintf(prefix, sizeof(prefix), "cpu%d ", cpu);
+		sched_lat_show_hist(m, prefix, &hist);
+	}
+	return 0;
+}
+
+static ssize_t sched_latency_write(struct file *file, const char __user *buf,
+				   size_t count, loff_t *ppos)
+{
+	int cpu, enable, err;
+
+	err = kstrtoint_from_user(buf, count, 0, &enable);
+	if (err)
+		return err;
+
+	if (!enable) {
+		ACCESS_ONCE(sched_lat_hist_enabled) = 0;
+		return count;
+	}
+
+	for_each_possible_cpu(cpu) {
+		struct rq *rq = cpu_rq(cpu);
+
+		raw_spin_lock_irq(&rq->lock);
+		memset(&rq->lat_hist, 0, sizeof(rq->lat_hist));
+		raw_spin_unlock_irq(&rq->lock);
+	}
+	ACCESS_ONCE(sched_lat_hist_enabled) = 1;
+	return count;
+}
+
+static int sched_latency_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, sched_latency_show, NULL);
+}
+
+static const struct file_operations proc_sched_latency_operations = {
+	.open    = sched_latency_open,
+	.read    = seq_read,
+	.write   = sched_latency_write,
+	.llseek  = seq_lseek,
+	.release = single_release,
+};
+
+/*
+ * The scheduler only touches p->lat_hist with the rq lock held and
+ * interrupts off, so synchronize_sched() is enough before freeing it.
+ */
+void proc_sched_lat_show_task(struct task_struct *p, struct seq_file *m)
+{
+	struct sched_lat_hist *hist, copy;
+
+	preempt_disable();
+	hist = ACCESS_ONCE(p->lat_hist);
+	if (hist)
+		copy = *hist;
+	preempt_enable();
+
+	if (!hist)
+		return;
+
+	sched_lat_show_header(m);
+	sched_lat_show_hist(m, "", &copy);
+}
+
+/*
+ * Enabling an already enabled task clears its histogram, disabling it
+ * frees the histogram.
+ */
+int proc_sched_lat_set_task(struct task_struct *p, int enable)
+{
+	struct sched_lat_hist *hist;
+
+	if (!enable) {
+		hist = xchg(&p->lat_hist, NULL);
+		if (hist) {
+			synchronize_sched();
+			kfree(hist);
+		}
+		return 0;
+	}
+
+	hist = kzalloc(sizeof(*hist), GFP_KERNEL);
+	if (!hist)
+		return -ENOMEM;
+
+	if (cmpxchg(&p->lat_hist, NULL, hist)) {
+		kfree(hist);
+		preempt_disable();
+		hist = ACCESS_ONCE(p->lat_hist);
+		if (hist)
+			memset(hist, 0, sizeof(*hist));
+		preempt_enable();
+	}
+	return 0;
+}
+
+/* Called from free_task(), the task can no longer be scheduled */
+void sched_lat_hist_free(struct task_struct *p)
+{
+	kfree(p->lat_hist);
+	p->lat_hist = NULL;
+}
+
 static int __init proc_schedstat_init(void)
 {
 	proc_create("schedstat", 0, NULL, &proc_schedstat_operations);
+	proc_create("sched_latency", S_IRUGO | S_IWUSR, NULL,
+		    &proc_sched_latency_operations);
 	return 0;
 }
 module_init(proc_schedstat_init);
@@ -29,6 +29,48 @@ rq_sched_info_dequeued(struct rq *rq, unsigned long long delta)
 	if (rq)
 		rq->rq_sched_info.run_delay += delta;
 }
+
+/* per-cpu histograms, off until enabled through /proc/sched_latency */
+extern unsigned int sched_lat_hist_enabled;
+
+/*
+ * A task dequeued before it got to run (migration, priority change)
+ * keeps the delay so far; it ends up in one histogram bucket once the
+ * task is finally picked.
+ */
+static inline void
+sched_lat_dequeued(struct task_struct *t, unsigned long long delta)
+{
+	t->sched_info.lat_pending += delta;
+}
+
+static inline void
+sched_lat_arrive(struct rq *rq, struct task_struct *t,
+		 unsigned long long delta)
+{
+	struct sched_lat_hist *hist = ACCESS_ONCE(t->lat_hist);
+	int type = t->sched_info.lat_preempted ?
+			SCHED_LAT_PREEMPT : SCHED_LAT_WAKEUP;
+	int idx;
+
+	delta += t->sched_info.lat_pending;
+	t->sched_info.lat_pending = 0;
+	t->sched_info.lat_preempted = 0;
+
+	if (likely(!sched_lat_hist_enabled && !hist))
+		return;
+
+	idx = min_t(int, fls64(delta >> 10), SCHED_LAT_BUCKETS - 1);
+	if (sched_lat_hist_enabled)
+		rq->lat_hist.count[type][idx]++;
+	if (unlikely(hist))
+		hist->count[type][idx]++;
+}
+
+static inline void sched_lat_preempted(struct task_struct *t)
+{
+	t->sched_info.lat_preempted = 1;
+}
 # define schedstat_inc(rq, field)	do { (rq)->field++; } while (0)
 # define schedstat_add(rq, field, amt)	do { (rq)->field += (amt); } while (0)
 # define schedstat_set(var, val)	do { var = (val); } while (0)
@@ -42,6 +84,15 @@ rq_sched_info_dequeued(struct rq *rq, unsigned long long delta)
 static inline void
 rq_sched_info_depart(struct rq *rq, unsigned long long delta)
 {}
+static inline void
+sched_lat_dequeued(struct task_struct *t, unsigned long long delta)
+{}
+static inline void
+sched_lat_arrive(struct rq *rq, struct task_struct *t,
+		 unsigned long long delta)
+{}
+static inline void sched_lat_preempted(struct task_struct *t)
+{}
 # define schedstat_inc(rq, field)	do { } while (0)
 # define schedstat_add(rq, field, amt)	do { } while (0)
 # define schedstat_set(var, val)	do { } while (0)
@@ -68,6 +119,7 @@ static inline void sched_info_dequeued(struct task_struct *t)
 			delta = now - t->sched_info.last_queued;
 	sched_info_reset_dequeued(t);
 	t->sched_info.run_delay += delta;
+	sched_lat_dequeued(t, delta);
 
 	rq_sched_info_dequeued(task_rq(t), delta);
 }
@@ -87,6 +139,7 @@ static void sched_info_arrive(struct task_struct *t)
 	t->sched_info.run_delay += delta;
 	t->sched_info.last_arrival = now;
 	t->sched_info.pcount++;
+	sched_lat_arrive(task_rq(t), t, delta);
 
 	rq_sched_info_arrive(task_rq(t), delta);
 }
@@ -117,8 +170,10 @@ static inline void sched_info_depart(struct task_struct *t)
 
 	rq_sched_info_depart(task_rq(t), delta);
 
-	if (t->state == TASK_RUNNING)
+	if (t->state == TASK_RUNNING) {
+		sched_lat_preempted(t);
 		sched_info_queued(t);
+	}
 }
 
 /*
@@ -458,6 +458,17 @@ static struct ctl_table kern_table[] = {
 		.proc_handler	= sched_boost_handler,
 	},
 #endif	/* CONFIG_SCHED_HMP */
+#ifdef CONFIG_SCHED_ENERGY_AWARE
+	{
+		.procname	= "sched_energy_aware",
+		.data		= &sysctl_sched_energy_aware,
+		.maxlen		= sizeof(unsigned int),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= &zero,
+		.extra2		= &one,
+	},
+#endif
 #ifdef CONFIG_SCHED_DEBUG
 	{
 		.procname	= "sched_min_granularity_ns",
@@ -48,6 +48,9 @@
 #include <linux/moduleparam.h>
 #include <linux/uaccess.h>
 #include <linux/bug.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/sort.h>
 
 #include "workqueue_internal.h"
 
@@ -140,6 +143,31 @@ enum {
 
 /* struct worker is defined in workqueue_internal.h */
 
+#ifdef CONFIG_WQ_STATS
+/*
+ * Histogram bucket 0 counts durations below 1024ns, bucket i durations
+ * in [512ns << i, 1024ns << i), the last bucket everything longer.
+ */
+#define WQ_STATS_BUCKETS	20
+#define WQ_STATS_FUNCS_BITS	6		/* work functions tracked */
+#define WQ_STATS_FUNCS		(1 << WQ_STATS_FUNCS_BITS)
+#define WQ_STATS_TOP		8		/* shown per pool */
+
+struct wq_func_stats {
+	work_func_t		func;
+	u64			count;
+	u64			total_ns;
+	u64			max_ns;
+};
+
+struct wq_pool_stats {
+	u32			queue_hist[WQ_STATS_BUCKETS];
+	u32			exec_hist[WQ_STATS_BUCKETS];
+	u64			untracked_ns;	/* table full */
+	struct wq_func_stats	funcs[WQ_STATS_FUNCS];
+};
+#endif
+
 struct worker_pool {
 	spinlock_t		lock;		/* the pool lock */
 	int			cpu;		/* I: the associated cpu */
@@ -177,6 +205,10 @@ struct worker_pool {
 	 */
 	atomic_t		nr_running ____cacheline_aligned_in_smp;
 
+#ifdef CONFIG_WQ_STATS
+	struct wq_pool_stats	stats;		/* L: latency and exec time */
+#endif
+
 	/*
 	 * Destruction of pool is sched-RCU protected to allow dereferences
 	 * from get_work_pool().
@@ -307,6 +339,8 @@ struct workqueue_struct *system_long_wq __read_mostly;
 EXPORT_SYMBOL_GPL(system_long_wq);
 struct workqueue_struct *system_unbound_wq __read_mostly;
 EXPORT_SYMBOL_GPL(system_unbound_wq);
+struct workqueue_struct *system_highpri_unbound_wq __read_mostly;
+EXPORT_SYMBOL_GPL(system_highpri_unbound_wq);
 struct workqueue_struct *system_freezable_wq __read_mostly;
 EXPORT_SYMBOL_GPL(system_freezable_wq);
 
@@ -1237,6 +1271,77 @@ fail:
 	return -EAGAIN;
 }
 
+#ifdef CONFIG_WQ_STATS
+static int wq_stats_bucket(s64 ns)
+{
+	if (ns <= 0)
+		return 0;
+	return min_t(int, fls64(ns >> 10), WQ_STATS_BUCKETS - 1);
+}
+
+static void wq_stats_queued(struct work_struct *work)
+{
+	work->queued_time = local_clock();
+}
+
+/*
+ * @work is about to run: account how long it waited, from insertion
+ * into the pool (or the delayed list of its pwq) to now.
+ *
+ * CONTEXT:
+ * spin_lock_irq(pool->lock).
+ */
+static u64 wq_stats_start(struct worker_pool *pool, struct work_struct *work)
+{
+	u64 now = local_clock();
+
+	pool->stats.queue_hist[wq_stats_bucket(now - work->queued_time)]++;
+	return now;
+}
+
+/*
+ * @func, started at @start, has returned.  Work functions are kept in
+ * a small open addressed table; once it is full the time of new ones
+ * only shows up in untracked_ns.  A worker of an unbound pool may have
+ * moved to another cpu meanwhile, whose local_clock() can be behind;
+ * such a negative run time counts as zero.
+ *
+ * CONTEXT:
+ * spin_lock_irq(pool->lock).
+ */
+static void wq_stats_done(struct worker_pool *pool, work_func_t func,
+			  u64 start)
+{
+	struct wq_pool_stats *stats = &pool->stats;
+	s64 delta = local_clock() - start;
+	u64 ns = delta > 0 ? delta : 0;
+	unsigned int i, idx = hash_ptr((void *)func, WQ_STATS_FUNCS_BITS);
+
+	stats->exec_hist[wq_stats_bucket(ns)]++;
+
+	for (i = 0; i < WQ_STATS_FUNCS; i++) {
+		struct wq_func_stats *fs;
+
+		fs = &stats->funcs[(idx + i) & (WQ_STATS_FUNCS - 1)];
+		if (!fs->func)
+			fs->func = func;
+		if (fs->func == func) {
+			fs->count++;
+			fs->total_ns += ns;
+			fs->max_ns = max(fs->max_ns, ns);
+			return;
+		}
+	}
+	stats->untracked_ns += ns;
+}
+#else
+static inline void wq_stats_queued(struct work_struct *work) { }
+static inline u64 wq_stats_start(struct worker_pool *pool,
+				 struct work_struct *work) { return 0; }
+static inline void wq_stats_done(struct worker_pool *pool, work_func_t func,
+				 u64 start) { }
+#endif
+
 /**
  * insert_work - insert a work into a pool
  * @pwq: pwq @work belongs to
@@ -1258,6 +1363,7 @@ static void insert_work(struct pool_workqueue *pwq, struct work_struct *work,
 	/* we own @work, set data and link */
 	set_work_pwq(work, pwq, extra_flags);
 	list_add_tail(&work->entry, head);
+	wq_stats_queued(work);
 	get_pwq(pwq);
 
 	/*
@@ -2104,6 +2210,7 @@ __acquires(&pool->lock)
 	bool cpu_intensive = pwq->wq->flags & WQ_CPU_INTENSIVE;
 	int work_color;
 	struct worker *collision;
+	u64 exec_start;
 #ifdef CONFIG_LOCKDEP
 	/*
 	 * It is permissible to free the struct work_struct from
@@ -2169,6 +2276,7 @@ __acquires(&pool->lock)
 	 */
 	set_work_pool_and_clear_pending(work, pool->id);
 
+	exec_start = wq_stats_start(pool, work);
 	spin_unlock_irq(&pool->lock);
 
 	lock_map_acquire_read(&pwq->wq->lockdep_map);
@@ -2204,6 +2312,8 @@ __acquires(&pool->lock)
 
 	spin_lock_irq(&pool->lock);
 
+	wq_stats_done(pool, worker->current_func, exec_start);
+
 	/* clear cpu intensive status */
 	if (unlikely(cpu_intensive))
 		worker_clr_flags(worker, WORKER_CPU_INTENSIVE);
@@ -5093,10 +5203,113 @@ static int __init init_workqueues(void)
 	system_long_wq = alloc_workqueue("events_long", 0, 0);
 	system_unbound_wq = alloc_workqueue("events_unbound", WQ_UNBOUND,
 					    WQ_UNBOUND_MAX_ACTIVE);
+	system_highpri_unbound_wq = alloc_workqueue("events_highpri_unbound",
+						    WQ_UNBOUND | WQ_HIGHPRI,
+						    WQ_UNBOUND_MAX_ACTIVE);
 	system_freezable_wq = alloc_workqueue("events_freezable",
 					      WQ_FREEZABLE, 0);
 	BUG_ON(!system_wq || !system_highpri_wq || !system_long_wq ||
-	       !system_unbound_wq || !system_freezable_wq);
+	       !system_unbound_wq || !system_highpri_unbound_wq ||
+	       !system_freezable_wq);
 	return 0;
 }
 early_initcall(init_workqueues);
+
+#ifdef CONFIG_WQ_STATS
+static int wq_func_stats_cmp(const void *a, const void *b)
+{
+	const struct wq_func_stats *l = a, *r = b;
+
+	if (l->total_ns == r->total_ns)
+		return 0;
+	return l->total_ns < r->total_ns ? 1 : -1;
+}
+
+static void wq_stats_show_hist(struct seq_file *m, const char *name,
+			       const u32 *hist)
+{
+	int i;
+
+	seq_printf(m, "  %s", name);
+	for (i = 0; i < WQ_STATS_BUCKETS; i++)
+		seq_printf(m, " %u", hist[i]);
+	seq_putc(m, '\n');
+}
+
+/*
+ * debugfs workqueue/pools: queueing latency and execution time
+ * histograms of every pool, followed by the work functions that took
+ * the most time in it.
+ */
+static int wq_stats_show(struct seq_file *m, void *v)
+{
+	struct wq_pool_stats *stats;
+	struct worker_pool *pool;
+	int pi, i;
+
+	stats = kmalloc(sizeof(*stats), GFP_KERNEL);
+	if (!stats)
+		return -ENOMEM;
+
+	seq_printf(m, "ns 0");
+	for (i = 1; i < WQ_STATS_BUCKETS; i++)
+		seq_printf(m, " %lu", 512UL << i);
+	seq_putc(m, '\n');
+
+	mutex_lock(&wq_pool_mutex);
+	for_each_pool(pool, pi) {
+		spin_lock_irq(&pool->lock);
+		*stats = pool->stats;
+		spin_unlock_irq(&pool->lock);
+
+		if (pool->cpu >= 0)
+			seq_printf(m, "pool %d cpu %d nice %d\n", pool->id,
+				   pool->cpu, pool->attrs->nice);
+		else
+			seq_printf(m, "pool %d unbound nice %d\n", pool->id,
+				   pool->attrs->nice);
+		wq_stats_show_hist(m, "queue", stats->queue_hist);
+		wq_stats_show_hist(m, "exec", stats->exec_hist);
+
+		sort(stats->funcs, WQ_STATS_FUNCS, sizeof(stats->funcs[0]),
+		     wq_func_stats_cmp, NULL);
+		for (i = 0; i < WQ_STATS_TOP && stats->funcs[i].func; i++)
+			seq_printf(m, "  %pf count %llu total_ns %llu max_ns %llu\n",
+				   stats->funcs[i].func, stats->funcs[i].count,
+				   stats->funcs[i].total_ns,
+				   stats->funcs[i].max_ns);
+		if (stats->untracked_ns)
+			seq_printf(m, "  untracked total_ns %llu\n",
+				   stats->untracked_ns);
+	}
+	mutex_unlock(&wq_pool_mutex);
+
+	kfree(stats);
+	return 0;
+}
+
+static int wq_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, wq_stats_show, NULL);
+}
+
+static const struct file_operations wq_stats_fops = {
+	.open		= wq_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init wq_stats_debugfs_init(void)
+{
+	struct dentry *dir;
+
+	dir = debugfs_create_dir("workqueue", NULL);
+	if (!dir)
+		return -ENOMEM;
+	if (!debugfs_create_file("pools", S_IRUGO, dir, NULL, &wq_stats_fops))
+		return -ENOMEM;
+	return 0;
+}
+late_initcall(wq_stats_debugfs_init);
+#endif
@@ -0,0 +1,1222 @@
+/*
+ * cpufreq-replay -- record cpu load traces and replay them through
+ * models of the bundled cpufreq governors.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * A trace is the text output of the power:cpu_idle and power:cpu_frequency
+ * tracepoints.  Every interval a cpu spends out of idle is turned into a
+ * burst of work, measured in frequency * time at the frequency the cpu was
+ * really running at.  The bursts are then replayed at the frequencies picked
+ * by each governor model: work queues up on a cpu while it runs slower than
+ * in the recording and drains faster when it runs quicker.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <errno.h>
+#include <math.h>
+
+#define MAX_CPUS		32
+#define MAX_FREQS		64
+
+#define SIM_STEP_US		100.0
+#define DRAIN_LIMIT_US		5000000.0
+
+#define DEF_DEADLINE_US		16667
+#define DEF_SAMPLING_US		20000
+#define DEF_RECORD_BUF_KB	8192
+
+#define IDLE_EXIT		4294967295UL
+
+static char *tracing_dir = "/sys/kernel/debug/tracing";
+static unsigned int deadline_us = DEF_DEADLINE_US;
+static unsigned int sampling_us = DEF_SAMPLING_US;
+static int verbose;
+
+/* A busy period of one cpu as seen in the recording */
+struct burst {
+	double arrival;
+	double work;		/* kHz * us */
+};
+
+struct cpu_trace {
+	struct burst *bursts;
+	int nr_bursts;
+	int alloc;
+
+	int online;		/* cpu produced idle events */
+	int busy;
+	double busy_start;
+	double last;
+	double work;
+	unsigned int freq;
+};
+
+struct policy {
+	int cpus[MAX_CPUS];
+	int nr_cpus;
+	unsigned int freqs[MAX_FREQS];	/* ascending */
+	int nr_freqs;
+	unsigned int init_freq;
+};
+
+static struct cpu_trace cpu_trace[MAX_CPUS];
+static int cpu_policy[MAX_CPUS];
+static struct policy policies[MAX_CPUS];
+static int nr_policies;
+static int nr_cpus;
+static double trace_start, trace_end;
+
+/* Per cpu replay state */
+struct sim_cpu {
+	int cpu;
+	int head;		/* oldest burst not yet completed */
+	double rem;		/* work left in the head burst */
+	double win_busy;	/* us busy since the last governor sample */
+	double win_work;	/* kHz * us done since the last governor sample */
+	double util;		/* PELT style running average, 0..1 */
+	int running;
+};
+
+struct sim_policy {
+	struct policy *p;
+	struct sim_cpu cpus[MAX_CPUS];
+	int idx;		/* current index into p->freqs */
+	double win_start;
+	double next_sample;
+
+	/* governor private state */
+	double last_change;
+	double floor_time;
+	unsigned int floor_freq;
+	unsigned int requested;
+	int up_ticks, down_ticks;
+
+	/* results */
+	double residency[MAX_FREQS];
+	double energy;
+	double lat_sum;
+	unsigned long bursts;
+	unsigned long missed;
+};
+
+struct governor {
+	const char *name;
+	void (*start)(struct sim_policy *sp);
+	void (*update)(struct sim_policy *sp, double now);
+};
+
+static void *xrealloc(void *ptr, size_t size)
+{
+	ptr = realloc(ptr, size);
+	if (!ptr) {
+		perror("realloc");
+		exit(1);
+	}
+	return ptr;
+}
+
+/*
+ * Frequency table helpers, following cpufreq_frequency_table_target()
+ */
+static int freq_index_l(struct policy *p, double target)
+{
+	int i;
+
+	for (i = 0; i < p->nr_freqs; i++)
+		if (p->freqs[i] >= target)
+			return i;
+	return p->nr_freqs - 1;
+}
+
+static int freq_index_h(struct policy *p, double target)
+{
+	int i;
+
+	for (i = p->nr_freqs - 1; i >= 0; i--)
+		if (p->freqs[i] <= target)
+			return i;
+	return 0;
+}
+
+static int freq_index_c(struct policy *p, double target)
+{
+	int l = freq_index_l(p, target);
+	int h = freq_index_h(p, target);
+
+	if (target - p->freqs[h] < p->freqs[l] - target)
+		return h;
+	return l;
+}
+
+static unsigned int cur_freq(struct sim_policy *sp)
+{
+	return sp->p->freqs[sp->idx];
+}
+
+static unsigned int min_freq(struct sim_policy *sp)
+{
+	return sp->p->freqs[0];
+}
+
+static unsigned int max_freq(struct sim_policy *sp)
+{
+	return sp->p->freqs[sp->p->nr_freqs - 1];
+}
+
+static void set_freq(struct sim_policy *sp, int idx, double now)
+{
+	if (idx != sp->idx)
+		sp->last_change = now;
+	sp->idx = idx;
+}
+
+/*
+ * Returns the highest busy percentage of the policy cpus over the window
+ * since the previous sample and, in loadadj, the highest busy time weighted
+ * frequency (the interactive governor's loadadjfreq), then opens a new
+ * window.  If cpu_adj is given, it receives the loadadjfreq of every cpu of
+ * the policy.
+ */
+static unsigned int sample_load_cpus(struct sim_policy *sp, double now,
+				     double *loadadj, double *cpu_adj)
+{
+	double window = now - sp->win_start;
+	double load = 0, adj = 0;
+	int i;
+
+	for (i = 0; i < sp->p->nr_cpus; i++) {
+		struct sim_cpu *c = &sp->cpus[i];
+		double a = 0;
+
+		if (window > 0) {
+			if (c->win_busy * 100 / window > load)
+				load = c->win_busy * 100 / window;
+			a = c->win_work * 100 / window;
+			if (a > adj)
+				adj = a;
+		}
+		if (cpu_adj)
+			cpu_adj[i] = a;
+		c->win_busy = 0;
+		c->win_work = 0;
+	}
+	sp->win_start = now;
+	if (loadadj)
+		*loadadj = adj;
+
+	return load > 100 ? 100 : (unsigned int)load;
+}
+
+static unsigned int sample_load(struct sim_policy *sp, double now,
+				double *loadadj)
+{
+	return sample_load_cpus(sp, now, loadadj, NULL);
+}
+
+static int sample_due(struct sim_policy *sp, double now, double period)
+{
+	if (now < sp->next_sample)
+		return 0;
+	sp->next_sample += period;
+	return 1;
+}
+
+static void start_common(struct sim_policy *sp)
+{
+	sp->next_sample = trace_start + sampling_us;
+	sp->requested = cur_freq(sp);
+}
+
+/* performance, powersave */
+
+static void performance_start(struct sim_policy *sp)
+{
+	sp->idx = sp->p->nr_freqs - 1;
+}
+
+static void powersave_start(struct sim_policy *sp)
+{
+	sp->idx = 0;
+}
+
+/* ondemand: od_check_cpu() with the default tunables */
+
+static void ondemand_update(struct sim_policy *sp, double now)
+{
+	unsigned int load;
+	double next;
+
+	if (!sample_due(sp, now, sampling_us))
+		return;
+
+	load = sample_load(sp, now, NULL);
+	if (load > 80) {
+		set_freq(sp, sp->p->nr_freqs - 1, now);
+		return;
+	}
+	next = min_freq(sp) + load * (double)(max_freq(sp) - min_freq(sp)) / 100;
+	set_freq(sp, freq_index_c(sp->p, next), now);
+}
+
+/* conservative: cs_check_cpu() with the default tunables */
+
+static void conservative_update(struct sim_policy *sp, double now)
+{
+	double step = max_freq(sp) * 5 / 100.0;
+	unsigned int load;
+
+	if (!sample_due(sp, now, sampling_us))
+		return;
+
+	load = sample_load(sp, now, NULL);
+	if (load > 80) {
+		if (sp->requested >= max_freq(sp))
+			return;
+		sp->requested += step;
+		if (sp->requested > max_freq(sp))
+			sp->requested = max_freq(sp);
+		set_freq(sp, freq_index_h(sp->p, sp->requested), now);
+	} else if (load < 20) {
+		if (sp->requested <= min_freq(sp) + step)
+			sp->requested = min_freq(sp);
+		else
+			sp->requested -= step;
+		set_freq(sp, freq_index_l(sp->p, sp->requested), now);
+	}
+}
+
+/*
+ * zzmoove: the default profile walks the frequency table one step at a
+ * time, two when the load is above smooth_up, on a 100ms sampling period.
+ * The other profiles of cpufreq_zzmoove_profiles.h cannot be selected.
+ * Hotplugging, freezing and the early demand heuristics are not modelled.
+ */
+
+static void zzmoove_start(struct sim_policy *sp)
+{
+	start_common(sp);
+	sp->next_sample = trace_start + 100000;
+}
+
+static void zzmoove_update(struct sim_policy *sp, double now)
+{
+	unsigned int load;
+	int idx = sp->idx;
+
+	if (!sample_due(sp, now, 100000))
+		return;
+
+	load = sample_load(sp, now, NULL);
+	if (load > 70)
+		idx += load > 75 ? 2 : 1;
+	else if (load < 52)
+		idx--;
+	if (idx < 0)
+		idx = 0;
+	if (idx >= sp->p->nr_freqs)
+		idx = sp->p->nr_freqs - 1;
+	set_freq(sp, idx, now);
+}
+
+/*
+ * interactive: cpufreq_interactive_timer() with a single target_load and
+ * hispeed_freq at the policy maximum.  barry_allen differs in target_load
+ * and go_hispeed_load.  intelliactive keeps the interactive defaults and
+ * adds its two phase ramp and sync_freq floor; it judges the load of the
+ * other cpus of the same policy only, as policies are replayed one at a
+ * time.
+ */
+
+struct interactive_tunables {
+	unsigned int target_load;
+	unsigned int go_hispeed_load;
+	unsigned int two_phase_freq;		/* 0: straight to hispeed */
+	unsigned int sync_freq;			/* 0: no sync floor */
+	unsigned int up_threshold_any_cpu_load;
+	unsigned int up_threshold_any_cpu_freq;
+};
+
+static const struct interactive_tunables interactive_def = { 90, 99 };
+static const struct interactive_tunables barry_allen_def = { 80, 90 };
+static const struct interactive_tunables intelliactive_def = {
+	90, 99, 1190400, 800000, 95, 998400,
+};
+
+/*
+ * intelliactive: keep at least sync_freq while another cpu is both busy
+ * and running fast, see cpufreq_interactive_timer() in intelliactive.
+ */
+static unsigned int sync_floor(struct sim_policy *sp, const double *cpu_adj,
+			       const struct interactive_tunables *t)
+{
+	unsigned int cur = cur_freq(sp);
+	int i, busiest = 0, others = 0;
+
+	for (i = 1; i < sp->p->nr_cpus; i++)
+		if (cpu_adj[i] > cpu_adj[busiest])
+			busiest = i;
+
+	/* the decision is taken for the busiest cpu, look at the rest */
+	for (i = 0; i < sp->p->nr_cpus; i++)
+		if (i != busiest &&
+		    cpu_adj[i] / cur >= t->up_threshold_any_cpu_load)
+			others = 1;
+
+	if (others && cur > t->up_threshold_any_cpu_freq)
+		return t->sync_freq;
+	return 0;
+}
+
+#define ABOVE_HISPEED_DELAY_US	20000
+#define MIN_SAMPLE_TIME_US	80000
+
+static void interactive_common(struct sim_policy *sp, double now,
+			       const struct interactive_tunables *t)
+{
+	unsigned int hispeed = max_freq(sp);
+	unsigned int cur = cur_freq(sp);
+	double cpu_adj[MAX_CPUS];
+	double loadadj, load;
+	unsigned int new_freq, floor;
+
+	if (!sample_due(sp, now, sampling_us))
+		return;
+
+	sample_load_cpus(sp, now, &loadadj, cpu_adj);
+	load = loadadj / cur;
+
+	new_freq = sp->p->freqs[freq_index_l(sp->p, loadadj / t->target_load)];
+	if (load >= t->go_hispeed_load && cur < hispeed) {
+		/* intelliactive first stops at two_phase_freq on the way up */
+		if (t->two_phase_freq && t->two_phase_freq >= cur &&
+		    t->two_phase_freq < hispeed)
+			new_freq = t->two_phase_freq;
+		else
+			new_freq = hispeed;
+	} else if (load >= t->go_hispeed_load && new_freq < hispeed) {
+		new_freq = hispeed;
+	} else if (new_freq > hispeed && cur < hispeed) {
+		new_freq = hispeed;
+	} else if (t->sync_freq && new_freq < t->sync_freq) {
+		floor = sync_floor(sp, cpu_adj, t);
+		if (floor > new_freq)
+			new_freq = floor;
+	}
+
+	if (cur >= hispeed && new_freq > cur &&
+	    now - sp->last_change < ABOVE_HISPEED_DELAY_US)
+		return;
+
+	if (new_freq < sp->floor_freq &&
+	    now - sp->floor_time < MIN_SAMPLE_TIME_US)
+		return;
+
+	sp->floor_freq = new_freq;
+	sp->floor_time = now;
+	set_freq(sp, freq_index_l(sp->p, new_freq), now);
+}
+
+static void interactive_update(struct sim_policy *sp, double now)
+{
+	interactive_common(sp, now, &interactive_def);
+}
+
+static void intelliactive_update(struct sim_policy *sp, double now)
+{
+	interactive_common(sp, now, &intelliactive_def);
+}
+
+static void barry_allen_update(struct sim_policy *sp, double now)
+{
+	interactive_common(sp, now, &barry_allen_def);
+}
+
+/*
+ * alucard: the frequency is pumped through the table so that the load
+ * tracks cur / max; larger steps up below FREQ_RESPONSIVENESS, larger
+ * steps down above it.
+ */
+
+#define ALUCARD_FREQ_RESPONSIVENESS	1113600
+
+static void alucard_update(struct sim_policy *sp, double now)
+{
+	unsigned int target_load, load;
+	int inc = 1, dec = 2;
+	int idx = sp->idx;
+
+	if (!sample_due(sp, now, sampling_us))
+		return;
+
+	load = sample_load(sp, now, NULL);
+	target_load = cur_freq(sp) * 100 / max_freq(sp);
+	if (cur_freq(sp) < ALUCARD_FREQ_RESPONSIVENESS) {
+		inc = 2;
+		dec = 1;
+	}
+
+	if (load >= target_load)
+		idx += inc;
+	else
+		idx -= dec;
+	if (idx < 0)
+		idx = 0;
+	if (idx >= sp->p->nr_freqs)
+		idx = sp->p->nr_freqs - 1;
+	set_freq(sp, idx, now);
+}
+
+/* lionfish: lf_check_cpu() with the default tunables */
+
+static void lionfish_update(struct sim_policy *sp, double now)
+{
+	unsigned int step = max_freq(sp) * 5 / 100;
+	unsigned int hispeed = max_freq(sp) * 83 / 100;
+	unsigned int cur = cur_freq(sp);
+	unsigned int load, next;
+	int voted = 0;
+
+	if (!sample_due(sp, now, sampling_us))
+		return;
+
+	load = sample_load(sp, now, NULL);
+	if (hispeed < min_freq(sp))
+		hispeed = min_freq(sp);
+
+	if (load > 95 && sp->requested < hispeed) {
+		if (cur == max_freq(sp))
+			return;
+		if (sp->requested + step < 800000)
+			sp->requested = 800000 > max_freq(sp) ?
+					max_freq(sp) : 800000;
+		else
+			sp->requested = hispeed;
+		set_freq(sp, freq_index_h(sp->p, sp->requested), now);
+		sp->up_ticks = sp->down_ticks = 0;
+		return;
+	}
+
+	if (load > 80) {
+		if (sp->requested >= max_freq(sp))
+			return;
+		sp->up_ticks++;
+		sp->down_ticks = 0;
+		voted = 1;
+	}
+	if (load < 40) {
+		if (cur <= min_freq(sp))
+			return;
+		sp->down_ticks++;
+		sp->up_ticks = 0;
+		voted = 1;
+	}
+	if (!voted) {
+		if (sp->down_ticks)
+			sp->down_ticks--;
+		if (sp->up_ticks)
+			sp->up_ticks--;
+	}
+
+	if (sp->up_ticks >= 2) {
+		next = cur * 130 / 100;
+		if (next < sp->requested + step)
+			next = sp->requested + step;
+		if (next > max_freq(sp))
+			next = max_freq(sp);
+		sp->requested = next;
+		set_freq(sp, freq_index_h(sp->p, next), now);
+		sp->up_ticks = sp->down_ticks = 0;
+	} else if (sp->down_ticks >= 3) {
+		next = cur * 65 / 100;
+		if (next > sp->requested - step)
+			next = sp->requested - step;
+		if (next < min_freq(sp) || sp->requested < step)
+			next = min_freq(sp);
+		sp->requested = next;
+		set_freq(sp, freq_index_l(sp->p, next), now);
+		sp->up_ticks = sp->down_ticks = 0;
+	}
+}
+
+/*
+ * sched: the runnable average is approximated per cpu with a 32ms half
+ * life and evaluated at every busy/idle transition and every scheduler
+ * tick, as cpufreq_sched_update() is called from enqueue, dequeue and tick.
+ */
+
+#define PELT_HALFLIFE_US	32000.0
+#define SCHED_TICK_US		10000.0
+#define SCHED_UP_RATE_US	1000.0
+#define SCHED_DOWN_RATE_US	20000.0
+
+static void sched_update(struct sim_policy *sp, double now)
+{
+	int changed = 0, i;
+	double util = 0;
+	unsigned int next;
+	int idx;
+
+	for (i = 0; i < sp->p->nr_cpus; i++) {
+		struct sim_cpu *c = &sp->cpus[i];
+		double y = pow(0.5, SIM_STEP_US / PELT_HALFLIFE_US);
+		int running = c->rem > 0;
+
+		c->util = c->util * y + (running ? 1 - y : 0);
+		if (running != c->running)
+			changed = 1;
+		c->running = running;
+		if (c->util > util)
+			util = c->util;
+	}
+	if (sample_due(sp, now, SCHED_TICK_US))
+		changed = 1;
+	if (!changed)
+		return;
+
+	next = cur_freq(sp) * 1.25 * util;
+	idx = freq_index_l(sp->p, next);
+	if (idx == sp->idx)
+		return;
+	if (idx > sp->idx && now - sp->last_change < SCHED_UP_RATE_US)
+		return;
+	if (idx < sp->idx && now - sp->last_change < SCHED_DOWN_RATE_US)
+		return;
+	set_freq(sp, idx, now);
+}
+
+static void sched_start(struct sim_policy *sp)
+{
+	sp->next_sample = trace_start + SCHED_TICK_US;
+}
+
+/*
+ * Every model is a hand-written approximation of the governor's frequency
+ * selection with its default tunables, not the kernel code itself.
+ */
+static const struct governor governors[] = {
+	{ "performance",	performance_start,	NULL },
+	{ "powersave",		powersave_start,	NULL },
+	{ "ondemand",		start_common,		ondemand_update },
+	{ "conservative",	start_common,		conservative_update },
+	{ "zzmoove",		zzmoove_start,		zzmoove_update },
+	{ "interactive",	start_common,		interactive_update },
+	{ "intelliactive",	start_common,		intelliactive_update },
+	{ "barry_allen",	start_common,		barry_allen_update },
+	{ "alucard",		start_common,		alucard_update },
+	{ "lionfish",		start_common,		lionfish_update },
+	{ "sched",		sched_start,		sched_update },
+};
+
+#define NR_GOVERNORS	(sizeof(governors) / sizeof(governors[0]))
+
+/*
+ * Relative power of a busy cpu at a frequency: f * V^2 with the voltage
+ * scaled linearly between 0.8 and 1.2 across the policy frequency range.
+ * Idle cpus are counted as free, so only differences in busy time and
+ * operating point show up.
+ */
+static double busy_power(struct policy *p, unsigned int freq)
+{
+	double fmin = p->freqs[0], fmax = p->freqs[p->nr_freqs - 1];
+	double v = 0.8;
+
+	if (fmax > fmin)
+		v += 0.4 * (freq - fmin) / (fmax - fmin);
+	return freq / fmax * v * v / 1.44;
+}
+
+/*
+ * Run one cpu for a step at the current frequency of its policy.  Bursts
+ * are served in arrival order; a burst that arrives while earlier ones are
+ * still queued waits for them, like work piling up on a slow cpu.
+ */
+static void run_cpu(struct sim_policy *sp, struct sim_cpu *c, double now,
+		    double step)
+{
+	struct cpu_trace *ct = &cpu_trace[c->cpu];
+	double freq = cur_freq(sp);
+	double t = now, end = now + step;
+	double busy = 0;
+
+	while (t < end && c->head < ct->nr_bursts) {
+		struct burst *b = &ct->bursts[c->head];
+		double run;
+
+		if (c->rem <= 0) {
+			if (b->arrival >= end)
+				break;
+			if (b->arrival > t)
+				t = b->arrival;
+			c->rem = b->work;
+		}
+
+		run = c->rem / freq;
+		if (t + run > end)
+			run = end - t;
+		c->rem -= run * freq;
+		t += run;
+		busy += run;
+
+		if (c->rem <= 1e-6) {
+			double lat = t - b->arrival;
+
+			c->rem = 0;
+			c->head++;
+			sp->bursts++;
+			sp->lat_sum += lat;
+			if (lat > deadline_us &&
+			    b->work / max_freq(sp) <= deadline_us)
+				sp->missed++;
+		}
+	}
+
+	c->win_busy += busy;
+	c->win_work += busy * freq;
+	sp->energy += busy * busy_power(sp->p, freq);
+}
+
+static int cpus_pending(struct sim_policy *sp)
+{
+	int i;
+
+	for (i = 0; i < sp->p->nr_cpus; i++) {
+		struct sim_cpu *c = &sp->cpus[i];
+
+		if (c->head < cpu_trace[c->cpu].nr_bursts)
+			return 1;
+	}
+	return 0;
+}
+
+static void simulate(const struct governor *gov, struct sim_policy *sims)
+{
+	double now;
+	int pol, i;
+
+	for (pol = 0; pol < nr_policies; pol++) {
+		struct sim_policy *sp = &sims[pol];
+		struct policy *p = &policies[pol];
+
+		memset(sp, 0, sizeof(*sp));
+		sp->p = p;
+		sp->idx = freq_index_l(p, p->init_freq);
+		sp->win_start = trace_start;
+		for (i = 0; i < p->nr_cpus; i++)
+			sp->cpus[i].cpu = p->cpus[i];
+		gov->start(sp);
+
+		for (now = trace_start; ; now += SIM_STEP_US) {
+			if (now >= trace_end &&
+			    (!cpus_pending(sp) ||
+			     now >= trace_end + DRAIN_LIMIT_US))
+				break;
+			if (gov->update)
+				gov->update(sp, now);
+			for (i = 0; i < p->nr_cpus; i++)
+				run_cpu(sp, &sp->cpus[i], now, SIM_STEP_US);
+			sp->residency[sp->idx] += SIM_STEP_US;
+		}
+	}
+}
+
+static void report(const struct governor *gov, struct sim_policy *sims,
+		   double ref_energy)
+{
+	double energy = 0;
+	unsigned long bursts = 0, missed = 0;
+	double lat = 0;
+	int pol, i;
+
+	for (pol = 0; pol < nr_policies; pol++) {
+		energy += sims[pol].energy;
+		bursts += sims[pol].bursts;
+		missed += sims[pol].missed;
+		lat += sims[pol].lat_sum;
+	}
+
+	printf("%-14s %8.1f %10lu %8lu %12.1f\n", gov->name,
+	       ref_energy > 0 ? energy * 100 / ref_energy : 0,
+	       bursts, missed, bursts ? lat / bursts : 0);
+
+	if (!verbose)
+		return;
+
+	for (pol = 0; pol < nr_policies; pol++) {
+		struct sim_policy *sp = &sims[pol];
+		double total = 0;
+
+		for (i = 0; i < sp->p->nr_freqs; i++)
+			total += sp->residency[i];
+		printf("  policy%d:", sp->p->cpus[0]);
+		for (i = 0; i < sp->p->nr_freqs; i++) {
+			if (!sp->residency[i])
+				continue;
+			printf(" %u:%.1f%%", sp->p->freqs[i],
+			       sp->residency[i] * 100 / total);
+		}
+		printf("\n");
+	}
+}
+
+/*
+ * Trace parsing
+ */
+
+static void add_freq(struct policy *p, unsigned int freq)
+{
+	int i, j;
+
+	for (i = 0; i < p->nr_freqs; i++) {
+		if (p->freqs[i] == freq)
+			return;
+		if (p->freqs[i] > freq)
+			break;
+	}
+	if (p->nr_freqs == MAX_FREQS)
+		return;
+	for (j = p->nr_freqs; j > i; j--)
+		p->freqs[j] = p->freqs[j - 1];
+	p->freqs[i] = freq;
+	p->nr_freqs++;
+}
+
+static int parse_cpu_list(char *s, struct policy *p)
+{
+	char *tok, *save;
+
+	for (tok = strtok_r(s, ",", &save); tok;
+	     tok = strtok_r(NULL, ",", &save)) {
+		int first, last;
+
+		if (sscanf(tok, "%d-%d", &first, &last) != 2)
+			last = first = atoi(tok);
+		for (; first <= last; first++) {
+			if (first < 0 || first >= MAX_CPUS ||
+			    p->nr_cpus == MAX_CPUS)
+				return -1;
+			p->cpus[p->nr_cpus++] = first;
+		}
+	}
+	return 0;
+}
+
+/*
+ * "# policy cpus=0-3 cur=800000 freqs=200000,400000,..." as written by the
+ * recorder.
+ */
+static void parse_policy_header(char *line)
+{
+	struct policy *p;
+	char *tok, *save;
+	int i;
+
+	if (nr_policies == MAX_CPUS)
+		return;
+	p = &policies[nr_policies];
+	memset(p, 0, sizeof(*p));
+
+	for (tok = strtok_r(line, " \t\n", &save); tok;
+	     tok = strtok_r(NULL, " \t\n", &save)) {
+		if (!strncmp(tok, "cpus=", 5)) {
+			if (parse_cpu_list(tok + 5, p))
+				return;
+		} else if (!strncmp(tok, "cur=", 4)) {
+			p->init_freq = strtoul(tok + 4, NULL, 10);
+		} else if (!strncmp(tok, "freqs=", 6)) {
+			char *f, *fsave;
+
+			for (f = strtok_r(tok + 6, ",", &fsave); f;
+			     f = strtok_r(NULL, ",", &fsave))
+				add_freq(p, strtoul(f, NULL, 10));
+		}
+	}
+	if (!p->nr_cpus || !p->nr_freqs)
+		return;
+	for (i = 0; i < p->nr_cpus; i++)
+		cpu_policy[p->cpus[i]] = nr_policies;
+	nr_policies++;
+}
+
+/*
+ * Returns 0 for cpu_idle, 1 for cpu_frequency, -1 for anything else.  The
+ * timestamp is the "1234.567890:" field in front of the event name.
+ */
+static int parse_event(char *line, double *ts, unsigned long *state,
+		       unsigned long *cpu)
+{
+	char *ev, *p;
+	int type;
+
+	if ((ev = strstr(line, " cpu_idle: ")))
+		type = 0;
+	else if ((ev = strstr(line, " cpu_frequency: ")))
+		type = 1;
+	else
+		return -1;
+
+	p = ev;
+	while (p > line && p[-1] != ' ')
+		p--;
+	if (p == ev)
+		return -1;
+	*ts = strtod(p, NULL) * 1000000.0;
+
+	p = strchr(ev + 1, ' ');
+	if (sscanf(p, " state=%lu cpu_id=%lu", state, cpu) != 2)
+		return -1;
+	if (*cpu >= MAX_CPUS)
+		return -1;
+
+	return type;
+}
+
+static void account(struct cpu_trace *ct, double ts)
+{
+	if (ct->busy && ts > ct->last)
+		ct->work += (ts - ct->last) * ct->freq;
+	ct->last = ts;
+}
+
+static void close_burst(struct cpu_trace *ct)
+{
+	if (ct->work <= 0)
+		return;
+	if (ct->nr_bursts == ct->alloc) {
+		ct->alloc = ct->alloc ? ct->alloc * 2 : 1024;
+		ct->bursts = xrealloc(ct->bursts,
+				      ct->alloc * sizeof(*ct->bursts));
+	}
+	ct->bursts[ct->nr_bursts].arrival = ct->busy_start;
+	ct->bursts[ct->nr_bursts].work = ct->work;
+	ct->nr_bursts++;
+}
+
+static int load_trace(FILE *f)
+{
+	unsigned int first_freq[MAX_CPUS] = { 0 };
+	char line[1024];
+	unsigned long state, cpu;
+	double ts;
+	int type, i, first = 1;
+
+	/* pass 1: topology, frequencies, online cpus and trace bounds */
+	while (fgets(line, sizeof(line), f)) {
+		if (!strncmp(line, "# policy ", 9)) {
+			parse_policy_header(line + 9);
+			continue;
+		}
+		type = parse_event(line, &ts, &state, &cpu);
+		if (type < 0)
+			continue;
+		if (first || ts < trace_start)
+			trace_start = ts;
+		if (first || ts > trace_end)
+			trace_end = ts;
+		first = 0;
+		if ((int)cpu >= nr_cpus)
+			nr_cpus = cpu + 1;
+		if (type == 0)
+			cpu_trace[cpu].online = 1;
+		else if (!first_freq[cpu])
+			first_freq[cpu] = state;
+	}
+	if (first) {
+		fprintf(stderr, "no cpu_idle or cpu_frequency events found\n");
+		return -1;
+	}
+
+	/* without a recorder header every cpu is its own policy */
+	if (!nr_policies) {
+		rewind(f);
+		for (i = 0; i < nr_cpus; i++) {
+			policies[i].cpus[0] = i;
+			policies[i].nr_cpus = 1;
+			policies[i].init_freq = first_freq[i];
+			cpu_policy[i] = i;
+		}
+		nr_policies = nr_cpus;
+		while (fgets(line, sizeof(line), f))
+			if (parse_event(line, &ts, &state, &cpu) == 1)
+				add_freq(&policies[cpu], state);
+		for (i = 0; i < nr_policies; i++) {
+			if (!policies[i].nr_freqs) {
+				fprintf(stderr, "no frequencies seen for cpu%d, "
+					"record with -r to get the tables\n", i);
+				return -1;
+			}
+		}
+	}
+
+	for (i = 0; i < MAX_CPUS; i++) {
+		struct policy *p = &policies[cpu_policy[i]];
+
+		cpu_trace[i].busy = 1;
+		cpu_trace[i].busy_start = trace_start;
+		cpu_trace[i].last = trace_start;
+		cpu_trace[i].freq = first_freq[i] ? first_freq[i] :
+				    p->init_freq;
+		if (!cpu_trace[i].freq)
+			cpu_trace[i].freq = p->freqs[p->nr_freqs - 1];
+	}
+
+	/*
+	 * pass 2: busy bursts.  Every cpu is taken to be busy from the start
+	 * of the trace until its first idle entry; a first event that is an
+	 * idle exit means it was idle instead and the guess is thrown away.
+	 */
+	rewind(f);
+	while (fgets(line, sizeof(line), f)) {
+		struct cpu_trace *ct;
+
+		type = parse_event(line, &ts, &state, &cpu);
+		if (type < 0)
+			continue;
+		ct = &cpu_trace[cpu];
+		account(ct, ts);
+
+		if (type == 1) {
+			ct->freq = state;
+			continue;
+		}
+		if (state == IDLE_EXIT) {
+			ct->busy = 1;
+			ct->busy_start = ts;
+			ct->work = 0;
+		} else if (ct->busy) {
+			close_burst(ct);
+			ct->busy = 0;
+			ct->work = 0;
+		}
+	}
+	for (i = 0; i < nr_cpus; i++) {
+		account(&cpu_trace[i], trace_end);
+		if (cpu_trace[i].busy && cpu_trace[i].online)
+			close_burst(&cpu_trace[i]);
+	}
+
+	return 0;
+}
+
+/*
+ * Recording
+ */
+
+static int write_file(const char *name, const char *val)
+{
+	char path[512];
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s/%s", tracing_dir, name);
+	f = fopen(path, "w");
+	if (!f) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	fputs(val, f);
+	if (fclose(f)) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+static int read_sysfs(const char *path, char *buf, int len)
+{
+	FILE *f = fopen(path, "r");
+
+	if (!f)
+		return -1;
+	if (!fgets(buf, len, f)) {
+		fclose(f);
+		return -1;
+	}
+	fclose(f);
+	buf[strcspn(buf, "\n")] = 0;
+	return 0;
+}
+
+static void record_header(FILE *out)
+{
+	char path[256], cpus[256], freqs[1024], cur[32];
+	int done[MAX_CPUS] = { 0 };
+	int cpu;
+
+	for (cpu = 0; cpu < MAX_CPUS; cpu++) {
+		char *s;
+
+		if (done[cpu])
+			continue;
+		snprintf(path, sizeof(path),
+			 "/sys/devices/system/cpu/cpu%d/cpufreq/related_cpus",
+			 cpu);
+		if (read_sysfs(path, cpus, sizeof(cpus)))
+			continue;
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/"
+			 "cpufreq/scaling_available_frequencies", cpu);
+		if (read_sysfs(path, freqs, sizeof(freqs)))
+			continue;
+		snprintf(path, sizeof(path),
+			 "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_cur_freq",
+			 cpu);
+		if (read_sysfs(path, cur, sizeof(cur)))
+			strcpy(cur, "0");
+
+		for (s = strtok(cpus, " "); s; s = strtok(NULL, " ")) {
+			if (atoi(s) < MAX_CPUS)
+				done[atoi(s)] = 1;
+			fprintf(out, "%s%s", s == cpus ? "# policy cpus=" : ",",
+				s);
+		}
+		fprintf(out, " cur=%s freqs=", cur);
+		for (s = strtok(freqs, " "); s; s = strtok(NULL, " "))
+			fprintf(out, "%s%s", s == freqs ? "" : ",", s);
+		fprintf(out, "\n");
+	}
+}
+
+static int record(const char *out_name, unsigned int secs)
+{
+	char path[512], buf[4096], val[32];
+	FILE *out, *trace;
+	size_t n;
+	int ret = -1;
+
+	out = fopen(out_name, "w");
+	if (!out) {
+		perror(out_name);
+		return -1;
+	}
+	record_header(out);
+
+	snprintf(val, sizeof(val), "%d", DEF_RECORD_BUF_KB);
+	if (write_file("tracing_on", "0") ||
+	    write_file("buffer_size_kb", val) ||
+	    write_file("trace", "") ||
+	    write_file("events/power/cpu_idle/enable", "1") ||
+	    write_file("events/power/cpu_frequency/enable", "1"))
+		goto out;
+
+	fprintf(stderr, "recording for %u seconds...\n", secs);
+	if (write_file("tracing_on", "1"))
+		goto disable;
+	sleep(secs);
+	write_file("tracing_on", "0");
+
+	snprintf(path, sizeof(path), "%s/trace", tracing_dir);
+	trace = fopen(path, "r");
+	if (!trace) {
+		perror(path);
+		goto disable;
+	}
+	while ((n = fread(buf, 1, sizeof(buf), trace)) > 0)
+		fwrite(buf, 1, n, out);
+	fclose(trace);
+	ret = 0;
+
+disable:
+	write_file("events/power/cpu_idle/enable", "0");
+	write_file("events/power/cpu_frequency/enable", "0");
+out:
+	if (fclose(out))
+		ret = -1;
+	return ret;
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: cpufreq-replay [-r secs] [-T tracing_dir] [-g governor]\n"
+		"                      [-d deadline_us] [-s sampling_us] [-v] "
+		"trace\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	const char *only = NULL;
+	unsigned int record_secs = 0;
+	struct sim_policy *sims;
+	double ref_energy = 0;
+	unsigned int g;
+	FILE *f;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "r:T:g:d:s:v")) != -1) {
+		switch (opt) {
+		case 'r':
+			record_secs = atoi(optarg);
+			break;
+		case 'T':
+			tracing_dir = optarg;
+			break;
+		case 'g':
+			only = optarg;
+			break;
+		case 'd':
+			deadline_us = atoi(optarg);
+			break;
+		case 's':
+			sampling_us = atoi(optarg);
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc - 1 || !sampling_us)
+		usage();
+
+	if (record_secs && record(argv[optind], record_secs))
+		return 1;
+
+	f = fopen(argv[optind], "r");
+	if (!f) {
+		perror(argv[optind]);
+		return 1;
+	}
+	if (load_trace(f))
+		return 1;
+	fclose(f);
+
+	sims = calloc(nr_policies, sizeof(*sims));
+	if (!sims) {
+		perror("calloc");
+		return 1;
+	}
+
+	printf("trace: %.3f s, %d cpus, %d policies, deadline %u us\n\n",
+	       (trace_end - trace_start) / 1000000, nr_cpus, nr_policies,
+	       deadline_us);
+	printf("%-14s %8s %10s %8s %12s\n", "governor", "energy", "bursts",
+	       "missed", "latency(us)");
+
+	/* energy is reported relative to the performance governor */
+	simulate(&governors[0], sims);
+	for (g = 0; g < (unsigned int)nr_policies; g++)
+		ref_energy += sims[g].energy;
+
+	for (g = 0; g < NR_GOVERNORS; g++) {
+		if (only && strcmp(only, governors[g].name))
+			continue;
+		simulate(&governors[g], sims);
+		report(&governors[g], sims, ref_energy);
+	}
+
+	free(sims);
+	return 0;
+}
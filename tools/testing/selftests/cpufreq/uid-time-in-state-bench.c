@@ -0,0 +1,226 @@
+/*
+ * uid-time-in-state-bench -- time full reads of /proc/uid_time_in_state
+ *
+ * With -u NR_UIDS, NR_UIDS children first switch to UIDs BASE, BASE + 1
+ * ... and burn a few ticks of cpu each, so that the kernel has that many
+ * UIDs to report (this needs root).  The file is then read REPS times,
+ * start to finish, and the read time is reported.  The layout is checked
+ * on every read: a header with the frequency list, then fixed size
+ * per-UID records.
+ *
+ * Fails if the median read takes longer than LIMIT milliseconds.
+ *
+ * usage: uid-time-in-state-bench [-u nr_uids] [-b base] [-r reps]
+ *				  [-l limit_ms] [file]
+ *
+ * Licensed under the terms of the GNU GPL License version 2.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+static const char *path = "/proc/uid_time_in_state";
+static char *buf;
+static size_t buf_size = 1 << 20;
+
+static double now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/* Burn at least 30ms of cpu, a few ticks even at HZ=100 */
+static void burn(void)
+{
+	struct timespec ts;
+	double start;
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	start = ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+	do {
+		clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	} while (ts.tv_sec * 1e3 + ts.tv_nsec / 1e6 - start < 30);
+}
+
+static int spawn_uids(int nr_uids, uid_t base)
+{
+	long batch = sysconf(_SC_NPROCESSORS_ONLN);
+	int i, running = 0, status, err = 0;
+
+	if (batch < 1)
+		batch = 1;
+	for (i = 0; i < nr_uids; i++) {
+		pid_t pid;
+
+		if (running == batch) {
+			wait(&status);
+			running--;
+			if (!WIFEXITED(status) || WEXITSTATUS(status))
+				err = 1;
+		}
+		pid = fork();
+		if (pid < 0) {
+			perror("fork");
+			return 1;
+		}
+		if (!pid) {
+			if (setresuid(base + i, base + i, base + i))
+				_exit(1);
+			burn();
+			_exit(0);
+		}
+		running++;
+	}
+	while (running--) {
+		wait(&status);
+		if (!WIFEXITED(status) || WEXITSTATUS(status))
+			err = 1;
+	}
+	if (err)
+		fprintf(stderr, "could not run as every UID, not root?\n");
+	return err;
+}
+
+/* Read the whole file, returns its length or -1 */
+static ssize_t read_all(void)
+{
+	ssize_t len = 0, n;
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0) {
+		perror(path);
+		return -1;
+	}
+	for (;;) {
+		if (len == buf_size) {
+			buf_size *= 2;
+			buf = realloc(buf, buf_size);
+			if (!buf) {
+				close(fd);
+				return -1;
+			}
+		}
+		n = read(fd, buf + len, buf_size - len);
+		if (n < 0) {
+			perror(path);
+			close(fd);
+			return -1;
+		}
+		if (!n)
+			break;
+		len += n;
+	}
+	close(fd);
+	return len;
+}
+
+/* Check the layout, returns the number of UIDs or -1 */
+static long parse(size_t len, uint32_t *nr_freqs)
+{
+	size_t hdr_len, rec_len;
+
+	if (len < 8) {
+		fprintf(stderr, "short header\n");
+		return -1;
+	}
+	memcpy(nr_freqs, buf, sizeof(*nr_freqs));
+	hdr_len = 8 + ((*nr_freqs * 4 + 7) & ~(size_t)7);
+	rec_len = 8 + *nr_freqs * 8;
+	if (!*nr_freqs || len < hdr_len || (len - hdr_len) % rec_len) {
+		fprintf(stderr, "bad length %zu for %u freqs\n", len,
+			*nr_freqs);
+		return -1;
+	}
+	return (len - hdr_len) / rec_len;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-u nr_uids] [-b base] [-r reps] [-l limit_ms] [file]\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	int nr_uids = 0, reps = 100, opt, i;
+	uid_t base = 100000;
+	double limit = 10, *ms, t0;
+	uint32_t nr_freqs = 0;
+	long uids = 0;
+	ssize_t len = 0;
+
+	while ((opt = getopt(argc, argv, "u:b:r:l:")) != -1) {
+		switch (opt) {
+		case 'u':
+			nr_uids = atoi(optarg);
+			break;
+		case 'b':
+			base = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			reps = atoi(optarg);
+			break;
+		case 'l':
+			limit = atof(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind < argc - 1 || nr_uids < 0 || reps < 1)
+		usage(argv[0]);
+	if (optind == argc - 1)
+		path = argv[optind];
+
+	if (nr_uids && spawn_uids(nr_uids, base))
+		return 1;
+
+	buf = malloc(buf_size);
+	ms = calloc(reps, sizeof(*ms));
+	if (!buf || !ms)
+		return 1;
+
+	for (i = 0; i < reps; i++) {
+		t0 = now_ms();
+		len = read_all();
+		ms[i] = now_ms() - t0;
+		if (len < 0)
+			return 1;
+		uids = parse(len, &nr_freqs);
+		if (uids < 0)
+			return 1;
+	}
+	qsort(ms, reps, sizeof(*ms), cmp_double);
+
+	printf("%ld UIDs, %u freqs, %zd bytes\n", uids, nr_freqs, len);
+	printf("read ms: min %.3f median %.3f max %.3f\n",
+	       ms[0], ms[reps / 2], ms[reps - 1]);
+	if (uids < nr_uids)
+		fprintf(stderr, "only %ld of %d UIDs were reported\n", uids,
+			nr_uids);
+	if (ms[reps / 2] > limit) {
+		fprintf(stderr, "median read over %.1f ms\n", limit);
+		return 1;
+	}
+	return uids < nr_uids;
+}
@@ -0,0 +1,215 @@
+/*
+ * map-cluster-bench -- random reads of fragmented files on exfat
+ *
+ * NR_FILES files are grown side by side, one cluster at a time, so that
+ * their FAT chains interleave and every file offset has to be mapped by
+ * walking the FAT.  After dropping caches, READS random 4 KB preads are
+ * spread over the files and timed.  The EXFAT_IOC_GET_MAP_STAT counters
+ * taken around the reads show how often the per-file cluster run cache
+ * answered a lookup, how many FAT entries the walks read and how the FAT
+ * cache sized for this volume did; run it on cards of different sizes to
+ * check that sizing.  With -s SIZE_MB per file, the FAT chains touch
+ * NR_FILES * SIZE_MB / cluster size entries.
+ *
+ * Dropping caches needs root.
+ *
+ * usage: map-cluster-bench [-n nr_files] [-s size_mb] [-r reads] mnt
+ *
+ * Licensed under the terms of the GNU GPL License version 2.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/types.h>
+
+/* from fs/exfat/exfat_api.h and exfat.h */
+struct map_stat {
+	uint64_t map_calls;
+	uint64_t run_hits;
+	uint64_t fat_reads;
+	uint64_t fat_cache_hits;
+	uint64_t fat_cache_misses;
+};
+#define EXFAT_IOC_GET_MAP_STAT	_IOR('f', 103, struct map_stat)
+
+static int nr_files = 8;
+static int size_mb = 64;
+static long reads = 20000;
+
+static double now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static int drop_caches(void)
+{
+	int fd;
+
+	sync();
+	fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+	if (fd < 0 || write(fd, "3", 1) != 1) {
+		perror("/proc/sys/vm/drop_caches");
+		if (fd >= 0)
+			close(fd);
+		return -1;
+	}
+	close(fd);
+	return 0;
+}
+
+static int get_stat(int fd, struct map_stat *st)
+{
+	if (ioctl(fd, EXFAT_IOC_GET_MAP_STAT, st)) {
+		perror("EXFAT_IOC_GET_MAP_STAT");
+		return -1;
+	}
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-n nr_files] [-s size_mb] [-r reads] mnt\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	struct map_stat st0, st1;
+	struct statvfs sv;
+	char path[4096], *buf;
+	size_t clu, nr_clu, off;
+	double t0, ms;
+	int *fds, opt, i, ret = 0;
+	long n;
+
+	while ((opt = getopt(argc, argv, "n:s:r:")) != -1) {
+		switch (opt) {
+		case 'n':
+			nr_files = atoi(optarg);
+			break;
+		case 's':
+			size_mb = atoi(optarg);
+			break;
+		case 'r':
+			reads = atol(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || nr_files < 2 || size_mb < 1 || reads < 1)
+		usage(argv[0]);
+
+	if (statvfs(argv[optind], &sv)) {
+		perror(argv[optind]);
+		return 1;
+	}
+	clu = sv.f_bsize;
+	nr_clu = ((size_t)size_mb << 20) / clu;
+	buf = malloc(clu);
+	fds = calloc(nr_files, sizeof(*fds));
+	if (!buf || !fds || !nr_clu)
+		return 1;
+	memset(buf, 0x5a, clu);
+
+	for (i = 0; i < nr_files; i++) {
+		snprintf(path, sizeof(path), "%s/map-bench.%d", argv[optind], i);
+		fds[i] = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (fds[i] < 0) {
+			perror(path);
+			return 1;
+		}
+	}
+
+	/* interleave the chains */
+	for (off = 0; off < nr_clu; off++) {
+		for (i = 0; i < nr_files; i++) {
+			if (write(fds[i], buf, clu) != (ssize_t)clu) {
+				perror("write");
+				ret = 1;
+				goto out;
+			}
+		}
+	}
+	for (i = 0; i < nr_files; i++)
+		close(fds[i]);
+
+	if (drop_caches()) {
+		ret = 1;
+		goto out_unlink;
+	}
+	for (i = 0; i < nr_files; i++) {
+		snprintf(path, sizeof(path), "%s/map-bench.%d", argv[optind], i);
+		fds[i] = open(path, O_RDONLY);
+		if (fds[i] < 0) {
+			perror(path);
+			ret = 1;
+			goto out_unlink;
+		}
+	}
+
+	if (get_stat(fds[0], &st0)) {
+		ret = 1;
+		goto out;
+	}
+	srand(1);
+	t0 = now_ms();
+	for (n = 0; n < reads; n++) {
+		i = rand() % nr_files;
+		off = ((size_t)rand() * 4096) % ((size_t)size_mb << 20);
+		if (pread(fds[i], buf, 4096, off) != 4096) {
+			perror("pread");
+			ret = 1;
+			goto out;
+		}
+	}
+	ms = now_ms() - t0;
+	if (get_stat(fds[0], &st1)) {
+		ret = 1;
+		goto out;
+	}
+
+	st1.map_calls -= st0.map_calls;
+	st1.run_hits -= st0.run_hits;
+	st1.fat_reads -= st0.fat_reads;
+	st1.fat_cache_hits -= st0.fat_cache_hits;
+	st1.fat_cache_misses -= st0.fat_cache_misses;
+
+	printf("%d files of %d MB, %zu byte clusters, %ld reads\n",
+	       nr_files, size_mb, clu, reads);
+	printf("reads/s %.0f\n", reads / (ms / 1e3));
+	printf("chain lookups %llu, run cache hits %.1f%%, FAT reads per lookup %.1f\n",
+	       (unsigned long long)st1.map_calls,
+	       st1.map_calls ? 100.0 * st1.run_hits / st1.map_calls : 0,
+	       st1.map_calls ? (double)st1.fat_reads / st1.map_calls : 0);
+	printf("FAT cache hits %.1f%% of %llu\n",
+	       st1.fat_cache_hits + st1.fat_cache_misses ?
+	       100.0 * st1.fat_cache_hits /
+	       (st1.fat_cache_hits + st1.fat_cache_misses) : 0,
+	       (unsigned long long)(st1.fat_cache_hits + st1.fat_cache_misses));
+
+out:
+	for (i = 0; i < nr_files; i++)
+		if (fds[i] > 0)
+			close(fds[i]);
+out_unlink:
+	for (i = 0; i < nr_files; i++) {
+		snprintf(path, sizeof(path), "%s/map-bench.%d", argv[optind], i);
+		unlink(path);
+	}
+	return ret;
+}
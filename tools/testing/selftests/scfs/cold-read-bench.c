@@ -0,0 +1,200 @@
+/*
+ * cold-read-bench -- read a large compressed file through scfs from cold
+ *
+ * A SIZE_MB file of compressible data is written below the mount and
+ * flushed, then for REPS rounds the caches are dropped and the file is
+ * read start to finish with a single reader.  Reported are the time to
+ * the first 4 KB, which covers the first cluster lookup, lower read and
+ * decompression, and the throughput of the whole read.  With -f the file
+ * is not written; an existing one is read instead, e.g. one written on a
+ * mount with another comp_type, to time the first use of that
+ * decompressor.
+ *
+ * Dropping caches needs root.
+ *
+ * usage: cold-read-bench [-s size_mb] [-r reps] [-f file] mnt
+ *
+ * Licensed under the terms of the GNU GPL License version 2.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#define CHUNK	(1 << 20)
+
+static char path[4096];
+static char *buf;
+
+static double now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static int drop_caches(void)
+{
+	int fd;
+
+	sync();
+	fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+	if (fd < 0 || write(fd, "3", 1) != 1) {
+		perror("/proc/sys/vm/drop_caches");
+		if (fd >= 0)
+			close(fd);
+		return -1;
+	}
+	close(fd);
+	return 0;
+}
+
+/* Text-like data, compresses to about a third with lzo */
+static void fill(char *p, size_t len, unsigned int seed)
+{
+	static const char *words[] = {
+		"cluster ", "footer ", "lower ", "page ", "inode ",
+		"compress ", "buffer ", "read ", "write ", "meta ",
+	};
+	size_t off = 0, n;
+
+	while (off < len) {
+		seed = seed * 1103515245 + 12345;
+		n = strlen(words[(seed >> 16) % 10]);
+		if (n > len - off)
+			n = len - off;
+		memcpy(p + off, words[(seed >> 16) % 10], n);
+		off += n;
+	}
+}
+
+static int create_file(int size_mb)
+{
+	int fd, i;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0660);
+	if (fd < 0) {
+		perror(path);
+		return -1;
+	}
+	for (i = 0; i < size_mb; i++) {
+		fill(buf, CHUNK, i);
+		if (write(fd, buf, CHUNK) != CHUNK) {
+			perror(path);
+			close(fd);
+			return -1;
+		}
+	}
+	/* scfs writes the cluster metadata on the last close */
+	if (fsync(fd) || close(fd)) {
+		perror(path);
+		return -1;
+	}
+	return 0;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-s size_mb] [-r reps] [-f file] mnt\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	int size_mb = 64, reps = 5, opt, fd, i, ret = 0;
+	double *first, *mbps, t0, t1;
+	const char *file = NULL;
+	long long total;
+	ssize_t n;
+
+	while ((opt = getopt(argc, argv, "s:r:f:")) != -1) {
+		switch (opt) {
+		case 's':
+			size_mb = atoi(optarg);
+			break;
+		case 'r':
+			reps = atoi(optarg);
+			break;
+		case 'f':
+			file = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || size_mb < 1 || reps < 1)
+		usage(argv[0]);
+
+	if (file)
+		snprintf(path, sizeof(path), "%s/%s", argv[optind], file);
+	else
+		snprintf(path, sizeof(path), "%s/.cold-read-bench",
+			 argv[optind]);
+
+	buf = malloc(CHUNK);
+	first = calloc(reps, sizeof(*first));
+	mbps = calloc(reps, sizeof(*mbps));
+	if (!buf || !first || !mbps)
+		return 1;
+	if (!file && create_file(size_mb))
+		return 1;
+
+	for (i = 0; i < reps; i++) {
+		if (drop_caches()) {
+			ret = 1;
+			break;
+		}
+		t0 = now_ms();
+		fd = open(path, O_RDONLY);
+		if (fd < 0) {
+			perror(path);
+			ret = 1;
+			break;
+		}
+		n = read(fd, buf, 4096);
+		first[i] = now_ms() - t0;
+		total = 0;
+		while (n > 0) {
+			total += n;
+			n = read(fd, buf, CHUNK);
+		}
+		t1 = now_ms();
+		close(fd);
+		if (n < 0) {
+			perror(path);
+			ret = 1;
+			break;
+		}
+		mbps[i] = total / 1048576.0 / ((t1 - t0) / 1e3);
+	}
+
+	if (!ret) {
+		qsort(first, reps, sizeof(*first), cmp_double);
+		qsort(mbps, reps, sizeof(*mbps), cmp_double);
+		printf("%s, %d cold reads\n", path, reps);
+		printf("first 4K ms: min %.3f median %.3f max %.3f\n",
+		       first[0], first[reps / 2], first[reps - 1]);
+		printf("MB/s:        min %.1f median %.1f max %.1f\n",
+		       mbps[0], mbps[reps / 2], mbps[reps - 1]);
+	}
+
+	if (!file)
+		unlink(path);
+	return ret;
+}
@@ -0,0 +1,202 @@
+/*
+ * ctxsw-lat-bench -- context switch cost with and without the runnable
+ * delay histograms
+ *
+ * Two processes pinned to one cpu bounce a byte through a pair of pipes
+ * LOOPS times, so that every round trip is two wakeups and two context
+ * switches.  This is timed REPS times with the per-cpu histograms of
+ * /proc/sched_latency off and REPS times with them on, alternating, and
+ * the medians are compared.  With -t both processes also keep their own
+ * histogram (/proc/<pid>/task/<pid>/sched_latency) in the "on" runs.  The
+ * histograms are switched off again at the end.
+ *
+ * Needs CONFIG_SCHEDSTATS and root.
+ *
+ * usage: ctxsw-lat-bench [-l loops] [-r reps] [-c cpu] [-t]
+ *
+ * Licensed under the terms of the GNU GPL License version 2.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+static long loops = 100000;
+static int reps = 5;
+static int per_task;
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int write_str(const char *path, const char *val)
+{
+	int fd = open(path, O_WRONLY);
+	ssize_t len = strlen(val);
+
+	if (fd < 0 || write(fd, val, len) != len) {
+		perror(path);
+		if (fd >= 0)
+			close(fd);
+		return -1;
+	}
+	close(fd);
+	return 0;
+}
+
+static int task_hist(pid_t pid, int on)
+{
+	char path[64];
+
+	snprintf(path, sizeof(path), "/proc/%d/task/%d/sched_latency",
+		 (int)pid, (int)pid);
+	return write_str(path, on ? "1" : "0");
+}
+
+/* ns per context switch for one run */
+static double run(int on)
+{
+	int ping[2], pong[2];
+	double t0, t1;
+	pid_t child;
+	char c = 0;
+	long i;
+
+	if (write_str("/proc/sched_latency", on ? "1" : "0"))
+		return -1;
+	if (pipe(ping) || pipe(pong)) {
+		perror("pipe");
+		return -1;
+	}
+
+	child = fork();
+	if (child < 0) {
+		perror("fork");
+		return -1;
+	}
+	if (!child) {
+		for (i = 0; i < loops; i++) {
+			if (read(ping[0], &c, 1) != 1 ||
+			    write(pong[1], &c, 1) != 1)
+				_exit(1);
+		}
+		_exit(0);
+	}
+
+	if (per_task && on &&
+	    (task_hist(getpid(), 1) || task_hist(child, 1))) {
+		kill(child, SIGKILL);
+		waitpid(child, NULL, 0);
+		return -1;
+	}
+
+	t0 = now_ns();
+	for (i = 0; i < loops; i++) {
+		if (write(ping[1], &c, 1) != 1 || read(pong[0], &c, 1) != 1) {
+			perror("pipe");
+			break;
+		}
+	}
+	t1 = now_ns();
+
+	if (per_task && on)
+		task_hist(getpid(), 0);
+	waitpid(child, NULL, 0);
+	close(ping[0]);
+	close(ping[1]);
+	close(pong[0]);
+	close(pong[1]);
+
+	return i == loops ? (t1 - t0) / (loops * 2) : -1;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-l loops] [-r reps] [-c cpu] [-t]\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	double *off, *on, m_off, m_on;
+	cpu_set_t set;
+	int cpu = 0, opt, i, ret = 0;
+
+	while ((opt = getopt(argc, argv, "l:r:c:t")) != -1) {
+		switch (opt) {
+		case 'l':
+			loops = atol(optarg);
+			break;
+		case 'r':
+			reps = atoi(optarg);
+			break;
+		case 'c':
+			cpu = atoi(optarg);
+			break;
+		case 't':
+			per_task = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc || loops < 1 || reps < 1)
+		usage(argv[0]);
+
+	/* the child inherits the affinity */
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (sched_setaffinity(0, sizeof(set), &set)) {
+		perror("sched_setaffinity");
+		return 1;
+	}
+
+	off = calloc(reps, sizeof(*off));
+	on = calloc(reps, sizeof(*on));
+	if (!off || !on)
+		return 1;
+
+	for (i = 0; i < reps; i++) {
+		off[i] = run(0);
+		on[i] = run(1);
+		if (off[i] < 0 || on[i] < 0) {
+			ret = 1;
+			break;
+		}
+	}
+	write_str("/proc/sched_latency", "0");
+	if (ret)
+		return ret;
+
+	qsort(off, reps, sizeof(*off), cmp_double);
+	qsort(on, reps, sizeof(*on), cmp_double);
+	m_off = off[reps / 2];
+	m_on = on[reps / 2];
+
+	printf("cpu%d, %ld round trips x %d\n", cpu, loops, reps);
+	printf("ns per switch: histograms off %.1f, on%s %.1f (%+.1f%%)\n",
+	       m_off, per_task ? " with per-task" : "", m_on,
+	       (m_on - m_off) * 100 / m_off);
+	return 0;
+}
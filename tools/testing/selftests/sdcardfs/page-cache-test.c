@@ -0,0 +1,232 @@
+/*
+ * page-cache-test -- page cache used to read a file through sdcardfs
+ *
+ * read, readv, mmap and sendfile on sdcardfs all work on the page cache of
+ * the lower file, so reading a file once should grow the page cache by
+ * about the file size, not twice that.  A SIZE_MB file is written below
+ * the mount, then for every access method the caches are dropped, the
+ * whole file is read and the growth of Cached in /proc/meminfo is
+ * compared with the file size.
+ *
+ * Fails if any method grows the page cache by more than LIMIT percent of
+ * the file size.  Dropping caches needs root, and a quiet system gives
+ * the most stable numbers.
+ *
+ * usage: page-cache-test [-s size_mb] [-l limit_pct] mnt
+ *
+ * Licensed under the terms of the GNU GPL License version 2.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#define CHUNK	(1 << 20)
+
+static char path[4096];
+static size_t size;
+static char *buf;
+
+static long cached_kb(void)
+{
+	FILE *f = fopen("/proc/meminfo", "r");
+	char line[256];
+	long kb = -1;
+
+	if (!f) {
+		perror("/proc/meminfo");
+		return -1;
+	}
+	while (fgets(line, sizeof(line), f))
+		if (sscanf(line, "Cached: %ld kB", &kb) == 1)
+			break;
+	fclose(f);
+	return kb;
+}
+
+static int drop_caches(void)
+{
+	int fd;
+
+	sync();
+	fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+	if (fd < 0 || write(fd, "3", 1) != 1) {
+		perror("/proc/sys/vm/drop_caches");
+		if (fd >= 0)
+			close(fd);
+		return -1;
+	}
+	close(fd);
+	return 0;
+}
+
+static int create_file(void)
+{
+	size_t done;
+	int fd;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0660);
+	if (fd < 0) {
+		perror(path);
+		return -1;
+	}
+	for (done = 0; done < size; done += CHUNK) {
+		memset(buf, done / CHUNK + 1, CHUNK);
+		if (write(fd, buf, CHUNK) != CHUNK) {
+			perror(path);
+			close(fd);
+			return -1;
+		}
+	}
+	if (fsync(fd)) {
+		perror(path);
+		close(fd);
+		return -1;
+	}
+	close(fd);
+	return 0;
+}
+
+static int do_read(int fd)
+{
+	ssize_t n;
+
+	while ((n = read(fd, buf, CHUNK)) > 0)
+		;
+	return n;
+}
+
+static int do_readv(int fd)
+{
+	struct iovec iov[2] = {
+		{ buf, CHUNK / 2 },
+		{ buf + CHUNK / 2, CHUNK / 2 },
+	};
+	ssize_t n;
+
+	while ((n = readv(fd, iov, 2)) > 0)
+		;
+	return n;
+}
+
+static int do_mmap(int fd)
+{
+	volatile char *p;
+	unsigned long sum = 0;
+	size_t off;
+
+	p = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED)
+		return -1;
+	for (off = 0; off < size; off += 4096)
+		sum += p[off];
+	munmap((void *)p, size);
+	return sum ? 0 : -1;
+}
+
+static int do_sendfile(int fd)
+{
+	int null = open("/dev/null", O_WRONLY);
+	ssize_t n;
+
+	if (null < 0)
+		return -1;
+	while ((n = sendfile(null, fd, NULL, CHUNK)) > 0)
+		;
+	close(null);
+	return n;
+}
+
+static const struct method {
+	const char *name;
+	int (*fn)(int fd);
+} methods[] = {
+	{ "read", do_read },
+	{ "readv", do_readv },
+	{ "mmap", do_mmap },
+	{ "sendfile", do_sendfile },
+};
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-s size_mb] [-l limit_pct] mnt\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	int size_mb = 64, limit = 150, opt, fd, ret = 0;
+	long before, after, pct;
+	unsigned int i;
+
+	while ((opt = getopt(argc, argv, "s:l:")) != -1) {
+		switch (opt) {
+		case 's':
+			size_mb = atoi(optarg);
+			break;
+		case 'l':
+			limit = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || size_mb < 1 || limit < 100)
+		usage(argv[0]);
+
+	snprintf(path, sizeof(path), "%s/.page-cache-test", argv[optind]);
+	size = (size_t)size_mb << 20;
+	buf = malloc(CHUNK);
+	if (!buf || create_file())
+		return 1;
+
+	printf("%d MB file, limit %d%%\n", size_mb, limit);
+	printf("method      cached kB    %% of file\n");
+	for (i = 0; i < sizeof(methods) / sizeof(methods[0]); i++) {
+		if (drop_caches()) {
+			ret = 1;
+			break;
+		}
+		fd = open(path, O_RDONLY);
+		if (fd < 0) {
+			perror(path);
+			ret = 1;
+			break;
+		}
+		before = cached_kb();
+		if (methods[i].fn(fd) < 0) {
+			fprintf(stderr, "%s: %s\n", methods[i].name,
+				strerror(errno));
+			close(fd);
+			ret = 1;
+			break;
+		}
+		after = cached_kb();
+		close(fd);
+		if (before < 0 || after < 0) {
+			ret = 1;
+			break;
+		}
+
+		pct = (after - before) * 100 / (size_mb * 1024L);
+		printf("%-10s %10ld %12ld\n", methods[i].name, after - before,
+		       pct);
+		if (pct > limit) {
+			fprintf(stderr, "%s: page cache grew by %ld%% of the file\n",
+				methods[i].name, pct);
+			ret = 1;
+		}
+	}
+
+	unlink(path);
+	return ret;
+}
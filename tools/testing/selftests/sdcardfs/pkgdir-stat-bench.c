@@ -0,0 +1,202 @@
+/*
+ * pkgdir-stat-bench -- parallel stat() and readdir() under Android/data
+ *
+ * Every lookup below Android/data, obb and media derives the owner of a
+ * package directory from packages.list, so this is where contention on
+ * the package table shows up.  NR_DIRS package directories are created
+ * (or the existing ones are used with -e), then 1, 2, 4 ... THREADS
+ * threads stat every directory and read the parent directory in a loop
+ * for SECS seconds each.  Lookups per second should scale with the
+ * number of threads.
+ *
+ * usage: pkgdir-stat-bench [-t threads] [-n nr_dirs] [-s secs] [-e] mnt
+ *
+ * Licensed under the terms of the GNU GPL License version 2.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+
+static char data_dir[4096];
+static char **paths;
+static int nr_paths;
+static int nr_dirs = 256;
+static int max_threads = 8;
+static int secs = 5;
+static volatile int stop;
+
+struct worker {
+	pthread_t thread;
+	int id;
+	unsigned long stats;
+	unsigned long readdirs;
+	int err;
+};
+
+static void *worker_fn(void *arg)
+{
+	struct worker *w = arg;
+	struct stat st;
+	int i = w->id % nr_paths;
+
+	while (!stop) {
+		if (stat(paths[i], &st)) {
+			w->err = errno;
+			break;
+		}
+		w->stats++;
+		if (++i == nr_paths) {
+			DIR *d = opendir(data_dir);
+
+			if (!d) {
+				w->err = errno;
+				break;
+			}
+			while (readdir(d))
+				;
+			closedir(d);
+			w->readdirs++;
+			i = 0;
+		}
+	}
+	return NULL;
+}
+
+static int run(int threads)
+{
+	struct worker *w = calloc(threads, sizeof(*w));
+	struct timespec t0, t1;
+	unsigned long stats = 0, readdirs = 0;
+	double elapsed;
+	int i, err = 0;
+
+	if (!w)
+		return -ENOMEM;
+
+	stop = 0;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < threads; i++) {
+		w[i].id = i;
+		pthread_create(&w[i].thread, NULL, worker_fn, &w[i]);
+	}
+	sleep(secs);
+	stop = 1;
+	for (i = 0; i < threads; i++) {
+		pthread_join(w[i].thread, NULL);
+		stats += w[i].stats;
+		readdirs += w[i].readdirs;
+		if (w[i].err)
+			err = w[i].err;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+	printf("%7d %14.0f %14.1f\n", threads, stats / elapsed,
+	       readdirs / elapsed);
+	free(w);
+
+	if (err) {
+		fprintf(stderr, "lookup failed: %s\n", strerror(err));
+		return -err;
+	}
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-t threads] [-n nr_dirs] [-s secs] [-e] mnt\n"
+		"  -e  use the directories already in Android/data\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	int existing = 0, created = 0, threads, opt, i, ret = 0;
+
+	while ((opt = getopt(argc, argv, "t:n:s:e")) != -1) {
+		switch (opt) {
+		case 't':
+			max_threads = atoi(optarg);
+			break;
+		case 'n':
+			nr_dirs = atoi(optarg);
+			break;
+		case 's':
+			secs = atoi(optarg);
+			break;
+		case 'e':
+			existing = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || max_threads < 1 || nr_dirs < 1 || secs < 1)
+		usage(argv[0]);
+
+	snprintf(data_dir, sizeof(data_dir), "%s/Android/data", argv[optind]);
+
+	if (existing) {
+		DIR *d = opendir(data_dir);
+		struct dirent *de;
+
+		if (!d) {
+			perror(data_dir);
+			return 1;
+		}
+		while ((de = readdir(d))) {
+			if (de->d_name[0] == '.')
+				continue;
+			paths = realloc(paths, (nr_paths + 1) * sizeof(*paths));
+			if (!paths ||
+			    asprintf(&paths[nr_paths], "%s/%s", data_dir,
+				     de->d_name) < 0)
+				return 1;
+			nr_paths++;
+		}
+		closedir(d);
+	} else {
+		paths = calloc(nr_dirs, sizeof(*paths));
+		if (!paths)
+			return 1;
+		for (i = 0; i < nr_dirs; i++) {
+			if (asprintf(&paths[i], "%s/com.example.bench%d",
+				     data_dir, i) < 0)
+				return 1;
+			if (mkdir(paths[i], 0771) && errno != EEXIST) {
+				perror(paths[i]);
+				ret = 1;
+				goto out;
+			}
+			nr_paths = ++created;
+		}
+	}
+	if (!nr_paths) {
+		fprintf(stderr, "%s: no package directories\n", data_dir);
+		return 1;
+	}
+
+	printf("%d package directories, %d s per run\n", nr_paths, secs);
+	printf("threads      stats/s     readdirs/s\n");
+	for (threads = 1; threads <= max_threads; threads *= 2) {
+		if (run(threads)) {
+			ret = 1;
+			break;
+		}
+	}
+
+out:
+	for (i = 0; i < created; i++)
+		rmdir(paths[i]);
+	return ret;
+}